@@ -27,6 +27,8 @@ var path = require('path');
 
 var daemonUpdater = require('./daemonUpdater');
 var daemonUtils = require('./daemonUtils');
+var TarExtractor = require('./tarExtractor');
+var moduleCache = require('./moduleCache');
 var WEBSOCKETOPEN=1; // =  WebSocket.Open
 
 var currentFile_,
@@ -34,6 +36,8 @@ var currentFile_,
   pathToProject_ = '/node_app_slot/',
   crashLog_ = __dirname+'/crash.log',
   configFile_ = __dirname+'/../config.json',
+  deployManifest_ = __dirname+'/../deploy-manifest.json',
+  deployExtractor_ = null,
   basePort=58888;
 
 var config = new require('./daemonConfig')(configFile_);
@@ -159,6 +163,11 @@ function initWebSocketServer(){
 }
 
 function handleFileInfo(ws, message) {
+  //a new upload is starting, drop what is left of an interrupted one
+  if (deployExtractor_) {
+    deployExtractor_.abort();
+    deployExtractor_ = null;
+  }
   if (message.type === "file") {
     currentFile_ = message.data;
   }
@@ -216,43 +225,43 @@ function handleConfig(ws, mode, data) {
 
 /**
  * This function handles downloading of the binary stream and untaring it.
+ * The archive is extracted straight into the app slot as it arrives, it may
+ * span several binary messages.  Only files that changed since the last
+ * deploy are written (see tarExtractor.js).  The socket is paused while the
+ * extractor is behind.  The extractor is kept until the next upload starts,
+ * so once the archive ended or failed the rest of its messages are dropped
+ * instead of being read as a new archive.
  * If the 'clean' command is sent, we call npm rebuild on the modoules
  */
 function downloadProject(ws, message,clean) {
-  var fileName = "bundle.tar";
-  if (currentFile_) {
-    fileName = currentFile_.name;
-  }
-  var pathToZipFile = pathToTmp_ + "/" + fileName;
-  var data = message;
-  console.log("receviing file data");
-  //Clear project
-  var ignore=clean?'':'node_modules';
-  
-  fs.writeFile(pathToZipFile, data, function(error) {
-    if (error) {
-      sendWSData(ws,JSON.stringify({'message': 'error', 'data': 'Unable to download project'}));
+  if (!deployExtractor_) {
+    console.log("receviing file data");
+    //node_modules is only replaced on a clean deploy
+    var ignore=clean?'':'node_modules';
+    deployExtractor_ = new TarExtractor(pathToProject_,{ignore:ignore,manifest:deployManifest_});
+    deployExtractor_.on('drain',function(){ws.resume();});
+    deployExtractor_.on('error',function(err){
       currentFile_ = null;
-    } else {
-      
-      //Clear out the app path slot and then unzip it
-      daemonUtils.clearFolder(pathToProject_,false,ignore);
-      daemonUtils.unzip(pathToZipFile,pathToProject_)
-      .then(function(){
-        if(clean){
-          return handleCommand(ws,'clean');
-        }
-        else {
-          var colors = require('colors/safe');
-          sendWSData(ws,JSON.stringify({'message': colors.yellow.bold('[ Upload Complete ]'), 'data': pathToProject_ }));
-          currentFile_ = null;
-        }
-      }).
-      fail(function(res){
-        sendError(ws,'Error extracting update - '+res);
-      });      
-    }
-  });
+      sendError(ws,'Error extracting project - '+err.message);
+    });
+    deployExtractor_.on('finish',function(stats){
+      sendToConsole(ws,'\n'+stats.written+' files written, '+stats.unchanged+' unchanged, '+stats.removed+
+        ' removed ('+(stats.bytes/1024).toFixed(1)+' KB in '+stats.elapsed+' ms)\n');
+      if(clean){
+        return handleCommand(ws,'clean');
+      }
+      else {
+        var colors = require('colors/safe');
+        sendWSData(ws,JSON.stringify({'message': colors.yellow.bold('[ Upload Complete ]'), 'data': pathToProject_ }));
+        currentFile_ = null;
+      }
+    });
+  }
+
+  if (!deployExtractor_.write(message)) {
+    //wait for the extractor to catch up
+    ws.pause();
+  }
 }
 
 // this function handles updating the daemon itself  Please see daemonUpdater.js
@@ -272,7 +281,8 @@ function returnStatus(ws,message){
     isRunning:false,
     isDebugging:false,
     version:productVersion,
-    time:new Date().getTime()
+    time:new Date().getTime(),
+    moduleCache:moduleCache.getStats()
   };
   if(currentlyRunningApp!==null)
   {
@@ -361,7 +371,7 @@ function handleCommand(ws, message)
     currentlyRunningApp.on('error',function(res){
       sendToConsole(ws,res.toString());
     });
-    currentlyRunningApp.clean();
+    currentlyRunningApp.clean().on('close',function(data){returnStatus(ws);});
   }
   else if(message === 'debug'){
     stopGracefully();
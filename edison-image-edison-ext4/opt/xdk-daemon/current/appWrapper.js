@@ -167,7 +167,7 @@ function AppWrapper(appPath) {
       var titleNote =  '(may take several minutes)'.grey;
 
       var npm = new NPMTool();      
-      applicationState.npmProcess=npm.runCommand('rebuild',{fancyTitle:fancyTitle,titleNote:titleNote},appPath,_self);
+      applicationState.npmProcess=npm.runCachedRebuild({fancyTitle:fancyTitle,titleNote:titleNote},appPath,_self);
       return applicationState.npmProcess;
     }
 
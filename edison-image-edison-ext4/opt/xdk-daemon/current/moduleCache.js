@@ -0,0 +1,328 @@
+/**
+ * @license Copyright 2013 - 2014 Intel Corporation All Rights Reserved.
+ *
+ * The source code, information and material ("Material") contained herein is owned by Intel Corporation or its
+ * suppliers or licensors, and title to such Material remains with Intel Corporation or its suppliers or
+ * licensors. The Material contains proprietary information of Intel or its suppliers and licensors. The
+ * Material is protected by worldwide copyright laws and treaty provisions. No part of the Material may be used,
+ * copied, reproduced, modified, published, uploaded, posted, transmitted, distributed or disclosed in any way
+ * without Intel's prior express written permission. No license under any patent, copyright or other intellectual
+ * property rights in the Material is granted to or conferred upon you, either expressly, by implication,
+ * inducement, estoppel or otherwise. Any license under such intellectual property rights must be express and
+ * approved by Intel in writing.
+ *
+ * Unless otherwise agreed by Intel in writing, you may not remove or alter this notice or any other notice
+ * embedded in Materials by Intel or Intel's suppliers or licensors in any way.
+ */
+
+var fs = require('fs');
+var path = require('path');
+var crypto = require('crypto');
+
+/**
+ * Cache of built native node modules.
+ *
+ * A clean deploy used to run npm rebuild over all of node_modules, which
+ * compiles every native addon with the on board g++.  Built module trees are
+ * kept here, keyed by package name, version, node ABI, arch and a hash of the
+ * package's files (leaving out node-gyp's build output), and are put back
+ * with hard links so a clean deploy with unchanged dependencies only rebuilds
+ * the modules that were never built on this device.  The hash keeps a git or
+ * local dependency whose version was not bumped from getting a stale build.
+ * Entries unused for CACHE_MAX_AGE, or beyond the CACHE_MAX_ENTRIES most
+ * recently used, are removed when new ones are stored.
+ *
+ * Cached files are shared with node_modules through hard links, so they must
+ * only ever be replaced (unlink or rename), never rewritten in place.  The
+ * deploy extractor and npm both do so.
+ */
+
+var cacheDir_ = path.resolve(__dirname, '../module-cache');
+
+var CACHE_MAX_ENTRIES = 32;
+var CACHE_MAX_AGE = 30*24*60*60*1000;
+
+var stats_ = {
+  hits:0,
+  misses:0,
+  lastHits:[],
+  lastMisses:[],
+  lastRestoreTime:0
+};
+
+//feed the paths and contents of the files under dir to hash, in a stable order,
+//skipping the build directory node-gyp creates next to a binding.gyp
+function hashTree(hash, dir, relative) {
+  var files = fs.readdirSync(dir).sort();
+  var hasGyp = files.indexOf('binding.gyp') !== -1;
+
+  for(var i = 0; i < files.length; i++) {
+    if(hasGyp && files[i] === 'build') {
+      continue;
+    }
+    var file = path.join(dir, files[i]);
+    var name = relative+'/'+files[i];
+    var stat = fs.lstatSync(file);
+    if(stat.isDirectory()) {
+      hashTree(hash, file, name);
+    }
+    else if(stat.isSymbolicLink()) {
+      hash.update('l'+name+'\0'+fs.readlinkSync(file)+'\0');
+    }
+    else {
+      hash.update('f'+name+'\0'+stat.size+'\0');
+      hash.update(fs.readFileSync(file));
+    }
+  }
+}
+
+function cacheKey(name, version, dir) {
+  var id = [name, version, process.versions.modules, process.platform, process.arch].join('|');
+  var hash = crypto.createHash('sha1').update(id);
+  hashTree(hash, dir, '');
+  return hash.digest('hex');
+}
+
+function hasBinding(dir) {
+  var files;
+  try {
+    files = fs.readdirSync(dir);
+  }
+  catch(err) {
+    return false;
+  }
+  for(var i = 0; i < files.length; i++) {
+    if(files[i] === 'binding.gyp') {
+      return true;
+    }
+    var file = path.join(dir, files[i]);
+    if(fs.lstatSync(file).isDirectory() && hasBinding(file)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//top level packages of node_modules that contain a native addon, anywhere in their tree
+function nativeModules(appPath) {
+  var modulesDir = path.join(appPath, 'node_modules');
+  var found = [];
+  var dirs = [];
+  var names;
+
+  try {
+    names = fs.readdirSync(modulesDir);
+  }
+  catch(err) {
+    return found;
+  }
+  for(var i = 0; i < names.length; i++) {
+    if(names[i].charAt(0) === '@') {
+      var scoped = [];
+      try {
+        scoped = fs.readdirSync(path.join(modulesDir, names[i]));
+      }
+      catch(err) {}
+      for(var j = 0; j < scoped.length; j++) {
+        dirs.push(names[i]+'/'+scoped[j]);
+      }
+    }
+    else if(names[i].charAt(0) !== '.') {
+      dirs.push(names[i]);
+    }
+  }
+
+  for(var k = 0; k < dirs.length; k++) {
+    var dir = path.join(modulesDir, dirs[k]);
+    var pkg;
+    try {
+      pkg = JSON.parse(fs.readFileSync(path.join(dir, 'package.json')));
+    }
+    catch(err) {
+      continue;
+    }
+    if(!pkg.name || !pkg.version || !hasBinding(dir)) {
+      continue;
+    }
+    var key;
+    try {
+      key = cacheKey(pkg.name, pkg.version, dir);
+    }
+    catch(err) {
+      console.log('moduleCache: unable to hash '+pkg.name+': '+err);
+      continue;
+    }
+    found.push({name:pkg.name, version:pkg.version, dir:dir, key:key});
+  }
+  return found;
+}
+
+function clearTree(dir) {
+  var files;
+  try {
+    files = fs.readdirSync(dir);
+  }
+  catch(err) {
+    return;
+  }
+  for(var i = 0; i < files.length; i++) {
+    var file = path.join(dir, files[i]);
+    if(fs.lstatSync(file).isDirectory()) {
+      clearTree(file);
+    }
+    else {
+      fs.unlinkSync(file);
+    }
+  }
+  fs.rmdirSync(dir);
+}
+
+//recreate the tree at src at dest, hard linking the files
+function linkTree(src, dest) {
+  var files = fs.readdirSync(src);
+  fs.mkdirSync(dest);
+  for(var i = 0; i < files.length; i++) {
+    var from = path.join(src, files[i]);
+    var to = path.join(dest, files[i]);
+    var stat = fs.lstatSync(from);
+    if(stat.isDirectory()) {
+      linkTree(from, to);
+    }
+    else if(stat.isSymbolicLink()) {
+      fs.symlinkSync(fs.readlinkSync(from), to);
+    }
+    else {
+      fs.linkSync(from, to);
+    }
+  }
+}
+
+/**
+ * Put back the cached builds of the native modules of appPath.
+ * Returns {hits, misses}, arrays of the modules restored and the ones
+ * that still have to be built.
+ */
+function restore(appPath) {
+  var started = new Date().getTime();
+  var modules = nativeModules(appPath);
+  var result = {hits:[], misses:[]};
+
+  for(var i = 0; i < modules.length; i++) {
+    var cached = path.join(cacheDir_, modules[i].key);
+    if(!fs.existsSync(cached)) {
+      result.misses.push(modules[i]);
+      continue;
+    }
+    //build the restored tree next to the module and only then swap it in, so a
+    //failure leaves the extracted module as it was
+    var dir = modules[i].dir;
+    var tmpDir = path.join(path.dirname(dir), '.'+path.basename(dir)+'.restore');
+    var oldDir = path.join(path.dirname(dir), '.'+path.basename(dir)+'.old');
+    try {
+      clearTree(tmpDir);
+      clearTree(oldDir);
+      linkTree(cached, tmpDir);
+      fs.renameSync(dir, oldDir);
+      try {
+        fs.renameSync(tmpDir, dir);
+      }
+      catch(err) {
+        fs.renameSync(oldDir, dir);
+        throw err;
+      }
+      result.hits.push(modules[i]);
+      try {
+        clearTree(oldDir);
+        //the entry's mtime is its last use, for prune()
+        var now = new Date();
+        fs.utimesSync(cached, now, now);
+      }
+      catch(err) {}
+    }
+    catch(err) {
+      console.log('moduleCache: unable to restore '+modules[i].name+': '+err);
+      clearTree(tmpDir);
+      result.misses.push(modules[i]);
+    }
+  }
+
+  stats_.hits += result.hits.length;
+  stats_.misses += result.misses.length;
+  stats_.lastHits = result.hits.map(function(m) { return m.name+'@'+m.version; });
+  stats_.lastMisses = result.misses.map(function(m) { return m.name+'@'+m.version; });
+  stats_.lastRestoreTime = new Date().getTime() - started;
+  return result;
+}
+
+//remove the entries unused for CACHE_MAX_AGE and those beyond the
+//CACHE_MAX_ENTRIES most recently used
+function prune() {
+  var now = new Date().getTime();
+  var entries = [];
+  var names;
+
+  try {
+    names = fs.readdirSync(cacheDir_);
+  }
+  catch(err) {
+    return;
+  }
+  for(var i = 0; i < names.length; i++) {
+    if(!/^[0-9a-f]{40}$/.test(names[i])) {
+      continue;
+    }
+    try {
+      entries.push({name:names[i], used:fs.statSync(path.join(cacheDir_, names[i])).mtime.getTime()});
+    }
+    catch(err) {}
+  }
+  entries.sort(function(a, b) { return b.used - a.used; });
+
+  for(var j = 0; j < entries.length; j++) {
+    if(j < CACHE_MAX_ENTRIES && now - entries[j].used < CACHE_MAX_AGE) {
+      continue;
+    }
+    try {
+      clearTree(path.join(cacheDir_, entries[j].name));
+    }
+    catch(err) {
+      console.log('moduleCache: unable to remove '+entries[j].name+': '+err);
+    }
+  }
+}
+
+/**
+ * Add freshly built modules (as returned in the misses of restore) to the cache.
+ */
+function store(modules) {
+  try {
+    fs.mkdirSync(cacheDir_);
+  }
+  catch(err) {}
+
+  for(var i = 0; i < modules.length; i++) {
+    var cached = path.join(cacheDir_, modules[i].key);
+    var tmpDir = cached+'.tmp';
+    try {
+      clearTree(tmpDir);
+      linkTree(modules[i].dir, tmpDir);
+      //an entry only appears once it is complete
+      fs.renameSync(tmpDir, cached);
+    }
+    catch(err) {
+      console.log('moduleCache: unable to cache '+modules[i].name+': '+err);
+      clearTree(tmpDir);
+    }
+  }
+  prune();
+}
+
+function getStats() {
+  return stats_;
+}
+
+module.exports = {
+  restore:restore,
+  store:store,
+  getStats:getStats
+};
@@ -20,6 +20,7 @@ var events = require('events');
 var semver = require('semver');
 var fs = require('fs');
 var path = require('path');
+var moduleCache = require('./moduleCache');
 
 //detect alternate path for node.js headers - needed for node-gyp to run
 //------------------------------------------------------------
@@ -51,7 +52,7 @@ function NPMTool() {
 
   //_npmCommand - execute an actual NPM command
   //------------------------------------------------------------
-  _npmCommand = function(npmCommandToRun,appPath)
+  _npmCommand = function(npmCommandToRun,appPath,packages)
   { 
     if(npmCommandToRun == undefined)
       npmCommandToRun = 'install';
@@ -66,7 +67,7 @@ function NPMTool() {
     //This can be changed to a more intellegent 'search' for the npm app in the future (if needed);
     var npmBinary = process.execPath.match(/(.+\/).+$/)[1]+'npm';
 
-    var args = [npmCommandToRun,'--color=always'] //Array of arguments to be passed to the program
+    var args = [npmCommandToRun].concat(packages||[],'--color=always') //Array of arguments to be passed to the program
 
     if(nodeHeadersPath != null)
     {
@@ -109,7 +110,7 @@ function NPMTool() {
       _emitter.emit('console','|================================================================\n');
 
       console.log(command,appPath);
-      var installProcess = _npmCommand(command,appPath);
+      var installProcess = _npmCommand(command,appPath,options.packages);
 
       installProcess.stdout.on('data', function (data) {
         console.log('stdout: ' + data);
@@ -135,6 +136,35 @@ function NPMTool() {
       });
       return installProcess;
     }    
+
+    // Rebuild the native modules, reusing the builds in the module cache
+    // see moduleCache.js
+    //--------------------------------------
+    this.runCachedRebuild = function(options,appPath,_emitter)
+    {
+      var _self = this;
+      var cached = moduleCache.restore(appPath);
+      //callers chain on the returned process, so run without a console rather than return nothing
+      _emitter = _emitter||new events.EventEmitter();
+      _emitter.emit('console','\nModule cache: '+cached.hits.length+' restored, '+cached.misses.length+' to build\n');
+
+      if(cached.misses.length === 0) {
+        //nothing to build, stand in for the npm process
+        var done = new events.EventEmitter();
+        done.kill = function(){};
+        process.nextTick(function(){ done.emit('close',0); });
+        return done;
+      }
+
+      options.packages = cached.misses.map(function(m) { return m.name; });
+      var rebuildProcess = this.runCommand('rebuild',options,appPath,_emitter);
+      rebuildProcess.on('close', function(code) {
+        if(code === 0) {
+          moduleCache.store(cached.misses);
+        }
+      });
+      return rebuildProcess;
+    }
     
     events.EventEmitter.call(this);
 
@@ -0,0 +1,815 @@
+/**
+ * @license Copyright 2013 - 2014 Intel Corporation All Rights Reserved.
+ *
+ * The source code, information and material ("Material") contained herein is owned by Intel Corporation or its
+ * suppliers or licensors, and title to such Material remains with Intel Corporation or its suppliers or
+ * licensors. The Material contains proprietary information of Intel or its suppliers and licensors. The
+ * Material is protected by worldwide copyright laws and treaty provisions. No part of the Material may be used,
+ * copied, reproduced, modified, published, uploaded, posted, transmitted, distributed or disclosed in any way
+ * without Intel's prior express written permission. No license under any patent, copyright or other intellectual
+ * property rights in the Material is granted to or conferred upon you, either expressly, by implication,
+ * inducement, estoppel or otherwise. Any license under such intellectual property rights must be express and
+ * approved by Intel in writing.
+ *
+ * Unless otherwise agreed by Intel in writing, you may not remove or alter this notice or any other notice
+ * embedded in Materials by Intel or Intel's suppliers or licensors in any way.
+ */
+
+var fs = require('fs');
+var path = require('path');
+var crypto = require('crypto');
+var events = require('events');
+var sys = require('util');
+var jf = require('jsonfile');
+
+var BLOCK_SIZE = 512;
+var COPY_SIZE = 65536;
+var HIGH_WATER_MARK = 1048576;
+
+/**
+ * Incremental tar extractor used for project deploys.
+ *
+ * Chunks of the archive are fed with write() as they come off the web socket,
+ * so the bundle never goes through /tmp and tar is not shelled out to.  The
+ * data of every file is compared against the deployed copy as it arrives and
+ * only goes to disk once it differs, so an edit-deploy cycle only writes the
+ * files that were edited.  Files that are not in the bundle any more are
+ * removed when the archive ends (folders named by ignore are left alone).
+ *
+ * File data is read and written with asynchronous calls one chunk at a time,
+ * entries are never held in memory whole.  write() returns false once more
+ * than HIGH_WATER_MARK bytes are waiting, 'drain' is emitted when they have
+ * been taken.  'finish' is emitted with the deploy stats at the end of the
+ * archive, 'error' on the first failure.  Either way the extractor drops
+ * whatever else is written to it, so the rest of the upload is never taken
+ * for a new archive.
+ *
+ * The hashes of the deployed files are kept in the manifest file together with
+ * their size and mtime, so hard links to files of an earlier deploy do not
+ * have to be read back.
+ */
+
+//make TarExtractor an EventEmitter;
+sys.inherits(TarExtractor, events.EventEmitter);
+
+function TarExtractor(dest, options) {
+  if(false === (this instanceof TarExtractor)) {
+    return new TarExtractor(dest, options);
+  }
+  events.EventEmitter.call(this);
+  options = options || {};
+
+  var self_ = this;
+  var destPath = path.resolve(dest);
+  var ignore = options.ignore || '';
+  var manifestPath = options.manifest || null;
+  var manifest = {};
+  var deployed = {};
+  var umask = process.umask();
+  var realDest = null;      // destPath with symlinks resolved, once it exists
+
+  var pending = [];         // chunks not consumed yet
+  var pendingLength = 0;
+  var entry = null;         // entry whose data is being received
+  var longName = null;      // GNU long name / pax path for the next entry
+  var longLink = null;
+  var finished = false;
+  var failed = null;        // first error, later chunks are dropped
+  var busy = false;         // waiting on the file system
+  var needDrain = false;
+
+  this.stats = {
+    written:0,
+    unchanged:0,
+    removed:0,
+    bytes:0,
+    startTime:new Date().getTime(),
+    elapsed:0
+  };
+
+  if(manifestPath) {
+    try {
+      manifest = jf.readFileSync(manifestPath);
+    }
+    catch(err) {
+      manifest = {};
+    }
+  }
+
+  //====================================================================================================================
+  // Private Functions
+  //====================================================================================================================
+
+  //take len bytes off the pending chunks, copying only if they span chunks
+  function take(len) {
+    if(pending[0].length < len) {
+      pending = [Buffer.concat(pending, pendingLength)];
+    }
+    var out = pending[0].slice(0, len);
+    pending[0] = pending[0].slice(len);
+    if(pending[0].length === 0) {
+      pending.shift();
+    }
+    pendingLength -= len;
+    return out;
+  }
+
+  function readString(block, offset, len) {
+    var end = offset;
+    while(end < offset + len && block[end] !== 0) {
+      end++;
+    }
+    return block.toString('utf8', offset, end);
+  }
+
+  function readOctal(block, offset, len) {
+    //GNU base-256 encoding for sizes of 8GB and up
+    if(block[offset] & 0x80) {
+      var value = block[offset] & 0x7f;
+      for(var i = 1; i < len; i++) {
+        value = value * 256 + block[offset + i];
+      }
+      return value;
+    }
+    var text = readString(block, offset, len).trim();
+    return text.length ? parseInt(text, 8) : 0;
+  }
+
+  function validChecksum(block) {
+    var sum = 0;
+    for(var i = 0; i < BLOCK_SIZE; i++) {
+      sum += (i >= 148 && i < 156) ? 32 : block[i];
+    }
+    return sum === readOctal(block, 148, 8);
+  }
+
+  function isZeroBlock(block) {
+    for(var i = 0; i < BLOCK_SIZE; i++) {
+      if(block[i] !== 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //map an archive path to a path below dest, refusing anything that escapes it
+  function resolveEntry(name) {
+    var relative = path.normalize(name.replace(/^\/+/, '')).replace(/\/+$/, '');
+    if(relative === '.' || relative === '') {
+      return null;
+    }
+    if(relative === '..' || relative.indexOf('../') === 0) {
+      throw new Error('refusing to extract '+name+' outside of '+destPath);
+    }
+    return relative;
+  }
+
+  function isInside(file, root) {
+    return file === root || file.indexOf(root+path.sep) === 0;
+  }
+
+  //links extracted earlier must not carry later entries out of dest: resolve
+  //the deepest existing folder above target and check it is still below dest.
+  //Returns the path of target relative to dest with those links resolved.
+  function checkParents(target) {
+    if(!realDest) {
+      mkdirs(destPath);
+      realDest = fs.realpathSync(destPath);
+    }
+    var dir = path.dirname(target);
+    var real = null;
+    while(real === null) {
+      try {
+        real = fs.realpathSync(dir);
+      }
+      catch(err) {
+        if(dir === destPath || path.dirname(dir) === dir) {
+          throw err;
+        }
+        dir = path.dirname(dir);
+      }
+    }
+    if(!isInside(real, realDest)) {
+      throw new Error('refusing to extract '+target+' through a link outside of '+destPath);
+    }
+    return path.relative(realDest, path.join(real, path.relative(dir, target)));
+  }
+
+  function parsePax(data) {
+    var offset = 0;
+    var fields = {};
+    while(offset < data.length) {
+      var space = offset;
+      while(space < data.length && data[space] !== 32) {
+        space++;
+      }
+      var len = parseInt(data.toString('ascii', offset, space), 10);
+      if(!len) {
+        break;
+      }
+      var record = data.toString('utf8', space + 1, offset + len - 1);
+      var eq = record.indexOf('=');
+      fields[record.substr(0, eq)] = record.substr(eq + 1);
+      offset += len;
+    }
+    return fields;
+  }
+
+  function mkdirs(dir) {
+    try {
+      if(fs.statSync(dir).isDirectory()) {
+        return;
+      }
+      fs.unlinkSync(dir);
+    }
+    catch(err) {
+      mkdirs(path.dirname(dir));
+    }
+    fs.mkdirSync(dir);
+  }
+
+  //hash of a file on disk, read a piece at a time
+  function hashFile(file) {
+    var hash = crypto.createHash('sha1');
+    var buf = new Buffer(COPY_SIZE);
+    var fd = fs.openSync(file, 'r');
+    try {
+      var len;
+      while((len = fs.readSync(fd, buf, 0, COPY_SIZE, null)) > 0) {
+        hash.update(buf.slice(0, len));
+      }
+    }
+    finally {
+      fs.closeSync(fd);
+    }
+    return hash.digest('hex');
+  }
+
+  //record of a file already on disk, hashed unless the manifest still matches it
+  function fileRecord(known, file) {
+    var stat = fs.statSync(file);
+    var record = manifest[known];
+    if(!record || record.size !== stat.size || record.mtime !== stat.mtime.getTime()) {
+      record = {hash:hashFile(file), size:stat.size, mtime:stat.mtime.getTime()};
+    }
+    return record;
+  }
+
+  function sameBytes(a, b, len) {
+    for(var i = 0; i < len; i++) {
+      if(a[i] !== b[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //fs.read/fs.write may stop short, go on until len bytes are done (or EOF)
+  function readFully(fd, buf, len, position, callback, done) {
+    done = done || 0;
+    fs.read(fd, buf, done, len - done, position + done, function(err, bytes) {
+      if(err || bytes === 0 || done + bytes === len) {
+        return callback(err, done + (bytes || 0));
+      }
+      readFully(fd, buf, len, position, callback, done + bytes);
+    });
+  }
+
+  function writeFully(fd, buf, callback, done) {
+    done = done || 0;
+    fs.write(fd, buf, done, buf.length - done, null, function(err, bytes) {
+      if(err || done + bytes === buf.length) {
+        return callback(err);
+      }
+      writeFully(fd, buf, callback, done + bytes);
+    });
+  }
+
+  //a regular file entry.  While the data matches the deployed file it is only
+  //compared; at the first difference the matching part is copied from the old
+  //file and the rest is written.  Existing files are replaced through a rename
+  //so running apps and hard linked copies of the old file never see a
+  //partially written one.
+  function openSink(relative, mode, size) {
+    var sink = {
+      relative:relative,
+      target:path.join(destPath, relative),
+      mode:mode,
+      hash:crypto.createHash('sha1'),
+      offset:0,             // bytes received so far
+      stat:null,
+      oldFd:null,           // deployed file, while it still matches
+      fd:null,              // file being written
+      file:null
+    };
+    sink.realRelative = checkParents(sink.target);
+    try {
+      sink.stat = fs.lstatSync(sink.target);
+    }
+    catch(err) {}
+
+    if(sink.stat && sink.stat.isFile() && sink.stat.size === size) {
+      sink.oldFd = fs.openSync(sink.target, 'r');
+    }
+    else {
+      createFile(sink);
+    }
+    return sink;
+  }
+
+  function createFile(sink) {
+    if(sink.stat) {
+      sink.file = sink.target+'.xdk-new';
+    }
+    else {
+      mkdirs(path.dirname(sink.target));
+      sink.file = sink.target;
+    }
+    sink.fd = fs.openSync(sink.file, 'w', sink.mode);
+  }
+
+  //the data stopped matching at sink.offset: start the new file with what did
+  function diverge(sink, callback) {
+    var buf = new Buffer(Math.min(COPY_SIZE, sink.offset));
+    var copied = 0;
+    function copy(err) {
+      if(err || copied === sink.offset) {
+        var oldFd = sink.oldFd;
+        sink.oldFd = null;
+        return fs.close(oldFd, function(closeErr) {
+          callback(err || closeErr);
+        });
+      }
+      var len = Math.min(buf.length, sink.offset - copied);
+      readFully(sink.oldFd, buf, len, copied, function(err, bytes) {
+        if(!err && bytes !== len) {
+          err = new Error(sink.target+' changed while it was being replaced');
+        }
+        if(err) {
+          return copy(err);
+        }
+        copied += len;
+        writeFully(sink.fd, buf.slice(0, len), copy);
+      });
+    }
+    try {
+      createFile(sink);
+    }
+    catch(err) {
+      return callback(err);
+    }
+    copy(null);
+  }
+
+  function sinkWrite(sink, data, callback) {
+    sink.hash.update(data);
+    if(sink.oldFd === null) {
+      sink.offset += data.length;
+      return writeFully(sink.fd, data, callback);
+    }
+    var old = new Buffer(data.length);
+    readFully(sink.oldFd, old, data.length, sink.offset, function(err, bytes) {
+      if(err) {
+        return callback(err);
+      }
+      if(bytes === data.length && sameBytes(old, data, bytes)) {
+        sink.offset += data.length;
+        return callback(null);
+      }
+      diverge(sink, function(err) {
+        if(err) {
+          return callback(err);
+        }
+        sink.offset += data.length;
+        writeFully(sink.fd, data, callback);
+      });
+    });
+  }
+
+  function sinkEnd(sink, callback) {
+    var hash = sink.hash.digest('hex');
+    var unchanged = sink.oldFd !== null;
+    var fd = unchanged ? sink.oldFd : sink.fd;
+    sink.oldFd = sink.fd = null;
+
+    fs.close(fd, function(err) {
+      if(err) {
+        return callback(err);
+      }
+      try {
+        if(unchanged) {
+          if((sink.stat.mode & 511) !== sink.mode) {
+            fs.chmodSync(sink.target, sink.mode);
+          }
+          self_.stats.unchanged++;
+        }
+        else {
+          //the mode given to open is subject to the umask
+          if((sink.mode & umask) !== 0) {
+            fs.chmodSync(sink.file, sink.mode);
+          }
+          if(sink.file !== sink.target) {
+            if(sink.stat.isDirectory()) {
+              clearTree(sink.target);
+            }
+            fs.renameSync(sink.file, sink.target);
+          }
+          self_.stats.written++;
+        }
+        var stat = fs.statSync(sink.target);
+        deployed[sink.relative] = {hash:hash, size:stat.size, mtime:stat.mtime.getTime()};
+        //written through a folder link: keep the sweep from removing the real file
+        if(sink.realRelative !== sink.relative) {
+          deployed[sink.realRelative] = deployed[sink.relative];
+        }
+      }
+      catch(err) {
+        return callback(err);
+      }
+      callback(null);
+    });
+  }
+
+  //drop a file left half written by a failed deploy
+  function abortSink(sink) {
+    try {
+      if(sink.oldFd !== null) {
+        fs.closeSync(sink.oldFd);
+      }
+      if(sink.fd !== null) {
+        fs.closeSync(sink.fd);
+        fs.unlinkSync(sink.file);
+      }
+    }
+    catch(err) {}
+    sink.oldFd = sink.fd = null;
+  }
+
+  function extractLink(relative, linkName, hardLink) {
+    var target = path.join(destPath, relative);
+    var source = null;
+    if(hardLink) {
+      source = resolveEntry(linkName);
+      checkParents(path.join(destPath, source));
+    }
+    else if(linkName.charAt(0) === '/' || !isInside(path.resolve(path.dirname(target), linkName), destPath)) {
+      throw new Error('refusing to extract link '+relative+' to '+linkName+' outside of '+destPath);
+    }
+    checkParents(target);
+    mkdirs(path.dirname(target));
+    if(!hardLink) {
+      try {
+        if(fs.readlinkSync(target) === linkName) {
+          deployed[relative] = {link:linkName};
+          self_.stats.unchanged++;
+          return;
+        }
+      }
+      catch(err) {}
+    }
+    try {
+      fs.unlinkSync(target);
+    }
+    catch(err) {}
+    if(hardLink) {
+      fs.linkSync(path.join(destPath, source), target);
+      //the source may be a file kept from an earlier deploy rather than one of
+      //this archive, then the link is recorded from the file it points to
+      deployed[relative] = deployed[source] || fileRecord(source, target);
+    }
+    else {
+      fs.symlinkSync(linkName, target);
+      deployed[relative] = {link:linkName};
+    }
+    self_.stats.written++;
+  }
+
+  function clearTree(dir) {
+    var files = fs.readdirSync(dir);
+    for(var i = 0; i < files.length; i++) {
+      var file = path.join(dir, files[i]);
+      if(fs.lstatSync(file).isDirectory()) {
+        clearTree(file);
+      }
+      else {
+        fs.unlinkSync(file);
+      }
+    }
+    fs.rmdirSync(dir);
+  }
+
+  //remove what the previous deploy left behind; returns true if dir is now empty
+  function sweep(dir, relative) {
+    var files;
+    try {
+      files = fs.readdirSync(dir);
+    }
+    catch(err) {
+      return false;
+    }
+    var kept = 0;
+    for(var i = 0; i < files.length; i++) {
+      var name = relative ? relative+'/'+files[i] : files[i];
+      var file = path.join(dir, files[i]);
+      var stat = fs.lstatSync(file);
+      if(stat.isDirectory()) {
+        if(ignore && files[i] === ignore) {
+          kept++;
+        }
+        else if(sweep(file, name) && deployed[name] !== true) {
+          fs.rmdirSync(file);
+          self_.stats.removed++;
+        }
+        else {
+          kept++;
+        }
+      }
+      else if(deployed[name] === undefined) {
+        fs.unlinkSync(file);
+        self_.stats.removed++;
+      }
+      else {
+        kept++;
+      }
+    }
+    return kept === 0;
+  }
+
+  function processHeader(block) {
+    if(!validChecksum(block)) {
+      throw new Error('invalid tar header');
+    }
+    var type = String.fromCharCode(block[156] || 48);
+    var size = readOctal(block, 124, 12);
+    var name = readString(block, 0, 100);
+    var prefix = readString(block, 345, 155);
+    if(prefix && block.toString('ascii', 257, 262) === 'ustar') {
+      name = prefix+'/'+name;
+    }
+
+    entry = {
+      type:type,
+      name:longName || name,
+      linkName:longLink || readString(block, 157, 100),
+      mode:readOctal(block, 100, 8) & 511,
+      size:size,
+      remaining:size,
+      keep:type === 'L' || type === 'K' || type === 'x',   // metadata, buffered
+      chunks:[],
+      sink:null
+    };
+    if(type !== 'L' && type !== 'K' && type !== 'x' && type !== 'g') {
+      longName = longLink = null;
+    }
+    if(type === '0' || type === '7') {
+      var relative = resolveEntry(entry.name);
+      if(relative) {
+        entry.sink = openSink(relative, entry.mode, size);
+      }
+    }
+  }
+
+  //keep the parent folders from being swept
+  function keepParents(relative) {
+    for(var dir = path.dirname(relative); dir !== '.'; dir = path.dirname(dir)) {
+      deployed[dir] = true;
+    }
+  }
+
+  function finishEntry() {
+    var current = entry;
+    var data = current.chunks.length === 1 ? current.chunks[0] : Buffer.concat(current.chunks, current.size);
+    var relative;
+    entry = null;
+
+    switch(current.type) {
+      case 'L':
+        longName = readString(data, 0, data.length);
+        return;
+      case 'K':
+        longLink = readString(data, 0, data.length);
+        return;
+      case 'x':
+        var fields = parsePax(data);
+        longName = fields.path || longName;
+        longLink = fields.linkpath || longLink;
+        return;
+      case 'g':
+      case '0':
+      case '7':
+        //regular files are finished by their sink
+        return;
+    }
+
+    if(!(relative = resolveEntry(current.name))) {
+      return;
+    }
+    switch(current.type) {
+      case '5':
+        checkParents(path.join(destPath, relative));
+        mkdirs(path.join(destPath, relative));
+        deployed[relative] = true;
+        break;
+      case '2':
+        extractLink(relative, current.linkName, false);
+        break;
+      case '1':
+        extractLink(relative, current.linkName, true);
+        break;
+      default:
+        console.log('tarExtractor: skipping '+current.name+' of type '+current.type);
+        return;
+    }
+    keepParents(relative);
+  }
+
+  //remove the files of the previous deploy that were not in this archive and
+  //save the manifest
+  function complete() {
+    try {
+      sweep(destPath, '');
+    }
+    catch(err) {
+      return fail(err);
+    }
+
+    if(manifestPath) {
+      var files = {};
+      for(var name in deployed) {
+        if(deployed[name] && deployed[name].hash) {
+          files[name] = deployed[name];
+        }
+      }
+      //node_modules is not part of incremental bundles, keep what we knew about it
+      if(ignore) {
+        for(var known in manifest) {
+          if(!files[known] && known.split('/').indexOf(ignore) !== -1) {
+            files[known] = manifest[known];
+          }
+        }
+      }
+      try {
+        jf.writeFileSync(manifestPath, files);
+      }
+      catch(err) {
+        console.log('error writing deploy manifest: '+manifestPath);
+      }
+    }
+
+    self_.stats.elapsed = new Date().getTime() - self_.stats.startTime;
+    release();
+    self_.emit('finish', self_.stats);
+  }
+
+  //writers waiting for 'drain' must not stall once everything is dropped
+  function release() {
+    pending = [];
+    pendingLength = 0;
+    if(needDrain) {
+      needDrain = false;
+      self_.emit('drain');
+    }
+  }
+
+  function cleanup() {
+    if(entry && entry.sink) {
+      abortSink(entry.sink);
+    }
+    entry = null;
+  }
+
+  function fail(err) {
+    if(failed) {
+      return;
+    }
+    failed = err;
+    cleanup();
+    release();
+    self_.emit('error', err);
+  }
+
+  //called back when a file system call is done
+  function resume(err) {
+    busy = false;
+    if(failed) {
+      //aborted while the call was outstanding
+      return cleanup();
+    }
+    if(err) {
+      return fail(err);
+    }
+    pump();
+  }
+
+  //consume as much of the pending data as possible; stops while a file system
+  //call is outstanding, resume() picks up from there
+  function pump() {
+    if(busy || failed || finished) {
+      return;
+    }
+    var ended = false;
+    try {
+      while(true) {
+        if(needDrain && pendingLength <= HIGH_WATER_MARK) {
+          needDrain = false;
+          self_.emit('drain');
+        }
+        if(entry) {
+          if(entry.remaining > 0) {
+            if(pendingLength === 0) {
+              return;
+            }
+            var data = take(Math.min(entry.remaining, pending[0].length));
+            entry.remaining -= data.length;
+            if(entry.sink) {
+              self_.stats.bytes += data.length;
+              busy = true;
+              return sinkWrite(entry.sink, data, resume);
+            }
+            if(entry.keep) {
+              entry.chunks.push(data);
+            }
+            continue;
+          }
+          //data is padded to a whole block
+          var padding = (BLOCK_SIZE - entry.size % BLOCK_SIZE) % BLOCK_SIZE;
+          if(pendingLength < padding) {
+            return;
+          }
+          if(padding) {
+            take(padding);
+          }
+          if(entry.sink) {
+            var sink = entry.sink;
+            busy = true;
+            return sinkEnd(sink, function(err) {
+              if(!err) {
+                entry = null;
+                keepParents(sink.relative);
+              }
+              resume(err);
+            });
+          }
+          finishEntry();
+          continue;
+        }
+        if(pendingLength < BLOCK_SIZE) {
+          return;
+        }
+        var block = take(BLOCK_SIZE);
+        if(isZeroBlock(block)) {
+          //anything after the end of the archive is padding
+          finished = ended = true;
+          break;
+        }
+        processHeader(block);
+      }
+    }
+    catch(err) {
+      return fail(err);
+    }
+    if(ended) {
+      complete();
+    }
+  }
+
+  //====================================================================================================================
+  // Privleged Functions
+  //====================================================================================================================
+
+  /**
+   * Feed the next chunk of the archive.  Returns false when the caller should
+   * wait for 'drain' before writing more.  Chunks written after the archive
+   * ended or failed are dropped.
+   */
+  this.write = function(chunk) {
+    if(finished || failed) {
+      return true;
+    }
+    pending.push(chunk);
+    pendingLength += chunk.length;
+    pump();
+    if(pendingLength > HIGH_WATER_MARK) {
+      needDrain = true;
+      return false;
+    }
+    return true;
+  };
+
+  /**
+   * Give up on an upload that was interrupted by a new one.  A file being
+   * written is removed, nothing is swept and no events are emitted.
+   */
+  this.abort = function() {
+    if(finished || failed) {
+      return;
+    }
+    failed = new Error('upload interrupted');
+    if(!busy) {
+      cleanup();
+    }
+    release();
+  };
+}
+
+module.exports = TarExtractor;
@@ -0,0 +1,663 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file comm_dispatcher.h
+* @brief Receive from many communication handles on one thread.
+*
+* The receive function of a plugin blocks until one message arrives, so a
+* client of many services needs a thread per handle. A CommDispatcher waits on
+* the sockets of all its sources with epoll instead, reads whatever each ready
+* source has without blocking, and hands the messages of a source to its
+* handler as one batch. Handlers run on the dispatcher thread, or on a pool of
+* worker threads when one is requested; batches of one source are always
+* delivered in order, one at a time.
+*
+* Sources are ZMQ sockets (ZMQ_FD), mosquitto clients (mosquitto_socket) or
+* any other descriptor with a read function. Messages belong to the
+* dispatcher and are freed when the handler returns.
+*/
+
+#ifndef __IOTKIT_COMM_DISPATCHER_H
+#define __IOTKIT_COMM_DISPATCHER_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <zmq.h>
+#include <mosquitto.h>
+#include "iotkit-comm.h"
+
+#define COMM_DISPATCHER_MAX_EVENTS 64
+#define COMM_BATCH_SIZE 32
+#define COMM_BATCHES_PER_ROUND 4 // batches read from one source before the others get a turn
+#define COMM_IDLE_INTERVAL 100 // ms between calls of the idle functions (mosquitto keepalive)
+
+/** one received message; topic is only set for sources that carry it apart from the payload
+*/
+typedef struct _CommMessage {
+    char *topic;
+    char *data;
+    size_t length;
+} CommMessage;
+
+struct _CommSource;
+struct _CommDispatcher;
+
+/** called with up to COMM_BATCH_SIZE messages of a source
+*/
+typedef void (*CommBatchHandler)(struct _CommSource *source, CommMessage *messages, int count);
+
+/** read without blocking; returns the number of messages stored, or -1 once the source is unusable
+*/
+typedef int (*CommSourceRead)(struct _CommSource *source, uint32_t events, CommMessage *messages, int max);
+
+typedef struct _CommSource {
+    int fd;
+    void *socket; // zmq socket or struct mosquitto, depending on read
+    CommSourceRead read;
+    void (*idle)(struct _CommSource *source);
+    CommBatchHandler handler;
+    void *userData;
+
+    struct _CommDispatcher *dispatcher;
+    uint32_t interest; // epoll events currently registered
+    bool ready; // may hold more messages than were read this round
+    bool busy; // a worker is running its handler
+    bool removed; // set from any thread, read with commSourceRemoved()
+    int pending; // batches queued or running
+
+    CommMessage *collect; // mosquitto message callback target
+    int collected;
+    int collectMax;
+
+    struct _CommSource *next;
+} CommSource;
+
+typedef struct _CommBatch {
+    CommSource *source;
+    CommMessage messages[COMM_BATCH_SIZE];
+    int count;
+    struct _CommBatch *next;
+} CommBatch;
+
+typedef struct _CommDispatcher {
+    int epfd;
+    int wakefd;
+    bool running; // accessed atomically, commDispatcherStop() may run on any thread
+    bool shutdown;
+
+    CommSource *sources;
+    CommSource *removedSources;
+    long lastIdle;
+
+    pthread_t *workers;
+    int workersCount;
+    pthread_mutex_t lock;
+    pthread_cond_t queued; // a batch was queued, or shutdown
+    pthread_cond_t finished; // a batch was delivered
+    CommBatch *head, *tail;
+    CommBatch *freeBatches;
+    int queuedCount;
+    int maxQueued;
+} CommDispatcher;
+
+/** ZMQ plugins keep their context and socket in an exported zmqContainer
+*/
+typedef struct _CommZmqContainer {
+    void *context;
+    void *socket;
+} CommZmqContainer;
+
+static inline long commDispatcherNow() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000L + tv.tv_usec / 1000;
+}
+
+static inline bool commSourceRemoved(CommSource *source) {
+    return __atomic_load_n(&source->removed, __ATOMIC_ACQUIRE);
+}
+
+static inline void freeCommMessages(CommMessage *messages, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        free(messages[i].topic);
+        free(messages[i].data);
+    }
+}
+
+static inline void *commDispatcherWorker(void *arg) {
+    CommDispatcher *dispatcher = (CommDispatcher *)arg;
+    CommBatch *batch, *prev;
+    CommSource *source;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    for (;;) {
+        // the oldest batch of a source that no other worker is delivering
+        prev = NULL;
+        for (batch = dispatcher->head; batch && batch->source->busy; batch = batch->next) {
+            prev = batch;
+        }
+        if (!batch) {
+            if (dispatcher->shutdown && !dispatcher->head) {
+                break;
+            }
+            pthread_cond_wait(&dispatcher->queued, &dispatcher->lock);
+            continue;
+        }
+
+        if (prev) {
+            prev->next = batch->next;
+        } else {
+            dispatcher->head = batch->next;
+        }
+        if (dispatcher->tail == batch) {
+            dispatcher->tail = prev;
+        }
+        dispatcher->queuedCount--;
+        source = batch->source;
+        source->busy = true;
+        pthread_mutex_unlock(&dispatcher->lock);
+
+        if (!commSourceRemoved(source)) {
+            source->handler(source, batch->messages, batch->count);
+        }
+        freeCommMessages(batch->messages, batch->count);
+
+        pthread_mutex_lock(&dispatcher->lock);
+        source->busy = false;
+        source->pending--;
+        batch->next = dispatcher->freeBatches;
+        dispatcher->freeBatches = batch;
+        pthread_cond_signal(&dispatcher->finished);
+        // other batches may have waited for this source
+        pthread_cond_broadcast(&dispatcher->queued);
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    return NULL;
+}
+
+/** Create a dispatcher
+* @param workers number of threads running the handlers, or 0 to run them on the dispatcher thread
+* @return the dispatcher, or NULL on failure
+*/
+static inline CommDispatcher *createCommDispatcher(int workers) {
+    CommDispatcher *dispatcher;
+    struct epoll_event ev;
+    int i;
+
+    if ((dispatcher = (CommDispatcher *)calloc(1, sizeof(CommDispatcher))) == NULL) {
+        fprintf(stderr, "Could not allocate memory for the dispatcher\n");
+        return NULL;
+    }
+    dispatcher->epfd = epoll_create1(EPOLL_CLOEXEC);
+    dispatcher->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (dispatcher->epfd < 0 || dispatcher->wakefd < 0) {
+        fprintf(stderr, "Could not create the dispatcher: %s\n", strerror(errno));
+        goto error;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(dispatcher->epfd, EPOLL_CTL_ADD, dispatcher->wakefd, &ev);
+
+    pthread_mutex_init(&dispatcher->lock, NULL);
+    pthread_cond_init(&dispatcher->queued, NULL);
+    pthread_cond_init(&dispatcher->finished, NULL);
+    dispatcher->maxQueued = workers * 4;
+
+    if (workers > 0) {
+        dispatcher->workers = (pthread_t *)calloc(workers, sizeof(pthread_t));
+        for (i = 0; dispatcher->workers && i < workers; i++) {
+            if (pthread_create(&dispatcher->workers[i], NULL, commDispatcherWorker, dispatcher) != 0) {
+                break;
+            }
+            dispatcher->workersCount++;
+        }
+        if (dispatcher->workersCount == 0) {
+            fprintf(stderr, "Could not start dispatcher workers, handlers run on the dispatcher thread\n");
+        }
+    }
+
+    return dispatcher;
+
+error:
+    if (dispatcher->epfd >= 0) {
+        close(dispatcher->epfd);
+    }
+    if (dispatcher->wakefd >= 0) {
+        close(dispatcher->wakefd);
+    }
+    free(dispatcher);
+    return NULL;
+}
+
+/** Watch a descriptor
+* @param fd descriptor to wait on
+* @param socket passed to read through the source
+* @param read reads the available messages without blocking
+* @param handler receives the messages
+* @param userData stored in the source for the handler
+* @return the source, or NULL on failure
+*/
+static inline CommSource *commDispatcherAddFd(CommDispatcher *dispatcher, int fd, void *socket,
+        CommSourceRead read, CommBatchHandler handler, void *userData) {
+    CommSource *source;
+    struct epoll_event ev;
+
+    if ((source = (CommSource *)calloc(1, sizeof(CommSource))) == NULL) {
+        fprintf(stderr, "Could not allocate memory for the source\n");
+        return NULL;
+    }
+    source->fd = fd;
+    source->socket = socket;
+    source->read = read;
+    source->handler = handler;
+    source->userData = userData;
+    source->dispatcher = dispatcher;
+    source->interest = EPOLLIN;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = source->interest;
+    ev.data.ptr = source;
+    if (epoll_ctl(dispatcher->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        fprintf(stderr, "Could not watch descriptor %d: %s\n", fd, strerror(errno));
+        free(source);
+        return NULL;
+    }
+
+    // whatever arrived before the source was added would not wake epoll for ZMQ
+    source->ready = true;
+    source->next = dispatcher->sources;
+    dispatcher->sources = source;
+    return source;
+}
+
+static inline int readZmqSource(CommSource *source, uint32_t events, CommMessage *messages, int max) {
+    int count = 0;
+    zmq_msg_t msg;
+    size_t size;
+
+    (void)events;
+
+    while (count < max) {
+        zmq_msg_init(&msg);
+        if (zmq_msg_recv(&msg, source->socket, ZMQ_DONTWAIT) < 0) {
+            zmq_msg_close(&msg);
+            if (errno != EAGAIN && errno != EINTR && count == 0) {
+                return -1;
+            }
+            break;
+        }
+        size = zmq_msg_size(&msg);
+        messages[count].topic = NULL;
+        messages[count].length = size;
+        if ((messages[count].data = (char *)malloc(size + 1)) != NULL) {
+            memcpy(messages[count].data, zmq_msg_data(&msg), size);
+            messages[count].data[size] = '\0';
+            count++;
+        }
+        zmq_msg_close(&msg);
+    }
+
+    return count;
+}
+
+/** Watch a ZMQ socket. ZMQ_FD only signals edges, so the socket is drained
+* until it would block before the dispatcher waits on it again.
+*/
+static inline CommSource *commDispatcherAddZmq(CommDispatcher *dispatcher, void *socket,
+        CommBatchHandler handler, void *userData) {
+    int fd;
+    size_t size = sizeof(fd);
+
+    if (zmq_getsockopt(socket, ZMQ_FD, &fd, &size) != 0) {
+        fprintf(stderr, "Could not get the descriptor of the ZMQ socket: %s\n", zmq_strerror(errno));
+        return NULL;
+    }
+    return commDispatcherAddFd(dispatcher, fd, socket, readZmqSource, handler, userData);
+}
+
+/** Watch the socket of a client created with createClient(). Only plugins that
+* export their socket can be watched; today those are the ZMQ plugins.
+*/
+static inline CommSource *commDispatcherAddCommHandle(CommDispatcher *dispatcher, CommHandle *commHandle,
+        CommBatchHandler handler, void *userData) {
+    CommZmqContainer *container = NULL;
+
+    if (commHandle->handle) {
+        container = (CommZmqContainer *)dlsym(commHandle->handle, "zmqContainer");
+    }
+    if (!container || !container->socket) {
+        fprintf(stderr, "Plugin of this handle does not expose a socket, use its receive function instead\n");
+        return NULL;
+    }
+    return commDispatcherAddZmq(dispatcher, container->socket, handler, userData);
+}
+
+static inline void collectMosquittoMessage(struct mosquitto *mosq, void *obj, const struct mosquitto_message *msg) {
+    CommSource *source = (CommSource *)obj;
+    CommMessage *message;
+
+    (void)mosq;
+
+    if (!source->collect || source->collected == source->collectMax) {
+        return;
+    }
+    message = &source->collect[source->collected];
+    message->topic = msg->topic ? strdup(msg->topic) : NULL;
+    message->length = msg->payloadlen;
+    if ((message->data = (char *)malloc(msg->payloadlen + 1)) != NULL) {
+        memcpy(message->data, msg->payload, msg->payloadlen);
+        message->data[msg->payloadlen] = '\0';
+        source->collected++;
+    } else {
+        free(message->topic);
+    }
+}
+
+static inline int readMosquittoSource(CommSource *source, uint32_t events, CommMessage *messages, int max) {
+    struct mosquitto *mosq = (struct mosquitto *)source->socket;
+    int available = 0;
+
+    if (events & EPOLLOUT) {
+        mosquitto_loop_write(mosq, 1);
+    }
+    if (!(events & EPOLLIN)) {
+        return 0;
+    }
+
+    // mosquitto reads one packet at a time and leaves the rest in the socket
+    source->collect = messages;
+    source->collected = 0;
+    source->collectMax = max;
+    do {
+        if (mosquitto_loop_read(mosq, 1) != MOSQ_ERR_SUCCESS) {
+            source->collect = NULL;
+            return source->collected > 0 ? source->collected : -1;
+        }
+    } while (source->collected < max && ioctl(source->fd, FIONREAD, &available) == 0 && available > 0);
+    source->collect = NULL;
+
+    return source->collected;
+}
+
+static inline void idleMosquittoSource(CommSource *source) {
+    struct mosquitto *mosq = (struct mosquitto *)source->socket;
+    uint32_t interest = EPOLLIN;
+    struct epoll_event ev;
+
+    mosquitto_loop_misc(mosq);
+    if (mosquitto_want_write(mosq)) {
+        interest |= EPOLLOUT;
+    }
+    if (interest != source->interest) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = interest;
+        ev.data.ptr = source;
+        epoll_ctl(source->dispatcher->epfd, EPOLL_CTL_MOD, source->fd, &ev);
+        source->interest = interest;
+    }
+}
+
+/** Watch a connected mosquitto client. The dispatcher takes over its network loop
+* and message callback; do not call mosquitto_loop() or mosquitto_loop_start() on it.
+*/
+static inline CommSource *commDispatcherAddMosquitto(CommDispatcher *dispatcher, struct mosquitto *mosq,
+        CommBatchHandler handler, void *userData) {
+    CommSource *source;
+    int fd = mosquitto_socket(mosq);
+
+    if (fd < 0) {
+        fprintf(stderr, "Mosquitto client is not connected\n");
+        return NULL;
+    }
+    if ((source = commDispatcherAddFd(dispatcher, fd, mosq, readMosquittoSource, handler, userData)) == NULL) {
+        return NULL;
+    }
+    source->idle = idleMosquittoSource;
+    source->ready = false;
+    mosquitto_user_data_set(mosq, source);
+    mosquitto_message_callback_set(mosq, collectMosquittoMessage);
+    idleMosquittoSource(source);
+    return source;
+}
+
+/** Stop watching a source; may be called from any thread or handler. The source
+* is freed once its queued batches are delivered.
+*/
+static inline void commDispatcherRemove(CommDispatcher *dispatcher, CommSource *source) {
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    __atomic_store_n(&source->removed, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&dispatcher->lock);
+    if (write(dispatcher->wakefd, &one, sizeof(one)) < 0) {
+        // the counter is already set, the dispatcher wakes up anyway
+    }
+}
+
+/** Move removed sources out of the watched list; dispatcher thread only */
+static inline void commDispatcherUnlinkRemoved(CommDispatcher *dispatcher) {
+    CommSource **link = &dispatcher->sources, *source;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    while ((source = *link) != NULL) {
+        if (source->removed) {
+            epoll_ctl(dispatcher->epfd, EPOLL_CTL_DEL, source->fd, NULL);
+            *link = source->next;
+            source->next = dispatcher->removedSources;
+            dispatcher->removedSources = source;
+        } else {
+            link = &source->next;
+        }
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+static inline void commDispatcherFreeRemoved(CommDispatcher *dispatcher) {
+    CommSource **link = &dispatcher->removedSources, *source;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    while ((source = *link) != NULL) {
+        if (source->pending == 0) {
+            *link = source->next;
+            free(source);
+        } else {
+            link = &source->next;
+        }
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+static inline void commDispatcherDeliver(CommDispatcher *dispatcher, CommSource *source, CommBatch *batch) {
+    CommBatch *queued;
+
+    if (dispatcher->workersCount == 0) {
+        source->handler(source, batch->messages, batch->count);
+        freeCommMessages(batch->messages, batch->count);
+        return;
+    }
+
+    pthread_mutex_lock(&dispatcher->lock);
+    while (dispatcher->queuedCount >= dispatcher->maxQueued) {
+        pthread_cond_wait(&dispatcher->finished, &dispatcher->lock);
+    }
+    if ((queued = dispatcher->freeBatches) != NULL) {
+        dispatcher->freeBatches = queued->next;
+    } else if ((queued = (CommBatch *)malloc(sizeof(CommBatch))) == NULL) {
+        pthread_mutex_unlock(&dispatcher->lock);
+        fprintf(stderr, "Could not allocate memory for a batch, %d messages dropped\n", batch->count);
+        freeCommMessages(batch->messages, batch->count);
+        return;
+    }
+    queued->source = source;
+    queued->count = batch->count;
+    memcpy(queued->messages, batch->messages, batch->count * sizeof(CommMessage));
+    queued->next = NULL;
+    if (dispatcher->tail) {
+        dispatcher->tail->next = queued;
+    } else {
+        dispatcher->head = queued;
+    }
+    dispatcher->tail = queued;
+    dispatcher->queuedCount++;
+    source->pending++;
+    pthread_cond_signal(&dispatcher->queued);
+    pthread_mutex_unlock(&dispatcher->lock);
+}
+
+/** Read one round from a source; returns false if it failed and was removed */
+static inline bool commDispatcherService(CommDispatcher *dispatcher, CommSource *source, uint32_t events) {
+    CommBatch batch;
+    int round;
+
+    source->ready = false;
+    for (round = 0; round < COMM_BATCHES_PER_ROUND; round++) {
+        batch.count = source->read(source, events, batch.messages, COMM_BATCH_SIZE);
+        if (batch.count < 0) {
+            fprintf(stderr, "Source on descriptor %d failed and is no longer watched\n", source->fd);
+            commDispatcherRemove(dispatcher, source);
+            return false;
+        }
+        if (batch.count > 0) {
+            commDispatcherDeliver(dispatcher, source, &batch);
+        }
+        if (batch.count < COMM_BATCH_SIZE || commSourceRemoved(source)) {
+            return true;
+        }
+    }
+    // more may be waiting; ZMQ would not signal it again
+    source->ready = true;
+    return true;
+}
+
+/** Wait for and deliver messages until commDispatcherStop() is called
+*/
+static inline void commDispatcherRun(CommDispatcher *dispatcher) {
+    struct epoll_event events[COMM_DISPATCHER_MAX_EVENTS];
+    CommSource *source;
+    bool anyReady = true;
+    uint64_t wake;
+    long now;
+    int i, n;
+
+    __atomic_store_n(&dispatcher->running, true, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&dispatcher->running, __ATOMIC_ACQUIRE)) {
+        n = epoll_wait(dispatcher->epfd, events, COMM_DISPATCHER_MAX_EVENTS, anyReady ? 0 : COMM_IDLE_INTERVAL);
+        if (n < 0 && errno != EINTR) {
+            fprintf(stderr, "Dispatcher wait failed: %s\n", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            source = (CommSource *)events[i].data.ptr;
+            if (!source) {
+                if (read(dispatcher->wakefd, &wake, sizeof(wake)) < 0) {
+                    // already reset by another wakeup
+                }
+                continue;
+            }
+            if (!commSourceRemoved(source)) {
+                commDispatcherService(dispatcher, source, events[i].events);
+            }
+        }
+
+        anyReady = false;
+        now = commDispatcherNow();
+        for (source = dispatcher->sources; source; source = source->next) {
+            if (commSourceRemoved(source)) {
+                continue;
+            }
+            if (source->ready) {
+                commDispatcherService(dispatcher, source, EPOLLIN);
+                anyReady = anyReady || source->ready;
+            }
+            if (source->idle && now - dispatcher->lastIdle >= COMM_IDLE_INTERVAL) {
+                source->idle(source);
+            }
+        }
+        if (now - dispatcher->lastIdle >= COMM_IDLE_INTERVAL) {
+            dispatcher->lastIdle = now;
+        }
+
+        commDispatcherUnlinkRemoved(dispatcher);
+        if (dispatcher->removedSources) {
+            commDispatcherFreeRemoved(dispatcher);
+        }
+    }
+    __atomic_store_n(&dispatcher->running, false, __ATOMIC_RELEASE);
+}
+
+/** Make commDispatcherRun() return; may be called from any thread or handler
+*/
+static inline void commDispatcherStop(CommDispatcher *dispatcher) {
+    uint64_t one = 1;
+
+    __atomic_store_n(&dispatcher->running, false, __ATOMIC_RELEASE);
+    if (write(dispatcher->wakefd, &one, sizeof(one)) < 0) {
+        // the counter is already set, the dispatcher wakes up anyway
+    }
+}
+
+/** Deliver the queued batches, stop the workers and free the dispatcher and its
+* sources. The sockets themselves are left to their owners.
+*/
+static inline void destroyCommDispatcher(CommDispatcher *dispatcher) {
+    CommSource *source;
+    CommBatch *batch;
+    int i;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->shutdown = true;
+    pthread_cond_broadcast(&dispatcher->queued);
+    pthread_mutex_unlock(&dispatcher->lock);
+    for (i = 0; i < dispatcher->workersCount; i++) {
+        pthread_join(dispatcher->workers[i], NULL);
+    }
+    free(dispatcher->workers);
+
+    for (source = dispatcher->sources; source; source = source->next) {
+        source->removed = true;
+    }
+    commDispatcherUnlinkRemoved(dispatcher);
+    commDispatcherFreeRemoved(dispatcher);
+    while ((batch = dispatcher->freeBatches) != NULL) {
+        dispatcher->freeBatches = batch->next;
+        free(batch);
+    }
+
+    pthread_mutex_destroy(&dispatcher->lock);
+    pthread_cond_destroy(&dispatcher->queued);
+    pthread_cond_destroy(&dispatcher->finished);
+    close(dispatcher->epfd);
+    close(dispatcher->wakefd);
+    free(dispatcher);
+}
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file credentials.h
+* @brief Lazily loaded, shared authentication credentials.
+*
+* A Crypto structure carries room for all nine keys and certificates, about
+* 70 KB per instance, whether or not the service is secured. Credentials are
+* a process wide, reference counted replacement: acquiring them only reads the
+* user and host from the authentication state, and each key or certificate is
+* mapped read-only from its file the first time it is asked for. Every handle
+* of the process shares the same mappings.
+*/
+
+#ifndef __IOTKIT_COMM_CREDENTIALS_H
+#define __IOTKIT_COMM_CREDENTIALS_H
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "iotkit-comm.h"
+
+#define CREDENTIAL_PATH_MAX 1024
+
+typedef enum {
+    CREDENTIAL_CA_SSL_CERT,
+    CREDENTIAL_HOST_PUBLIC_KEY,
+    CREDENTIAL_HOST_PRIVATE_KEY,
+    CREDENTIAL_HOST_SSH_CERT,
+    CREDENTIAL_HOST_SSL_CERT,
+    CREDENTIAL_USER_PRIVATE_KEY,
+    CREDENTIAL_USER_PUBLIC_KEY,
+    CREDENTIAL_USER_SSH_CERT,
+    CREDENTIAL_USER_SSL_CERT,
+    CREDENTIAL_COUNT
+} CredentialType;
+
+/** contents of a key or certificate file, mapped read-only
+*/
+typedef struct _CredentialBlob {
+    const char *data;
+    size_t length;
+    char *path;
+} CredentialBlob;
+
+/** authentication details shared by all handles of the process
+*/
+typedef struct _Credentials {
+    char *user;
+    char *host;
+    int mosquittoSecurePort;
+
+    CredentialBlob blobs[CREDENTIAL_COUNT];
+    int refCount;
+} Credentials;
+
+/** process-wide credentials, shared by every file that includes this header;
+* the definitions are weak so the linker keeps a single copy of each
+*/
+extern Credentials *g_credentials;
+extern pthread_mutex_t g_credentialsLock;
+
+__attribute__((weak)) Credentials *g_credentials = NULL;
+__attribute__((weak)) pthread_mutex_t g_credentialsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline const char *credentialName(CredentialType type) {
+    switch (type) {
+        case CREDENTIAL_CA_SSL_CERT:      return "CA certificate";
+        case CREDENTIAL_HOST_PUBLIC_KEY:  return "host public key";
+        case CREDENTIAL_HOST_PRIVATE_KEY: return "host private key";
+        case CREDENTIAL_HOST_SSH_CERT:    return "host SSH certificate";
+        case CREDENTIAL_HOST_SSL_CERT:    return "host SSL certificate";
+        case CREDENTIAL_USER_PRIVATE_KEY: return "user private key";
+        case CREDENTIAL_USER_PUBLIC_KEY:  return "user public key";
+        case CREDENTIAL_USER_SSH_CERT:    return "user SSH certificate";
+        case CREDENTIAL_USER_SSL_CERT:    return "user SSL certificate";
+        default:                          return "credential";
+    }
+}
+
+static inline const char *credentialsHomeDir() {
+    char *home = getenv("HOME");
+    struct passwd *pw;
+
+    if (home) {
+        return home;
+    }
+    if ((pw = getpwuid(getuid())) != NULL) {
+        return pw->pw_dir;
+    }
+    return ".";
+}
+
+/** Build the path of a credential file, following the layout created by iotkit-comm setupAuthentication
+*/
+static inline bool credentialPath(Credentials *credentials, CredentialType type, char *path, size_t size) {
+    ConfigFileData *c = &g_configData;
+    const char *home = credentialsHomeDir();
+    char id[256];
+    int len = -1;
+
+    if (type == CREDENTIAL_CA_SSL_CERT) {
+        len = snprintf(path, size, "/usr/local/%s/%s%s/%s%s", c->stateDirName, c->caName, c->keyDirSuffix,
+                c->caName, c->SSLCertSuffix);
+        return len > 0 && (size_t)len < size;
+    }
+
+    if (type <= CREDENTIAL_HOST_SSL_CERT) {
+        snprintf(id, sizeof(id), "%s%s", credentials->host, c->hostKeyNameSuffix);
+    } else {
+        snprintf(id, sizeof(id), "%s_%s", credentials->host, credentials->user);
+    }
+
+    switch (type) {
+        case CREDENTIAL_HOST_PUBLIC_KEY:
+        case CREDENTIAL_USER_PUBLIC_KEY:
+            len = snprintf(path, size, "%s/.%s/%s%s/%s%s%s", home, c->stateDirName, id, c->keyDirSuffix,
+                    id, c->privateKeyNameSuffix, c->SSHPubKeySuffix);
+            break;
+        case CREDENTIAL_HOST_PRIVATE_KEY:
+        case CREDENTIAL_USER_PRIVATE_KEY:
+            len = snprintf(path, size, "%s/.%s/%s%s/%s%s", home, c->stateDirName, id, c->keyDirSuffix,
+                    id, c->privateKeyNameSuffix);
+            break;
+        case CREDENTIAL_HOST_SSH_CERT:
+        case CREDENTIAL_USER_SSH_CERT:
+            len = snprintf(path, size, "%s/.%s/%s%s/%s%s%s%s", home, c->stateDirName, id, c->keyDirSuffix,
+                    id, c->privateKeyNameSuffix, c->SSHCertSuffix, c->SSHPubKeySuffix);
+            break;
+        case CREDENTIAL_HOST_SSL_CERT:
+        case CREDENTIAL_USER_SSL_CERT:
+            len = snprintf(path, size, "%s/.%s/%s%s/%s%s%s", home, c->stateDirName, id, c->keyDirSuffix,
+                    id, c->privateKeyNameSuffix, c->SSLCertSuffix);
+            break;
+        default:
+            break;
+    }
+    return len > 0 && (size_t)len < size;
+}
+
+/** Take a reference on the credentials of this process. Only the user and host
+* are read here; keys and certificates are loaded by getCredential().
+* @return credentials, or NULL if authentication was not set up
+*/
+static inline Credentials *acquireCredentials() {
+    AuthenticationState *local = g_configData.localState;
+    AuthenticationState *global = g_configData.globalState;
+    Credentials *credentials = NULL;
+
+    pthread_mutex_lock(&g_credentialsLock);
+    if (g_credentials) {
+        g_credentials->refCount++;
+        credentials = g_credentials;
+    } else if (!local || !global || !local->host || !global->host || !local->user) {
+        fprintf(stderr, "No credentials found. Please create credentials using iotkit-comm setupAuthentication\n");
+    } else if (strcmp(local->host, global->host) != 0) {
+        fprintf(stderr, "Credentials do not seem to have been setup correctly for this host. Please rerun "
+                "iotkit-comm setupAuthentication\n");
+    } else if ((credentials = (Credentials *)calloc(1, sizeof(Credentials))) == NULL) {
+        fprintf(stderr, "Could not allocate memory for credentials\n");
+    } else {
+        credentials->user = strdup(local->user);
+        credentials->host = strdup(local->host);
+        credentials->mosquittoSecurePort = global->mosquittoSecurePort;
+        credentials->refCount = 1;
+        g_credentials = credentials;
+    }
+    pthread_mutex_unlock(&g_credentialsLock);
+
+    return credentials;
+}
+
+/** Take a reference on the credentials only if the spec asks for a secure channel
+* @return credentials, or NULL for insecure specs and when authentication was not set up
+*/
+static inline Credentials *acquireCredentialsForSpec(ServiceSpec *specification) {
+    if (!specification->type_params.mustsecure && !getSpecPropertyValue(specification, "__mustsecure")) {
+        return NULL;
+    }
+    return acquireCredentials();
+}
+
+/** Map a key or certificate on first use
+* @return the blob, valid until the last reference is released, or NULL if the file is missing
+*/
+static inline const CredentialBlob *getCredential(Credentials *credentials, CredentialType type) {
+    CredentialBlob *blob = &credentials->blobs[type];
+    char path[CREDENTIAL_PATH_MAX];
+    struct stat st;
+    void *data;
+    int fd;
+
+    pthread_mutex_lock(&g_credentialsLock);
+    if (blob->data) {
+        pthread_mutex_unlock(&g_credentialsLock);
+        return blob;
+    }
+
+    if (!credentialPath(credentials, type, path, sizeof(path)) || (fd = open(path, O_RDONLY)) < 0) {
+        pthread_mutex_unlock(&g_credentialsLock);
+        fprintf(stderr, "No %s found. Please recreate credentials using iotkit-comm setupAuthentication\n",
+                credentialName(type));
+        return NULL;
+    }
+
+    data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        pthread_mutex_unlock(&g_credentialsLock);
+        fprintf(stderr, "Could not read %s at %s\n", credentialName(type), path);
+        return NULL;
+    }
+
+    blob->path = strdup(path);
+    blob->length = st.st_size;
+    blob->data = (const char *)data;
+    pthread_mutex_unlock(&g_credentialsLock);
+
+    return blob;
+}
+
+/** Path of a key or certificate, for tools that take file names (ssh -i); maps it as well
+*/
+static inline const char *getCredentialPath(Credentials *credentials, CredentialType type) {
+    const CredentialBlob *blob = getCredential(credentials, type);
+    return blob ? blob->path : NULL;
+}
+
+/** Drop a reference; the last one unmaps everything
+*/
+static inline void releaseCredentials(Credentials *credentials) {
+    int i;
+
+    if (!credentials) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_credentialsLock);
+    if (--credentials->refCount > 0) {
+        pthread_mutex_unlock(&g_credentialsLock);
+        return;
+    }
+    if (g_credentials == credentials) {
+        g_credentials = NULL;
+    }
+    pthread_mutex_unlock(&g_credentialsLock);
+
+    for (i = 0; i < CREDENTIAL_COUNT; i++) {
+        if (credentials->blobs[i].data) {
+            munmap((void *)credentials->blobs[i].data, credentials->blobs[i].length);
+            free(credentials->blobs[i].path);
+        }
+    }
+    free(credentials->user);
+    free(credentials->host);
+    free(credentials);
+}
+
+#endif
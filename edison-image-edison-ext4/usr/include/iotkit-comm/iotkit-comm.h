@@ -205,10 +205,10 @@ int g_funcEntries;
 
 CommHandle *createClient(ServiceQuery *);
 CommHandle *createService(CommHandle *commHandle, ServiceSpec *specification);
-void *commInterfacesLookup(CommHandle *commHandle, char *funcname);
+void *commInterfacesLookup(CommHandle *commHandle, const char *funcname);
 void cleanUp(CommHandle **);
 void cleanUpService(ServiceSpec **servSpec, CommHandle **commHandle);
-char *getSpecPropertyValue(ServiceSpec *specification, char *key);
+char *getSpecPropertyValue(ServiceSpec *specification, const char *key);
 bool fileExists(char *absPath);
 
 Crypto *crypto_init();
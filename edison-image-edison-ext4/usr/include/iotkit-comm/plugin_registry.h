@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file plugin_registry.h
+* @brief Process wide registry of communication plugins and typed interface tables.
+*
+* commInterfacesLookup() searches the interfaces of a handle by name on every
+* call, and cleanUp() closes the plugin library, so the next createClient() or
+* createService() loads and relocates it again. The registry keeps one
+* reference on each plugin library for the life of the process and parses each
+* plugin interface file once. ClientInterface and ServiceInterface are resolved
+* once per handle; their members are then called directly.
+*/
+
+#ifndef __IOTKIT_COMM_PLUGIN_REGISTRY_H
+#define __IOTKIT_COMM_PLUGIN_REGISTRY_H
+
+#include <pthread.h>
+#include "iotkit-comm.h"
+#include "cJSON.h"
+#include "util.h"
+
+#define PLUGIN_REGISTRY_SIZE 16
+#define PLUGIN_INTERFACE_MAX_FUNCTIONS 16
+
+/** functions of a client plugin; members the plugin does not provide are NULL
+*/
+typedef struct _ClientInterface {
+    int (*send)(char *message, Context context);
+    int (*receive)(void (*handler)(char *message, Context context));
+    int (*subscribe)(char *topic);
+    int (*unsubscribe)(char *topic);
+    int (*done)();
+} ClientInterface;
+
+/** functions of a service plugin; members the plugin does not provide are NULL
+*/
+typedef struct _ServiceInterface {
+    void (*sendTo)(void *client, char *message, Context context);
+    int (*publish)(char *message, Context context);
+    int (*receive)(void (*handler)(void *client, char *message, Context context));
+    int (*done)();
+} ServiceInterface;
+
+/** a plugin library kept loaded by the registry
+*/
+typedef struct _RegisteredPlugin {
+    char *path;
+    void *handle;
+} RegisteredPlugin;
+
+/** function names required by a plugin interface file
+*/
+typedef struct _RegisteredInterface {
+    char *name;
+    char *functions[PLUGIN_INTERFACE_MAX_FUNCTIONS];
+    int functionsCount;
+} RegisteredInterface;
+
+typedef struct _PluginRegistry {
+    RegisteredPlugin plugins[PLUGIN_REGISTRY_SIZE];
+    int pluginsCount;
+    RegisteredInterface interfaces[PLUGIN_REGISTRY_SIZE];
+    int interfacesCount;
+} PluginRegistry;
+
+/** process-wide registry, shared by every file that includes this header;
+* the definitions are weak so the linker keeps a single copy of each
+*/
+extern PluginRegistry g_pluginRegistry;
+extern pthread_mutex_t g_pluginRegistryLock;
+
+__attribute__((weak)) PluginRegistry g_pluginRegistry;
+__attribute__((weak)) pthread_mutex_t g_pluginRegistryLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool registerPluginLibrary(char *path) {
+    PluginRegistry *registry = &g_pluginRegistry;
+    void *handle;
+    int i;
+
+    for (i = 0; i < registry->pluginsCount; i++) {
+        if (strcmp(registry->plugins[i].path, path) == 0) {
+            return true;
+        }
+    }
+    if (registry->pluginsCount == PLUGIN_REGISTRY_SIZE) {
+        fprintf(stderr, "Plugin registry is full, %s is not kept loaded\n", path);
+        return false;
+    }
+    if ((handle = dlopen(path, RTLD_LAZY)) == NULL) {
+        fprintf(stderr, "Could not load plugin %s: %s\n", path, dlerror());
+        return false;
+    }
+
+    registry->plugins[registry->pluginsCount].path = strdup(path);
+    registry->plugins[registry->pluginsCount].handle = handle;
+    registry->pluginsCount++;
+    return true;
+}
+
+/** Keep the client and service libraries of a plugin loaded until releasePlugins()
+* @param pluginName plugin name as in the type of a service spec, e.g. "zmqreqrep"
+* @return true if at least one side of the plugin was found
+*/
+static inline bool retainPlugin(char *pluginName) {
+    char path[256];
+    bool found = false;
+
+    pthread_mutex_lock(&g_pluginRegistryLock);
+    snprintf(path, sizeof(path), "%slib%s-%s.so", LIB_PLUGINS_DIRECTORY, pluginName,
+            g_configData.clientFileSuffix ? g_configData.clientFileSuffix : "client");
+    if (fileExists(path)) {
+        found = registerPluginLibrary(path);
+    }
+    snprintf(path, sizeof(path), "%slib%s-%s.so", LIB_PLUGINS_DIRECTORY, pluginName,
+            g_configData.serverFileSuffix ? g_configData.serverFileSuffix : "service");
+    if (fileExists(path)) {
+        found = registerPluginLibrary(path) || found;
+    }
+    pthread_mutex_unlock(&g_pluginRegistryLock);
+
+    return found;
+}
+
+/** Function names listed by a plugin interface file, parsed on first use
+* @param interfaceName interface file name without ".json", e.g. "client-interface"
+* @return the interface, or NULL if the file is missing or malformed
+*/
+static inline RegisteredInterface *getPluginInterface(char *interfaceName) {
+    PluginRegistry *registry = &g_pluginRegistry;
+    RegisteredInterface *interface = NULL;
+    char path[256];
+    cJSON *json = NULL, *functions;
+    char *text = NULL;
+    FILE *fp;
+    long size;
+    int i;
+
+    pthread_mutex_lock(&g_pluginRegistryLock);
+    for (i = 0; i < registry->interfacesCount; i++) {
+        if (strcmp(registry->interfaces[i].name, interfaceName) == 0) {
+            pthread_mutex_unlock(&g_pluginRegistryLock);
+            return &registry->interfaces[i];
+        }
+    }
+    if (registry->interfacesCount == PLUGIN_REGISTRY_SIZE) {
+        goto out;
+    }
+
+    snprintf(path, sizeof(path), "%s%s/%s.json", LIB_CONFIG_DIRECTORY,
+            g_configData.pluginInterfaceDir ? g_configData.pluginInterfaceDir : "plugin-interfaces", interfaceName);
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Could not open plugin interface file %s\n", path);
+        goto out;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size > 0 && (text = (char *)malloc(size + 1)) != NULL && fread(text, 1, size, fp) == (size_t)size) {
+        text[size] = '\0';
+        json = cJSON_Parse(text);
+    }
+    fclose(fp);
+
+    functions = json ? cJSON_GetObjectItem(json, "functions") : NULL;
+    if (!isJsonArray(functions)) {
+        fprintf(stderr, "Invalid plugin interface file %s\n", path);
+        goto out;
+    }
+
+    interface = &registry->interfaces[registry->interfacesCount];
+    interface->name = strdup(interfaceName);
+    interface->functionsCount = 0;
+    for (i = 0; i < cJSON_GetArraySize(functions) && i < PLUGIN_INTERFACE_MAX_FUNCTIONS; i++) {
+        cJSON *item = cJSON_GetArrayItem(functions, i);
+        if (isJsonString(item)) {
+            interface->functions[interface->functionsCount++] = strdup(item->valuestring);
+        }
+    }
+    registry->interfacesCount++;
+
+out:
+    pthread_mutex_unlock(&g_pluginRegistryLock);
+    if (json) {
+        cJSON_Delete(json);
+    }
+    free(text);
+    return interface;
+}
+
+/** Current value of a plugin function pointer, or NULL */
+static inline void *lookupPluginFunction(CommHandle *commHandle, const char *funcname) {
+    void **iptr = (void **)commInterfacesLookup(commHandle, funcname);
+    return iptr ? *iptr : NULL;
+}
+
+/** Check the handle provides every function its interface file requires */
+static inline bool checkPluginInterface(CommHandle *commHandle) {
+    RegisteredInterface *interface;
+    int i;
+
+    if (!commHandle->interface || !*commHandle->interface ||
+            (interface = getPluginInterface(*commHandle->interface)) == NULL) {
+        return true;
+    }
+    for (i = 0; i < interface->functionsCount; i++) {
+        if (!commInterfacesLookup(commHandle, interface->functions[i])) {
+            fprintf(stderr, "Plugin does not define required function '%s'\n", interface->functions[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Resolve the functions of a client handle once, for direct calls
+* @return false if the plugin lacks a function required by its interface
+*/
+static inline bool resolveClientInterface(CommHandle *commHandle, ClientInterface *client) {
+    client->send = (int (*)(char *, Context))lookupPluginFunction(commHandle, "send");
+    client->receive = (int (*)(void (*)(char *, Context)))lookupPluginFunction(commHandle, "receive");
+    client->subscribe = (int (*)(char *))lookupPluginFunction(commHandle, "subscribe");
+    client->unsubscribe = (int (*)(char *))lookupPluginFunction(commHandle, "unsubscribe");
+    client->done = (int (*)())lookupPluginFunction(commHandle, "done");
+    return checkPluginInterface(commHandle);
+}
+
+/** Resolve the functions of a service handle once, for direct calls
+* @return false if the plugin lacks a function required by its interface
+*/
+static inline bool resolveServiceInterface(CommHandle *commHandle, ServiceInterface *service) {
+    service->sendTo = (void (*)(void *, char *, Context))lookupPluginFunction(commHandle, "sendTo");
+    service->publish = (int (*)(char *, Context))lookupPluginFunction(commHandle, "publish");
+    service->receive = (int (*)(void (*)(void *, char *, Context)))lookupPluginFunction(commHandle, "receive");
+    service->done = (int (*)())lookupPluginFunction(commHandle, "done");
+    return checkPluginInterface(commHandle);
+}
+
+/** Drop the references taken by retainPlugin() and the parsed interface files */
+static inline void releasePlugins() {
+    PluginRegistry *registry = &g_pluginRegistry;
+    int i, j;
+
+    pthread_mutex_lock(&g_pluginRegistryLock);
+    for (i = 0; i < registry->pluginsCount; i++) {
+        dlclose(registry->plugins[i].handle);
+        free(registry->plugins[i].path);
+    }
+    for (i = 0; i < registry->interfacesCount; i++) {
+        for (j = 0; j < registry->interfaces[i].functionsCount; j++) {
+            free(registry->interfaces[i].functions[j]);
+        }
+        free(registry->interfaces[i].name);
+    }
+    registry->pluginsCount = 0;
+    registry->interfacesCount = 0;
+    pthread_mutex_unlock(&g_pluginRegistryLock);
+}
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file service_filter.h
+* @brief Precomputed state for filtering discovered services.
+*
+* The address table holds the IPv4 addresses of this machine as integers. It
+* is built once and rebuilt only after the kernel reports an address change
+* on a netlink socket, so checking whether a service is local or choosing the
+* service address with the longest prefix match costs no system calls beyond
+* one non-blocking read. A CompiledServiceQuery keeps the name regex of a
+* query compiled for the lifetime of a discovery.
+*/
+
+#ifndef __IOTKIT_COMM_SERVICE_FILTER_H
+#define __IOTKIT_COMM_SERVICE_FILTER_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <dns_sd.h>
+#include "iotkit-comm.h"
+
+#define ADDRESS_TABLE_SIZE 32
+
+/** IPv4 address of a local interface, in host byte order
+*/
+typedef struct _InterfaceAddress {
+    uint32_t address;
+    uint32_t netmask;
+} InterfaceAddress;
+
+typedef struct _AddressTable {
+    InterfaceAddress entries[ADDRESS_TABLE_SIZE];
+    int count;
+    bool valid;
+    bool netlinkOpened;
+    int netlinkFd; // -1 if netlink is unavailable; the table is then rebuilt on every refresh
+} AddressTable;
+
+/** process-wide address table, shared by every file that includes this header;
+* the definitions are weak so the linker keeps a single copy of each
+*/
+extern AddressTable g_addressTable;
+extern pthread_mutex_t g_addressTableLock;
+
+__attribute__((weak)) AddressTable g_addressTable;
+__attribute__((weak)) pthread_mutex_t g_addressTableLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void buildAddressTable(AddressTable *table) {
+    struct ifaddrs *ifaddr, *ifa;
+
+    table->count = 0;
+    if (getifaddrs(&ifaddr) != 0) {
+        fprintf(stderr, "Could not get the addresses of this machine: %s\n", strerror(errno));
+        return;
+    }
+    for (ifa = ifaddr; ifa && table->count < ADDRESS_TABLE_SIZE; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET || (ifa->ifa_flags & IFF_LOOPBACK)) {
+            continue;
+        }
+        table->entries[table->count].address = ntohl(((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr);
+        table->entries[table->count].netmask = ifa->ifa_netmask ?
+                ntohl(((struct sockaddr_in *)ifa->ifa_netmask)->sin_addr.s_addr) : 0;
+        table->count++;
+    }
+    freeifaddrs(ifaddr);
+    table->valid = true;
+}
+
+/** Rebuild the address table if the addresses of this machine changed; call with g_addressTableLock held
+*/
+static inline AddressTable *refreshAddressTable() {
+    AddressTable *table = &g_addressTable;
+    struct sockaddr_nl local;
+    char buffer[4096];
+    bool changed = !table->valid;
+    ssize_t len;
+
+    if (!table->netlinkOpened) {
+        table->netlinkOpened = true;
+        table->netlinkFd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+        memset(&local, 0, sizeof(local));
+        local.nl_family = AF_NETLINK;
+        local.nl_groups = RTMGRP_IPV4_IFADDR;
+        if (table->netlinkFd >= 0 && bind(table->netlinkFd, (struct sockaddr *)&local, sizeof(local)) != 0) {
+            close(table->netlinkFd);
+            table->netlinkFd = -1;
+        }
+    }
+
+    if (table->netlinkFd < 0) {
+        changed = true;
+    } else {
+        // the content does not matter, any address event means the table is stale
+        while ((len = recv(table->netlinkFd, buffer, sizeof(buffer), 0)) > 0 || (len < 0 && errno == ENOBUFS)) {
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        buildAddressTable(table);
+    }
+    return table;
+}
+
+/** Number of leading bits two addresses have in common
+*/
+static inline int addressPrefixLength(uint32_t a, uint32_t b) {
+    return a == b ? 32 : __builtin_clz(a ^ b);
+}
+
+static inline bool parseIPv4Address(const char *address, uint32_t *value) {
+    struct in_addr addr;
+
+    if (!address || inet_pton(AF_INET, address, &addr) != 1) {
+        return false;
+    }
+    *value = ntohl(addr.s_addr);
+    return true;
+}
+
+/** Check if an address belongs to this machine
+*/
+static inline bool isLocalAddress(const char *address) {
+    AddressTable *table;
+    uint32_t value;
+    bool found = false;
+    int i;
+
+    if (!parseIPv4Address(address, &value)) {
+        return false;
+    }
+    pthread_mutex_lock(&g_addressTableLock);
+    table = refreshAddressTable();
+    for (i = 0; i < table->count && !found; i++) {
+        found = table->entries[i].address == value;
+    }
+    pthread_mutex_unlock(&g_addressTableLock);
+
+    return found;
+}
+
+/** Longest prefix an address shares with an address of this machine
+* @return prefix length in bits, or -1 if the address is not IPv4 or this machine has no address
+*/
+static inline int longestPrefixMatch(const char *address) {
+    AddressTable *table;
+    uint32_t value;
+    int i, len, longest = -1;
+
+    if (!parseIPv4Address(address, &value)) {
+        return -1;
+    }
+    pthread_mutex_lock(&g_addressTableLock);
+    table = refreshAddressTable();
+    for (i = 0; i < table->count; i++) {
+        len = addressPrefixLength(value, table->entries[i].address);
+        if (len > longest) {
+            longest = len;
+        }
+    }
+    pthread_mutex_unlock(&g_addressTableLock);
+
+    return longest;
+}
+
+/** Choose the service address to connect to: a local one if the service runs on this machine,
+* otherwise the one sharing the longest prefix with an address of this machine
+* @return index into addresses, or -1 if none of them is usable
+*/
+static inline int selectServiceAddress(char **addresses, int count) {
+    AddressTable *table;
+    uint32_t value;
+    int i, j, len, best = -1, longest = -1;
+
+    pthread_mutex_lock(&g_addressTableLock);
+    table = refreshAddressTable();
+    for (i = 0; i < count; i++) {
+        if (!parseIPv4Address(addresses[i], &value)) {
+            continue;
+        }
+        for (j = 0; j < table->count; j++) {
+            len = addressPrefixLength(value, table->entries[j].address);
+            if (len > longest) {
+                longest = len;
+                best = i;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_addressTableLock);
+
+    return best;
+}
+
+/** A service query with its name regex compiled once
+*/
+typedef struct _CompiledServiceQuery {
+    ServiceQuery *query;
+    regex_t nameRegEx;
+    bool hasNameRegEx;
+} CompiledServiceQuery;
+
+/** Compile the name regex of a query
+* @return false if the regex is invalid
+*/
+static inline bool compileServiceQuery(ServiceQuery *query, CompiledServiceQuery *compiled) {
+    char error[256];
+    int status;
+
+    compiled->query = query;
+    compiled->hasNameRegEx = false;
+    if (query->service_name) {
+        if ((status = regcomp(&compiled->nameRegEx, query->service_name, REG_EXTENDED | REG_NOSUB)) != 0) {
+            regerror(status, &compiled->nameRegEx, error, sizeof(error));
+            fprintf(stderr, "Invalid service name regex '%s': %s\n", query->service_name, error);
+            return false;
+        }
+        compiled->hasNameRegEx = true;
+    }
+    return true;
+}
+
+/** Check a discovered service against a query: its name matches the query name regex, or
+* one of the query properties has the same value in its TXT record. A query with neither
+* matches every service of its type.
+*/
+static inline bool compiledServiceQueryMatches(CompiledServiceQuery *compiled, const char *servicename,
+        uint16_t txtLen, const unsigned char *txtRecord) {
+    ServiceQuery *query = compiled->query;
+    const void *value;
+    uint8_t valueLen;
+    int i;
+
+    if (compiled->hasNameRegEx && servicename && regexec(&compiled->nameRegEx, servicename, 0, NULL, 0) == 0) {
+        return true;
+    }
+
+    for (i = 0; i < query->numProperties; i++) {
+        value = TXTRecordGetValuePtr(txtLen, txtRecord, query->properties[i]->key, &valueLen);
+        if (value && query->properties[i]->value && valueLen == strlen(query->properties[i]->value) &&
+                memcmp(value, query->properties[i]->value, valueLen) == 0) {
+            return true;
+        }
+    }
+
+    return !compiled->hasNameRegEx && query->numProperties == 0;
+}
+
+static inline void freeCompiledServiceQuery(CompiledServiceQuery *compiled) {
+    if (compiled->hasNameRegEx) {
+        regfree(&compiled->nameRegEx);
+        compiled->hasNameRegEx = false;
+    }
+}
+
+#endif
@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Streaming variants of retrieveData() and advancedDataInquiry().
+ *
+ * The response body is parsed with a JsonStreamParser as it is received
+ * and the samples are handed to a callback in fixed size batches of
+ * (timestamp, value) tuples, all belonging to one component. Nothing
+ * grows with the size of the result, so peak memory stays at a few
+ * tens of kilobytes however long the requested time range is.
+ *
+ * advancedDataInquiryStream() also pages through componentRowLimit: each
+ * component that returned a full page is queried again from the timestamp
+ * of its last sample, skipping the samples at that timestamp it already
+ * delivered, until it is exhausted.
+ */
+
+#ifndef __DATA_STREAM_H
+#define __DATA_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "data_api.h"
+#include "advanced_data_inquiry.h"
+#include "rest_pool.h"
+
+#define DATA_BATCH_SIZE 128
+#define DATA_BATCH_TEXT_SIZE 8192
+#define DATA_ID_MAX 128
+#define DATA_VALUE_MAX 256
+
+/** A sample; value points into the batch and is only valid during the callback
+*/
+typedef struct _DataPoint {
+    long long timestamp;
+    const char *value;
+} DataPoint;
+
+/** Consecutive samples of one component
+*/
+typedef struct _DataBatch {
+    char deviceId[DATA_ID_MAX];
+    char componentId[DATA_ID_MAX];
+    DataPoint points[DATA_BATCH_SIZE];
+    int count;
+
+    char text[DATA_BATCH_TEXT_SIZE]; // storage for the values of points
+    size_t textUsed;
+} DataBatch;
+
+/** Called for every full batch and once more for the remainder
+* @return false to stop the query
+*/
+typedef bool (*DataBatchCallback)(DataBatch *batch, void *userData);
+
+typedef enum {
+    DATA_KEY_OTHER,
+    DATA_KEY_SERIES,
+    DATA_KEY_POINTS,
+    DATA_KEY_TS,
+    DATA_KEY_VALUE,
+    DATA_KEY_DATA,
+    DATA_KEY_COMPONENTS,
+    DATA_KEY_SAMPLES_HEADER,
+    DATA_KEY_SAMPLES,
+    DATA_KEY_DEVICE_ID,
+    DATA_KEY_COMPONENT_ID
+} DataStreamKey;
+
+/** A component that returned a full page of samples and has more to fetch
+*/
+typedef struct _DataStreamPage {
+    char componentId[DATA_ID_MAX];
+    long long startTimestamp;
+    int skip; // samples at startTimestamp delivered by the previous page
+    struct _DataStreamPage *next;
+} DataStreamPage;
+
+typedef struct _DataStream {
+    JsonStreamParser parser;
+    DataStreamKey keys[JSON_STREAM_MAX_DEPTH];
+    bool advanced;
+
+    DataBatch batch;
+    DataBatchCallback callback;
+    void *userData;
+    bool stopped;
+
+    // sample being decoded
+    long long timestamp;
+    bool haveTimestamp;
+    char value[DATA_VALUE_MAX];
+    bool haveValue;
+
+    // advancedDataInquiry samples are rows of columns named by samplesHeader
+    int column;
+    int timestampColumn;
+    int valueColumn;
+
+    // pagination of the current component
+    char deviceId[DATA_ID_MAX];
+    char componentId[DATA_ID_MAX];
+    int rowLimit;
+    int rows;
+    int delivered;
+    long long lastTimestamp;
+    int lastTimestampRows; // rows of this page at lastTimestamp
+    long long skipTimestamp;
+    int skip;
+    DataStreamPage *pages;
+} DataStream;
+
+static inline bool dataStreamFlush(DataStream *stream) {
+    if(stream->batch.count > 0 && !stream->stopped) {
+        if(!stream->callback(&stream->batch, stream->userData)) {
+            stream->stopped = true;
+        }
+    }
+    stream->batch.count = 0;
+    stream->batch.textUsed = 0;
+    return !stream->stopped;
+}
+
+static inline bool dataStreamEmitPoint(DataStream *stream) {
+    DataBatch *batch = &stream->batch;
+    size_t len = strlen(stream->value) + 1;
+
+    if(strcmp(batch->componentId, stream->componentId) != 0 || strcmp(batch->deviceId, stream->deviceId) != 0) {
+        if(!dataStreamFlush(stream)) {
+            return false;
+        }
+        strcpy(batch->deviceId, stream->deviceId);
+        strcpy(batch->componentId, stream->componentId);
+    }
+    if(batch->count == DATA_BATCH_SIZE || batch->textUsed + len > DATA_BATCH_TEXT_SIZE) {
+        if(!dataStreamFlush(stream)) {
+            return false;
+        }
+    }
+
+    memcpy(batch->text + batch->textUsed, stream->value, len);
+    batch->points[batch->count].timestamp = stream->timestamp;
+    batch->points[batch->count].value = batch->text + batch->textUsed;
+    batch->textUsed += len;
+    batch->count ++;
+    return true;
+}
+
+/** Count an advancedDataInquiry sample towards the page, and deliver it unless
+* the previous page already did
+*/
+static inline bool dataStreamPageSample(DataStream *stream) {
+    if(stream->rows > 0 && stream->timestamp == stream->lastTimestamp) {
+        stream->lastTimestampRows ++;
+    } else {
+        stream->lastTimestampRows = 1;
+    }
+    stream->rows ++;
+    stream->lastTimestamp = stream->timestamp;
+
+    if(stream->skip > 0 && stream->timestamp == stream->skipTimestamp) {
+        stream->skip --;
+        return true;
+    }
+    stream->skip = 0;
+    if(!stream->haveValue) {
+        return true;
+    }
+    stream->delivered ++;
+    return dataStreamEmitPoint(stream);
+}
+
+static inline DataStreamKey dataStreamClassifyKey(const char *key) {
+    static const struct { const char *name; DataStreamKey key; } known[] = {
+        { "series", DATA_KEY_SERIES },
+        { "points", DATA_KEY_POINTS },
+        { "ts", DATA_KEY_TS },
+        { "value", DATA_KEY_VALUE },
+        { "data", DATA_KEY_DATA },
+        { "components", DATA_KEY_COMPONENTS },
+        { "samplesHeader", DATA_KEY_SAMPLES_HEADER },
+        { "samples", DATA_KEY_SAMPLES },
+        { "deviceId", DATA_KEY_DEVICE_ID },
+        { "componentId", DATA_KEY_COMPONENT_ID }
+    };
+    size_t i;
+
+    for(i = 0; i < sizeof(known) / sizeof(known[0]); i ++) {
+        if(strcmp(key, known[i].name) == 0) {
+            return known[i].key;
+        }
+    }
+    return DATA_KEY_OTHER;
+}
+
+static inline void dataStreamCopy(char *dest, size_t size, const char *text) {
+    strncpy(dest, text, size - 1);
+    dest[size - 1] = '\0';
+}
+
+/** Remember the component for another page if it filled this one
+*/
+static inline void dataStreamEndComponent(DataStream *stream) {
+    DataStreamPage *page;
+
+    if(stream->rowLimit <= 0 || stream->rows < stream->rowLimit) {
+        return;
+    }
+    if(!(page = (DataStreamPage *)malloc(sizeof(DataStreamPage)))) {
+        fprintf(stderr, "dataStreamEndComponent::Out of memory, samples after %lld are skipped\n", stream->lastTimestamp);
+        return;
+    }
+    strcpy(page->componentId, stream->componentId);
+    if(stream->delivered > 0) {
+        page->startTimestamp = stream->lastTimestamp;
+        page->skip = stream->lastTimestampRows;
+    } else {
+        // the whole page shares one timestamp, asking again would return the same rows
+        fprintf(stderr, "dataStreamEndComponent::A page of %d samples of %s all at %lld, any more at it are skipped\n",
+                stream->rowLimit, stream->componentId, stream->lastTimestamp);
+        page->startTimestamp = stream->lastTimestamp + 1;
+        page->skip = 0;
+    }
+    page->next = stream->pages;
+    stream->pages = page;
+}
+
+/*
+ * retrieveData:        {"series":[{"deviceId":..,"componentId":..,"points":[{"ts":..,"value":..}]}]}
+ *                      depth 1    2 3                                  4 5
+ * advancedDataInquiry: {"data":[{"deviceId":..,"components":[{"componentId":..,
+ *                      depth 1  2 3                          4 5
+ *                          "samplesHeader":[..],"samples":[[..]]}]}]}
+ *                                          6              6 7
+ */
+static inline bool dataStreamEvent(void *userData, JsonEvent event, const char *text, size_t len, int depth) {
+    DataStream *stream = (DataStream *)userData;
+    DataStreamKey *keys = stream->keys;
+    bool isValue = event == JSON_EVENT_STRING || event == JSON_EVENT_NUMBER;
+
+    (void)len;
+
+    if(event == JSON_EVENT_KEY) {
+        keys[depth] = dataStreamClassifyKey(text);
+        return true;
+    }
+
+    if(event == JSON_EVENT_OBJECT_START || event == JSON_EVENT_ARRAY_START) {
+        // keys of a new container start out unknown
+        if(depth + 1 < JSON_STREAM_MAX_DEPTH) {
+            keys[depth + 1] = DATA_KEY_OTHER;
+        }
+    }
+
+    if(!stream->advanced) {
+        if(depth < 3 || keys[1] != DATA_KEY_SERIES) {
+            return true;
+        }
+        if(depth == 3 && isValue && keys[3] == DATA_KEY_DEVICE_ID) {
+            dataStreamCopy(stream->deviceId, sizeof(stream->deviceId), text);
+        } else if(depth == 3 && isValue && keys[3] == DATA_KEY_COMPONENT_ID) {
+            dataStreamCopy(stream->componentId, sizeof(stream->componentId), text);
+        } else if(depth == 4 && event == JSON_EVENT_OBJECT_START && keys[3] == DATA_KEY_POINTS) {
+            stream->haveTimestamp = stream->haveValue = false;
+        } else if(depth == 5 && isValue && keys[3] == DATA_KEY_POINTS) {
+            if(keys[5] == DATA_KEY_TS) {
+                stream->timestamp = strtoll(text, NULL, 10);
+                stream->haveTimestamp = true;
+            } else if(keys[5] == DATA_KEY_VALUE) {
+                dataStreamCopy(stream->value, sizeof(stream->value), text);
+                stream->haveValue = true;
+            }
+        } else if(depth == 4 && event == JSON_EVENT_OBJECT_END && keys[3] == DATA_KEY_POINTS) {
+            if(stream->haveTimestamp && stream->haveValue) {
+                return dataStreamEmitPoint(stream);
+            }
+        }
+        return true;
+    }
+
+    if(depth < 3 || keys[1] != DATA_KEY_DATA) {
+        return true;
+    }
+    if(depth == 3 && isValue && keys[3] == DATA_KEY_DEVICE_ID) {
+        dataStreamCopy(stream->deviceId, sizeof(stream->deviceId), text);
+    } else if(depth < 4 || keys[3] != DATA_KEY_COMPONENTS) {
+        return true;
+    } else if(depth == 4 && event == JSON_EVENT_OBJECT_START) {
+        stream->rows = 0;
+        stream->delivered = 0;
+        stream->timestampColumn = 0;
+        stream->valueColumn = 1;
+    } else if(depth == 4 && event == JSON_EVENT_OBJECT_END) {
+        dataStreamEndComponent(stream);
+    } else if(depth == 5 && isValue && keys[5] == DATA_KEY_COMPONENT_ID) {
+        dataStreamCopy(stream->componentId, sizeof(stream->componentId), text);
+    } else if(depth == 5 && event == JSON_EVENT_ARRAY_START) {
+        stream->column = 0;
+    } else if(depth == 6 && event == JSON_EVENT_STRING && keys[5] == DATA_KEY_SAMPLES_HEADER) {
+        if(strcmp(text, "Timestamp") == 0) {
+            stream->timestampColumn = stream->column;
+        } else if(strcmp(text, "Value") == 0) {
+            stream->valueColumn = stream->column;
+        }
+        stream->column ++;
+    } else if(depth == 6 && event == JSON_EVENT_ARRAY_START && keys[5] == DATA_KEY_SAMPLES) {
+        stream->column = 0;
+        stream->haveTimestamp = stream->haveValue = false;
+    } else if(depth == 7 && keys[5] == DATA_KEY_SAMPLES) {
+        if(stream->column == stream->timestampColumn && isValue) {
+            stream->timestamp = strtoll(text, NULL, 10);
+            stream->haveTimestamp = true;
+        } else if(stream->column == stream->valueColumn && isValue) {
+            dataStreamCopy(stream->value, sizeof(stream->value), text);
+            stream->haveValue = true;
+        }
+        stream->column ++;
+    } else if(depth == 6 && event == JSON_EVENT_ARRAY_END && keys[5] == DATA_KEY_SAMPLES) {
+        if(stream->haveTimestamp) {
+            return dataStreamPageSample(stream);
+        }
+    }
+
+    return true;
+}
+
+static inline size_t dataStreamWrite(char *data, size_t size, size_t nmemb, void *userData) {
+    DataStream *stream = (DataStream *)userData;
+
+    if(!jsonStreamFeed(&stream->parser, data, size * nmemb)) {
+        return 0;
+    }
+    return size * nmemb;
+}
+
+/** Run one query and feed its response through the stream
+*/
+static inline bool dataStreamQuery(HttpConnectionPool *pool, DataStream *stream, UrlTemplate *tpl, JsonBuffer *body) {
+    SharedHeaders *headers;
+    char url[URL_MAX_LENGTH];
+    CURLcode res;
+    long code = 0;
+
+    // the headers first, a new login recompiles the templates
+    if(!(headers = getCachedUserAuthorizationHeaders())) {
+        return false;
+    }
+    if(!expandApiUrl(tpl, NULL, url, sizeof(url))) {
+        unrefHeaders(headers);
+        return false;
+    }
+
+    jsonStreamInit(&stream->parser, dataStreamEvent, stream);
+    res = doPooledHttpRequestStreaming(pool, "POST", url, headers->list, body->data, dataStreamWrite, stream, &code);
+    jsonStreamFinish(&stream->parser);
+    jsonStreamFree(&stream->parser);
+    unrefHeaders(headers);
+
+    if(stream->stopped) {
+        return true;
+    }
+    if(res != CURLE_OK || code < 200 || code >= 300) {
+        fprintf(stderr, "dataStreamQuery::Query failed with HTTP code %ld\n", code);
+        return false;
+    }
+    return true;
+}
+
+static inline void dataStreamWriteStringList(JsonWriter *writer, const char *name, StringList *list) {
+    if(!list) {
+        return;
+    }
+    jsonWriteKey(writer, name);
+    jsonWriteArrayStart(writer);
+    for(; list; list = list->next) {
+        jsonWriteString(writer, list->data);
+    }
+    jsonWriteArrayEnd(writer);
+}
+
+static inline void dataStreamWriteFilter(JsonWriter *writer, AttributeFilter *filter) {
+    for(; filter; filter = filter->next) {
+        dataStreamWriteStringList(writer, filter->filterName, filter->filterValues);
+    }
+}
+
+static inline void dataStreamWriteFilterList(JsonWriter *writer, const char *name, AttributeFilterList *list) {
+    if(!list) {
+        return;
+    }
+    jsonWriteKey(writer, name);
+    jsonWriteObjectStart(writer);
+    for(; list; list = list->next) {
+        dataStreamWriteFilter(writer, list->filterData);
+    }
+    jsonWriteObjectEnd(writer);
+}
+
+/** Write an advanced data inquiry; page, if given, restricts it to one component
+* starting at the last timestamp of its previous page
+*/
+static inline bool dataStreamWriteInquiry(JsonBuffer *body, AdvancedDataInquiry *inquiry, DataStreamPage *page) {
+    JsonWriter writer;
+    StringList only;
+    KeyValueParams *sort;
+    bool paged = inquiry->componentRowLimit > 0 && !inquiry->countOnly;
+
+    jsonWriterInit(&writer, body);
+    jsonWriteObjectStart(&writer);
+
+    dataStreamWriteStringList(&writer, "gatewayIds", inquiry->gatewayIds);
+    dataStreamWriteStringList(&writer, "deviceIds", inquiry->deviceIds);
+    if(page) {
+        only.data = page->componentId;
+        only.next = NULL;
+        dataStreamWriteStringList(&writer, "componentIds", &only);
+    } else {
+        dataStreamWriteStringList(&writer, "componentIds", inquiry->componentIds);
+    }
+
+    jsonWriteKey(&writer, "startTimestamp");
+    jsonWriteInt(&writer, page ? page->startTimestamp : inquiry->startTimestamp);
+    jsonWriteKey(&writer, "endTimestamp");
+    jsonWriteInt(&writer, inquiry->endTimestamp);
+
+    dataStreamWriteStringList(&writer, "returnedMeasureAttributes", inquiry->returnedMeasureAttributes);
+    jsonWriteKey(&writer, "showMeasureLocation");
+    jsonWriteBool(&writer, inquiry->showMeasureLocation);
+    dataStreamWriteFilterList(&writer, "devCompAttributeFilter", inquiry->devCompAttributeFilter);
+    dataStreamWriteFilterList(&writer, "measurementAttributeFilter", inquiry->measurementAttributeFilter);
+    if(inquiry->valueFilter) {
+        jsonWriteKey(&writer, "valueFilter");
+        jsonWriteObjectStart(&writer);
+        dataStreamWriteFilter(&writer, inquiry->valueFilter);
+        jsonWriteObjectEnd(&writer);
+    }
+    if(inquiry->componentRowLimit > 0) {
+        jsonWriteKey(&writer, "componentRowLimit");
+        jsonWriteInt(&writer, inquiry->componentRowLimit);
+    }
+    jsonWriteKey(&writer, "countOnly");
+    jsonWriteBool(&writer, inquiry->countOnly);
+
+    // pages are contiguous only if samples come in timestamp order, so when
+    // paging the caller's sort keys only order samples sharing a timestamp
+    jsonWriteKey(&writer, "sort");
+    jsonWriteArrayStart(&writer);
+    if(paged || !inquiry->sort) {
+        jsonWriteObjectStart(&writer);
+        jsonWriteKey(&writer, "Timestamp");
+        jsonWriteString(&writer, "Asc");
+        jsonWriteObjectEnd(&writer);
+    }
+    for(sort = inquiry->sort; sort; sort = sort->next) {
+        if(paged && strcmp(sort->name, "Timestamp") == 0) {
+            continue;
+        }
+        jsonWriteObjectStart(&writer);
+        jsonWriteKey(&writer, sort->name);
+        jsonWriteString(&writer, sort->value);
+        jsonWriteObjectEnd(&writer);
+    }
+    jsonWriteArrayEnd(&writer);
+
+    jsonWriteObjectEnd(&writer);
+    return jsonWriterFinish(&writer) != NULL;
+}
+
+/** Like retrieveData(), but delivers the samples in batches as they are received
+* @return true if the query completed or was stopped by the callback
+*/
+static inline bool retrieveDataStream(HttpConnectionPool *pool, RetrieveData *retrieveObj,
+        DataBatchCallback callback, void *userData) {
+    DataStream *stream = (DataStream *)calloc(1, sizeof(DataStream));
+    JsonBuffer body;
+    JsonWriter writer;
+    StringList *list;
+    bool ok = false, stopped;
+
+    if(!stream) {
+        return false;
+    }
+    stream->callback = callback;
+    stream->userData = userData;
+    memset(&body, 0, sizeof(body));
+
+    jsonWriterInit(&writer, &body);
+    jsonWriteObjectStart(&writer);
+    jsonWriteKey(&writer, "from");
+    jsonWriteInt(&writer, retrieveObj->fromMillis);
+    jsonWriteKey(&writer, "to");
+    jsonWriteInt(&writer, retrieveObj->toMillis);
+    jsonWriteKey(&writer, "targetFilter");
+    jsonWriteObjectStart(&writer);
+    dataStreamWriteStringList(&writer, "deviceList", retrieveObj->deviceList);
+    jsonWriteObjectEnd(&writer);
+    jsonWriteKey(&writer, "metrics");
+    jsonWriteArrayStart(&writer);
+    for(list = retrieveObj->componentId; list; list = list->next) {
+        jsonWriteObjectStart(&writer);
+        jsonWriteKey(&writer, "id");
+        jsonWriteString(&writer, list->data);
+        jsonWriteKey(&writer, "op");
+        jsonWriteString(&writer, "none");
+        jsonWriteObjectEnd(&writer);
+    }
+    jsonWriteArrayEnd(&writer);
+    jsonWriteObjectEnd(&writer);
+
+    if(jsonWriterFinish(&writer)) {
+        ok = dataStreamQuery(pool, stream, &urlTemplates.retrieve_data, &body) && dataStreamFlush(stream);
+    }
+
+    stopped = stream->stopped;
+    jsonBufferFree(&body);
+    free(stream);
+    return ok || stopped;
+}
+
+/** Like advancedDataInquiry(), but delivers the samples in batches as they are
+* received and follows componentRowLimit pages until every component is exhausted
+* @return true if all pages completed or the callback stopped the query
+*/
+static inline bool advancedDataInquiryStream(HttpConnectionPool *pool, AdvancedDataInquiry *inquiry,
+        DataBatchCallback callback, void *userData) {
+    DataStream *stream = (DataStream *)calloc(1, sizeof(DataStream));
+    DataStreamPage *page = NULL;
+    JsonBuffer body;
+    bool ok = true, stopped;
+
+    if(!stream) {
+        return false;
+    }
+    stream->advanced = true;
+    stream->callback = callback;
+    stream->userData = userData;
+    stream->rowLimit = inquiry->countOnly ? 0 : inquiry->componentRowLimit;
+    memset(&body, 0, sizeof(body));
+
+    do {
+        if(!dataStreamWriteInquiry(&body, inquiry, page) ||
+                !dataStreamQuery(pool, stream, &urlTemplates.advanced_data_inquiry, &body) ||
+                !dataStreamFlush(stream)) {
+            ok = false;
+        }
+        free(page);
+
+        page = stream->pages;
+        if(page) {
+            stream->pages = page->next;
+            stream->skipTimestamp = page->startTimestamp;
+            stream->skip = page->skip;
+        }
+    } while(ok && page);
+
+    // pages left over after a failure or a stop
+    free(page);
+    while((page = stream->pages)) {
+        stream->pages = page->next;
+        free(page);
+    }
+
+    stopped = stream->stopped;
+    jsonBufferFree(&body);
+    free(stream);
+    return ok || stopped;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,745 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+* @file json_stream.h
+* @brief Streaming JSON writer, cJSON arena allocator and incremental parser.
+*
+* JsonWriter emits JSON text straight into a reusable, growable JsonBuffer
+* instead of building a cJSON tree and printing it. JsonArena plugs into
+* cJSON_InitHooks so that every node of a parsed response comes from a bump
+* allocator and releasing the tree is a single reset. JsonStreamParser is
+* fed a document in chunks, as they arrive, and reports tokens through a
+* callback without building a tree at all.
+*/
+
+#ifndef __JSON_STREAM_H
+#define __JSON_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+#include "cJSON.h"
+
+#define JSON_BUFFER_MIN 1024
+#define JSON_WRITER_MAX_DEPTH 32
+#define JSON_STREAM_MAX_DEPTH 32
+#define JSON_ARENA_BLOCK_SIZE 16384
+
+/** Growable output buffer, reused across documents by jsonBufferReset()
+*/
+typedef struct _JsonBuffer {
+    char *data;
+    size_t len;
+    size_t size;
+    bool external; // data is caller storage and must not be freed
+    bool failed; // an allocation failed, contents are truncated
+} JsonBuffer;
+
+/** Start with caller supplied storage, e.g. a stack array; the buffer moves
+* to the heap only if a document outgrows it
+*/
+static inline void jsonBufferInitStatic(JsonBuffer *buf, char *storage, size_t size) {
+    buf->data = storage;
+    buf->size = size;
+    buf->len = 0;
+    buf->external = true;
+    buf->failed = false;
+    if(size) {
+        storage[0] = '\0';
+    }
+}
+
+static inline void jsonBufferReset(JsonBuffer *buf) {
+    buf->len = 0;
+    buf->failed = false;
+    if(buf->data) {
+        buf->data[0] = '\0';
+    }
+}
+
+static inline void jsonBufferFree(JsonBuffer *buf) {
+    if(!buf->external) {
+        free(buf->data);
+    }
+    memset(buf, 0, sizeof(JsonBuffer));
+}
+
+static inline bool jsonBufferReserve(JsonBuffer *buf, size_t extra) {
+    size_t size;
+    char *data;
+
+    if(buf->failed) {
+        return false;
+    }
+    if(buf->len + extra + 1 <= buf->size) {
+        return true;
+    }
+
+    size = buf->size * 2;
+    if(size < buf->len + extra + 1) {
+        size = buf->len + extra + 1;
+    }
+    if(size < JSON_BUFFER_MIN) {
+        size = JSON_BUFFER_MIN;
+    }
+
+    if(buf->external) {
+        data = (char *)malloc(size);
+        if(data && buf->len) {
+            memcpy(data, buf->data, buf->len);
+        }
+    } else {
+        data = (char *)realloc(buf->data, size);
+    }
+    if(!data) {
+        fprintf(stderr, "jsonBufferReserve::Out of memory\n");
+        buf->failed = true;
+        return false;
+    }
+
+    buf->data = data;
+    buf->size = size;
+    buf->external = false;
+    return true;
+}
+
+static inline void jsonBufferAppend(JsonBuffer *buf, const char *text, size_t len) {
+    if(!jsonBufferReserve(buf, len)) {
+        return;
+    }
+    memcpy(buf->data + buf->len, text, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+static inline void jsonBufferAppendChar(JsonBuffer *buf, char c) {
+    if(!jsonBufferReserve(buf, 1)) {
+        return;
+    }
+    buf->data[buf->len ++] = c;
+    buf->data[buf->len] = '\0';
+}
+
+/** Streaming writer state
+*/
+typedef struct _JsonWriter {
+    JsonBuffer *buf;
+    int depth;
+    bool needComma[JSON_WRITER_MAX_DEPTH];
+    bool afterKey;
+} JsonWriter;
+
+/** Start a new document in buf, discarding its previous contents
+*/
+static inline void jsonWriterInit(JsonWriter *writer, JsonBuffer *buf) {
+    writer->buf = buf;
+    writer->depth = 0;
+    writer->needComma[0] = false;
+    writer->afterKey = false;
+    jsonBufferReset(buf);
+}
+
+static inline void jsonWriteSeparator(JsonWriter *writer) {
+    if(writer->afterKey) {
+        writer->afterKey = false;
+        return;
+    }
+    if(writer->needComma[writer->depth]) {
+        jsonBufferAppendChar(writer->buf, ',');
+    }
+    writer->needComma[writer->depth] = true;
+}
+
+static inline void jsonWriteOpen(JsonWriter *writer, char c) {
+    jsonWriteSeparator(writer);
+    jsonBufferAppendChar(writer->buf, c);
+    if(writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        fprintf(stderr, "jsonWriteOpen::Document nested deeper than %d\n", JSON_WRITER_MAX_DEPTH);
+        writer->buf->failed = true;
+        return;
+    }
+    writer->needComma[++ writer->depth] = false;
+}
+
+static inline void jsonWriteClose(JsonWriter *writer, char c) {
+    if(writer->depth > 0) {
+        writer->depth --;
+    }
+    jsonBufferAppendChar(writer->buf, c);
+}
+
+static inline void jsonWriteObjectStart(JsonWriter *writer) {
+    jsonWriteOpen(writer, '{');
+}
+
+static inline void jsonWriteObjectEnd(JsonWriter *writer) {
+    jsonWriteClose(writer, '}');
+}
+
+static inline void jsonWriteArrayStart(JsonWriter *writer) {
+    jsonWriteOpen(writer, '[');
+}
+
+static inline void jsonWriteArrayEnd(JsonWriter *writer) {
+    jsonWriteClose(writer, ']');
+}
+
+static inline void jsonWriteQuoted(JsonBuffer *buf, const char *text) {
+    const unsigned char *p = (const unsigned char *)text;
+    char escape[8];
+
+    jsonBufferAppendChar(buf, '"');
+    for(; *p; p ++) {
+        const unsigned char *run = p;
+
+        // copy runs of plain characters in one go
+        while(*p >= 0x20 && *p != '"' && *p != '\\') {
+            p ++;
+        }
+        if(p != run) {
+            jsonBufferAppend(buf, (const char *)run, p - run);
+        }
+        if(!*p) {
+            break;
+        }
+
+        switch(*p) {
+            case '"': jsonBufferAppend(buf, "\\\"", 2); break;
+            case '\\': jsonBufferAppend(buf, "\\\\", 2); break;
+            case '\b': jsonBufferAppend(buf, "\\b", 2); break;
+            case '\f': jsonBufferAppend(buf, "\\f", 2); break;
+            case '\n': jsonBufferAppend(buf, "\\n", 2); break;
+            case '\r': jsonBufferAppend(buf, "\\r", 2); break;
+            case '\t': jsonBufferAppend(buf, "\\t", 2); break;
+            default:
+                snprintf(escape, sizeof(escape), "\\u%04x", *p);
+                jsonBufferAppend(buf, escape, 6);
+                break;
+        }
+    }
+    jsonBufferAppendChar(buf, '"');
+}
+
+static inline void jsonWriteKey(JsonWriter *writer, const char *name) {
+    jsonWriteSeparator(writer);
+    jsonWriteQuoted(writer->buf, name);
+    jsonBufferAppendChar(writer->buf, ':');
+    writer->afterKey = true;
+}
+
+static inline void jsonWriteString(JsonWriter *writer, const char *value) {
+    jsonWriteSeparator(writer);
+    if(value) {
+        jsonWriteQuoted(writer->buf, value);
+    } else {
+        jsonBufferAppend(writer->buf, "null", 4);
+    }
+}
+
+static inline void jsonWriteNumber(JsonWriter *writer, double value) {
+    char number[32];
+    int len;
+
+    jsonWriteSeparator(writer);
+    if(isnan(value) || isinf(value)) {
+        jsonBufferAppend(writer->buf, "null", 4);
+        return;
+    }
+    len = snprintf(number, sizeof(number), "%.15g", value);
+    jsonBufferAppend(writer->buf, number, len);
+}
+
+static inline void jsonWriteInt(JsonWriter *writer, long long value) {
+    char number[24];
+    int len;
+
+    jsonWriteSeparator(writer);
+    len = snprintf(number, sizeof(number), "%lld", value);
+    jsonBufferAppend(writer->buf, number, len);
+}
+
+static inline void jsonWriteBool(JsonWriter *writer, bool value) {
+    jsonWriteSeparator(writer);
+    if(value) {
+        jsonBufferAppend(writer->buf, "true", 4);
+    } else {
+        jsonBufferAppend(writer->buf, "false", 5);
+    }
+}
+
+static inline void jsonWriteNull(JsonWriter *writer) {
+    jsonWriteSeparator(writer);
+    jsonBufferAppend(writer->buf, "null", 4);
+}
+
+/** Finish the document
+* @return the NUL terminated text, or NULL if it is incomplete or truncated
+*/
+static inline char *jsonWriterFinish(JsonWriter *writer) {
+    if(writer->buf->failed || writer->depth != 0) {
+        return NULL;
+    }
+    return writer->buf->data;
+}
+
+typedef struct _JsonArenaBlock {
+    struct _JsonArenaBlock *next;
+    char *data;
+    size_t size;
+    size_t used;
+} JsonArenaBlock;
+
+/** Bump allocator for cJSON nodes; memory is only returned by jsonArenaReset()
+* or jsonArenaFree()
+*/
+typedef struct _JsonArena {
+    JsonArenaBlock *blocks;
+    JsonArenaBlock *current;
+    size_t blockSize;
+    struct _JsonArena *previous; // arena active on this thread before jsonArenaBegin()
+} JsonArena;
+
+/* cJSON_InitHooks is process wide, so the arena state behind the hooks must be
+ * too: one current arena per thread and one count of arenas in use, shared by
+ * every file that includes this header. The definitions are weak so the
+ * linker keeps a single copy of each.
+ */
+extern __thread JsonArena *jsonCurrentArena;
+extern int jsonArenaUsers;
+extern pthread_mutex_t jsonArenaHooksLock;
+
+__attribute__((weak)) __thread JsonArena *jsonCurrentArena = NULL;
+__attribute__((weak)) int jsonArenaUsers = 0;
+__attribute__((weak)) pthread_mutex_t jsonArenaHooksLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void jsonArenaInit(JsonArena *arena, size_t blockSize) {
+    arena->blocks = NULL;
+    arena->current = NULL;
+    arena->blockSize = blockSize ? blockSize : JSON_ARENA_BLOCK_SIZE;
+    arena->previous = NULL;
+}
+
+static inline void *jsonArenaAlloc(JsonArena *arena, size_t size) {
+    JsonArenaBlock *block = arena->current;
+
+    size = (size + 7) & ~(size_t)7;
+
+    // use the next already allocated block before asking for a new one
+    while(block && block->used + size > block->size) {
+        block = block->next;
+    }
+
+    if(!block) {
+        size_t blockSize = size > arena->blockSize ? size : arena->blockSize;
+
+        block = (JsonArenaBlock *)malloc(sizeof(JsonArenaBlock) + blockSize);
+        if(!block) {
+            return NULL;
+        }
+        block->data = (char *)(block + 1);
+        block->size = blockSize;
+        block->used = 0;
+
+        if(arena->current) {
+            block->next = arena->current->next;
+            arena->current->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    arena->current = block;
+    block->used += size;
+    return block->data + block->used - size;
+}
+
+static inline bool jsonArenaOwns(JsonArena *arena, void *ptr) {
+    JsonArenaBlock *block;
+
+    for(block = arena->blocks; block; block = block->next) {
+        if((char *)ptr >= block->data && (char *)ptr < block->data + block->size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Release everything allocated from the arena at once, keeping its blocks
+* for the next document
+*/
+static inline void jsonArenaReset(JsonArena *arena) {
+    JsonArenaBlock *block;
+
+    for(block = arena->blocks; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->blocks;
+}
+
+static inline void jsonArenaFree(JsonArena *arena) {
+    while(arena->blocks) {
+        JsonArenaBlock *block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+    arena->current = NULL;
+}
+
+static inline void *jsonArenaMallocHook(size_t size) {
+    if(jsonCurrentArena) {
+        return jsonArenaAlloc(jsonCurrentArena, size);
+    }
+    return malloc(size);
+}
+
+static inline void jsonArenaFreeHook(void *ptr) {
+    if(jsonCurrentArena && jsonArenaOwns(jsonCurrentArena, ptr)) {
+        return;
+    }
+    free(ptr);
+}
+
+/** Make cJSON allocate from arena on the calling thread until jsonArenaEnd().
+* Parse and inspect a response in between, then drop the whole tree with
+* jsonArenaReset() instead of cJSON_Delete(). Strings printed by cJSON while
+* the arena is active also live in it and must not be passed to free().
+* Other threads keep using malloc/free. Every jsonArenaBegin() must be paired
+* with a jsonArenaEnd() on the same thread, on every exit path.
+*/
+static inline void jsonArenaBegin(JsonArena *arena) {
+    cJSON_Hooks hooks;
+
+    pthread_mutex_lock(&jsonArenaHooksLock);
+    if(jsonArenaUsers++ == 0) {
+        hooks.malloc_fn = jsonArenaMallocHook;
+        hooks.free_fn = jsonArenaFreeHook;
+        cJSON_InitHooks(&hooks);
+    }
+    pthread_mutex_unlock(&jsonArenaHooksLock);
+
+    arena->previous = jsonCurrentArena;
+    jsonCurrentArena = arena;
+}
+
+/** Stop allocating from arena on the calling thread; the default cJSON
+* allocator is restored once no thread has an arena active
+*/
+static inline void jsonArenaEnd(JsonArena *arena) {
+    jsonCurrentArena = arena->previous;
+    arena->previous = NULL;
+
+    pthread_mutex_lock(&jsonArenaHooksLock);
+    if(--jsonArenaUsers == 0) {
+        cJSON_InitHooks(NULL);
+    }
+    pthread_mutex_unlock(&jsonArenaHooksLock);
+}
+
+typedef enum {
+    JSON_EVENT_OBJECT_START,
+    JSON_EVENT_OBJECT_END,
+    JSON_EVENT_ARRAY_START,
+    JSON_EVENT_ARRAY_END,
+    JSON_EVENT_KEY,
+    JSON_EVENT_STRING,
+    JSON_EVENT_NUMBER,
+    JSON_EVENT_TRUE,
+    JSON_EVENT_FALSE,
+    JSON_EVENT_NULL
+} JsonEvent;
+
+/** Called for every token; text is NUL terminated for keys, strings and numbers.
+* depth counts the enclosing objects and arrays. Return false to stop parsing.
+*/
+typedef bool (*JsonEventCallback)(void *userData, JsonEvent event, const char *text, size_t len, int depth);
+
+typedef enum {
+    JSON_LEX_IDLE,
+    JSON_LEX_STRING,
+    JSON_LEX_ESCAPE,
+    JSON_LEX_UNICODE,
+    JSON_LEX_NUMBER,
+    JSON_LEX_LITERAL
+} JsonLexState;
+
+/** Incremental parser; memory use is bounded by the longest single token
+*/
+typedef struct _JsonStreamParser {
+    JsonEventCallback callback;
+    void *userData;
+
+    JsonLexState state;
+    int depth;
+    char containers[JSON_STREAM_MAX_DEPTH];
+    char last; // last structural token, 's' after a string
+
+    JsonBuffer token;
+    unsigned int unicode;
+    unsigned int highSurrogate;
+    int unicodeDigits;
+
+    bool failed;
+} JsonStreamParser;
+
+static inline void jsonStreamInit(JsonStreamParser *parser, JsonEventCallback callback, void *userData) {
+    memset(parser, 0, sizeof(JsonStreamParser));
+    parser->callback = callback;
+    parser->userData = userData;
+    parser->last = ',';
+}
+
+static inline void jsonStreamFree(JsonStreamParser *parser) {
+    jsonBufferFree(&parser->token);
+}
+
+static inline bool jsonStreamEmit(JsonStreamParser *parser, JsonEvent event, const char *text, size_t len) {
+    if(!parser->callback(parser->userData, event, text, len, parser->depth)) {
+        parser->failed = true;
+        return false;
+    }
+    return true;
+}
+
+static inline void jsonStreamAppendCodePoint(JsonBuffer *buf, unsigned int cp) {
+    char utf8[4];
+    int len;
+
+    if(cp < 0x80) {
+        utf8[0] = cp; len = 1;
+    } else if(cp < 0x800) {
+        utf8[0] = 0xc0 | (cp >> 6); utf8[1] = 0x80 | (cp & 0x3f); len = 2;
+    } else if(cp < 0x10000) {
+        utf8[0] = 0xe0 | (cp >> 12); utf8[1] = 0x80 | ((cp >> 6) & 0x3f); utf8[2] = 0x80 | (cp & 0x3f); len = 3;
+    } else {
+        utf8[0] = 0xf0 | (cp >> 18); utf8[1] = 0x80 | ((cp >> 12) & 0x3f);
+        utf8[2] = 0x80 | ((cp >> 6) & 0x3f); utf8[3] = 0x80 | (cp & 0x3f); len = 4;
+    }
+    jsonBufferAppend(buf, utf8, len);
+}
+
+static inline bool jsonStreamEndScalar(JsonStreamParser *parser) {
+    const char *text = parser->token.data ? parser->token.data : "";
+    size_t len = parser->token.len;
+
+    parser->state = JSON_LEX_IDLE;
+    parser->last = 's';
+
+    if(parser->token.failed) {
+        parser->failed = true;
+        return false;
+    }
+    if(text[0] == '-' || (text[0] >= '0' && text[0] <= '9')) {
+        return jsonStreamEmit(parser, JSON_EVENT_NUMBER, text, len);
+    }
+    if(strcmp(text, "true") == 0) {
+        return jsonStreamEmit(parser, JSON_EVENT_TRUE, text, len);
+    }
+    if(strcmp(text, "false") == 0) {
+        return jsonStreamEmit(parser, JSON_EVENT_FALSE, text, len);
+    }
+    if(strcmp(text, "null") == 0) {
+        return jsonStreamEmit(parser, JSON_EVENT_NULL, text, len);
+    }
+
+    fprintf(stderr, "jsonStreamFeed::Unexpected token %s\n", text);
+    parser->failed = true;
+    return false;
+}
+
+/** Feed the next chunk of the document
+* @return false on a syntax error or if the callback stopped parsing
+*/
+static inline bool jsonStreamFeed(JsonStreamParser *parser, const char *data, size_t len) {
+    size_t i = 0;
+
+    while(i < len && !parser->failed) {
+        char c = data[i];
+
+        switch(parser->state) {
+        case JSON_LEX_IDLE:
+            i ++;
+            switch(c) {
+            case ' ': case '\t': case '\r': case '\n':
+                break;
+            case '{': case '[':
+                if(parser->depth + 1 >= JSON_STREAM_MAX_DEPTH) {
+                    fprintf(stderr, "jsonStreamFeed::Document nested deeper than %d\n", JSON_STREAM_MAX_DEPTH);
+                    parser->failed = true;
+                    return false;
+                }
+                jsonStreamEmit(parser, c == '{' ? JSON_EVENT_OBJECT_START : JSON_EVENT_ARRAY_START, NULL, 0);
+                parser->containers[++ parser->depth] = c;
+                parser->last = c;
+                break;
+            case '}': case ']':
+                if(parser->depth == 0 || parser->containers[parser->depth] != (c == '}' ? '{' : '[')) {
+                    fprintf(stderr, "jsonStreamFeed::Unbalanced '%c'\n", c);
+                    parser->failed = true;
+                    return false;
+                }
+                parser->depth --;
+                jsonStreamEmit(parser, c == '}' ? JSON_EVENT_OBJECT_END : JSON_EVENT_ARRAY_END, NULL, 0);
+                parser->last = 's';
+                break;
+            case ':': case ',':
+                parser->last = c;
+                break;
+            case '"':
+                jsonBufferReset(&parser->token);
+                parser->state = JSON_LEX_STRING;
+                break;
+            default:
+                if(c == '-' || (c >= '0' && c <= '9')) {
+                    parser->state = JSON_LEX_NUMBER;
+                } else if(c == 't' || c == 'f' || c == 'n') {
+                    parser->state = JSON_LEX_LITERAL;
+                } else {
+                    fprintf(stderr, "jsonStreamFeed::Unexpected character '%c'\n", c);
+                    parser->failed = true;
+                    return false;
+                }
+                jsonBufferReset(&parser->token);
+                jsonBufferAppendChar(&parser->token, c);
+                break;
+            }
+            break;
+
+        case JSON_LEX_STRING: {
+            size_t start = i;
+
+            while(i < len && data[i] != '"' && data[i] != '\\') {
+                i ++;
+            }
+            if(i != start) {
+                jsonBufferAppend(&parser->token, data + start, i - start);
+            }
+            if(i == len) {
+                break;
+            }
+            if(data[i ++] == '\\') {
+                parser->state = JSON_LEX_ESCAPE;
+                break;
+            }
+
+            parser->state = JSON_LEX_IDLE;
+            if(parser->token.failed) {
+                parser->failed = true;
+                return false;
+            }
+            // a string is a key when it opens an object member
+            if(parser->containers[parser->depth] == '{' && (parser->last == '{' || parser->last == ',')) {
+                jsonStreamEmit(parser, JSON_EVENT_KEY, parser->token.data ? parser->token.data : "", parser->token.len);
+            } else {
+                jsonStreamEmit(parser, JSON_EVENT_STRING, parser->token.data ? parser->token.data : "", parser->token.len);
+            }
+            parser->last = 's';
+            break;
+        }
+
+        case JSON_LEX_ESCAPE:
+            i ++;
+            parser->state = JSON_LEX_STRING;
+            switch(c) {
+            case 'b': jsonBufferAppendChar(&parser->token, '\b'); break;
+            case 'f': jsonBufferAppendChar(&parser->token, '\f'); break;
+            case 'n': jsonBufferAppendChar(&parser->token, '\n'); break;
+            case 'r': jsonBufferAppendChar(&parser->token, '\r'); break;
+            case 't': jsonBufferAppendChar(&parser->token, '\t'); break;
+            case 'u':
+                parser->unicode = 0;
+                parser->unicodeDigits = 0;
+                parser->state = JSON_LEX_UNICODE;
+                break;
+            default: jsonBufferAppendChar(&parser->token, c); break;
+            }
+            break;
+
+        case JSON_LEX_UNICODE:
+            i ++;
+            if(c >= '0' && c <= '9') {
+                parser->unicode = (parser->unicode << 4) | (c - '0');
+            } else if((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+                parser->unicode = (parser->unicode << 4) | ((c | 0x20) - 'a' + 10);
+            } else {
+                fprintf(stderr, "jsonStreamFeed::Invalid \\u escape\n");
+                parser->failed = true;
+                return false;
+            }
+            if(++ parser->unicodeDigits < 4) {
+                break;
+            }
+
+            parser->state = JSON_LEX_STRING;
+            if(parser->unicode >= 0xd800 && parser->unicode <= 0xdbff) {
+                parser->highSurrogate = parser->unicode;
+            } else if(parser->unicode >= 0xdc00 && parser->unicode <= 0xdfff && parser->highSurrogate) {
+                jsonStreamAppendCodePoint(&parser->token,
+                        0x10000 + ((parser->highSurrogate - 0xd800) << 10) + (parser->unicode - 0xdc00));
+                parser->highSurrogate = 0;
+            } else {
+                jsonStreamAppendCodePoint(&parser->token, parser->unicode);
+                parser->highSurrogate = 0;
+            }
+            break;
+
+        case JSON_LEX_NUMBER:
+        case JSON_LEX_LITERAL:
+            if((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '.' || c == '-' || c == '+' || c == 'E') {
+                jsonBufferAppendChar(&parser->token, c);
+                i ++;
+                break;
+            }
+            // the delimiter is handled by the idle state
+            jsonStreamEndScalar(parser);
+            break;
+        }
+    }
+
+    return !parser->failed;
+}
+
+/** Signal the end of the document
+* @return true if the document was complete and valid
+*/
+static inline bool jsonStreamFinish(JsonStreamParser *parser) {
+    if(!parser->failed && (parser->state == JSON_LEX_NUMBER || parser->state == JSON_LEX_LITERAL)) {
+        jsonStreamEndScalar(parser);
+    }
+    return !parser->failed && parser->state == JSON_LEX_IDLE && parser->depth == 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
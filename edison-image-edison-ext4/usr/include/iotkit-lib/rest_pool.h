@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Persistent HTTP connection pool for the REST layer.
+ *
+ * A pool owns a curl multi handle, whose connection cache keeps
+ * connections to the cloud alive between requests, and a curl share
+ * handle holding the DNS cache and TLS session ids, so repeated requests
+ * skip DNS, TCP and TLS handshakes. Blocking requests run on a single
+ * reused easy handle; asynchronous submissions are queued on the multi
+ * handle and completed by performHttpConnectionPool() from the
+ * application's own loop.
+ */
+
+#ifndef __REST_POOL_H
+#define __REST_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "iotkit.h"
+#include "url_template.h"
+#include "json_stream.h"
+
+#define HTTP_POOL_MAX_CONNECTIONS 4
+#define HTTP_POOL_DNS_CACHE_TIMEOUT 300
+#define HTTP_POOL_KEEPALIVE_IDLE 60
+
+typedef void (*HttpCompletionCallback)(HttpResponse *response, void *userData);
+
+typedef struct _PooledHttpRequest {
+    CURL *easy;
+    HttpResponse response;
+    size_t length;
+
+    HttpCompletionCallback callback;
+    void *userData;
+    SharedHeaders *headers; // reference held until the request completes
+
+    struct _PooledHttpRequest *next;
+} PooledHttpRequest;
+
+typedef struct _HttpConnectionPool {
+    CURLM *multi;
+    CURLSH *share;
+    pthread_mutex_t shareLocks[CURL_LOCK_DATA_LAST];
+
+    PooledHttpRequest sync; // handle for blocking requests
+    pthread_mutex_t syncLock;
+
+    PooledHttpRequest *active; // async requests in flight
+    PooledHttpRequest *idle; // recycled handles for async requests
+    int running;
+
+    long requests;
+    long connects; // new connections opened, the rest were reused
+
+    JsonArena arena; // cJSON allocations made by completion callbacks
+    bool useArena;
+} HttpConnectionPool;
+
+static inline void httpPoolLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    HttpConnectionPool *pool = (HttpConnectionPool *)userptr;
+    (void)handle;
+    (void)access;
+    pthread_mutex_lock(&pool->shareLocks[data]);
+}
+
+static inline void httpPoolUnlock(CURL *handle, curl_lock_data data, void *userptr) {
+    HttpConnectionPool *pool = (HttpConnectionPool *)userptr;
+    (void)handle;
+    pthread_mutex_unlock(&pool->shareLocks[data]);
+}
+
+static inline size_t httpPoolWrite(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    PooledHttpRequest *request = (PooledHttpRequest *)userdata;
+    size_t len = size * nmemb;
+    char *data = (char *)realloc(request->response.data, request->length + len + 1);
+
+    if(!data) {
+        fprintf(stderr, "httpPoolWrite::Out of memory\n");
+        return 0;
+    }
+    memcpy(data + request->length, ptr, len);
+    request->length += len;
+    data[request->length] = '\0';
+    request->response.data = data;
+
+    return len;
+}
+
+/** Prepare an easy handle for a new request, keeping its cached connections
+*/
+static inline bool httpPoolSetupRequest(HttpConnectionPool *pool, PooledHttpRequest *request,
+        const char *method, char *url, struct curl_slist *headers, char *body, bool copyBody) {
+    CURL *easy = request->easy;
+
+    curl_easy_reset(easy);
+    curl_easy_setopt(easy, CURLOPT_SHARE, pool->share);
+    curl_easy_setopt(easy, CURLOPT_URL, url);
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(easy, CURLOPT_DNS_CACHE_TIMEOUT, (long)HTTP_POOL_DNS_CACHE_TIMEOUT);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPIDLE, (long)HTTP_POOL_KEEPALIVE_IDLE);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPINTVL, (long)HTTP_POOL_KEEPALIVE_IDLE);
+    curl_easy_setopt(easy, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, httpPoolWrite);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, request);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, request);
+
+    if(body) {
+        // async callers may release the body before the request is sent
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, (long)strlen(body));
+        curl_easy_setopt(easy, copyBody ? CURLOPT_COPYPOSTFIELDS : CURLOPT_POSTFIELDS, body);
+    }
+    if(strcmp(method, "GET") != 0 && strcmp(method, "POST") != 0) {
+        curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, method);
+    }
+
+    request->response.code = 0;
+    request->response.data = NULL;
+    request->length = 0;
+
+    return true;
+}
+
+/** Record how many of the pool's requests needed a new connection
+*/
+static inline void httpPoolAccount(HttpConnectionPool *pool, PooledHttpRequest *request) {
+    long connects = 0;
+
+    curl_easy_getinfo(request->easy, CURLINFO_RESPONSE_CODE, &request->response.code);
+    curl_easy_getinfo(request->easy, CURLINFO_NUM_CONNECTS, &connects);
+    pool->requests++;
+    pool->connects += connects;
+}
+
+/** Create a connection pool. Call once, after iotkit_init()
+* @param maxConnections number of idle connections kept alive, 0 for the default
+* @return pool or NULL on failure
+*/
+static inline HttpConnectionPool *createHttpConnectionPool(int maxConnections) {
+    HttpConnectionPool *pool = (HttpConnectionPool *)calloc(1, sizeof(HttpConnectionPool));
+    int i;
+
+    if(!pool) {
+        return NULL;
+    }
+    for(i = 0; i < CURL_LOCK_DATA_LAST; i ++) {
+        pthread_mutex_init(&pool->shareLocks[i], NULL);
+    }
+    pthread_mutex_init(&pool->syncLock, NULL);
+
+    pool->share = curl_share_init();
+    pool->multi = curl_multi_init();
+    pool->sync.easy = curl_easy_init();
+    if(!pool->share || !pool->multi || !pool->sync.easy) {
+        fprintf(stderr, "createHttpConnectionPool::Unable to initialize curl handles\n");
+        if(pool->sync.easy) curl_easy_cleanup(pool->sync.easy);
+        if(pool->multi) curl_multi_cleanup(pool->multi);
+        if(pool->share) curl_share_cleanup(pool->share);
+        free(pool);
+        return NULL;
+    }
+
+    curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, httpPoolLock);
+    curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, httpPoolUnlock);
+    curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    // queue requests beyond the limit so they wait for a kept-alive connection
+    // instead of opening (and handshaking) one each
+    if(maxConnections <= 0) {
+        maxConnections = HTTP_POOL_MAX_CONNECTIONS;
+    }
+    curl_multi_setopt(pool->multi, CURLMOPT_MAXCONNECTS, (long)maxConnections);
+    curl_multi_setopt(pool->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)maxConnections);
+    jsonArenaInit(&pool->arena, 0);
+
+    return pool;
+}
+
+/** Have cJSON allocate from a per-request arena while completion callbacks run.
+* Responses parsed in a callback are released all at once when it returns;
+* anything the callback keeps must be copied out, and cJSON_Delete() on such
+* trees becomes a no-op
+*/
+static inline void httpPoolUseJsonArena(HttpConnectionPool *pool, bool enable) {
+    pool->useArena = enable;
+}
+
+/** Close all pooled connections and free the pool. Pending async requests are dropped
+*/
+static inline void destroyHttpConnectionPool(HttpConnectionPool *pool) {
+    PooledHttpRequest *request;
+    int i;
+
+    if(!pool) {
+        return;
+    }
+
+    while(pool->active) {
+        request = pool->active;
+        pool->active = request->next;
+        curl_multi_remove_handle(pool->multi, request->easy);
+        free(request->response.data);
+        unrefHeaders(request->headers);
+        request->headers = NULL;
+        request->next = pool->idle;
+        pool->idle = request;
+    }
+
+    while(pool->idle) {
+        request = pool->idle;
+        pool->idle = request->next;
+        curl_easy_cleanup(request->easy);
+        free(request);
+    }
+
+    curl_multi_cleanup(pool->multi);
+    curl_easy_cleanup(pool->sync.easy);
+    curl_share_cleanup(pool->share);
+    jsonArenaFree(&pool->arena);
+
+    for(i = 0; i < CURL_LOCK_DATA_LAST; i ++) {
+        pthread_mutex_destroy(&pool->shareLocks[i]);
+    }
+    pthread_mutex_destroy(&pool->syncLock);
+    free(pool);
+}
+
+/** Perform a blocking request on a pooled connection
+* @param method HTTP method, e.g. "GET" or "POST"
+* @param body request body or NULL
+* @param response filled in with the HTTP code and body, free response->data when done
+* @return curl result code
+*/
+static inline CURLcode doPooledHttpRequest(HttpConnectionPool *pool, const char *method, char *url,
+        struct curl_slist *headers, char *body, HttpResponse *response) {
+    CURLcode res;
+
+    pthread_mutex_lock(&pool->syncLock);
+    httpPoolSetupRequest(pool, &pool->sync, method, url, headers, body, false);
+    res = curl_easy_perform(pool->sync.easy);
+    if(res != CURLE_OK) {
+        fprintf(stderr, "doPooledHttpRequest::%s\n", curl_easy_strerror(res));
+    }
+    httpPoolAccount(pool, &pool->sync);
+    *response = pool->sync.response;
+    pool->sync.response.data = NULL;
+    pthread_mutex_unlock(&pool->syncLock);
+
+    return res;
+}
+
+/** Perform a blocking request on a pooled connection, handing the response body
+* to write as it arrives instead of collecting it
+* @param write curl write callback, return less than the size given to abort
+* @param code filled in with the HTTP response code
+* @return curl result code, CURLE_WRITE_ERROR if write aborted the transfer
+*/
+static inline CURLcode doPooledHttpRequestStreaming(HttpConnectionPool *pool, const char *method, char *url,
+        struct curl_slist *headers, char *body, curl_write_callback write, void *userData, long *code) {
+    CURLcode res;
+
+    pthread_mutex_lock(&pool->syncLock);
+    httpPoolSetupRequest(pool, &pool->sync, method, url, headers, body, false);
+    curl_easy_setopt(pool->sync.easy, CURLOPT_WRITEFUNCTION, write);
+    curl_easy_setopt(pool->sync.easy, CURLOPT_WRITEDATA, userData);
+    res = curl_easy_perform(pool->sync.easy);
+    if(res != CURLE_OK && res != CURLE_WRITE_ERROR) {
+        fprintf(stderr, "doPooledHttpRequestStreaming::%s\n", curl_easy_strerror(res));
+    }
+    httpPoolAccount(pool, &pool->sync);
+    *code = pool->sync.response.code;
+    pthread_mutex_unlock(&pool->syncLock);
+
+    return res;
+}
+
+/** Queue a non-blocking request on the pool, completed by performHttpConnectionPool()
+* @param headers the request holds a reference to them until it completes
+* @param callback called with the response once complete, response->data is freed when it returns
+* @return true if the request was queued
+*/
+static inline bool doPooledHttpRequestAsync(HttpConnectionPool *pool, const char *method, char *url,
+        SharedHeaders *headers, char *body, HttpCompletionCallback callback, void *userData) {
+    PooledHttpRequest *request = pool->idle;
+
+    if(request) {
+        pool->idle = request->next;
+    } else {
+        request = (PooledHttpRequest *)calloc(1, sizeof(PooledHttpRequest));
+        if(!request || !(request->easy = curl_easy_init())) {
+            fprintf(stderr, "doPooledHttpRequestAsync::Unable to allocate request\n");
+            free(request);
+            return false;
+        }
+    }
+
+    httpPoolSetupRequest(pool, request, method, url, headers ? headers->list : NULL, body, true);
+    request->callback = callback;
+    request->userData = userData;
+
+    if(curl_multi_add_handle(pool->multi, request->easy) != CURLM_OK) {
+        request->next = pool->idle;
+        pool->idle = request;
+        return false;
+    }
+    request->headers = refHeaders(headers);
+    request->next = pool->active;
+    pool->active = request;
+    pool->running ++;
+
+    return true;
+}
+
+/** Drive the pool's async requests and run completion callbacks
+* @param timeoutMs time to wait for socket activity, 0 to only process what is ready
+* @return number of requests still in flight
+*/
+static inline int performHttpConnectionPool(HttpConnectionPool *pool, int timeoutMs) {
+    PooledHttpRequest *request, **link;
+    CURLMsg *msg;
+    int still, left;
+
+    if(pool->running == 0) {
+        return 0;
+    }
+
+    if(timeoutMs > 0) {
+        curl_multi_wait(pool->multi, NULL, 0, timeoutMs, NULL);
+    }
+    curl_multi_perform(pool->multi, &still);
+
+    while((msg = curl_multi_info_read(pool->multi, &left))) {
+        if(msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+        if(msg->data.result != CURLE_OK) {
+            fprintf(stderr, "performHttpConnectionPool::%s\n", curl_easy_strerror(msg->data.result));
+        }
+        httpPoolAccount(pool, request);
+        curl_multi_remove_handle(pool->multi, request->easy);
+        for(link = &pool->active; *link != request; link = &(*link)->next);
+        *link = request->next;
+        pool->running --;
+
+        if(request->callback && pool->useArena) {
+            jsonArenaBegin(&pool->arena);
+            request->callback(&request->response, request->userData);
+            jsonArenaEnd(&pool->arena);
+            jsonArenaReset(&pool->arena);
+        } else if(request->callback) {
+            request->callback(&request->response, request->userData);
+        }
+        free(request->response.data);
+        request->response.data = NULL;
+        unrefHeaders(request->headers);
+        request->headers = NULL;
+
+        request->next = pool->idle;
+        pool->idle = request;
+    }
+
+    return pool->running;
+}
+
+/** Build the url, headers and body of a data submission without allocating
+* @param headers on success, a reference to the device headers for the caller to release
+*/
+static inline bool httpPoolPrepareSubmission(char *cname, char *value, char *url, size_t urlLen,
+        SharedHeaders **headers, JsonBuffer *body) {
+    SensorComp *sensor = sensorsList;
+    struct timeval now;
+    long long millis;
+    JsonWriter writer;
+
+    while(sensor && strcmp(sensor->name, cname) != 0) {
+        sensor = sensor->next;
+    }
+    if(!sensor) {
+        fprintf(stderr, "httpPoolPrepareSubmission::Component is not registered\n");
+        return false;
+    }
+    if(!expandApiUrl(&urlTemplates.submit_data, NULL, url, urlLen)) {
+        return false;
+    }
+
+    gettimeofday(&now, NULL);
+    millis = (long long)now.tv_sec * 1000 + now.tv_usec / 1000;
+
+    jsonWriterInit(&writer, body);
+    jsonWriteObjectStart(&writer);
+    jsonWriteKey(&writer, "on");
+    jsonWriteInt(&writer, millis);
+    jsonWriteKey(&writer, "accountId");
+    jsonWriteString(&writer, configurations.data_account_id);
+    jsonWriteKey(&writer, "data");
+    jsonWriteArrayStart(&writer);
+    jsonWriteObjectStart(&writer);
+    jsonWriteKey(&writer, "componentId");
+    jsonWriteString(&writer, sensor->cid);
+    jsonWriteKey(&writer, "on");
+    jsonWriteInt(&writer, millis);
+    jsonWriteKey(&writer, "value");
+    jsonWriteString(&writer, value);
+    jsonWriteObjectEnd(&writer);
+    jsonWriteArrayEnd(&writer);
+    jsonWriteObjectEnd(&writer);
+
+    if(!jsonWriterFinish(&writer)) {
+        return false;
+    }
+    return (*headers = getCachedDeviceAuthorizationHeaders()) != NULL;
+}
+
+/** Same as submitData(), but on a pooled connection
+*/
+static inline char *submitDataPooled(HttpConnectionPool *pool, char *cname, char *value) {
+    SharedHeaders *headers;
+    char url[URL_MAX_LENGTH];
+    char storage[BODY_SIZE_MIN];
+    JsonBuffer body;
+    HttpResponse response;
+    char *json = NULL;
+
+    jsonBufferInitStatic(&body, storage, sizeof(storage));
+    if(httpPoolPrepareSubmission(cname, value, url, sizeof(url), &headers, &body)) {
+        doPooledHttpRequest(pool, "POST", url, headers->list, body.data, &response);
+        unrefHeaders(headers);
+        json = createHttpResponseJson(&response);
+        free(response.data);
+    }
+    jsonBufferFree(&body);
+
+    return json;
+}
+
+/** Submit an observation without blocking; completion is reported to callback
+* from performHttpConnectionPool()
+*/
+static inline bool submitDataAsync(HttpConnectionPool *pool, char *cname, char *value,
+        HttpCompletionCallback callback, void *userData) {
+    SharedHeaders *headers;
+    char url[URL_MAX_LENGTH];
+    char storage[BODY_SIZE_MIN];
+    JsonBuffer body;
+    bool queued = false;
+
+    jsonBufferInitStatic(&body, storage, sizeof(storage));
+    if(httpPoolPrepareSubmission(cname, value, url, sizeof(url), &headers, &body)) {
+        // the queued request takes its own reference
+        queued = doPooledHttpRequestAsync(pool, "POST", url, headers, body.data, callback, userData);
+        unrefHeaders(headers);
+    }
+    jsonBufferFree(&body);
+
+    return queued;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
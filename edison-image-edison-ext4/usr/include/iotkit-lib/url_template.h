@@ -0,0 +1,459 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Precompiled URL templates and cached authorization headers.
+ *
+ * prepareUrl() scans and reallocates the path template on every request.
+ * Here each API path of the Configurations struct is compiled once, after
+ * iotkit_init(), into a list of literal and parameter segments, with the
+ * device constants {data_account_id} and {device_id} already expanded.
+ * Requests then expand the remaining parameters into a caller supplied
+ * buffer. The "Authorization: Bearer" headers are built once and reused;
+ * the user token is reloaded only when authorization.json changes on disk.
+ * The templates and the cached headers are shared by every thread and
+ * guarded by urlTemplatesLock.
+ */
+
+#ifndef __URL_TEMPLATE_H
+#define __URL_TEMPLATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "iotkit.h"
+
+#define URL_TEMPLATE_MAX_SEGMENTS 8
+#define URL_MAX_LENGTH 512
+
+/** API paths of the Configurations struct that are compiled into templates
+*/
+#define IOTKIT_URL_TEMPLATES(X) \
+    X(advanced_data_inquiry) \
+    X(aggregated_report_interface) \
+    X(create_an_account) \
+    X(get_account_information) \
+    X(get_account_activation_code) \
+    X(renew_account_activation) \
+    X(update_an_account_name) \
+    X(delete_an_account_name) \
+    X(add_an_user_to_account) \
+    X(get_user_associated_with_account) \
+    X(update_user_associated_with_account) \
+    X(new_auth_token) \
+    X(auth_token_info) \
+    X(me_info) \
+    X(create_new_alert) \
+    X(get_list_of_alerts) \
+    X(get_alert_information) \
+    X(reset_alert) \
+    X(update_alert_status) \
+    X(add_comment_to_alert) \
+    X(list_components) \
+    X(get_component_details) \
+    X(create_an_cmp_catalog) \
+    X(update_an_cmp_catalog) \
+    X(list_all_devices) \
+    X(get_device_info) \
+    X(get_my_device_info) \
+    X(create_a_device) \
+    X(update_a_device) \
+    X(activate_a_device) \
+    X(activate_a_device2) \
+    X(delete_a_device) \
+    X(add_a_component) \
+    X(delete_a_component) \
+    X(list_all_tags_for_devices) \
+    X(list_all_attributes_for_devices) \
+    X(get_list_of_invitation) \
+    X(get_invitation_list_send_to_specific_user) \
+    X(create_invitation) \
+    X(delete_invitations) \
+    X(submit_data) \
+    X(retrieve_data) \
+    X(create_a_rule) \
+    X(update_a_rule) \
+    X(get_list_of_rules) \
+    X(get_one_rule_info) \
+    X(create_a_rule_as_draft) \
+    X(update_status_of_a_rule) \
+    X(delete_a_draft_rule) \
+    X(create_a_user) \
+    X(get_user_information) \
+    X(update_user_attributes) \
+    X(accept_terms_and_conditions) \
+    X(delete_a_user) \
+    X(request_change_password) \
+    X(change_password)
+
+typedef struct _UrlSegment {
+    const char *text; // literal text, or parameter name
+    size_t len;
+    bool isParam;
+} UrlSegment;
+
+/** A URL split into literal and parameter segments
+*/
+typedef struct _UrlTemplate {
+    char *text; // single allocation holding every segment's text
+    UrlSegment segments[URL_TEMPLATE_MAX_SEGMENTS];
+    int segmentsCount;
+} UrlTemplate;
+
+typedef struct _UrlTemplates {
+#define X(name) UrlTemplate name;
+    IOTKIT_URL_TEMPLATES(X)
+#undef X
+} UrlTemplates;
+
+/** Header list shared by the cache and the requests in flight, freed with
+* the last reference
+*/
+typedef struct _SharedHeaders {
+    struct curl_slist *list;
+    int refs;
+} SharedHeaders;
+
+/** Cached "Authorization: Bearer" headers
+*/
+typedef struct _AuthorizationCache {
+    struct timespec authMTime; // authorization.json modification time at last load
+    SharedHeaders *userHeaders; // content type and user token
+
+    char *deviceToken; // token deviceHeaders were built from
+    SharedHeaders *deviceHeaders; // content type and device token
+} AuthorizationCache;
+
+/** process-wide templates and headers, shared by every file that includes this
+* header; the definitions are weak so the linker keeps a single copy of each
+*/
+extern UrlTemplates urlTemplates;
+extern AuthorizationCache authorizationCache;
+extern pthread_mutex_t urlTemplatesLock;
+
+__attribute__((weak)) UrlTemplates urlTemplates;
+__attribute__((weak)) AuthorizationCache authorizationCache;
+__attribute__((weak)) pthread_mutex_t urlTemplatesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void freeUrlTemplate(UrlTemplate *tpl) {
+    free(tpl->text);
+    tpl->text = NULL;
+    tpl->segmentsCount = 0;
+}
+
+/** Compile url_prepend + url_append into tpl, expanding the device constants
+* @return true on success
+*/
+static inline bool compileUrlTemplate(UrlTemplate *tpl, char *url_prepend, char *url_append) {
+    size_t len = strlen(url_prepend) + 1;
+    const char *p, *end;
+    char *out;
+
+    tpl->text = NULL;
+    tpl->segmentsCount = 0;
+
+    // size of the template with the device constants expanded
+    for(p = url_append; *p; p ++) {
+        len ++;
+        if(*p == '{') {
+            if(strncmp(p, "{data_account_id}", 17) == 0 && configurations.data_account_id) {
+                len += strlen(configurations.data_account_id);
+            } else if(strncmp(p, "{device_id}", 11) == 0 && configurations.device_id) {
+                len += strlen(configurations.device_id);
+            }
+        }
+    }
+    if(!(tpl->text = (char *)malloc(len))) {
+        return false;
+    }
+
+    strcpy(tpl->text, url_prepend);
+    out = tpl->text + strlen(url_prepend);
+    tpl->segments[0].text = tpl->text;
+    tpl->segments[0].isParam = false;
+    tpl->segmentsCount = 1;
+
+    for(p = url_append; *p; ) {
+        const char *constant = NULL;
+
+        if(*p != '{' || !(end = strchr(p, '}'))) {
+            *out ++ = *p ++;
+            continue;
+        }
+
+        if(strncmp(p, "{data_account_id}", end - p + 1) == 0) {
+            constant = configurations.data_account_id;
+        } else if(strncmp(p, "{device_id}", end - p + 1) == 0) {
+            constant = configurations.device_id;
+        }
+        if(constant) {
+            strcpy(out, constant);
+            out += strlen(constant);
+            p = end + 1;
+            continue;
+        }
+
+        if(tpl->segmentsCount + 2 > URL_TEMPLATE_MAX_SEGMENTS) {
+            fprintf(stderr, "compileUrlTemplate::Too many parameters in %s\n", url_append);
+            freeUrlTemplate(tpl);
+            return false;
+        }
+
+        // close the literal, add the parameter, open the next literal
+        tpl->segments[tpl->segmentsCount - 1].len = out - tpl->segments[tpl->segmentsCount - 1].text;
+        memcpy(out, p + 1, end - p - 1);
+        tpl->segments[tpl->segmentsCount].text = out;
+        tpl->segments[tpl->segmentsCount].len = end - p - 1;
+        tpl->segments[tpl->segmentsCount].isParam = true;
+        out += end - p - 1;
+        tpl->segments[tpl->segmentsCount + 1].text = out;
+        tpl->segments[tpl->segmentsCount + 1].isParam = false;
+        tpl->segmentsCount += 2;
+        p = end + 1;
+    }
+    *out = '\0';
+    tpl->segments[tpl->segmentsCount - 1].len = out - tpl->segments[tpl->segmentsCount - 1].text;
+
+    return true;
+}
+
+/** Expand a compiled template into buf without allocating. For the templates
+* in urlTemplates, use expandApiUrl() instead, which takes urlTemplatesLock
+* @param urlParams values of the parameters left in the template
+* @return true on success, false if a parameter is missing or buf is too small
+*/
+static inline bool expandUrlTemplate(UrlTemplate *tpl, KeyValueParams *urlParams, char *buf, size_t bufLen) {
+    size_t used = 0;
+    int i;
+
+    if(!tpl->text) {
+        fprintf(stderr, "expandUrlTemplate::Template is not compiled, call iotkit_compile_url_templates()\n");
+        return false;
+    }
+
+    for(i = 0; i < tpl->segmentsCount; i ++) {
+        const char *text = tpl->segments[i].text;
+        size_t len = tpl->segments[i].len;
+
+        if(tpl->segments[i].isParam) {
+            KeyValueParams *param = urlParams;
+
+            while(param && (strncmp(param->name, text, len) != 0 || param->name[len] != '\0')) {
+                param = param->next;
+            }
+            if(!param) {
+                fprintf(stderr, "expandUrlTemplate::Missing value for URL parameter %.*s\n", (int)len, text);
+                return false;
+            }
+            text = param->value;
+            len = strlen(param->value);
+        }
+
+        if(used + len >= bufLen) {
+            fprintf(stderr, "expandUrlTemplate::URL is longer than %d characters\n", (int)bufLen);
+            return false;
+        }
+        memcpy(buf + used, text, len);
+        used += len;
+    }
+    buf[used] = '\0';
+
+    return true;
+}
+
+static inline SharedHeaders *refHeaders(SharedHeaders *headers) {
+    if(headers) {
+        __atomic_add_fetch(&headers->refs, 1, __ATOMIC_RELAXED);
+    }
+    return headers;
+}
+
+static inline void unrefHeaders(SharedHeaders *headers) {
+    if(headers && __atomic_sub_fetch(&headers->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        curl_slist_free_all(headers->list);
+        free(headers);
+    }
+}
+
+/** Build a header list holding the content type and a bearer token of any length
+* @return headers with one reference, or NULL if out of memory
+*/
+static inline SharedHeaders *buildAuthorizationHeaders(const char *token) {
+    size_t len = strlen(HEADER_AUTHORIZATION ": " HEADER_AUTHORIZATION_BEARER) + strlen(token) + 1;
+    SharedHeaders *headers = (SharedHeaders *)calloc(1, sizeof(SharedHeaders));
+    char *header = (char *)malloc(len);
+    struct curl_slist *list = NULL;
+
+    if(headers && header) {
+        snprintf(header, len, "%s: %s%s", HEADER_AUTHORIZATION, HEADER_AUTHORIZATION_BEARER, token);
+        // curl_slist_append copies the strings
+        list = curl_slist_append(NULL, HEADER_CONTENT_TYPE_NAME ": " HEADER_CONTENT_TYPE_JSON);
+        headers->list = list ? curl_slist_append(list, header) : NULL;
+    }
+    free(header);
+
+    if(!headers || !headers->list) {
+        curl_slist_free_all(list);
+        free(headers);
+        return NULL;
+    }
+    headers->refs = 1;
+    return headers;
+}
+
+// caller holds urlTemplatesLock
+static inline bool compileUrlTemplatesLocked() {
+    bool ok = true;
+
+#define X(name) \
+    freeUrlTemplate(&urlTemplates.name); \
+    if(configurations.name && !compileUrlTemplate(&urlTemplates.name, configurations.base_url, configurations.name)) { \
+        ok = false; \
+    }
+    IOTKIT_URL_TEMPLATES(X)
+#undef X
+
+    return ok;
+}
+
+/** Compile every API path of the Configurations struct, call after iotkit_init()
+* and again if the data account or device id change
+* @return true if all paths were compiled
+*/
+static inline bool iotkit_compile_url_templates() {
+    bool ok;
+
+    pthread_mutex_lock(&urlTemplatesLock);
+    ok = compileUrlTemplatesLocked();
+    pthread_mutex_unlock(&urlTemplatesLock);
+
+    return ok;
+}
+
+/** Release the compiled templates and cached headers, call before iotkit_cleanup()
+*/
+static inline void iotkit_free_url_templates() {
+    pthread_mutex_lock(&urlTemplatesLock);
+#define X(name) freeUrlTemplate(&urlTemplates.name);
+    IOTKIT_URL_TEMPLATES(X)
+#undef X
+
+    // requests still in flight keep their own reference
+    unrefHeaders(authorizationCache.userHeaders);
+    unrefHeaders(authorizationCache.deviceHeaders);
+    free(authorizationCache.deviceToken);
+    memset(&authorizationCache, 0, sizeof(authorizationCache));
+    pthread_mutex_unlock(&urlTemplatesLock);
+}
+
+/** Expand one of the templates of urlTemplates, compiling them first if needed
+* @return true on success, false if a parameter is missing or buf is too small
+*/
+static inline bool expandApiUrl(UrlTemplate *tpl, KeyValueParams *urlParams, char *buf, size_t bufLen) {
+    bool ok = true;
+
+    pthread_mutex_lock(&urlTemplatesLock);
+    if(!tpl->text) {
+        ok = compileUrlTemplatesLocked();
+    }
+    ok = ok && expandUrlTemplate(tpl, urlParams, buf, bufLen);
+    pthread_mutex_unlock(&urlTemplatesLock);
+
+    return ok;
+}
+
+/** Headers for user (JWT) authorized requests. The token is reloaded, and the
+* templates recompiled, only when authorization.json has changed since the last call
+* @return headers with a reference for the caller, release it with unrefHeaders(),
+* or NULL if no token is available
+*/
+static inline SharedHeaders *getCachedUserAuthorizationHeaders() {
+    SharedHeaders *headers = NULL;
+    char path[BODY_SIZE_MIN];
+    struct stat st;
+    char *token;
+
+    snprintf(path, sizeof(path), "%s%s", configurations.store_path ? configurations.store_path : DEFAULT_CONFIG_DIR,
+            AUTHORIZATION_FILE_NAME);
+    if(stat(path, &st) != 0) {
+        memset(&st, 0, sizeof(st));
+    }
+
+    pthread_mutex_lock(&urlTemplatesLock);
+    if(authorizationCache.userHeaders &&
+            st.st_mtim.tv_sec == authorizationCache.authMTime.tv_sec &&
+            st.st_mtim.tv_nsec == authorizationCache.authMTime.tv_nsec) {
+        headers = refHeaders(authorizationCache.userHeaders);
+    } else if(!(token = getConfigAuthorizationToken())) {
+        fprintf(stderr, "getCachedUserAuthorizationHeaders::Authorization Token not available\n");
+    } else if((headers = buildAuthorizationHeaders(token))) {
+        unrefHeaders(authorizationCache.userHeaders);
+        authorizationCache.userHeaders = refHeaders(headers);
+        authorizationCache.authMTime = st.st_mtim;
+
+        // a new login may have switched the data account
+        compileUrlTemplatesLocked();
+    }
+    pthread_mutex_unlock(&urlTemplatesLock);
+
+    return headers;
+}
+
+/** Headers for device token authorized requests such as data submission
+* @return headers with a reference for the caller, release it with unrefHeaders(),
+* or NULL if the device is not activated
+*/
+static inline SharedHeaders *getCachedDeviceAuthorizationHeaders() {
+    SharedHeaders *headers = NULL;
+    char *token = NULL;
+
+    if(!configurations.deviceToken) {
+        fprintf(stderr, "getCachedDeviceAuthorizationHeaders::Device is not activated\n");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&urlTemplatesLock);
+    if(authorizationCache.deviceHeaders && strcmp(authorizationCache.deviceToken, configurations.deviceToken) == 0) {
+        headers = refHeaders(authorizationCache.deviceHeaders);
+    } else if((token = strdup(configurations.deviceToken)) && (headers = buildAuthorizationHeaders(token))) {
+        unrefHeaders(authorizationCache.deviceHeaders);
+        free(authorizationCache.deviceToken);
+        authorizationCache.deviceHeaders = refHeaders(headers);
+        authorizationCache.deviceToken = token;
+    } else {
+        free(token);
+    }
+    pthread_mutex_unlock(&urlTemplatesLock);
+
+    return headers;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
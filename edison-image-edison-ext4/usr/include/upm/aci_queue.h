@@ -39,6 +39,9 @@
 /* The ACI_QUEUE_SIZE determines the memory usage of the system.            */
 /* Successfully tested to a ACI_QUEUE_SIZE of 4 (interrupt) and 4 (polling) */
 /***********************************************************************    */
+/* It is compiled into libupm-nrf8001; for a queue sized at runtime see     */
+/* aci_ring.h and upm::NRF8001EventPump.                                    */
+/***********************************************************************    */
 #define ACI_QUEUE_SIZE  4
 
 /** Data type for queue of data packets to send/receive from radio.
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @brief Runtime-sized queue of ACI packets.
+ */
+
+/** @defgroup aci_ring aci_ring
+@{
+@ingroup aci_queue
+
+*/
+
+#ifndef ACI_RING_H__
+#define ACI_RING_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hal_aci_tl.h"
+
+/** Data type for a queue of ACI packets sized at runtime.
+ *
+ *  Same FIFO as aci_queue_t without the compile-time ACI_QUEUE_SIZE limit:
+ *  the number of entries is rounded up to a power of two and head and tail
+ *  run freely, so an index is taken with a mask and the fill level is
+ *  tail - head. Only the producer writes tail and only the consumer writes
+ *  head, with release stores paired with acquire loads, so one producer and
+ *  one consumer on different threads (such as the mraa interrupt thread
+ *  and the application) need no lock and no interrupt masking.
+ */
+typedef struct {
+    hal_aci_data_t *         aci_data;
+    uint32_t                 mask;
+    uint32_t                 head;
+    uint32_t                 tail;
+} aci_ring_t;
+
+/** Largest ring: the next power of two above it does not fit the indices. */
+#define ACI_RING_MAX_SIZE 0x80000000u
+
+/** @brief Allocate the entries of a ring.
+ *  @param aci_r ring to initialize
+ *  @param size minimum number of entries, at most ACI_RING_MAX_SIZE
+ *  @return false if size is too large or the entries could not be allocated
+ */
+static inline bool aci_ring_init(aci_ring_t *aci_r, uint32_t size)
+{
+    uint32_t entries = 1;
+
+    aci_r->aci_data = NULL;
+    aci_r->mask     = 0;
+    aci_r->head     = 0;
+    aci_r->tail     = 0;
+
+    if (size > ACI_RING_MAX_SIZE)
+    {
+        return false;
+    }
+    while (entries < size)
+    {
+        entries <<= 1;
+    }
+    if (entries > SIZE_MAX / sizeof(hal_aci_data_t))
+    {
+        return false;
+    }
+    aci_r->aci_data = (hal_aci_data_t *) malloc(entries * sizeof(hal_aci_data_t));
+    aci_r->mask     = entries - 1;
+
+    return aci_r->aci_data != NULL;
+}
+
+/** @brief Release the entries of a ring. */
+static inline void aci_ring_free(aci_ring_t *aci_r)
+{
+    free(aci_r->aci_data);
+    aci_r->aci_data = NULL;
+}
+
+/** @brief Number of packets in the ring. */
+static inline uint32_t aci_ring_count(aci_ring_t *aci_r)
+{
+    return __atomic_load_n(&aci_r->tail, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&aci_r->head, __ATOMIC_ACQUIRE);
+}
+
+static inline bool aci_ring_is_empty(aci_ring_t *aci_r)
+{
+    return aci_ring_count(aci_r) == 0;
+}
+
+static inline bool aci_ring_is_full(aci_ring_t *aci_r)
+{
+    return aci_ring_count(aci_r) > aci_r->mask;
+}
+
+/** @brief Copy the oldest packet without removing it. Consumer side. */
+static inline bool aci_ring_peek(aci_ring_t *aci_r, hal_aci_data_t *p_data)
+{
+    uint32_t head = aci_r->head;
+
+    if (__atomic_load_n(&aci_r->tail, __ATOMIC_ACQUIRE) == head)
+    {
+        return false;
+    }
+    memcpy(p_data, &aci_r->aci_data[head & aci_r->mask], sizeof(hal_aci_data_t));
+    return true;
+}
+
+/** @brief Remove the oldest packet. Consumer side. */
+static inline bool aci_ring_dequeue(aci_ring_t *aci_r, hal_aci_data_t *p_data)
+{
+    if (!aci_ring_peek(aci_r, p_data))
+    {
+        return false;
+    }
+    __atomic_store_n(&aci_r->head, aci_r->head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/** @brief Append a packet, false if the ring is full. Producer side. */
+static inline bool aci_ring_enqueue(aci_ring_t *aci_r, hal_aci_data_t *p_data)
+{
+    uint32_t tail = aci_r->tail;
+
+    if (tail - __atomic_load_n(&aci_r->head, __ATOMIC_ACQUIRE) > aci_r->mask)
+    {
+        return false;
+    }
+    memcpy(&aci_r->aci_data[tail & aci_r->mask], p_data, sizeof(hal_aci_data_t));
+    __atomic_store_n(&aci_r->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* The ring needs no interrupt masking, so the _from_isr variants of the
+ * aci_queue API are the same functions. */
+static inline bool aci_ring_dequeue_from_isr(aci_ring_t *aci_r, hal_aci_data_t *p_data)
+{
+    return aci_ring_dequeue(aci_r, p_data);
+}
+
+static inline bool aci_ring_enqueue_from_isr(aci_ring_t *aci_r, hal_aci_data_t *p_data)
+{
+    return aci_ring_enqueue(aci_r, p_data);
+}
+
+static inline bool aci_ring_is_empty_from_isr(aci_ring_t *aci_r)
+{
+    return aci_ring_is_empty(aci_r);
+}
+
+static inline bool aci_ring_is_full_from_isr(aci_ring_t *aci_r)
+{
+    return aci_ring_is_full(aci_r);
+}
+
+static inline bool aci_ring_peek_from_isr(aci_ring_t *aci_r, hal_aci_data_t *p_data)
+{
+    return aci_ring_peek(aci_r, p_data);
+}
+
+#endif /* ACI_RING_H__ */
+/** @} */
@@ -24,7 +24,14 @@
 #pragma once
 
 #include <string>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <mraa/i2c.h>
+#include <mraa/gpio.h>
 
 #define ADC121C021_I2C_BUS 0
 #define ADC121C021_DEFAULT_I2C_ADDR 0x55
@@ -44,6 +51,16 @@
 #define ADC121C021_REG_LOWEST_CONV     0x06
 #define ADC121C021_REG_HIGHEST_CONV    0x07
 
+// ADC121C021_REG_CONFIG bits
+#define ADC121C021_CONFIG_POLARITY     0x01
+#define ADC121C021_CONFIG_ALERT_PIN    0x04
+#define ADC121C021_CONFIG_ALERT_FLAG   0x08
+#define ADC121C021_CONFIG_ALERT_HOLD   0x10
+
+// ADC121C021_REG_ALERT_STATUS bits
+#define ADC121C021_ALERT_UNDER         0x01
+#define ADC121C021_ALERT_OVER          0x02
+
 // For the Grove I2C ADC
 #define ADC121C021_DEFAULT_VREF        3.0
 
@@ -290,6 +307,399 @@ namespace upm {
     bool m_alertLow;
     bool m_alertHigh;
   };
-}
 
+  /**
+   * alert recorded by ADC121C021Monitor; low and high both false means
+   * the result moved back inside the limits
+   */
+  typedef struct {
+    uint16_t value;    // conversion result when the alert pin moved
+    bool     low;      // under the low limit
+    bool     high;     // over the high limit
+    uint64_t timeUs;   // CLOCK_MONOTONIC time it was handled
+  } ADC121C021_ALERT_T;
+
+  /**
+   * @brief Alert-driven monitoring and block reads for the ADC121C021
+   *
+   * Threshold monitoring with ADC121C021 means polling value() over I2C.
+   * ADC121C021Monitor puts the converter in automatic conversion mode
+   * instead, with the limits and hysteresis programmed and the ALERT pin
+   * enabled, and watches the pin with an mraa edge interrupt. Alerts
+   * self-clear, so the pin only moves when the input crosses a limit, and
+   * the bus is touched only then: the handler reads the alert status and
+   * the result and queues them in a ring for getAlert()/waitAlert().
+   *
+   * readBlock() streams results with the register pointer preset, so each
+   * reading is two data bytes with no pointer write, getRange() reads the
+   * lowest and highest conversion registers back to back, and conversions
+   * to volts use a scale computed once.
+   *
+   * The monitor opens its own I2C context on the bus; while it runs, the
+   * ADC121C021 methods should not be used on the same converter.
+   *
+   * @ingroup i2c adc121c021
+   */
+  class ADC121C021Monitor {
+  public:
+    /**
+     * ADC121C021Monitor constructor
+     *
+     * @param bus i2c bus to use
+     * @param alertPin gpio pin wired to the ALERT output
+     * @param address the address for this sensor; default is 0x55
+     * @param vref reference voltage for this sensor; default is 3.0
+     * @param depth number of alerts buffered, rounded up to a power of two
+     */
+    ADC121C021Monitor(int bus, int alertPin,
+                      uint8_t address = ADC121C021_DEFAULT_I2C_ADDR,
+                      float vref = ADC121C021_DEFAULT_VREF,
+                      unsigned int depth = 64) :
+      m_alert(NULL), m_pointer(-1), m_scale(vref / ADC121C021_RESOLUTION),
+      m_head(0), m_tail(0), m_alerts(0), m_dropped(0), m_transfers(0),
+      m_running(false)
+    {
+      unsigned int size = 1;
+      while (size < depth)
+        size <<= 1;
+      m_mask = size - 1;
+      m_ring = new ADC121C021_ALERT_T[size];
+
+      pthread_mutex_init(&m_i2cLock, NULL);
+      sem_init(&m_ready, 0, 0);
+
+      if (!(m_i2c = mraa_i2c_init(bus)))
+        {
+          fprintf(stderr, "%s: mraa_i2c_init failed\n", __FUNCTION__);
+          return;
+        }
+      mraa_i2c_address(m_i2c, address);
+
+      if ((m_alert = mraa_gpio_init(alertPin)) == NULL)
+        {
+          fprintf(stderr, "Are you sure that pin%d you requested is valid on your platform?", alertPin);
+          return;
+        }
+      mraa_gpio_dir(m_alert, MRAA_GPIO_IN);
+    }
+
+    /**
+     * ADC121C021Monitor Destructor
+     */
+    ~ADC121C021Monitor()
+    {
+      stop();
+      if (m_alert)
+        mraa_gpio_close(m_alert);
+      if (m_i2c)
+        mraa_i2c_stop(m_i2c);
+      delete [] m_ring;
+      sem_destroy(&m_ready);
+      pthread_mutex_destroy(&m_i2cLock);
+    }
+
+    /**
+     * Program the limits, start automatic conversion and watch the ALERT
+     * pin, which is configured active low
+     *
+     * @param cycleTime automatic conversion cycle time
+     * @param lowLimit alert when a result is below this
+     * @param highLimit alert when a result is above this
+     * @param hysteresis how far back inside a limit a result must move
+     * to clear its alert
+     * @return 0 (MRAA_SUCCESS) if successful; non-zero otherwise
+     */
+    mraa_result_t start(ADC121C021_CYCLE_TIME_T cycleTime, uint16_t lowLimit,
+                        uint16_t highLimit, uint16_t hysteresis = 0)
+    {
+      if (!m_i2c || !m_alert)
+        return MRAA_ERROR_INVALID_HANDLE;
+      if (m_running)
+        return MRAA_SUCCESS;
+
+      mraa_result_t rv;
+      pthread_mutex_lock(&m_i2cLock);
+      if ((rv = writeWord(ADC121C021_REG_ALERT_LIM_UNDER, lowLimit & 0x0fff)) ||
+          (rv = writeWord(ADC121C021_REG_ALERT_LIM_OVER, highLimit & 0x0fff)) ||
+          (rv = writeWord(ADC121C021_REG_ALERT_HYS, hysteresis & 0x0fff)) ||
+          (rv = writeByte(ADC121C021_REG_ALERT_STATUS,
+                          ADC121C021_ALERT_UNDER | ADC121C021_ALERT_OVER)) ||
+          (rv = writeByte(ADC121C021_REG_CONFIG, (cycleTime << 5) |
+                          ADC121C021_CONFIG_ALERT_FLAG |
+                          ADC121C021_CONFIG_ALERT_PIN)))
+        {
+          pthread_mutex_unlock(&m_i2cLock);
+          return rv;
+        }
+      pthread_mutex_unlock(&m_i2cLock);
+
+      // falling edges enter an alert, rising edges leave it
+      rv = mraa_gpio_isr(m_alert, MRAA_GPIO_EDGE_BOTH, &ADC121C021Monitor::isr, this);
+      if (rv == MRAA_SUCCESS)
+        m_running = true;
+      return rv;
+    }
+
+    /**
+     * Stop watching the ALERT pin, turn alerts and automatic conversion
+     * off and wake up any waiter
+     */
+    void stop()
+    {
+      if (!m_running)
+        return;
+      mraa_gpio_isr_exit(m_alert);
+      m_running = false;
+
+      pthread_mutex_lock(&m_i2cLock);
+      writeByte(ADC121C021_REG_CONFIG, 0);
+      pthread_mutex_unlock(&m_i2cLock);
+      sem_post(&m_ready);
+    }
+
+    /**
+     * Copy out the oldest buffered alert
+     *
+     * @param alert filled in with the alert
+     * @return true if an alert was copied
+     */
+    bool getAlert(ADC121C021_ALERT_T *alert)
+    {
+      unsigned int tail = m_tail;
+
+      if (__atomic_load_n(&m_head, __ATOMIC_ACQUIRE) == tail)
+        return false;
+      *alert = m_ring[tail & m_mask];
+      __atomic_store_n(&m_tail, tail + 1, __ATOMIC_RELEASE);
+      return true;
+    }
 
+    /**
+     * Sleep until an alert is buffered
+     *
+     * @param timeoutMs how long to wait, negative waits forever
+     * @return true if alerts are buffered, false on timeout or stop
+     */
+    bool waitAlert(int timeoutMs)
+    {
+      struct timespec deadline;
+
+      if (timeoutMs >= 0)
+        {
+          clock_gettime(CLOCK_REALTIME, &deadline);
+          deadline.tv_sec  += timeoutMs / 1000;
+          deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+          if (deadline.tv_nsec >= 1000000000L)
+            {
+              deadline.tv_sec++;
+              deadline.tv_nsec -= 1000000000L;
+            }
+        }
+
+      while (available() == 0 && m_running)
+        {
+          int error = timeoutMs < 0 ? sem_wait(&m_ready) : sem_timedwait(&m_ready, &deadline);
+          if (error != 0 && errno == ETIMEDOUT)
+            break;
+        }
+      return available() != 0;
+    }
+
+    /**
+     * Number of buffered alerts
+     */
+    unsigned int available()
+    {
+      return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) - m_tail;
+    }
+
+    /**
+     * Read consecutive conversion results.  The register pointer is set
+     * once, then each result is a two byte read.
+     *
+     * @param values buffer for the results
+     * @param count number of results to read
+     * @return number of results read
+     */
+    int readBlock(uint16_t *values, int count)
+    {
+      int i;
+
+      if (!m_i2c)
+        return 0;
+      pthread_mutex_lock(&m_i2cLock);
+      if (pointTo(ADC121C021_REG_RESULT) != MRAA_SUCCESS)
+        {
+          pthread_mutex_unlock(&m_i2cLock);
+          return 0;
+        }
+      for (i = 0; i < count; i++)
+        {
+          uint8_t raw[2];
+          m_transfers++;
+          if (mraa_i2c_read(m_i2c, raw, 2) != 2)
+            break;
+          values[i] = ((raw[0] << 8) | raw[1]) & 0x0fff;
+        }
+      pthread_mutex_unlock(&m_i2cLock);
+      return i;
+    }
+
+    /**
+     * Read the lowest and highest results converted so far
+     *
+     * @param lowest returned lowest result
+     * @param highest returned highest result
+     * @param clear if true, start a new range afterwards
+     * @return 0 (MRAA_SUCCESS) if successful; non-zero otherwise
+     */
+    mraa_result_t getRange(uint16_t *lowest, uint16_t *highest, bool clear = false)
+    {
+      mraa_result_t rv = MRAA_SUCCESS;
+
+      if (!m_i2c)
+        return MRAA_ERROR_INVALID_HANDLE;
+      pthread_mutex_lock(&m_i2cLock);
+      *lowest = readWord(ADC121C021_REG_LOWEST_CONV) & 0x0fff;
+      *highest = readWord(ADC121C021_REG_HIGHEST_CONV) & 0x0fff;
+      if (clear)
+        {
+          // any write resets them, to 0x0fff and 0
+          if ((rv = writeWord(ADC121C021_REG_LOWEST_CONV, 0)) == MRAA_SUCCESS)
+            rv = writeWord(ADC121C021_REG_HIGHEST_CONV, 0);
+        }
+      pthread_mutex_unlock(&m_i2cLock);
+      return rv;
+    }
+
+    /**
+     * Convert a result to volts
+     *
+     * @param val conversion result
+     * @return voltage
+     */
+    float toVolts(uint16_t val) { return val * m_scale; }
+
+    /**
+     * Convert results to volts
+     *
+     * @param values conversion results
+     * @param volts returned voltages
+     * @param count number of results
+     */
+    void toVolts(const uint16_t *values, float *volts, int count)
+    {
+      const float scale = m_scale;
+      for (int i = 0; i < count; i++)
+        volts[i] = values[i] * scale;
+    }
+
+    /**
+     * Number of alerts handled
+     */
+    unsigned int alerts() { return m_alerts; }
+
+    /**
+     * Number of alerts dropped because the ring was full
+     */
+    unsigned int dropped() { return m_dropped; }
+
+    /**
+     * Number of I2C transfers issued so far
+     */
+    unsigned int transfers() { return m_transfers; }
+
+  private:
+    static void isr(void *ctx)
+    {
+      ((ADC121C021Monitor *) ctx)->service();
+    }
+
+    /* read why the pin moved and queue it */
+    void service()
+    {
+      ADC121C021_ALERT_T alert;
+      struct timespec now;
+
+      pthread_mutex_lock(&m_i2cLock);
+      uint8_t status = readByte(ADC121C021_REG_ALERT_STATUS);
+      alert.value = readWord(ADC121C021_REG_RESULT) & 0x0fff;
+      pthread_mutex_unlock(&m_i2cLock);
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      alert.low = (status & ADC121C021_ALERT_UNDER) != 0;
+      alert.high = (status & ADC121C021_ALERT_OVER) != 0;
+      alert.timeUs = (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+      m_alerts++;
+
+      unsigned int head = m_head;
+      if (head - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) > m_mask)
+        {
+          m_dropped++;
+          return;
+        }
+      m_ring[head & m_mask] = alert;
+      __atomic_store_n(&m_head, head + 1, __ATOMIC_RELEASE);
+      sem_post(&m_ready);
+    }
+
+    /* the converter keeps its register pointer between transfers, so it is
+     * only written when it changes; callers hold m_i2cLock */
+    mraa_result_t pointTo(uint8_t reg)
+    {
+      if (m_pointer == reg)
+        return MRAA_SUCCESS;
+      m_transfers++;
+      mraa_result_t rv = mraa_i2c_write_byte(m_i2c, reg);
+      m_pointer = rv == MRAA_SUCCESS ? reg : -1;
+      return rv;
+    }
+
+    uint8_t readByte(uint8_t reg)
+    {
+      m_transfers++;
+      m_pointer = reg;
+      return mraa_i2c_read_byte_data(m_i2c, reg);
+    }
+
+    /* registers are big endian, SMBus words little endian */
+    uint16_t readWord(uint8_t reg)
+    {
+      m_transfers++;
+      m_pointer = reg;
+      uint16_t val = mraa_i2c_read_word_data(m_i2c, reg);
+      return (val >> 8) | (val << 8);
+    }
+
+    mraa_result_t writeByte(uint8_t reg, uint8_t byte)
+    {
+      m_transfers++;
+      m_pointer = reg;
+      return mraa_i2c_write_byte_data(m_i2c, byte, reg);
+    }
+
+    mraa_result_t writeWord(uint8_t reg, uint16_t word)
+    {
+      m_transfers++;
+      m_pointer = reg;
+      return mraa_i2c_write_word_data(m_i2c, (word >> 8) | (word << 8), reg);
+    }
+
+    mraa_i2c_context    m_i2c;
+    mraa_gpio_context   m_alert;
+    pthread_mutex_t     m_i2cLock;
+    sem_t               m_ready;
+    int                 m_pointer;
+    float               m_scale;
+
+    ADC121C021_ALERT_T *m_ring;
+    unsigned int        m_mask;
+    unsigned int        m_head;
+    unsigned int        m_tail;
+
+    volatile unsigned int m_alerts;
+    volatile unsigned int m_dropped;
+    volatile unsigned int m_transfers;
+    volatile bool       m_running;
+  };
+}
@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <mraa/aio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ANALOG_SAMPLER_MAX_CHANNELS 8
+
+namespace upm {
+
+/**
+ * @struct blockStats
+ * @brief Sums over a block of samples, from which mean and RMS follow
+ */
+typedef struct {
+    unsigned int count;      /**< Number of samples */
+    uint64_t     sum;        /**< Sum of the samples */
+    uint64_t     sumSquares; /**< Sum of the squared samples */
+    uint16_t     min;        /**< Smallest sample */
+    uint16_t     max;        /**< Largest sample */
+} blockStats;
+
+/**
+ * @brief Kernels over blocks of ADC samples
+ *
+ * The kernels use SSE2 when the compiler targets it and plain loops
+ * otherwise. Samples are ADC readings and must be below 0x8000, which
+ * holds for every converter mraa exposes.
+ *
+ * @ingroup analog
+ */
+class SampleBlock {
+    public:
+        /**
+         * Clear stats before accumulating blocks into them
+         */
+        static void reset (blockStats *stats) {
+            stats->count      = 0;
+            stats->sum        = 0;
+            stats->sumSquares = 0;
+            stats->min        = 0xffff;
+            stats->max        = 0;
+        }
+
+        /**
+         * Add a block of samples to stats
+         *
+         * @param block samples
+         * @param len number of samples
+         * @param stats sums to add to
+         */
+        static void accumulate (const uint16_t *block, unsigned int len, blockStats *stats) {
+            unsigned int i = 0;
+            uint64_t sum = 0, sumSquares = 0;
+            uint16_t lo = stats->min, hi = stats->max;
+#ifdef __SSE2__
+            const __m128i ones = _mm_set1_epi16 (1);
+            const __m128i zero = _mm_setzero_si128 ();
+            __m128i vmin = _mm_set1_epi16 (0x7fff);
+            __m128i vmax = zero;
+            __m128i vsq  = zero;
+
+            if (len >= 8) {
+                while (len - i >= 8) {
+                    // 32 bit sum lanes take 4096 rounds of two 15 bit samples
+                    unsigned int rounds = (len - i) / 8 < 4096 ? (len - i) / 8 : 4096;
+                    unsigned int end = i + rounds * 8;
+                    __m128i vsum = zero;
+                    for (; i < end; i += 8) {
+                        __m128i v  = _mm_loadu_si128 ((const __m128i *) (block + i));
+                        __m128i sq = _mm_madd_epi16 (v, v);
+                        vsum = _mm_add_epi32 (vsum, _mm_madd_epi16 (v, ones));
+                        // squares of pairs fill 31 bits, widen them right away
+                        vsq  = _mm_add_epi64 (vsq, _mm_unpacklo_epi32 (sq, zero));
+                        vsq  = _mm_add_epi64 (vsq, _mm_unpackhi_epi32 (sq, zero));
+                        vmin = _mm_min_epi16 (vmin, v);
+                        vmax = _mm_max_epi16 (vmax, v);
+                    }
+                    uint32_t lanes[4];
+                    _mm_storeu_si128 ((__m128i *) lanes, vsum);
+                    sum += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                }
+
+                uint64_t squares[2];
+                uint16_t mins[8], maxs[8];
+                _mm_storeu_si128 ((__m128i *) squares, vsq);
+                _mm_storeu_si128 ((__m128i *) mins, vmin);
+                _mm_storeu_si128 ((__m128i *) maxs, vmax);
+                sumSquares += squares[0] + squares[1];
+                for (int j = 0; j < 8; j++) {
+                    if (mins[j] < lo) lo = mins[j];
+                    if (maxs[j] > hi) hi = maxs[j];
+                }
+            }
+#endif
+            for (; i < len; i++) {
+                uint32_t v = block[i];
+                sum        += v;
+                sumSquares += v * v;
+                if (v < lo) lo = v;
+                if (v > hi) hi = v;
+            }
+
+            stats->count      += len;
+            stats->sum        += sum;
+            stats->sumSquares += sumSquares;
+            stats->min         = lo;
+            stats->max         = hi;
+        }
+
+        /**
+         * Count upward crossings of a threshold, i.e. samples at or above
+         * it following a sample below it
+         *
+         * @param block samples
+         * @param len number of samples
+         * @param threshold level to cross
+         * @param previous sample preceding the block, or -1 if none
+         * @return number of crossings
+         */
+        static unsigned int crossings (const uint16_t *block, unsigned int len,
+                                       uint16_t threshold, int previous = -1) {
+            unsigned int count = 0, i = 1;
+
+            if (len == 0) {
+                return 0;
+            }
+            if (previous >= 0 && previous < threshold && block[0] >= threshold) {
+                count++;
+            }
+#ifdef __SSE2__
+            const __m128i t = _mm_set1_epi16 ((short) threshold);
+            for (; i + 8 <= len; i += 8) {
+                __m128i cur  = _mm_loadu_si128 ((const __m128i *) (block + i));
+                __m128i prev = _mm_loadu_si128 ((const __m128i *) (block + i - 1));
+                __m128i up   = _mm_andnot_si128 (_mm_cmplt_epi16 (cur, t), _mm_cmplt_epi16 (prev, t));
+                // two mask bits per 16 bit lane
+                count += __builtin_popcount (_mm_movemask_epi8 (up)) / 2;
+            }
+#endif
+            for (; i < len; i++) {
+                count += (block[i - 1] < threshold) & (block[i] >= threshold);
+            }
+            return count;
+        }
+
+        /**
+         * Mean of accumulated samples
+         */
+        static double mean (const blockStats *stats) {
+            return stats->count ? (double) stats->sum / stats->count : 0;
+        }
+
+        /**
+         * Root mean square of accumulated samples
+         */
+        static double rms (const blockStats *stats) {
+            return stats->count ? sqrt ((double) stats->sumSquares / stats->count) : 0;
+        }
+
+        /**
+         * Root mean square of accumulated samples mapped to
+         * scale * sample + offset, e.g. volts around a bias
+         */
+        static double rms (const blockStats *stats, double scale, double offset) {
+            if (stats->count == 0) {
+                return 0;
+            }
+            double n = stats->count;
+            double square = scale * scale * (double) stats->sumSquares / n +
+                            2 * scale * offset * (double) stats->sum / n + offset * offset;
+            return square > 0 ? sqrt (square) : 0;
+        }
+
+        /**
+         * Root mean square of accumulated samples around their mean,
+         * i.e. the AC part of the signal
+         */
+        static double acRms (const blockStats *stats) {
+            return rms (stats, 1.0, -mean (stats));
+        }
+};
+
+/**
+ * @brief Background sampler shared by analog sensors
+ *
+ * A single thread reads every registered analog pin once per period, on
+ * absolute deadlines so the rate does not drift, and appends the readings
+ * to a ring per pin. Sensors read windows of the most recent samples from
+ * the ring or compute block statistics on it in place, so overlapping
+ * windows reuse the same readings instead of sampling again, and several
+ * sensors on one board share one thread.
+ *
+ * @ingroup analog
+ */
+class AnalogSampler {
+    public:
+        /**
+         * Instanciates an AnalogSampler object
+         *
+         * @param periodUs time between two readings of every pin, in microseconds
+         * @param depth number of readings kept per pin
+         */
+        AnalogSampler (unsigned int periodUs, unsigned int depth = 1024) :
+                m_periodUs(periodUs ? periodUs : 1), m_depth(depth > 1 ? depth : 2),
+                m_channels(0), m_rounds(0), m_overruns(0), m_running(false) {
+            pthread_condattr_t attr;
+
+            pthread_mutex_init (&m_lock, NULL);
+            pthread_condattr_init (&attr);
+            pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+            pthread_cond_init (&m_cond, &attr);
+            pthread_condattr_destroy (&attr);
+        }
+
+        /**
+         * AnalogSampler object destructor, stops sampling and closes the pins
+         */
+        ~AnalogSampler () {
+            stop ();
+            for (int i = 0; i < m_channels; i++) {
+                mraa_aio_close (m_channel[i].aio);
+                delete [] m_channel[i].ring;
+            }
+            pthread_cond_destroy (&m_cond);
+            pthread_mutex_destroy (&m_lock);
+        }
+
+        /**
+         * Sample an analog pin; a pin added twice is sampled once
+         *
+         * @param pin analog pin
+         * @return channel number, or -1 if the pin is invalid or the sampler is full
+         */
+        int addChannel (int pin) {
+            int channel = -1;
+
+            pthread_mutex_lock (&m_lock);
+            for (int i = 0; i < m_channels; i++) {
+                if (m_channel[i].pin == pin) {
+                    channel = i;
+                }
+            }
+            if (channel < 0 && m_channels < ANALOG_SAMPLER_MAX_CHANNELS) {
+                mraa_aio_context aio = mraa_aio_init (pin);
+                if (aio == NULL) {
+                    fprintf (stderr, "Are you sure that pin%d you requested is valid on your platform?", pin);
+                } else {
+                    channel = m_channels;
+                    m_channel[channel].pin   = pin;
+                    m_channel[channel].aio   = aio;
+                    m_channel[channel].ring  = new uint16_t[m_depth];
+                    m_channel[channel].first = m_rounds;
+                    m_channels++;
+                }
+            }
+            pthread_mutex_unlock (&m_lock);
+
+            return channel;
+        }
+
+        /**
+         * Start the sampling thread
+         *
+         * @return Result of operation
+         */
+        mraa_result_t start () {
+            if (m_running) {
+                return MRAA_SUCCESS;
+            }
+            m_running = true;
+            if (pthread_create (&m_thread, NULL, &AnalogSampler::run, this) != 0) {
+                m_running = false;
+                return MRAA_ERROR_NO_RESOURCES;
+            }
+            return MRAA_SUCCESS;
+        }
+
+        /**
+         * Stop the sampling thread and wake up any waiter
+         */
+        void stop () {
+            if (!m_running) {
+                return;
+            }
+            pthread_mutex_lock (&m_lock);
+            m_running = false;
+            pthread_cond_broadcast (&m_cond);
+            pthread_mutex_unlock (&m_lock);
+            pthread_join (m_thread, NULL);
+        }
+
+        /**
+         * Number of readings taken on a channel so far
+         */
+        uint64_t count (int channel) {
+            pthread_mutex_lock (&m_lock);
+            uint64_t n = available (channel);
+            pthread_mutex_unlock (&m_lock);
+            return n;
+        }
+
+        /**
+         * Sleep until a channel has at least the given number of readings
+         *
+         * @param channel channel number
+         * @param samples readings to wait for, counted from the start of the channel
+         * @param timeoutMs how long to wait, negative waits forever
+         * @return true if the readings are there, false on timeout or stop
+         */
+        bool waitSamples (int channel, uint64_t samples, int timeoutMs) {
+            struct timespec deadline;
+
+            if (timeoutMs >= 0) {
+                clock_gettime (CLOCK_MONOTONIC, &deadline);
+                deadline.tv_sec  += timeoutMs / 1000;
+                deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+                if (deadline.tv_nsec >= 1000000000L) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+            }
+
+            pthread_mutex_lock (&m_lock);
+            while (available (channel) < samples && m_running) {
+                if (timeoutMs < 0) {
+                    pthread_cond_wait (&m_cond, &m_lock);
+                } else if (pthread_cond_timedwait (&m_cond, &m_lock, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+            bool found = available (channel) >= samples;
+            pthread_mutex_unlock (&m_lock);
+
+            return found;
+        }
+
+        /**
+         * Sleep until a channel holds a full window of readings, for at
+         * most twice the time the window takes to fill
+         *
+         * @param channel channel number
+         * @param len window length, at most depth - 1
+         * @return true if the window is full, false on timeout or stop
+         */
+        bool waitWindow (int channel, unsigned int len) {
+            if (len > m_depth - 1) len = m_depth - 1;
+            uint64_t fillMs = (uint64_t) len * m_periodUs / 1000;
+            return waitSamples (channel, len, (int) (2 * fillMs + 100));
+        }
+
+        /**
+         * Copy the most recent readings of a channel, oldest first
+         *
+         * @param channel channel number
+         * @param buffer receives the readings
+         * @param len number of readings wanted, at most depth - 1
+         * @return number of readings copied, fewer than len if not taken yet
+         */
+        unsigned int latest (int channel, uint16_t *buffer, unsigned int len) {
+            const uint16_t *first, *second;
+            unsigned int firstLen, secondLen;
+
+            pthread_mutex_lock (&m_lock);
+            len = window (channel, len, &first, &firstLen, &second, &secondLen);
+            memcpy (buffer, first, firstLen * sizeof (uint16_t));
+            memcpy (buffer + firstLen, second, secondLen * sizeof (uint16_t));
+            pthread_mutex_unlock (&m_lock);
+
+            return len;
+        }
+
+        /**
+         * Block statistics over the most recent readings of a channel,
+         * computed in place
+         *
+         * @param channel channel number
+         * @param len number of readings, at most depth - 1
+         * @param stats filled in; stats->count tells how many readings were used
+         */
+        void stats (int channel, unsigned int len, blockStats *stats) {
+            const uint16_t *first, *second;
+            unsigned int firstLen, secondLen;
+
+            SampleBlock::reset (stats);
+            pthread_mutex_lock (&m_lock);
+            window (channel, len, &first, &firstLen, &second, &secondLen);
+            SampleBlock::accumulate (first, firstLen, stats);
+            SampleBlock::accumulate (second, secondLen, stats);
+            pthread_mutex_unlock (&m_lock);
+        }
+
+        /**
+         * Upward threshold crossings in the most recent readings of a channel
+         *
+         * @param channel channel number
+         * @param len number of readings, at most depth - 1
+         * @param threshold level to cross
+         */
+        unsigned int crossings (int channel, unsigned int len, uint16_t threshold) {
+            const uint16_t *first, *second;
+            unsigned int firstLen, secondLen, count;
+
+            pthread_mutex_lock (&m_lock);
+            window (channel, len, &first, &firstLen, &second, &secondLen);
+            count = SampleBlock::crossings (first, firstLen, threshold);
+            if (secondLen) {
+                count += SampleBlock::crossings (second, secondLen, threshold,
+                                                 firstLen ? first[firstLen - 1] : -1);
+            }
+            pthread_mutex_unlock (&m_lock);
+
+            return count;
+        }
+
+        /**
+         * Time between two readings, in microseconds
+         */
+        unsigned int periodUs () {
+            return m_periodUs;
+        }
+
+        /**
+         * Readings that can be kept per channel
+         */
+        unsigned int depth () {
+            return m_depth;
+        }
+
+        /**
+         * Number of periods skipped because reading the pins took too long
+         */
+        unsigned int overruns () {
+            return m_overruns;
+        }
+
+    private:
+        typedef struct {
+            int              pin;
+            mraa_aio_context aio;
+            uint16_t *       ring;
+            uint64_t         first; /* round the channel was added in */
+        } channel;
+
+        /* with m_lock held */
+        uint64_t available (int channel) {
+            if (channel < 0 || channel >= m_channels) {
+                return 0;
+            }
+            return m_rounds - m_channel[channel].first;
+        }
+
+        /* with m_lock held; the newest len readings as up to two ring segments */
+        unsigned int window (int channel, unsigned int len,
+                             const uint16_t **first, unsigned int *firstLen,
+                             const uint16_t **second, unsigned int *secondLen) {
+            uint64_t n = available (channel);
+
+            if (len > n) len = n;
+            if (len > m_depth - 1) len = m_depth - 1;
+
+            unsigned int start = (unsigned int) ((m_rounds - len) % m_depth);
+            const uint16_t *ring = len ? m_channel[channel].ring : NULL;
+            *first     = ring + start;
+            *firstLen  = start + len <= m_depth ? len : m_depth - start;
+            *second    = ring;
+            *secondLen = len - *firstLen;
+            return len;
+        }
+
+        static void addUs (struct timespec *ts, unsigned int us) {
+            ts->tv_sec  += us / 1000000;
+            ts->tv_nsec += (long) (us % 1000000) * 1000L;
+            if (ts->tv_nsec >= 1000000000L) {
+                ts->tv_sec++;
+                ts->tv_nsec -= 1000000000L;
+            }
+        }
+
+        static void *run (void *ctx) {
+            AnalogSampler *This = (AnalogSampler *) ctx;
+            uint16_t readings[ANALOG_SAMPLER_MAX_CHANNELS];
+            struct timespec next, now;
+
+            clock_gettime (CLOCK_MONOTONIC, &next);
+            for (;;) {
+                pthread_mutex_lock (&This->m_lock);
+                int channels = This->m_channels;
+                bool running = This->m_running;
+                pthread_mutex_unlock (&This->m_lock);
+                if (!running) {
+                    break;
+                }
+
+                // contexts of existing channels never change, read them unlocked
+                for (int i = 0; i < channels; i++) {
+                    readings[i] = mraa_aio_read (This->m_channel[i].aio);
+                }
+
+                pthread_mutex_lock (&This->m_lock);
+                unsigned int slot = (unsigned int) (This->m_rounds % This->m_depth);
+                for (int i = 0; i < channels; i++) {
+                    This->m_channel[i].ring[slot] = readings[i];
+                }
+                // channels added meanwhile start with the next round
+                for (int i = channels; i < This->m_channels; i++) {
+                    This->m_channel[i].first = This->m_rounds + 1;
+                }
+                This->m_rounds++;
+                pthread_cond_broadcast (&This->m_cond);
+                pthread_mutex_unlock (&This->m_lock);
+
+                addUs (&next, This->m_periodUs);
+                clock_gettime (CLOCK_MONOTONIC, &now);
+                if (now.tv_sec > next.tv_sec ||
+                    (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+                    // fell behind, restart the schedule instead of bursting
+                    This->m_overruns++;
+                    next = now;
+                } else {
+                    clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+                }
+            }
+            return NULL;
+        }
+
+        pthread_t           m_thread;
+        pthread_mutex_t     m_lock;
+        pthread_cond_t      m_cond;
+
+        unsigned int        m_periodUs;
+        unsigned int        m_depth;
+        channel             m_channel[ANALOG_SAMPLER_MAX_CHANNELS];
+        int                 m_channels;
+        uint64_t            m_rounds;
+        unsigned int        m_overruns;
+        volatile bool       m_running;
+};
+
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include <mraa/gpio.h>
+
+namespace upm {
+
+/**
+ * @brief Two-wire bit-bang engine
+ *
+ * Drivers for clock/data chips describe a whole frame up front as a list
+ * of clock edges, data levels and minimum hold times, then emit() plays
+ * it in one tight loop. Writes that would not change a pin are dropped
+ * while the frame is built, the pins use mraa's memory mapped path when
+ * the platform has one, and holds are timed by spinning on
+ * CLOCK_MONOTONIC rather than sleeping, since a sleep costs far more
+ * than the microseconds these chips need. Holds shorter than a pin
+ * write, as measured when the engine is created, are dropped as well.
+ *
+ * Timings are minimums: preemption can only stretch a frame, which both
+ * clocked protocols here tolerate.
+ *
+ * The data pin can be released to input for a clock the chip drives it
+ * in, such as an acknowledge; the next data level drives it again.
+ *
+ * @ingroup gpio
+ */
+class TwoWireBitBang {
+    public:
+        /**
+         * Instanciates a TwoWireBitBang object, both pins start low
+         *
+         * @param clkPin clock pin
+         * @param dataPin data pin
+         */
+        TwoWireBitBang (uint8_t clkPin, uint8_t dataPin) :
+                m_clkLevel(0), m_dataLevel(0), m_clkPin(0), m_dataPin(0),
+                m_dataInput(false), m_dataInputPin(false),
+                m_writeNs(0), m_frameNs(0), m_mmaped(false) {
+            m_clk  = initPin (clkPin);
+            m_data = initPin (dataPin);
+            if (m_clk == NULL || m_data == NULL) {
+                return;
+            }
+            m_mmaped = (mraa_gpio_use_mmaped (m_clk, 1) == MRAA_SUCCESS) &&
+                       (mraa_gpio_use_mmaped (m_data, 1) == MRAA_SUCCESS);
+
+            /* cost of one pin write, below which a hold needs no timing */
+            uint64_t begin = now ();
+            for (int i = 0; i < 16; i++) {
+                mraa_gpio_write (m_data, 0);
+            }
+            m_writeNs = (now () - begin) / 16;
+        }
+
+        /**
+         * TwoWireBitBang object destructor
+         */
+        ~TwoWireBitBang () {
+            if (m_clk != NULL) {
+                mraa_gpio_close (m_clk);
+            }
+            if (m_data != NULL) {
+                mraa_gpio_close (m_data);
+            }
+        }
+
+        /**
+         * Drop the frame being built
+         */
+        void clear () {
+            m_steps.clear ();
+            m_clkLevel  = m_clkPin;
+            m_dataLevel = m_dataPin;
+            m_dataInput = m_dataInputPin;
+        }
+
+        /**
+         * Append a clock level
+         */
+        void clock (int level) {
+            append (m_clkLevel, STEP_CLK, level);
+        }
+
+        /**
+         * Append a data level, driving the data pin again if it was released
+         */
+        void data (int level) {
+            if (m_dataInput) {
+                m_steps.push_back (((uint64_t) MRAA_GPIO_OUT << STEP_SHIFT) | STEP_DATA_DIR);
+                m_dataInput = false;
+                /* the level the pin comes back with is not known, always write it */
+                m_dataLevel = -1;
+            }
+            append (m_dataLevel, STEP_DATA, level);
+        }
+
+        /**
+         * Append a switch of the data pin to input, leaving it to the chip
+         */
+        void releaseData () {
+            if (!m_dataInput) {
+                m_steps.push_back (((uint64_t) MRAA_GPIO_IN << STEP_SHIFT) | STEP_DATA_DIR);
+                m_dataInput = true;
+            }
+        }
+
+        /**
+         * Append a minimum time for the pins to hold their levels
+         *
+         * @param ns hold time in nanoseconds
+         */
+        void hold (uint32_t ns) {
+            if (ns <= m_writeNs) {
+                return;
+            }
+            if (!m_steps.empty () && (m_steps.back () & STEP_MASK) == STEP_HOLD) {
+                ns += m_steps.back () >> STEP_SHIFT;
+                m_steps.pop_back ();
+            }
+            m_steps.push_back (((uint64_t) ns << STEP_SHIFT) | STEP_HOLD);
+        }
+
+        /**
+         * Play the frame on the pins, then start an empty one
+         *
+         * @return Result of operation
+         */
+        mraa_result_t emit () {
+            if (m_clk == NULL || m_data == NULL) {
+                return MRAA_ERROR_INVALID_HANDLE;
+            }
+
+            uint64_t begin = now (), edge = begin;
+            for (size_t i = 0; i < m_steps.size (); i++) {
+                uint64_t step = m_steps[i];
+                switch (step & STEP_MASK) {
+                    case STEP_CLK:
+                        mraa_gpio_write (m_clk, (int) (step >> STEP_SHIFT));
+                        break;
+                    case STEP_DATA:
+                        mraa_gpio_write (m_data, (int) (step >> STEP_SHIFT));
+                        break;
+                    case STEP_DATA_DIR:
+                        mraa_gpio_dir (m_data, (gpio_dir_t) (step >> STEP_SHIFT));
+                        break;
+                    case STEP_HOLD:
+                        edge += step >> STEP_SHIFT;
+                        while (now () < edge) {
+                        }
+                        break;
+                }
+                if ((step & STEP_MASK) != STEP_HOLD) {
+                    edge = now ();
+                }
+            }
+            m_frameNs = now () - begin;
+            m_clkPin  = m_clkLevel;
+            m_dataPin = m_dataLevel;
+            m_dataInputPin = m_dataInput;
+            m_steps.clear ();
+
+            return MRAA_SUCCESS;
+        }
+
+        /**
+         * Number of steps in the frame being built
+         */
+        size_t steps () {
+            return m_steps.size ();
+        }
+
+        /**
+         * Duration of the last emitted frame, in nanoseconds
+         */
+        uint64_t frameTime () {
+            return m_frameNs;
+        }
+
+        /**
+         * Measured cost of one pin write, in nanoseconds
+         */
+        uint32_t writeTime () {
+            return m_writeNs;
+        }
+
+        /**
+         * Whether the pins are driven through memory mapped io
+         */
+        bool mmaped () {
+            return m_mmaped;
+        }
+
+    private:
+        enum {
+            STEP_CLK      = 0,
+            STEP_DATA     = 1,
+            STEP_HOLD     = 2,
+            STEP_DATA_DIR = 3,
+            STEP_MASK     = 3,
+            STEP_SHIFT    = 2
+        };
+
+        static mraa_gpio_context initPin (uint8_t pin) {
+            mraa_gpio_context ctx = mraa_gpio_init (pin);
+            if (ctx == NULL) {
+                fprintf (stderr, "Are you sure that pin%d you requested is valid on your platform?", pin);
+                return NULL;
+            }
+            mraa_gpio_dir (ctx, MRAA_GPIO_OUT);
+            mraa_gpio_write (ctx, 0);
+            return ctx;
+        }
+
+        /* levels are tracked as the frame is built, so it only holds changes
+         * from the levels the previous frame left on the pins */
+        void append (int &current, uint32_t type, int level) {
+            level = level ? 1 : 0;
+            if (level == current) {
+                return;
+            }
+            current = level;
+            m_steps.push_back (((uint64_t) level << STEP_SHIFT) | type);
+        }
+
+        static uint64_t now () {
+            struct timespec ts;
+            clock_gettime (CLOCK_MONOTONIC, &ts);
+            return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+
+        mraa_gpio_context       m_clk;
+        mraa_gpio_context       m_data;
+        std::vector<uint64_t>   m_steps; // hold times are summed, so they need the width
+        int                     m_clkLevel;
+        int                     m_dataLevel;
+        int                     m_clkPin;
+        int                     m_dataPin;
+        bool                    m_dataInput;
+        bool                    m_dataInputPin;
+        uint32_t                m_writeNs;
+        uint64_t                m_frameNs;
+        bool                    m_mmaped;
+};
+
+}
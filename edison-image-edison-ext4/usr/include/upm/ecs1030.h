@@ -28,6 +28,8 @@
 #include <mraa/aio.h>
 #include <mraa/gpio.h>
 
+#include "analogsampler.h"
+
 namespace upm {
 
 #define NUMBER_OF_SAMPLES  500
@@ -107,4 +109,53 @@ class ECS1030 {
         int                 m_sample;
         double              m_filteredSample;
 };
+
+/**
+ * @brief ECS1030 fed by an AnalogSampler
+ *
+ * Computes the current of getCurrency_A() as one RMS pass over the
+ * history of a shared background sampler. Pick a sampler period and
+ * window that span whole mains cycles, e.g. 40us and NUMBER_OF_SAMPLES
+ * for one 50Hz cycle.
+ *
+ * @ingroup ecs1030 analog
+ */
+class ECS1030Stream {
+    public:
+        /**
+         * Instanciates a ECS1030Stream object
+         *
+         * @param sampler sampler reading the pin
+         * @param pinNumber number of the data pin
+         */
+        ECS1030Stream (AnalogSampler &sampler, uint8_t pinNumber) :
+                m_sampler(sampler), m_channel(sampler.addChannel (pinNumber)) {}
+
+        /**
+         * Return currency data for the most recent samples
+         *
+         * @param len number of samples
+         */
+        double getCurrency (unsigned int len = NUMBER_OF_SAMPLES) {
+            blockStats stats;
+
+            m_sampler.waitWindow (m_channel, len);
+            m_sampler.stats (m_channel, len, &stats);
+            return SampleBlock::rms (&stats, 5.1 / 1023, -2.5) / (2000.0 / CURRENT_RATIO);
+        }
+
+        /**
+         * Return power data for the most recent samples
+         *
+         * @param len number of samples
+         * @param voltage mains voltage
+         */
+        double getPower (unsigned int len = NUMBER_OF_SAMPLES, double voltage = 220.0) {
+            return voltage * getCurrency (len);
+        }
+
+    private:
+        AnalogSampler &     m_sampler;
+        int                 m_channel;
+};
 }
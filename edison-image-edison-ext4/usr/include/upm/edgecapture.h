@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <mraa/gpio.h>
+
+namespace upm {
+
+/**
+ * @struct edgeEvent
+ * @brief A single edge seen on a capture pin
+ */
+typedef struct {
+    uint64_t timestamp; /**< CLOCK_MONOTONIC time of the edge in ns */
+    int      level;     /**< Pin level right after the edge */
+} edgeEvent;
+
+/**
+ * @brief Timestamped GPIO edge capture
+ *
+ * Edges are timestamped on the mraa interrupt thread as soon as it is
+ * woken by the kernel and queued in a small ring, so drivers can compute
+ * pulse widths from timestamp differences and sleep on a condition
+ * variable instead of spinning on the pin. The sysfs gpio interface of
+ * the 3.10 kernel does not export kernel edge timestamps, so wake-up
+ * latency of the interrupt thread (typically tens of microseconds on the
+ * Edison) is the resolution limit.
+ *
+ * The capture also keeps the CPU time consumed by the interrupt thread,
+ * so callers can account the full cost of a measurement.
+ *
+ * @ingroup gpio
+ */
+class EdgeCapture {
+    public:
+        /**
+         * Instanciates an EdgeCapture object
+         *
+         * @param pin gpio pin to capture edges on
+         * @param depth number of edges buffered before the oldest is dropped
+         */
+        EdgeCapture (int pin, unsigned int depth = 64) :
+                m_depth(depth ? depth : 1), m_head(0), m_tail(0),
+                m_overruns(0), m_isrCpu(0), m_running(false) {
+            pthread_condattr_t attr;
+
+            pthread_mutex_init (&m_lock, NULL);
+            pthread_condattr_init (&attr);
+            pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+            pthread_cond_init (&m_cond, &attr);
+            pthread_condattr_destroy (&attr);
+
+            m_ring = new edgeEvent[m_depth];
+
+            if ((m_gpio = mraa_gpio_init (pin)) == NULL) {
+                fprintf (stderr, "Are you sure that pin%d you requested is valid on your platform?", pin);
+                return;
+            }
+            mraa_gpio_dir (m_gpio, MRAA_GPIO_IN);
+        }
+
+        /**
+         * EdgeCapture object destructor
+         */
+        ~EdgeCapture () {
+            stop ();
+            if (m_gpio != NULL) {
+                mraa_gpio_close (m_gpio);
+            }
+            delete [] m_ring;
+            pthread_cond_destroy (&m_cond);
+            pthread_mutex_destroy (&m_lock);
+        }
+
+        /**
+         * Start capturing edges
+         *
+         * @param edge which edges to capture
+         * @return Result of operation
+         */
+        mraa_result_t start (gpio_edge_t edge = MRAA_GPIO_EDGE_BOTH) {
+            if (m_gpio == NULL) {
+                return MRAA_ERROR_INVALID_HANDLE;
+            }
+            if (m_running) {
+                return MRAA_SUCCESS;
+            }
+
+            flush ();
+            mraa_result_t error = mraa_gpio_isr (m_gpio, edge, &EdgeCapture::isr, this);
+            if (error == MRAA_SUCCESS) {
+                m_running = true;
+            }
+            return error;
+        }
+
+        /**
+         * Stop capturing edges and wake up any waiter
+         */
+        void stop () {
+            if (!m_running) {
+                return;
+            }
+            mraa_gpio_isr_exit (m_gpio);
+            m_running = false;
+
+            pthread_mutex_lock (&m_lock);
+            pthread_cond_broadcast (&m_cond);
+            pthread_mutex_unlock (&m_lock);
+        }
+
+        /**
+         * Wait for the next captured edge without busy-waiting
+         *
+         * @param event filled in with the oldest queued edge
+         * @param timeoutMs how long to sleep for an edge, negative waits forever
+         * @return true if an edge was returned, false on timeout or stop
+         */
+        bool waitEdge (edgeEvent *event, int timeoutMs) {
+            struct timespec deadline;
+
+            if (timeoutMs >= 0) {
+                clock_gettime (CLOCK_MONOTONIC, &deadline);
+                deadline.tv_sec  += timeoutMs / 1000;
+                deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+                if (deadline.tv_nsec >= 1000000000L) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+            }
+
+            pthread_mutex_lock (&m_lock);
+            while (m_head == m_tail && m_running) {
+                if (timeoutMs < 0) {
+                    pthread_cond_wait (&m_cond, &m_lock);
+                } else if (pthread_cond_timedwait (&m_cond, &m_lock, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+
+            bool found = (m_head != m_tail);
+            if (found) {
+                *event = m_ring[m_tail];
+                m_tail = (m_tail + 1) % m_depth;
+            }
+            pthread_mutex_unlock (&m_lock);
+
+            return found;
+        }
+
+        /**
+         * Drop all queued edges
+         */
+        void flush () {
+            pthread_mutex_lock (&m_lock);
+            m_tail = m_head;
+            pthread_mutex_unlock (&m_lock);
+        }
+
+        /**
+         * Number of edges dropped because the ring was full
+         */
+        unsigned int overruns () {
+            return m_overruns;
+        }
+
+        /**
+         * CPU time consumed so far by the interrupt thread, in ns
+         */
+        uint64_t isrCpuTime () {
+            return m_isrCpu;
+        }
+
+        /**
+         * Gpio context of the capture pin
+         */
+        mraa_gpio_context gpio () {
+            return m_gpio;
+        }
+
+        /**
+         * Current CLOCK_MONOTONIC time in ns
+         */
+        static uint64_t now () {
+            return clockNs (CLOCK_MONOTONIC);
+        }
+
+        /**
+         * CPU time consumed so far by the calling thread, in ns
+         */
+        static uint64_t threadCpuTime () {
+            return clockNs (CLOCK_THREAD_CPUTIME_ID);
+        }
+
+    private:
+        static uint64_t clockNs (clockid_t clock) {
+            struct timespec ts;
+            clock_gettime (clock, &ts);
+            return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+
+        static void isr (void *ctx) {
+            EdgeCapture *This = (EdgeCapture *) ctx;
+            edgeEvent event;
+
+            event.timestamp = now ();
+            event.level     = mraa_gpio_read (This->m_gpio);
+
+            pthread_mutex_lock (&This->m_lock);
+            unsigned int next = (This->m_head + 1) % This->m_depth;
+            if (next == This->m_tail) {
+                This->m_tail = (This->m_tail + 1) % This->m_depth;
+                This->m_overruns++;
+            }
+            This->m_ring[This->m_head] = event;
+            This->m_head = next;
+            pthread_cond_signal (&This->m_cond);
+            pthread_mutex_unlock (&This->m_lock);
+
+            This->m_isrCpu = threadCpuTime ();
+        }
+
+        mraa_gpio_context   m_gpio;
+        pthread_mutex_t     m_lock;
+        pthread_cond_t      m_cond;
+
+        edgeEvent *         m_ring;
+        unsigned int        m_depth;
+        unsigned int        m_head;
+        unsigned int        m_tail;
+        unsigned int        m_overruns;
+
+        volatile uint64_t   m_isrCpu;
+        volatile bool       m_running;
+};
+
+}
@@ -26,6 +26,9 @@
 #include <string>
 #include <mraa/gpio.h>
 #include <mraa/aio.h>
+#include <stdio.h>
+
+#include "analogsampler.h"
 
 struct thresholdContext {
     long averageReading;
@@ -104,4 +107,121 @@ class Gas {
         mraa_aio_context    m_gasCtx;
 };
 
+/**
+ * @brief Gas sensor fed by an AnalogSampler
+ *
+ * Same threshold logic as Gas, on the samples of a shared background
+ * sampler: windows are read from the sampler's history, so the MQ sensors
+ * of one board share a single sampling thread and no call blocks for the
+ * length of a window once the sampler is running.
+ *
+ * @ingroup gas analog
+ */
+class GasStream {
+    public:
+        /**
+         * Instantiates a GasStream object
+         *
+         * @param sampler sampler reading the pin
+         * @param gasPin pin where gas is connected
+         */
+        GasStream (AnalogSampler &sampler, int gasPin) :
+                m_sampler(sampler), m_channel(sampler.addChannel (gasPin)) {}
+
+        /**
+         * Get the most recent samples, waiting only until the sampler has
+         * taken that many
+         *
+         * @param numberOfSamples number of samples in the window
+         * @param buffer buffer with sampled data
+         * @return number of samples copied
+         */
+        int getSampledWindow (unsigned int numberOfSamples, uint16_t * buffer) {
+            m_sampler.waitWindow (m_channel, numberOfSamples);
+            return m_sampler.latest (m_channel, buffer, numberOfSamples);
+        }
+
+        /**
+         * Update the threshold context with the most recent samples
+         *
+         * @param ctx threshold context
+         * @param threshold sample threshold
+         * @param len number of samples averaged into the reading
+         * @return running average if above threshold, 0 otherwise
+         */
+        int findThreshold (thresholdContext* ctx, unsigned int threshold, unsigned int len) {
+            blockStats stats;
+
+            m_sampler.waitWindow (m_channel, len);
+            m_sampler.stats (m_channel, len, &stats);
+            return update (ctx, threshold, &stats);
+        }
+
+        /**
+         * Given sampled buffer this method will return TRUE/FALSE if threshold
+         * was reached
+         *
+         * @param ctx threshold context
+         * @param threshold sample threshold
+         * @param buffer buffer with samples
+         * @param len buffer length
+         */
+        int findThreshold (thresholdContext* ctx, unsigned int threshold, uint16_t * buffer, unsigned int len) {
+            blockStats stats;
+
+            SampleBlock::reset (&stats);
+            SampleBlock::accumulate (buffer, len, &stats);
+            return update (ctx, threshold, &stats);
+        }
+
+        /**
+         * Return average data for the sampled window
+         *
+         * @param ctx threshold context
+         */
+        int getSampledData (thresholdContext* ctx) {
+            return ctx->averageReading;
+        }
+
+        /**
+         * Return the most recent sample
+         */
+        int getSample () {
+            uint16_t sample = 0;
+
+            m_sampler.waitWindow (m_channel, 1);
+            m_sampler.latest (m_channel, &sample, 1);
+            return sample;
+        }
+
+        /**
+         *
+         * Print running average of threshold context
+         *
+         * @param ctx threshold context
+         * @param resolution readings per printed star
+         */
+        void printGraph (thresholdContext* ctx, uint8_t resolution) {
+            long stars = resolution ? (ctx->runningAverage + resolution - 1) / resolution : 0;
+            std::string bar (stars > 0 ? stars : 0, '*');
+            printf ("(%ld) | %s\n", ctx->runningAverage, bar.c_str ());
+        }
+
+    private:
+        // ctx->averagedOver is the caller's smoothing factor, as for findThreshold
+        // of the unbuffered class; only the reading comes from the samples
+        int update (thresholdContext* ctx, unsigned int threshold, const blockStats *stats) {
+            if (stats->count == 0) {
+                return 0;
+            }
+            ctx->averageReading = stats->sum / stats->count;
+            ctx->runningAverage = (((ctx->averagedOver - 1) * ctx->runningAverage) +
+                                   ctx->averageReading) / ctx->averagedOver;
+            return ctx->runningAverage > (long) threshold ? ctx->runningAverage : 0;
+        }
+
+        AnalogSampler &     m_sampler;
+        int                 m_channel;
+};
+
 }
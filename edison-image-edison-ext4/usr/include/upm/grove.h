@@ -26,6 +26,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
 #include <mraa/aio.h>
 #include <mraa/gpio.h>
 
@@ -376,4 +381,331 @@ class GroveButton: public Grove {
         mraa_gpio_context m_gpio;
 };
 
+/**
+ * @brief Base of the table-driven Grove analog sensors
+ *
+ * Opens the analog pin at the resolution the board's ADC supports, so
+ * the sensor classes below can convert every possible ADC code once, when
+ * they are created, and then convert samples with a table lookup. Samples
+ * can be read and converted one at a time or as arrays.
+ *
+ * @ingroup grove analog
+ */
+class GroveAnalogTable: public Grove {
+    public:
+        /**
+         * Grove table-driven analog sensor constructor
+         *
+         * @param pin analog pin to use
+         * @param bits ADC resolution, 0 for mraa_adc_supported_bits()
+         */
+        GroveAnalogTable(unsigned int pin, int bits = 0)
+        {
+            if (bits <= 0) {
+                bits = mraa_adc_supported_bits();
+            }
+            if (bits <= 0 || bits > 16) {
+                bits = 10;
+            }
+            m_bits = bits;
+            m_max = (1 << bits) - 1;
+
+            if (!(m_aio = mraa_aio_init(pin))) {
+                fprintf(stderr, "%s: mraa_aio_init(%u) failed\n", __FUNCTION__, pin);
+                return;
+            }
+            mraa_aio_set_bit(m_aio, bits);
+        }
+        /**
+         * GroveAnalogTable destructor
+         */
+        ~GroveAnalogTable()
+        {
+            if (m_aio) {
+                mraa_aio_close(m_aio);
+            }
+        }
+        /**
+         * Get the ADC resolution the tables were built for
+         *
+         * @return number of bits
+         */
+        int bits()
+        {
+            return m_bits;
+        }
+        /**
+         * Get a raw value from the AIO pin
+         *
+         * @return the raw value from the ADC
+         */
+        uint16_t raw_value()
+        {
+            return mraa_aio_read(m_aio);
+        }
+        /**
+         * Read consecutive raw values from the AIO pin
+         *
+         * @param raw buffer for the values
+         * @param count number of values to read
+         * @return number of values read
+         */
+        int read(uint16_t *raw, int count)
+        {
+            if (!m_aio) {
+                return 0;
+            }
+            for (int i = 0; i < count; i++) {
+                raw[i] = mraa_aio_read(m_aio);
+            }
+            return count;
+        }
+    protected:
+        /* table index of a raw value, out of range values are clamped */
+        unsigned int index(uint16_t raw)
+        {
+            return raw > m_max ? m_max : raw;
+        }
+
+        mraa_aio_context m_aio;
+        int m_bits;
+        unsigned int m_max;
+};
+
+/**
+ * @brief Table-driven Grove temperature sensor
+ *
+ * Same conversion as GroveTemp::value(), at the ADC's full resolution,
+ * with the thermistor math done once per ADC code. At 10 bits the
+ * results are identical to GroveTemp.
+ *
+ * @ingroup grove analog
+ */
+class GroveTempTable: public GroveAnalogTable {
+    public:
+        /**
+         * Grove table-driven temperature sensor constructor
+         *
+         * @param pin analog pin to use
+         * @param bits ADC resolution, 0 for mraa_adc_supported_bits()
+         */
+        GroveTempTable(unsigned int pin, int bits = 0) :
+            GroveAnalogTable(pin, bits), m_celsius(m_max + 1)
+        {
+            m_name = "Temperature Sensor";
+            for (unsigned int a = 0; a <= m_max; a++) {
+                float r = (float)((double) m_max - a) * 10000.0 / a;
+                float t = 1.0 / (log(r / 10000.0) / 3975.0 + 1.0 / 298.15) - 273.15;
+                m_celsius[a] = lroundf(t);
+            }
+        }
+        /**
+         * Get the temperature from the sensor
+         *
+         * @return the normalized temperature in Celsius
+         */
+        int value()
+        {
+            return m_celsius[index(raw_value())];
+        }
+        /**
+         * Convert a raw value
+         *
+         * @param raw value from the ADC
+         * @return the temperature in Celsius
+         */
+        int value(uint16_t raw)
+        {
+            return m_celsius[index(raw)];
+        }
+        /**
+         * Convert raw values
+         *
+         * @param raw values from the ADC
+         * @param celsius returned temperatures in Celsius
+         * @param count number of values
+         */
+        void value(const uint16_t *raw, int *celsius, int count)
+        {
+            const int *table = &m_celsius[0];
+            for (int i = 0; i < count; i++) {
+                celsius[i] = table[index(raw[i])];
+            }
+        }
+    private:
+        std::vector<int> m_celsius;
+};
+
+/**
+ * @brief Table-driven Grove light sensor
+ *
+ * Same rough lux conversion as GroveLight::value(), at the ADC's full
+ * resolution, computed once per ADC code. At 10 bits the results are
+ * identical to GroveLight; the full dark code, where that formula
+ * divides by zero, reads INT_MAX.
+ *
+ * @ingroup grove analog
+ */
+class GroveLightTable: public GroveAnalogTable {
+    public:
+        /**
+         * Grove table-driven light sensor constructor
+         *
+         * @param pin analog pin to use
+         * @param bits ADC resolution, 0 for mraa_adc_supported_bits()
+         */
+        GroveLightTable(unsigned int pin, int bits = 0) :
+            GroveAnalogTable(pin, bits), m_lux(m_max + 1)
+        {
+            m_name = "Light Sensor";
+            for (unsigned int i = 0; i <= m_max; i++) {
+                float a = (float) i;
+                a = 10000.0 / pow(((double) m_max - a) * 10.0 / a * 15.0, 4.0 / 3.0);
+                m_lux[i] = a < (float) INT_MAX ? lroundf(a) : INT_MAX;
+            }
+        }
+        /**
+         * Get a rough light intensity from the sensor
+         *
+         * @return the light intensity value in lux
+         */
+        int value()
+        {
+            return m_lux[index(raw_value())];
+        }
+        /**
+         * Convert a raw value
+         *
+         * @param raw value from the ADC
+         * @return the light intensity in lux
+         */
+        int value(uint16_t raw)
+        {
+            return m_lux[index(raw)];
+        }
+        /**
+         * Convert raw values
+         *
+         * @param raw values from the ADC
+         * @param lux returned light intensities
+         * @param count number of values
+         */
+        void value(const uint16_t *raw, int *lux, int count)
+        {
+            const int *table = &m_lux[0];
+            for (int i = 0; i < count; i++) {
+                lux[i] = table[index(raw[i])];
+            }
+        }
+    private:
+        std::vector<int> m_lux;
+};
+
+/**
+ * @brief Table-driven Grove rotary angle sensor
+ *
+ * Same conversions as GroveRotary, at the ADC's full resolution, with
+ * the angle of every ADC code computed once. At 10 bits the results are
+ * identical to GroveRotary.
+ *
+ * @ingroup grove analog
+ */
+class GroveRotaryTable: public GroveAnalogTable {
+    public:
+        /** Tables held for each ADC code */
+        typedef enum {
+            ABS_DEG = 0,
+            ABS_RAD,
+            REL_DEG,
+            REL_RAD,
+            TABLES
+        } TABLE_T;
+
+        /**
+         * Grove table-driven rotary angle sensor constructor
+         *
+         * @param pin number of analog pin to use
+         * @param bits ADC resolution, 0 for mraa_adc_supported_bits()
+         */
+        GroveRotaryTable(unsigned int pin, int bits = 0) :
+            GroveAnalogTable(pin, bits), m_angle(TABLES * (m_max + 1))
+        {
+            m_name = "Rotary Angle Sensor";
+            for (unsigned int i = 0; i <= m_max; i++) {
+                float value = (float) i;
+                float deg = value * (float) m_max_angle / (float) m_max;
+                float rel = (value - (float) ((m_max + 1) / 2)) * (float) m_max_angle / (float) m_max;
+                m_angle[ABS_DEG * (m_max + 1) + i] = deg;
+                m_angle[ABS_RAD * (m_max + 1) + i] = deg * M_PI / 180.0;
+                m_angle[REL_DEG * (m_max + 1) + i] = rel;
+                m_angle[REL_RAD * (m_max + 1) + i] = rel * M_PI / 180.0;
+            }
+        }
+        /**
+         * Get absolute degrees from AIO pin
+         *
+         * @return the unsigned degrees from the ADC
+         */
+        float abs_deg()
+        {
+            return convert(ABS_DEG, raw_value());
+        }
+        /**
+         * Get absolute radians from AIO pin
+         *
+         * @return the unsigned radians from the ADC
+         */
+        float abs_rad()
+        {
+            return convert(ABS_RAD, raw_value());
+        }
+        /**
+         * Get relative degrees from AIO pin
+         *
+         * @return the signed degrees from the ADC
+         */
+        float rel_deg()
+        {
+            return convert(REL_DEG, raw_value());
+        }
+        /**
+         * Get relative radians from AIO pin
+         *
+         * @return the signed radians from the ADC
+         */
+        float rel_rad()
+        {
+            return convert(REL_RAD, raw_value());
+        }
+        /**
+         * Convert a raw value
+         *
+         * @param table conversion to apply
+         * @param raw value from the ADC
+         * @return the angle
+         */
+        float convert(TABLE_T table, uint16_t raw)
+        {
+            return m_angle[table * (m_max + 1) + index(raw)];
+        }
+        /**
+         * Convert raw values
+         *
+         * @param table conversion to apply
+         * @param raw values from the ADC
+         * @param angle returned angles
+         * @param count number of values
+         */
+        void convert(TABLE_T table, const uint16_t *raw, float *angle, int count)
+        {
+            const float *t = &m_angle[table * (m_max + 1)];
+            for (int i = 0; i < count; i++) {
+                angle[i] = t[index(raw[i])];
+            }
+        }
+    private:
+        std::vector<float> m_angle;
+        static const int m_max_angle = 300;
+};
+
 }
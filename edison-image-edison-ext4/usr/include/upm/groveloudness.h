@@ -26,6 +26,8 @@
 #include <string>
 #include <mraa/aio.h>
 
+#include "analogsampler.h"
+
 namespace upm {
 
   /**
@@ -60,6 +62,72 @@ namespace upm {
   private:
     mraa_aio_context m_aio;
   };
-}
 
+  /**
+   * @brief Grove Loudness Sensor fed by an AnalogSampler
+   *
+   * Reads the loudness from the history of a shared background sampler,
+   * so averages and peaks over a window cost no extra ADC reads.
+   *
+   * @ingroup grove analog
+   */
+  class GroveLoudnessStream {
+  public:
+    /**
+     * Grove analog loudness sensor constructor
+     *
+     * @param sampler sampler reading the pin
+     * @param pin analog pin to use
+     */
+    GroveLoudnessStream(AnalogSampler &sampler, int pin) :
+      m_sampler(sampler), m_channel(sampler.addChannel(pin)) {}
+
+    /**
+     * Get the most recent loudness value
+     *
+     * @return the loudness reading
+     */
+    int value()
+    {
+      uint16_t sample = 0;
+
+      m_sampler.waitWindow(m_channel, 1);
+      m_sampler.latest(m_channel, &sample, 1);
+      return sample;
+    }
+
+    /**
+     * Average loudness over the most recent readings
+     *
+     * @param len number of readings
+     * @return the average reading
+     */
+    float average(unsigned int len)
+    {
+      blockStats stats;
+
+      m_sampler.waitWindow(m_channel, len);
+      m_sampler.stats(m_channel, len, &stats);
+      return SampleBlock::mean(&stats);
+    }
 
+    /**
+     * Loudest of the most recent readings
+     *
+     * @param len number of readings
+     * @return the highest reading
+     */
+    int peak(unsigned int len)
+    {
+      blockStats stats;
+
+      m_sampler.waitWindow(m_channel, len);
+      m_sampler.stats(m_channel, len, &stats);
+      return stats.count ? stats.max : 0;
+    }
+
+  private:
+    AnalogSampler &m_sampler;
+    int m_channel;
+  };
+}
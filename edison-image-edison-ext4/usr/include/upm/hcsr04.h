@@ -28,6 +28,8 @@
 #include <mraa/gpio.h>
 #include <mraa/pwm.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include "edgecapture.h"
 
 #define HIGH                   1
 #define LOW                    0
@@ -35,6 +37,9 @@
 #define MAX_PERIOD             7968
 #define TRIGGER_PULSE          10
 
+#define HCSR04_ECHO_TIMEOUT    60
+#define HCSR04_FILTER_SIZE     5
+
 namespace upm {
 
 /**
@@ -101,4 +106,246 @@ class HCSR04 {
         std::string         m_name;
 };
 
+/**
+ * @brief C++ API for HCSR04 using timestamped edge capture
+ *
+ * Same sensor as HCSR04, but the echo pulse width is taken from the
+ * timestamps of its rising and falling edges and the caller sleeps while
+ * waiting for them, so a reading costs a few tens of microseconds of CPU
+ * instead of a core spinning for the whole echo. A continuous mode ranges
+ * from a background thread and publishes median filtered distances.
+ *
+ * @ingroup hcsr04 gpio
+ */
+class HCSR04Capture {
+    public:
+        /**
+         * Instanciates a HCSR04Capture object
+         *
+         * @param triggerPin gpio pin driving the sensor trigger input
+         * @param echoPin gpio pin connected to the sensor echo output
+         */
+        HCSR04Capture (uint8_t triggerPin, uint8_t echoPin) :
+                m_echo(echoPin), m_count(0), m_next(0), m_filtered(-1),
+                m_lastCpu(0), m_continuous(false), m_fptr(NULL), m_args(NULL) {
+            m_name = "HCSR04";
+            pthread_mutex_init (&m_measureLock, NULL);
+
+            if ((m_triggerPinCtx = mraa_gpio_init (triggerPin)) == NULL) {
+                fprintf (stderr, "Are you sure that pin%d you requested is valid on your platform?", triggerPin);
+                return;
+            }
+            mraa_gpio_dir (m_triggerPinCtx, MRAA_GPIO_OUT);
+            mraa_gpio_use_mmaped (m_triggerPinCtx, 1);
+            mraa_gpio_write (m_triggerPinCtx, LOW);
+
+            m_echo.start (MRAA_GPIO_EDGE_BOTH);
+        }
+
+        /**
+         * HCSR04Capture object destructor
+         */
+        ~HCSR04Capture () {
+            stopContinuous ();
+            m_echo.stop ();
+            if (m_triggerPinCtx != NULL) {
+                mraa_gpio_close (m_triggerPinCtx);
+            }
+            pthread_mutex_destroy (&m_measureLock);
+        }
+
+        /**
+         * Trigger the sensor and measure the distance, sleeping while
+         * the echo is in flight
+         *
+         * @param timeoutMs how long to wait for the echo to end
+         * @return distance in cm, or -1 if no echo was captured
+         */
+        double getDistance (int timeoutMs = HCSR04_ECHO_TIMEOUT) {
+            if (m_triggerPinCtx == NULL) {
+                return -1;
+            }
+
+            pthread_mutex_lock (&m_measureLock);
+            uint64_t cpuStart = EdgeCapture::threadCpuTime ();
+            uint64_t isrStart = m_echo.isrCpuTime ();
+            uint64_t deadline = EdgeCapture::now () + (uint64_t) timeoutMs * 1000000ULL;
+            uint64_t rising   = 0;
+            double   distance = -1;
+            edgeEvent edge;
+
+            m_echo.flush ();
+            trigger ();
+
+            for (;;) {
+                uint64_t now = EdgeCapture::now ();
+                if (now >= deadline ||
+                    !m_echo.waitEdge (&edge, (int) ((deadline - now) / 1000000ULL) + 1)) {
+                    break;
+                }
+                if (edge.level == HIGH) {
+                    rising = edge.timestamp;
+                } else if (rising != 0) {
+                    distance = (double) (edge.timestamp - rising) / 1000.0 / 58.0;
+                    break;
+                }
+            }
+
+            if (distance >= 0) {
+                m_window[m_next] = distance;
+                m_next = (m_next + 1) % HCSR04_FILTER_SIZE;
+                if (m_count < HCSR04_FILTER_SIZE) {
+                    m_count++;
+                }
+                m_filtered = median ();
+            }
+
+            m_lastCpu = (EdgeCapture::threadCpuTime () - cpuStart) +
+                        (m_echo.isrCpuTime () - isrStart);
+            pthread_mutex_unlock (&m_measureLock);
+
+            return distance;
+        }
+
+        /**
+         * Median of the last HCSR04_FILTER_SIZE valid distances
+         *
+         * @return filtered distance in cm, or -1 before the first reading
+         */
+        double getFilteredDistance () {
+            pthread_mutex_lock (&m_measureLock);
+            double filtered = m_filtered;
+            pthread_mutex_unlock (&m_measureLock);
+            return filtered;
+        }
+
+        /**
+         * Start ranging from a background thread
+         *
+         * @param periodMs time between two triggers, at least 60 ms is
+         * recommended by the datasheet
+         * @param fptr called with each filtered distance in cm and args,
+         * may be NULL to only update getFilteredDistance()
+         * @param args argument passed to fptr
+         * @return Result of operation
+         */
+        mraa_result_t startContinuous (unsigned int periodMs,
+                                       void (*fptr)(double, void *), void *args) {
+            if (m_triggerPinCtx == NULL) {
+                return MRAA_ERROR_INVALID_HANDLE;
+            }
+            if (m_continuous) {
+                return MRAA_ERROR_INVALID_RESOURCE;
+            }
+
+            m_periodMs   = periodMs;
+            m_fptr       = fptr;
+            m_args       = args;
+            m_continuous = true;
+            if (pthread_create (&m_thread, NULL, &HCSR04Capture::continuousLoop, this) != 0) {
+                m_continuous = false;
+                return MRAA_ERROR_NO_RESOURCES;
+            }
+            return MRAA_SUCCESS;
+        }
+
+        /**
+         * Stop the background ranging thread
+         */
+        void stopContinuous () {
+            if (!m_continuous) {
+                return;
+            }
+            m_continuous = false;
+            pthread_join (m_thread, NULL);
+        }
+
+        /**
+         * CPU time spent on the last reading by the calling thread and the
+         * interrupt thread together
+         *
+         * @return CPU time in microseconds
+         */
+        double getCpuTimePerReading () {
+            return (double) m_lastCpu / 1000.0;
+        }
+
+        /**
+         * Number of echo edges dropped because they were not consumed in time
+         */
+        unsigned int getOverruns () {
+            return m_echo.overruns ();
+        }
+
+        /**
+         * Return name of the component
+         */
+        std::string name()
+        {
+            return m_name;
+        }
+
+    private:
+        void trigger () {
+            struct timespec pulse = { 0, TRIGGER_PULSE * 1000 };
+
+            mraa_gpio_write (m_triggerPinCtx, HIGH);
+            nanosleep (&pulse, NULL);
+            mraa_gpio_write (m_triggerPinCtx, LOW);
+        }
+
+        double median () {
+            double sorted[HCSR04_FILTER_SIZE];
+
+            for (int i = 0; i < m_count; i++) {
+                int j = i;
+                for (; j > 0 && sorted[j - 1] > m_window[i]; j--) {
+                    sorted[j] = sorted[j - 1];
+                }
+                sorted[j] = m_window[i];
+            }
+            return sorted[m_count / 2];
+        }
+
+        static void * continuousLoop (void *ctx) {
+            HCSR04Capture *This = (HCSR04Capture *) ctx;
+
+            while (This->m_continuous) {
+                uint64_t start = EdgeCapture::now ();
+
+                if (This->getDistance () >= 0 && This->m_fptr != NULL) {
+                    This->m_fptr (This->getFilteredDistance (), This->m_args);
+                }
+
+                uint64_t elapsed = EdgeCapture::now () - start;
+                uint64_t period  = (uint64_t) This->m_periodMs * 1000000ULL;
+                if (elapsed < period) {
+                    struct timespec rest;
+                    rest.tv_sec  = (period - elapsed) / 1000000000ULL;
+                    rest.tv_nsec = (period - elapsed) % 1000000000ULL;
+                    nanosleep (&rest, NULL);
+                }
+            }
+            return NULL;
+        }
+
+        mraa_gpio_context   m_triggerPinCtx;
+        EdgeCapture         m_echo;
+        pthread_mutex_t     m_measureLock;
+
+        double              m_window[HCSR04_FILTER_SIZE];
+        int                 m_count;
+        int                 m_next;
+        double              m_filtered;
+        uint64_t            m_lastCpu;
+
+        pthread_t           m_thread;
+        volatile bool       m_continuous;
+        unsigned int        m_periodMs;
+        void                (*m_fptr)(double, void *);
+        void *              m_args;
+
+        std::string         m_name;
+};
+
 }
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <mraa/i2c.h>
 
 namespace upm {
@@ -101,4 +102,140 @@ class I2CLcd {
         mraa_i2c_context m_i2c_lcd_control;
 };
 
+/**
+ * @brief In-memory copy of the characters of a text display
+ *
+ * Drivers draw into the shadow buffer and flush only the cells that
+ * differ from what the display shows. nextRun() walks the changed cells
+ * row by row and joins runs separated by at most maxGap unchanged cells,
+ * so a driver can send each run as one multi-byte i2c write when that is
+ * cheaper than another cursor move. Text is clipped at the end of a row.
+ *
+ * @ingroup i2clcd
+ */
+class LcdShadowBuffer {
+    public:
+        /**
+         * LcdShadowBuffer constructor, every cell starts blank and stale
+         *
+         * @param rows number of rows of the display
+         * @param columns number of columns of the display
+         */
+        LcdShadowBuffer (int rows, int columns) :
+                m_rows(rows), m_columns(columns), m_row(0), m_column(0),
+                m_cells(rows * columns, ' '), m_shown(rows * columns, ' '),
+                m_stale(rows * columns, true) {}
+
+        /**
+         * Write a string at the cursor and move the cursor past it
+         */
+        void write (const std::string &msg) {
+            for (std::string::size_type i = 0; i < msg.size () && m_column < m_columns; i++) {
+                m_cells[m_row * m_columns + m_column++] = msg[i];
+            }
+        }
+
+        /**
+         * Move the cursor, clamped to the display
+         */
+        void setCursor (int row, int column) {
+            m_row    = row < 0 ? 0 : (row >= m_rows ? m_rows - 1 : row);
+            m_column = column < 0 ? 0 : column;
+        }
+
+        /**
+         * Blank every cell and home the cursor
+         */
+        void clear () {
+            m_cells.assign (m_cells.size (), ' ');
+            home ();
+        }
+
+        /**
+         * Move the cursor to the first cell
+         */
+        void home () {
+            m_row = m_column = 0;
+        }
+
+        /**
+         * Forget what the display shows, so the next flush redraws it all
+         */
+        void invalidate () {
+            m_stale.assign (m_stale.size (), true);
+        }
+
+        /**
+         * Find the next run of cells to send
+         *
+         * @param pos cell to search from, advanced past the run
+         * @param maxGap unchanged cells a run may span
+         * @param row row of the run
+         * @param column first column of the run
+         * @param len number of cells in the run
+         * @return false when no changed cell is left
+         */
+        bool nextRun (int &pos, int maxGap, int *row, int *column, int *len) {
+            int size = m_rows * m_columns;
+
+            while (pos < size && !dirty (pos)) {
+                pos++;
+            }
+            if (pos >= size) {
+                return false;
+            }
+
+            int end = pos + 1, rowEnd = (pos / m_columns + 1) * m_columns;
+            for (int i = end; i < rowEnd && i - end <= maxGap; i++) {
+                if (dirty (i)) {
+                    end = i + 1;
+                }
+            }
+
+            *row    = pos / m_columns;
+            *column = pos % m_columns;
+            *len    = end - pos;
+            pos     = end;
+            return true;
+        }
+
+        /**
+         * Record that a run reached the display
+         */
+        void markShown (int row, int column, int len) {
+            for (int i = row * m_columns + column; len-- > 0; i++) {
+                m_shown[i] = m_cells[i];
+                m_stale[i] = false;
+            }
+        }
+
+        /**
+         * Characters of a row, m_columns of them
+         */
+        const char *cells (int row) const {
+            return &m_cells[row * m_columns];
+        }
+
+        int rows () const {
+            return m_rows;
+        }
+
+        int columns () const {
+            return m_columns;
+        }
+
+    private:
+        bool dirty (int i) const {
+            return m_stale[i] || m_cells[i] != m_shown[i];
+        }
+
+        int m_rows;
+        int m_columns;
+        int m_row;
+        int m_column;
+        std::vector<char> m_cells;
+        std::vector<char> m_shown;
+        std::vector<bool> m_stale;
+};
+
 }
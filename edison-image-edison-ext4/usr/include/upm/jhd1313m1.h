@@ -107,4 +107,114 @@ class Jhd1313m1 : public I2CLcd {
         mraa_i2c_context m_i2c_lcd_rgb;
 };
 
+/**
+ * @brief Jhd1313m1 drawing into a shadow buffer
+ *
+ * write(), setCursor(), clear() and home() only change an in-memory copy
+ * of the display; flush() then sends the changed cells, one i2c write per
+ * run carrying both the cursor move and the characters, instead of one
+ * transaction per character. Use invalidate() after calling scroll() or
+ * anything else that changes the display behind the buffer.
+ *
+ * @ingroup i2clcd i2c
+ */
+class Jhd1313m1Buffered : public Jhd1313m1 {
+    public:
+        using I2CLcd::write;
+
+       /**
+        * Jhd1313m1Buffered constructor
+        *
+        * @param bus i2c bus to use
+        * @param lcdAddress the slave address the lcd is registered on
+        * @param rgbAddress the slave address the rgb backlight is on
+        * @param rows number of rows of the display
+        * @param columns number of columns of the display
+        */
+        Jhd1313m1Buffered(int bus, int lcdAddress=0x3E, int rgbAddress=0x62,
+                          int rows=2, int columns=16) :
+            Jhd1313m1(bus, lcdAddress, rgbAddress), m_shadow(rows, columns) {}
+       /**
+        * Write a string to the buffer
+        *
+        * @param msg The std::string to write, clipped at the end of the row
+        * @return Result of operation
+        */
+        mraa_result_t write(std::string msg)
+        {
+            m_shadow.write(msg);
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Set the buffer cursor to a coordinate
+        *
+        * @param row The row to set cursor to
+        * @param column The column to set cursor to
+        * @return Result of operation
+        */
+        mraa_result_t setCursor(int row, int column)
+        {
+            m_shadow.setCursor(row, column);
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Blank the buffer
+        *
+        * @return Result of operation
+        */
+        mraa_result_t clear()
+        {
+            m_shadow.clear();
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Return to coordinate 0,0
+        *
+        * @return Result of operation
+        */
+        mraa_result_t home()
+        {
+            m_shadow.home();
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Send the cells that changed since the last flush
+        *
+        * @return Result of operation
+        */
+        mraa_result_t flush()
+        {
+            static const uint8_t rowAddress[] = { 0x00, 0x40, 0x14, 0x54 };
+            int pos = 0, row, column, len;
+
+            /* a cursor move costs two bytes, so resend short unchanged gaps */
+            while (m_shadow.nextRun(pos, 2, &row, &column, &len)) {
+                std::vector<uint8_t> frame;
+                frame.push_back(LCD_CMD);
+                frame.push_back(LCD_CMD | (rowAddress[row & 3] + column));
+                frame.push_back(LCD_DATA);
+                frame.insert(frame.end(), m_shadow.cells(row) + column,
+                             m_shadow.cells(row) + column + len);
+
+                mraa_i2c_address(m_i2c_lcd_control, m_lcd_control_address);
+                mraa_result_t error = mraa_i2c_write(m_i2c_lcd_control, &frame[0], frame.size());
+                if (error != MRAA_SUCCESS) {
+                    return error;
+                }
+                m_shadow.markShown(row, column, len);
+            }
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Redraw every cell on the next flush
+        */
+        void invalidate()
+        {
+            m_shadow.invalidate();
+        }
+
+    private:
+        LcdShadowBuffer m_shadow;
+};
+
 }
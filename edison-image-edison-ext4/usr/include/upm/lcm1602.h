@@ -94,4 +94,130 @@ class Lcm1602 : public I2CLcd {
         mraa_result_t expandWrite(uint8_t value);
         mraa_result_t pulseEnable(uint8_t value);
     };
+
+/**
+ * @brief Lcm1602 drawing into a shadow buffer
+ *
+ * write(), setCursor(), clear() and home() only change an in-memory copy
+ * of the display; flush() then sends the changed cells. The PCF8574
+ * expander latches every byte written to it, so each nibble (data, data
+ * with E high, data with E low) is three bytes of one i2c write, and a
+ * whole run of characters plus its cursor move goes out in a single
+ * transaction instead of six per character. At 100kHz every byte takes
+ * about 90us, which covers the enable pulse width and the 37us the
+ * HD44780 needs per character. Use invalidate() if the display is changed
+ * behind the buffer.
+ *
+ * @ingroup i2clcd i2c
+ */
+class Lcm1602Buffered : public Lcm1602 {
+    public:
+        using I2CLcd::write;
+
+       /**
+        * Lcm1602Buffered constructor
+        *
+        * @param bus i2c bus to use
+        * @param address the slave address the lcd is registered on
+        * @param rows number of rows of the display
+        * @param columns number of columns of the display
+        */
+        Lcm1602Buffered(int bus, int address, int rows=2, int columns=16) :
+            Lcm1602(bus, address), m_shadow(rows, columns) {}
+       /**
+        * Write a string to the buffer
+        *
+        * @param msg The std::string to write, clipped at the end of the row
+        * @return Result of operation
+        */
+        mraa_result_t write(std::string msg)
+        {
+            m_shadow.write(msg);
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Set the buffer cursor to a coordinate
+        *
+        * @param row The row to set cursor to
+        * @param column The column to set cursor to
+        * @return Result of operation
+        */
+        mraa_result_t setCursor(int row, int column)
+        {
+            m_shadow.setCursor(row, column);
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Blank the buffer
+        *
+        * @return Result of operation
+        */
+        mraa_result_t clear()
+        {
+            m_shadow.clear();
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Return to coordinate 0,0
+        *
+        * @return Result of operation
+        */
+        mraa_result_t home()
+        {
+            m_shadow.home();
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Send the cells that changed since the last flush
+        *
+        * @return Result of operation
+        */
+        mraa_result_t flush()
+        {
+            static const uint8_t rowAddress[] = { 0x00, 0x40, 0x14, 0x54 };
+            int pos = 0, row, column, len;
+
+            /* a cursor move costs as much as a character, so only bridge one */
+            while (m_shadow.nextRun(pos, 1, &row, &column, &len)) {
+                std::vector<uint8_t> frame;
+                appendByte(frame, LCD_CMD | (rowAddress[row & 3] + column), 0);
+                for (int i = 0; i < len; i++) {
+                    appendByte(frame, m_shadow.cells(row)[column + i], LCD_RS);
+                }
+
+                mraa_i2c_address(m_i2c_lcd_control, m_lcd_control_address);
+                mraa_result_t error = mraa_i2c_write(m_i2c_lcd_control, &frame[0], frame.size());
+                if (error != MRAA_SUCCESS) {
+                    return error;
+                }
+                m_shadow.markShown(row, column, len);
+            }
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Redraw every cell on the next flush
+        */
+        void invalidate()
+        {
+            m_shadow.invalidate();
+        }
+
+    private:
+        static void appendNibble(std::vector<uint8_t> &frame, uint8_t value)
+        {
+            value |= LCD_BACKLIGHT;
+            frame.push_back(value);
+            frame.push_back(value | LCD_EN);
+            frame.push_back(value & ~LCD_EN);
+        }
+
+        static void appendByte(std::vector<uint8_t> &frame, uint8_t value, uint8_t mode)
+        {
+            appendNibble(frame, (value & 0xf0) | mode);
+            appendNibble(frame, ((value << 4) & 0xf0) | mode);
+        }
+
+        LcdShadowBuffer m_shadow;
+};
+
 }
@@ -26,6 +26,9 @@
 #include <string>
 #include <mraa/gpio.h>
 #include <mraa/aio.h>
+#include <stdio.h>
+
+#include "analogsampler.h"
 
 struct thresholdContext {
     long averageReading;
@@ -95,4 +98,136 @@ class Microphone {
         mraa_aio_context    m_micCtx;
 };
 
+/**
+ * @brief C++ API for a Microphone fed by an AnalogSampler
+ *
+ * Same threshold logic as Microphone, but the samples come from a shared
+ * background sampler, so consecutive windows overlap instead of being
+ * sampled again and several sensors share one sampling thread. The
+ * sampling period is the sampler's.
+ *
+ * @ingroup mic analog
+ */
+class MicrophoneStream {
+    public:
+        /**
+         * Instanciates a MicrophoneStream object
+         *
+         * @param sampler sampler reading the pin
+         * @param micPin pin where microphone is connected
+         */
+        MicrophoneStream (AnalogSampler &sampler, int micPin) :
+                m_sampler(sampler), m_channel(sampler.addChannel (micPin)) {}
+
+        /**
+         * Get the most recent samples, waiting only until the sampler has
+         * taken that many
+         *
+         * @param numberOfSamples number of samples in the window
+         * @param buffer bufer with sampled data
+         * @return number of samples copied
+         */
+        int getSampledWindow (unsigned int numberOfSamples, uint16_t * buffer) {
+            m_sampler.waitWindow (m_channel, numberOfSamples);
+            return m_sampler.latest (m_channel, buffer, numberOfSamples);
+        }
+
+        /**
+         * Update the threshold context with the most recent samples
+         *
+         * @param ctx threshold context
+         * @param threshold sample threshold
+         * @param len number of samples averaged into the reading
+         * @return running average if above threshold, 0 otherwise
+         */
+        int findThreshold (thresholdContext* ctx, unsigned int threshold, unsigned int len) {
+            blockStats stats;
+
+            m_sampler.waitWindow (m_channel, len);
+            m_sampler.stats (m_channel, len, &stats);
+            return update (ctx, threshold, &stats);
+        }
+
+        /**
+         * Given sampled buffer this method will return TRUE/FALSE if threshold
+         * was reached
+         *
+         * @param ctx threshold context
+         * @param threshold sample threshold
+         * @param buffer buffer with samples
+         * @param len bufer len
+         */
+        int findThreshold (thresholdContext* ctx, unsigned int threshold, uint16_t * buffer, unsigned int len) {
+            blockStats stats;
+
+            SampleBlock::reset (&stats);
+            SampleBlock::accumulate (buffer, len, &stats);
+            return update (ctx, threshold, &stats);
+        }
+
+        /**
+         * RMS of the most recent samples around their mean, in ADC units
+         *
+         * @param len number of samples
+         */
+        double rms (unsigned int len) {
+            blockStats stats;
+
+            m_sampler.waitWindow (m_channel, len);
+            m_sampler.stats (m_channel, len, &stats);
+            return SampleBlock::acRms (&stats);
+        }
+
+        /**
+         * Highest of the most recent samples
+         *
+         * @param len number of samples
+         */
+        uint16_t peak (unsigned int len) {
+            blockStats stats;
+
+            m_sampler.waitWindow (m_channel, len);
+            m_sampler.stats (m_channel, len, &stats);
+            return stats.max;
+        }
+
+        /**
+         * Number of times the most recent samples rise to the threshold
+         *
+         * @param len number of samples
+         * @param threshold sample threshold
+         */
+        unsigned int crossings (unsigned int len, uint16_t threshold) {
+            m_sampler.waitWindow (m_channel, len);
+            return m_sampler.crossings (m_channel, len, threshold);
+        }
+
+        /**
+         *
+         * Print running average of threshold context
+         *
+         * @param ctx threshold context
+         */
+        void printGraph (thresholdContext* ctx) {
+            std::string bar (ctx->runningAverage > 0 ? ctx->runningAverage : 0, '*');
+            printf ("(%ld) | %s\n", ctx->runningAverage, bar.c_str ());
+        }
+
+    private:
+        // ctx->averagedOver is the caller's smoothing factor, as for findThreshold
+        // of the unbuffered class; only the reading comes from the samples
+        int update (thresholdContext* ctx, unsigned int threshold, const blockStats *stats) {
+            if (stats->count == 0) {
+                return 0;
+            }
+            ctx->averageReading = stats->sum / stats->count;
+            ctx->runningAverage = (((ctx->averagedOver - 1) * ctx->runningAverage) +
+                                   ctx->averageReading) / ctx->averagedOver;
+            return ctx->runningAverage > (long) threshold ? ctx->runningAverage : 0;
+        }
+
+        AnalogSampler &     m_sampler;
+        int                 m_channel;
+};
+
 }
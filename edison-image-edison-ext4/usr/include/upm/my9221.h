@@ -27,6 +27,8 @@
 #include <mraa/aio.h>
 #include <mraa/gpio.h>
 
+#include "bitbang.h"
+
 #define MAX_BIT_PER_BLOCK     16
 #define CMDMODE               0x0000
 #define BIT_HIGH              0x00ff
@@ -89,4 +91,84 @@ class MY9221 {
         mraa_gpio_context m_dataPinCtx;
 };
 
+/**
+ * @brief MY9221 driven through the bit-bang engine
+ *
+ * Same LED bar protocol as MY9221, but the 208 data bits, each latched on
+ * a clock toggle, and the latch sequence are built as one frame of
+ * TwoWireBitBang and played in a single loop over memory mapped pins,
+ * without reading the clock pin back for every bit.
+ *
+ * @ingroup gpio
+ */
+class MY9221Batched {
+    public:
+        /**
+         * Instanciates a MY9221Batched object
+         *
+         * @param di data pin
+         * @param dcki clock pin
+         */
+        MY9221Batched (uint8_t di, uint8_t dcki) : m_wire(dcki, di), m_clock(LOW) {}
+
+        /**
+         * Set the level bar
+         *
+         * @param level selected level for the bar (1 - 10)
+         * @param direction up or down, true is up and is the default
+         */
+        mraa_result_t setBarLevel (uint8_t level, bool direction=true) {
+            if (level > 10) {
+                return MRAA_ERROR_INVALID_PARAMETER;
+            }
+
+            m_wire.clear ();
+            send16bitBlock (CMDMODE);
+            if (direction) {
+                level += 3;
+                for (uint8_t block_idx = 12; block_idx > 0; block_idx--) {
+                    send16bitBlock ((block_idx < level) ? BIT_HIGH : BIT_LOW);
+                }
+            } else {
+                for (uint8_t block_idx = 0; block_idx < 12; block_idx++) {
+                    send16bitBlock ((block_idx < level) ? BIT_HIGH : BIT_LOW);
+                }
+            }
+            lockData ();
+
+            return m_wire.emit ();
+        }
+
+        /**
+         * Duration of the last update, in nanoseconds
+         */
+        uint64_t frameTime () {
+            return m_wire.frameTime ();
+        }
+
+    private:
+        void send16bitBlock (uint16_t data) {
+            for (uint8_t bit_idx = 0; bit_idx < MAX_BIT_PER_BLOCK; bit_idx++, data <<= 1) {
+                m_wire.data ((data & 0x8000) ? HIGH : LOW);
+                m_clock = !m_clock;
+                m_wire.clock (m_clock);
+            }
+        }
+
+        /* data low for more than 220us, then four pulses latch the bits */
+        void lockData () {
+            m_wire.data (LOW);
+            m_wire.hold (220000);
+            for (int idx = 0; idx < 4; idx++) {
+                m_wire.data (HIGH);
+                m_wire.hold (100);
+                m_wire.data (LOW);
+                m_wire.hold (100);
+            }
+        }
+
+        TwoWireBitBang  m_wire;
+        int             m_clock;
+};
+
 }
@@ -29,6 +29,11 @@
 #include <mraa/gpio.h>
 #include <mraa/spi.h>
 #include <cstring>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 /* Memory Map */
 #define CONFIG              0x00
@@ -137,6 +142,11 @@ namespace upm {
 
 typedef void (* funcPtrVoidVoid) ();
 
+/**
+ * Handler for a batch of received payloads, laid out MAX_BUFFER bytes apart
+ */
+typedef void (* funcPtrPayloads) (const uint8_t * payloads, unsigned int count, void * arg);
+
 typedef enum {
     NRF_250KBPS = 0,
     NRF_1MBPS   = 1,
@@ -392,4 +402,503 @@ class NRF24L01 {
         std::string             m_name;
 };
 
+/**
+ * @brief Table-driven BLE packet coding for NRF24L01 beaconing
+ *
+ * Byte-wise equivalents of the bit loops behind NRF24L01 beaconing. The
+ * CRC-24 is computed in its bit-reflected form four bytes per step from
+ * slice-by-4 tables, the whitening sequence of every channel is
+ * precomputed for MAX_BUFFER bytes, and the bit reversal of the air
+ * format is a table lookup folded into the whitening, so encoding a
+ * packet is one pass over it. The bit-serial versions are kept as the
+ * reference the tables are checked against.
+ *
+ * @ingroup nrf24l01
+ */
+class NRF24L01BleCoder {
+    public:
+        /** Number of BLE channels with a precomputed whitening sequence */
+        static const uint8_t CHANNELS = 40;
+
+        /**
+         * Reverse the bit order of a byte
+         */
+        static uint8_t swapbits (uint8_t a) {
+            return tables ().reverse[a];
+        }
+
+        /**
+         * Compute the BLE CRC-24 of a buffer, like NRF24L01::bleCrc
+         *
+         * @param data buffer
+         * @param len buffer length
+         * @param dst 3 bytes holding the initial value, receives the CRC
+         */
+        static void crc (const uint8_t* data, uint8_t len, uint8_t* dst) {
+            const Tables &t = tables ();
+            uint32_t r = t.reverse[dst[0]] | (t.reverse[dst[1]] << 8) | (t.reverse[dst[2]] << 16);
+
+            r = crcUpdate (t, r, data, len);
+            dst[0] = t.reverse[r & 0xFF];
+            dst[1] = t.reverse[(r >> 8) & 0xFF];
+            dst[2] = t.reverse[r >> 16];
+        }
+
+        /**
+         * Whiten or de-whiten a buffer for a BLE channel
+         *
+         * @param data buffer
+         * @param len buffer length
+         * @param chan BLE channel (37, 38 and 39 for advertising)
+         */
+        static void whiten (uint8_t* data, uint8_t len, uint8_t chan) {
+            if (len > MAX_BUFFER || chan >= CHANNELS) {
+                whitenReference (data, len, swapbitsReference (chan) | 2);
+                return;
+            }
+            const uint8_t *seq = tables ().whitening[chan];
+            for (uint8_t i = 0; i < len; i++) {
+                data[i] ^= seq[i];
+            }
+        }
+
+        /**
+         * Encode a packet for the air, like NRF24L01::blePacketEncode
+         *
+         * @param packet packet whose last 3 bytes hold the initial CRC value
+         * @param len packet length, CRC included
+         * @param chan BLE channel
+         */
+        static void packetEncode (uint8_t* packet, uint8_t len, uint8_t chan) {
+            if (len < 3 || len > MAX_BUFFER || chan >= CHANNELS) {
+                packetEncodeReference (packet, len, chan);
+                return;
+            }
+            const Tables &t = tables ();
+            uint8_t dataLen = len - 3;
+            uint32_t r = t.reverse[packet[dataLen]] | (t.reverse[packet[dataLen + 1]] << 8) |
+                         (t.reverse[packet[dataLen + 2]] << 16);
+
+            r = crcUpdate (t, r, packet, dataLen);
+            packet[dataLen]     = r & 0xFF;
+            packet[dataLen + 1] = (r >> 8) & 0xFF;
+            packet[dataLen + 2] = r >> 16;
+            airFormat (t, packet, packet, len, t.whitening[chan]);
+        }
+
+        /**
+         * Encode one advertising PDU for channels 37, 38 and 39 at once.
+         * The CRC is the same on every channel, so it is computed once and
+         * only the whitening differs between the frames.
+         *
+         * @param pdu PDU without CRC
+         * @param len PDU length, at most MAX_BUFFER - 3
+         * @param frames receives the frame for each channel
+         * @return frame length, 0 if the PDU does not fit
+         */
+        static uint8_t encodeAdvertising (const uint8_t* pdu, uint8_t len, uint8_t frames[3][MAX_BUFFER]) {
+            if (len > MAX_BUFFER - 3) {
+                return 0;
+            }
+            const Tables &t = tables ();
+            uint8_t packet[MAX_BUFFER];
+            uint32_t r = crcUpdate (t, 0xAAAAAA, pdu, len); /* 0x555555 reflected */
+
+            memcpy (packet, pdu, len);
+            packet[len]     = r & 0xFF;
+            packet[len + 1] = (r >> 8) & 0xFF;
+            packet[len + 2] = r >> 16;
+            for (uint8_t i = 0; i < 3; i++) {
+                airFormat (t, packet, frames[i], len + 3, t.whitening[37 + i]);
+            }
+            return len + 3;
+        }
+
+        /**
+         * Bit-serial reference of swapbits()
+         */
+        static uint8_t swapbitsReference (uint8_t a) {
+            uint8_t v = 0;
+            for (uint8_t m = 0; m < 8; m++) {
+                if (a & (1 << m)) v |= 0x80 >> m;
+            }
+            return v;
+        }
+
+        /**
+         * Bit-serial reference of crc()
+         */
+        static void crcReference (const uint8_t* data, uint8_t len, uint8_t* dst) {
+            uint8_t v, t, d;
+
+            while (len--) {
+                d = *data++;
+                for (v = 0; v < 8; v++, d >>= 1) {
+                    t = dst[0] >> 7;
+                    dst[0] <<= 1;
+                    if (dst[1] & 0x80) dst[0] |= 1;
+                    dst[1] <<= 1;
+                    if (dst[2] & 0x80) dst[1] |= 1;
+                    dst[2] <<= 1;
+                    if (t != (d & 1)) {
+                        dst[2] ^= 0x5B;
+                        dst[1] ^= 0x06;
+                    }
+                }
+            }
+        }
+
+        /**
+         * Bit-serial reference of the whitening, seeded with a whitening
+         * coefficient rather than a channel
+         */
+        static void whitenReference (uint8_t* data, uint8_t len, uint8_t whitenCoeff) {
+            uint8_t m;
+
+            while (len--) {
+                for (m = 1; m; m <<= 1) {
+                    if (whitenCoeff & 0x80) {
+                        whitenCoeff ^= 0x11;
+                        (*data) ^= m;
+                    }
+                    whitenCoeff <<= 1;
+                }
+                data++;
+            }
+        }
+
+        /**
+         * Bit-serial reference of packetEncode()
+         */
+        static void packetEncodeReference (uint8_t* packet, uint8_t len, uint8_t chan) {
+            uint8_t i, dataLen = len - 3;
+
+            crcReference (packet, dataLen, packet + dataLen);
+            for (i = 0; i < 3; i++, dataLen++) {
+                packet[dataLen] = swapbitsReference (packet[dataLen]);
+            }
+            whitenReference (packet, len, swapbitsReference (chan) | 2);
+            for (i = 0; i < len; i++) {
+                packet[i] = swapbitsReference (packet[i]);
+            }
+        }
+
+    private:
+        class Tables {
+            public:
+                uint8_t  reverse[256];
+                uint32_t crc[4][256];
+                uint8_t  whitening[CHANNELS][MAX_BUFFER];
+
+                Tables () {
+                    for (int i = 0; i < 256; i++) {
+                        reverse[i] = swapbitsReference (i);
+
+                        uint32_t c = i;
+                        for (int b = 0; b < 8; b++) {
+                            c = (c & 1) ? (c >> 1) ^ 0xDA6000 : c >> 1; /* 0x00065B reflected */
+                        }
+                        crc[0][i] = c;
+                    }
+                    for (int k = 1; k < 4; k++) {
+                        for (int i = 0; i < 256; i++) {
+                            uint32_t c = crc[k - 1][i];
+                            crc[k][i] = (c >> 8) ^ crc[0][c & 0xFF];
+                        }
+                    }
+                    for (int chan = 0; chan < CHANNELS; chan++) {
+                        memset (whitening[chan], 0, MAX_BUFFER);
+                        whitenReference (whitening[chan], MAX_BUFFER, swapbitsReference (chan) | 2);
+                    }
+                }
+        };
+
+        static const Tables &tables () {
+            static const Tables t;
+            return t;
+        }
+
+        /* reflected CRC-24, r holds the register in its low 24 bits */
+        static uint32_t crcUpdate (const Tables &t, uint32_t r, const uint8_t* data, uint8_t len) {
+            for (; len >= 4; len -= 4, data += 4) {
+                r ^= data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+                r = t.crc[3][r & 0xFF] ^ t.crc[2][(r >> 8) & 0xFF] ^
+                    t.crc[1][(r >> 16) & 0xFF] ^ t.crc[0][r >> 24];
+            }
+            while (len--) {
+                r = (r >> 8) ^ t.crc[0][(r ^ *data++) & 0xFF];
+            }
+            return r;
+        }
+
+        /* packet bytes with the CRC stored reflected, to whitened on-air bytes */
+        static void airFormat (const Tables &t, const uint8_t* in, uint8_t* out, uint8_t len,
+                               const uint8_t* whitening) {
+            for (uint8_t i = 0; i < len; i++) {
+                out[i] = t.reverse[in[i] ^ whitening[i]];
+            }
+        }
+};
+
+/**
+ * @brief Interrupt-driven receive for NRF24L01
+ *
+ * Replaces calling pollListener() in a loop. The IRQ pin of the module is
+ * watched for falling edges, and on each interrupt the hardware RX FIFO
+ * is drained into a software ring, so bursts larger than the chip's three
+ * FIFO entries are not lost and no SPI traffic happens while idle. The
+ * ring has a single producer (the mraa interrupt thread) and a single
+ * consumer, and needs no lock; payloads are handed to the application in
+ * batches straight from the ring.
+ *
+ * While the receiver runs it owns the SPI bus of the radio, so transmit
+ * through send() rather than on the radio directly.
+ *
+ * @ingroup nrf24l01
+ */
+class NRF24L01Receiver {
+    public:
+        /**
+         * Instanciates a NRF24L01Receiver object
+         *
+         * @param radio configured radio
+         * @param irqPin gpio pin wired to the IRQ output of the module
+         * @param depth number of payloads buffered, rounded up to a power of two
+         */
+        NRF24L01Receiver (NRF24L01 &radio, int irqPin, unsigned int depth = 256) :
+                m_radio(radio), m_head(0), m_tail(0), m_received(0),
+                m_dropped(0), m_interrupts(0), m_running(false) {
+            unsigned int size = 1;
+            while (size < depth) {
+                size <<= 1;
+            }
+            m_mask = size - 1;
+            m_ring = new uint8_t[size * MAX_BUFFER];
+
+            pthread_mutex_init (&m_spiLock, NULL);
+            sem_init (&m_ready, 0, 0);
+
+            if ((m_irq = mraa_gpio_init (irqPin)) == NULL) {
+                fprintf (stderr, "Are you sure that pin%d you requested is valid on your platform?", irqPin);
+                return;
+            }
+            mraa_gpio_dir (m_irq, MRAA_GPIO_IN);
+        }
+
+        /**
+         * NRF24L01Receiver object destructor
+         */
+        ~NRF24L01Receiver () {
+            stop ();
+            if (m_irq != NULL) {
+                mraa_gpio_close (m_irq);
+            }
+            delete [] m_ring;
+            sem_destroy (&m_ready);
+            pthread_mutex_destroy (&m_spiLock);
+        }
+
+        /**
+         * Power up the receiver and start draining it on interrupts
+         *
+         * @return Result of operation
+         */
+        mraa_result_t start () {
+            if (m_irq == NULL) {
+                return MRAA_ERROR_INVALID_HANDLE;
+            }
+            if (m_running) {
+                return MRAA_SUCCESS;
+            }
+
+            pthread_mutex_lock (&m_spiLock);
+            m_radio.rxPowerUp ();
+            pthread_mutex_unlock (&m_spiLock);
+
+            mraa_result_t error = mraa_gpio_isr (m_irq, MRAA_GPIO_EDGE_FALLING, &NRF24L01Receiver::isr, this);
+            if (error == MRAA_SUCCESS) {
+                m_running = true;
+                /* the IRQ line may already be low with payloads waiting */
+                drain ();
+            }
+            return error;
+        }
+
+        /**
+         * Stop watching the IRQ pin and wake up any waiter
+         */
+        void stop () {
+            if (!m_running) {
+                return;
+            }
+            mraa_gpio_isr_exit (m_irq);
+            m_running = false;
+            sem_post (&m_ready);
+        }
+
+        /**
+         * Hand every buffered payload to a handler, in at most two batches,
+         * then release them
+         *
+         * @param handler called with consecutive payloads, MAX_BUFFER bytes apart
+         * @param arg passed to the handler
+         * @return number of payloads delivered
+         */
+        unsigned int dispatch (funcPtrPayloads handler, void * arg) {
+            unsigned int tail  = m_tail;
+            unsigned int count = __atomic_load_n (&m_head, __ATOMIC_ACQUIRE) - tail;
+
+            if (count == 0) {
+                return 0;
+            }
+            unsigned int first = m_mask + 1 - (tail & m_mask);
+            if (first > count) {
+                first = count;
+            }
+            handler (m_ring + (tail & m_mask) * MAX_BUFFER, first, arg);
+            if (count > first) {
+                handler (m_ring, count - first, arg);
+            }
+            __atomic_store_n (&m_tail, tail + count, __ATOMIC_RELEASE);
+
+            return count;
+        }
+
+        /**
+         * Copy out the oldest buffered payload
+         *
+         * @param data buffer of MAX_BUFFER bytes
+         * @return true if a payload was copied
+         */
+        bool getData (uint8_t * data) {
+            unsigned int tail = m_tail;
+
+            if (__atomic_load_n (&m_head, __ATOMIC_ACQUIRE) == tail) {
+                return false;
+            }
+            memcpy (data, m_ring + (tail & m_mask) * MAX_BUFFER, MAX_BUFFER);
+            __atomic_store_n (&m_tail, tail + 1, __ATOMIC_RELEASE);
+
+            return true;
+        }
+
+        /**
+         * Sleep until payloads are buffered
+         *
+         * @param timeoutMs how long to wait, negative waits forever
+         * @return true if payloads are buffered, false on timeout or stop
+         */
+        bool waitData (int timeoutMs) {
+            struct timespec deadline;
+
+            if (timeoutMs >= 0) {
+                clock_gettime (CLOCK_REALTIME, &deadline);
+                deadline.tv_sec  += timeoutMs / 1000;
+                deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+                if (deadline.tv_nsec >= 1000000000L) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+            }
+
+            while (available () == 0 && m_running) {
+                int error = timeoutMs < 0 ? sem_wait (&m_ready) : sem_timedwait (&m_ready, &deadline);
+                if (error != 0 && errno == ETIMEDOUT) {
+                    break;
+                }
+            }
+            return available () != 0;
+        }
+
+        /**
+         * Send a payload, serialized with the interrupt handler; the radio
+         * is back in receive mode when this returns
+         *
+         * @param value pointer to the buffer
+         */
+        void send (uint8_t * value) {
+            pthread_mutex_lock (&m_spiLock);
+            m_radio.send (value);
+            pthread_mutex_unlock (&m_spiLock);
+            /* a payload may have come in while the IRQ line was held by TX_DS */
+            drain ();
+        }
+
+        /**
+         * Number of buffered payloads
+         */
+        unsigned int available () {
+            return __atomic_load_n (&m_head, __ATOMIC_ACQUIRE) - m_tail;
+        }
+
+        /**
+         * Number of payloads read from the radio so far
+         */
+        uint64_t received () {
+            return m_received;
+        }
+
+        /**
+         * Number of payloads dropped because the ring was full
+         */
+        unsigned int dropped () {
+            return m_dropped;
+        }
+
+        /**
+         * Number of interrupts handled
+         */
+        unsigned int interrupts () {
+            return m_interrupts;
+        }
+
+    private:
+        static void isr (void *ctx) {
+            NRF24L01Receiver *This = (NRF24L01Receiver *) ctx;
+
+            This->m_interrupts++;
+            This->drain ();
+        }
+
+        /* read out the RX FIFO of the chip */
+        void drain () {
+            uint8_t scratch[MAX_BUFFER];
+            unsigned int count = 0;
+
+            pthread_mutex_lock (&m_spiLock);
+            while (m_radio.dataReady ()) {
+                unsigned int head = m_head;
+                if (head - __atomic_load_n (&m_tail, __ATOMIC_ACQUIRE) > m_mask) {
+                    m_radio.getData (scratch);
+                    m_dropped++;
+                } else {
+                    m_radio.getData (m_ring + (head & m_mask) * MAX_BUFFER);
+                    __atomic_store_n (&m_head, head + 1, __ATOMIC_RELEASE);
+                }
+                count++;
+            }
+            m_received += count;
+            pthread_mutex_unlock (&m_spiLock);
+
+            if (count) {
+                sem_post (&m_ready);
+            }
+        }
+
+        NRF24L01 &          m_radio;
+        mraa_gpio_context   m_irq;
+        pthread_mutex_t     m_spiLock;
+        sem_t               m_ready;
+
+        uint8_t *           m_ring;
+        unsigned int        m_mask;
+        unsigned int        m_head;
+        unsigned int        m_tail;
+
+        volatile uint64_t       m_received;
+        volatile unsigned int   m_dropped;
+        volatile unsigned int   m_interrupts;
+        volatile bool           m_running;
+};
+
 }
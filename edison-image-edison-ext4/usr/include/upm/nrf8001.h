@@ -27,9 +27,277 @@
 #include <mraa/aio.h>
 #include <mraa/gpio.h>
 #include <mraa/spi.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include <lib_aci.h>
 #include <aci_setup.h>
+#include <aci_ring.h>
 
 void init_local_interfaces (aci_state_t* aci, uint8_t reqn, uint8_t rdyn, uint8_t rst);
 void close_local_interfaces (aci_state_t* aci);
+
+namespace upm {
+
+/**
+ * @brief Background ACI event pump for nRF8001
+ *
+ * Runs lib_aci_event_get() on its own thread and moves the events into an
+ * aci_ring_t sized at runtime, so notification bursts do not back up in
+ * the 4-entry queue of the transport layer and the application can sleep
+ * in getEvent() instead of polling. The thread is woken by falling edges
+ * of RDYN, which the nRF8001 pulls low whenever it has an event or is
+ * ready for a command, and falls back to polling every pollMs if the edge
+ * interrupt cannot be set up. When the ring is full the pump stops
+ * reading, leaving the nRF8001 to hold its events, so none are dropped.
+ *
+ * The ACI library is not thread safe: once the pump runs, surround every
+ * lib_aci_* call of the application with lock() and unlock(). unlock()
+ * also wakes the pump to send the queued command.
+ *
+ * @ingroup nrf8001
+ */
+class NRF8001EventPump {
+    public:
+        /**
+         * Instanciates a NRF8001EventPump object
+         *
+         * @param aci state set up by init_local_interfaces()
+         * @param depth number of events buffered, rounded up to a power of two;
+         *        start() fails if it is over ACI_RING_MAX_SIZE
+         * @param pollMs longest sleep between two reads of the event queue
+         */
+        NRF8001EventPump (aci_state_t* aci, uint32_t depth = 64, int pollMs = 100) :
+                m_aci(aci), m_pollMs(pollMs), m_events(0), m_wakeups(0), m_running(false), m_edge(false) {
+            pthread_condattr_t attr;
+
+            pthread_mutex_init (&m_aciLock, NULL);
+            pthread_mutex_init (&m_lock, NULL);
+            pthread_condattr_init (&attr);
+            pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+            pthread_cond_init (&m_cond, &attr);
+            pthread_condattr_destroy (&attr);
+            sem_init (&m_wake, 0, 0);
+
+            aci_ring_init (&m_ring, depth);
+
+            if ((m_rdyn = mraa_gpio_init (aci->aci_pins.rdyn_pin)) != NULL) {
+                mraa_gpio_dir (m_rdyn, MRAA_GPIO_IN);
+            }
+        }
+
+        /**
+         * NRF8001EventPump object destructor
+         */
+        ~NRF8001EventPump () {
+            stop ();
+            if (m_rdyn != NULL) {
+                mraa_gpio_close (m_rdyn);
+            }
+            aci_ring_free (&m_ring);
+            sem_destroy (&m_wake);
+            pthread_cond_destroy (&m_cond);
+            pthread_mutex_destroy (&m_lock);
+            pthread_mutex_destroy (&m_aciLock);
+        }
+
+        /**
+         * Start the pump thread
+         *
+         * @return Result of operation
+         */
+        mraa_result_t start () {
+            if (m_ring.aci_data == NULL) {
+                return MRAA_ERROR_NO_RESOURCES;
+            }
+            if (__atomic_load_n (&m_running, __ATOMIC_ACQUIRE)) {
+                return MRAA_SUCCESS;
+            }
+            __atomic_store_n (&m_running, true, __ATOMIC_RELEASE);
+            if (pthread_create (&m_thread, NULL, &NRF8001EventPump::run, this) != 0) {
+                __atomic_store_n (&m_running, false, __ATOMIC_RELEASE);
+                return MRAA_ERROR_NO_RESOURCES;
+            }
+            if (m_rdyn != NULL) {
+                m_edge = (mraa_gpio_isr (m_rdyn, MRAA_GPIO_EDGE_FALLING, &NRF8001EventPump::isr, this) == MRAA_SUCCESS);
+            }
+            return MRAA_SUCCESS;
+        }
+
+        /**
+         * Stop the pump thread and wake up any waiter
+         */
+        void stop () {
+            if (!__atomic_load_n (&m_running, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+            if (m_edge) {
+                mraa_gpio_isr_exit (m_rdyn);
+                m_edge = false;
+            }
+            pthread_mutex_lock (&m_lock);
+            __atomic_store_n (&m_running, false, __ATOMIC_RELEASE);
+            pthread_cond_broadcast (&m_cond);
+            pthread_mutex_unlock (&m_lock);
+            sem_post (&m_wake);
+            pthread_join (m_thread, NULL);
+        }
+
+        /**
+         * Take the oldest event, sleeping until one arrives
+         *
+         * @param event filled in with the event
+         * @param timeoutMs how long to wait, negative waits forever
+         * @return true if an event was returned, false on timeout or stop
+         */
+        bool getEvent (hal_aci_evt_t* event, int timeoutMs) {
+            struct timespec deadline;
+
+            if (take (event)) {
+                return true;
+            }
+            if (timeoutMs >= 0) {
+                clock_gettime (CLOCK_MONOTONIC, &deadline);
+                deadline.tv_sec  += timeoutMs / 1000;
+                deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+                if (deadline.tv_nsec >= 1000000000L) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+            }
+
+            pthread_mutex_lock (&m_lock);
+            while (aci_ring_is_empty (&m_ring) && __atomic_load_n (&m_running, __ATOMIC_ACQUIRE)) {
+                if (timeoutMs < 0) {
+                    pthread_cond_wait (&m_cond, &m_lock);
+                } else if (pthread_cond_timedwait (&m_cond, &m_lock, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+            pthread_mutex_unlock (&m_lock);
+
+            return take (event);
+        }
+
+        /**
+         * Take the ACI library for a lib_aci_* call
+         */
+        void lock () {
+            pthread_mutex_lock (&m_aciLock);
+        }
+
+        /**
+         * Release the ACI library and let the pump send queued commands
+         */
+        void unlock () {
+            pthread_mutex_unlock (&m_aciLock);
+            sem_post (&m_wake);
+        }
+
+        /**
+         * Number of events read from the nRF8001 so far
+         */
+        uint32_t events () {
+            return __atomic_load_n (&m_events, __ATOMIC_RELAXED);
+        }
+
+        /**
+         * Number of times the pump thread woke up
+         */
+        uint32_t wakeups () {
+            return __atomic_load_n (&m_wakeups, __ATOMIC_RELAXED);
+        }
+
+        /**
+         * Whether the pump is woken by RDYN edges rather than polling
+         */
+        bool edgeDriven () {
+            return m_edge;
+        }
+
+    private:
+        bool take (hal_aci_evt_t* event) {
+            uint32_t count = aci_ring_count (&m_ring);
+
+            if (!aci_ring_dequeue (&m_ring, (hal_aci_data_t *) event)) {
+                return false;
+            }
+            if (count > m_ring.mask) {
+                /* the pump stopped reading on a full ring */
+                sem_post (&m_wake);
+            }
+            return true;
+        }
+
+        static void isr (void *ctx) {
+            sem_post (&((NRF8001EventPump *) ctx)->m_wake);
+        }
+
+        static void *run (void *ctx) {
+            NRF8001EventPump *This = (NRF8001EventPump *) ctx;
+            hal_aci_evt_t event;
+
+            while (__atomic_load_n (&This->m_running, __ATOMIC_ACQUIRE)) {
+                uint32_t count = 0;
+
+                pthread_mutex_lock (&This->m_aciLock);
+                while (!aci_ring_is_full (&This->m_ring) &&
+                       lib_aci_event_get (This->m_aci, &event)) {
+                    aci_ring_enqueue (&This->m_ring, (hal_aci_data_t *) &event);
+                    count++;
+                }
+                pthread_mutex_unlock (&This->m_aciLock);
+
+                if (count) {
+                    __atomic_add_fetch (&This->m_events, count, __ATOMIC_RELAXED);
+                    pthread_mutex_lock (&This->m_lock);
+                    pthread_cond_broadcast (&This->m_cond);
+                    pthread_mutex_unlock (&This->m_lock);
+                }
+
+                This->sleep ();
+                __atomic_add_fetch (&This->m_wakeups, 1, __ATOMIC_RELAXED);
+            }
+            return NULL;
+        }
+
+        /* until RDYN falls, a command is queued, an event is taken or pollMs */
+        void sleep () {
+            struct timespec deadline;
+
+            clock_gettime (CLOCK_REALTIME, &deadline);
+            deadline.tv_sec  += m_pollMs / 1000;
+            deadline.tv_nsec += (long) (m_pollMs % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            if (sem_timedwait (&m_wake, &deadline) == 0) {
+                /* one pass serves every wake-up posted so far */
+                while (sem_trywait (&m_wake) == 0) {
+                }
+            }
+        }
+
+        aci_state_t*        m_aci;
+        aci_ring_t          m_ring;
+        mraa_gpio_context   m_rdyn;
+        int                 m_pollMs;
+
+        pthread_t           m_thread;
+        pthread_mutex_t     m_aciLock;
+        pthread_mutex_t     m_lock;
+        pthread_cond_t      m_cond;
+        sem_t               m_wake;
+
+        /* shared with the pump thread, accessed with __atomic builtins */
+        uint32_t            m_events;
+        uint32_t            m_wakeups;
+        bool                m_running;
+        bool                m_edge;
+};
+
+}
@@ -24,8 +24,14 @@
 #pragma once
 
 #include <string>
+#include <math.h>
 #include <time.h>
+#include <pthread.h>
 #include <mraa/aio.h>
+#include "edgecapture.h"
+
+#define PPD42NS_SAMPLE_TIME    30000
+#define PPD42NS_FILTER_ALPHA   0.3
 
 namespace upm {
 
@@ -74,6 +80,204 @@ typedef struct
 		double pulseIn_polyfill(bool highLowValue, double endTime);
 		double m_timediff(timespec time1, timespec time2);
 	};
-}
 
+  /**
+   * @brief C++ API for the Dust Sensor using timestamped edge capture
+   *
+   * Low pulse occupancy is summed from the timestamps of the falling and
+   * rising edges seen during the sample window, and the caller sleeps in
+   * between, so a 30 second sample no longer keeps a core busy. A
+   * continuous mode samples back to back windows from a background thread
+   * and publishes exponentially smoothed readings.
+   *
+   * @ingroup gpio
+   */
+  class PPD42NSCapture {
+  public:
+    /**
+     * Dust Sensor Constructor
+     *
+     * @param pin digital pin to use
+     */
+    PPD42NSCapture(int pin) :
+        m_pin(pin), m_haveFiltered(false), m_lastCpu(0),
+        m_continuous(false), m_fptr(NULL), m_args(NULL) {
+      pthread_mutex_init(&m_measureLock, NULL);
+      m_filtered.lowPulseOccupancy = 0;
+      m_filtered.ratio = 0;
+      m_filtered.concentration = 0;
+      m_pin.start(MRAA_GPIO_EDGE_BOTH);
+    }
+
+    /**
+     * Dust Sensor Destructor
+     */
+    ~PPD42NSCapture() {
+      stopContinuous();
+      m_pin.stop();
+      pthread_mutex_destroy(&m_measureLock);
+    }
+
+    /**
+     * Sample the sensor for one window, sleeping between edges
+     *
+     * @param windowMs length of the sample window, the datasheet
+     * recommends 30 seconds
+     * @return struct dustData  contains data from dust sensor
+     */
+    dustData getData(unsigned int windowMs = PPD42NS_SAMPLE_TIME) {
+      dustData data = { 0, 0, 0 };
+
+      if (m_pin.gpio() == NULL) {
+        return data;
+      }
+
+      pthread_mutex_lock(&m_measureLock);
+      uint64_t cpuStart = EdgeCapture::threadCpuTime();
+      uint64_t isrStart = m_pin.isrCpuTime();
+      uint64_t start    = EdgeCapture::now();
+      uint64_t end      = start + (uint64_t) windowMs * 1000000ULL;
+      uint64_t low      = 0;
+      uint64_t lowStart = 0;
+      edgeEvent edge;
+
+      m_pin.flush();
+      if (mraa_gpio_read(m_pin.gpio()) == 0) {
+        lowStart = start;
+      }
+
+      for (;;) {
+        uint64_t now = EdgeCapture::now();
+        if (now >= end ||
+            !m_pin.waitEdge(&edge, (int) ((end - now) / 1000000ULL) + 1)) {
+          break;
+        }
+        if (edge.timestamp >= end) {
+          break;
+        }
+        if (edge.level == 0) {
+          if (lowStart == 0) {
+            lowStart = edge.timestamp;
+          }
+        } else if (lowStart != 0) {
+          low += edge.timestamp - lowStart;
+          lowStart = 0;
+        }
+      }
+      if (lowStart != 0) {
+        low += end - lowStart;
+      }
 
+      data.lowPulseOccupancy = (int) (low / 1000ULL);
+      data.ratio = data.lowPulseOccupancy / (windowMs * 10.0);
+      data.concentration = 1.1 * pow(data.ratio, 3) - 3.8 * pow(data.ratio, 2) +
+                           520 * data.ratio + 0.62;
+
+      if (m_haveFiltered) {
+        m_filtered.lowPulseOccupancy = data.lowPulseOccupancy;
+        m_filtered.ratio += PPD42NS_FILTER_ALPHA * (data.ratio - m_filtered.ratio);
+        m_filtered.concentration += PPD42NS_FILTER_ALPHA *
+                                    (data.concentration - m_filtered.concentration);
+      } else {
+        m_filtered = data;
+        m_haveFiltered = true;
+      }
+
+      m_lastCpu = (EdgeCapture::threadCpuTime() - cpuStart) +
+                  (m_pin.isrCpuTime() - isrStart);
+      pthread_mutex_unlock(&m_measureLock);
+
+      return data;
+    }
+
+    /**
+     * Exponentially smoothed ratio and concentration of all windows
+     * sampled so far
+     *
+     * @return struct dustData  lowPulseOccupancy is from the last window
+     */
+    dustData getFilteredData() {
+      pthread_mutex_lock(&m_measureLock);
+      dustData filtered = m_filtered;
+      pthread_mutex_unlock(&m_measureLock);
+      return filtered;
+    }
+
+    /**
+     * Start sampling back to back windows from a background thread
+     *
+     * @param windowMs length of each sample window
+     * @param fptr called with the filtered data after each window and
+     * args, may be NULL to only update getFilteredData()
+     * @param args argument passed to fptr
+     * @return Result of operation
+     */
+    mraa_result_t startContinuous(unsigned int windowMs,
+                                  void (*fptr)(dustData, void *), void *args) {
+      if (m_pin.gpio() == NULL) {
+        return MRAA_ERROR_INVALID_HANDLE;
+      }
+      if (m_continuous) {
+        return MRAA_ERROR_INVALID_RESOURCE;
+      }
+
+      m_windowMs   = windowMs;
+      m_fptr       = fptr;
+      m_args       = args;
+      m_continuous = true;
+      if (pthread_create(&m_thread, NULL, &PPD42NSCapture::continuousLoop, this) != 0) {
+        m_continuous = false;
+        return MRAA_ERROR_NO_RESOURCES;
+      }
+      return MRAA_SUCCESS;
+    }
+
+    /**
+     * Stop the background sampling thread, waits for the current window
+     * to end
+     */
+    void stopContinuous() {
+      if (!m_continuous) {
+        return;
+      }
+      m_continuous = false;
+      pthread_join(m_thread, NULL);
+    }
+
+    /**
+     * CPU time spent on the last window by the calling thread and the
+     * interrupt thread together
+     *
+     * @return CPU time in microseconds
+     */
+    double getCpuTimePerReading() {
+      return (double) m_lastCpu / 1000.0;
+    }
+
+  private:
+    static void * continuousLoop(void *ctx) {
+      PPD42NSCapture *This = (PPD42NSCapture *) ctx;
+
+      while (This->m_continuous) {
+        This->getData(This->m_windowMs);
+        if (This->m_fptr != NULL) {
+          This->m_fptr(This->getFilteredData(), This->m_args);
+        }
+      }
+      return NULL;
+    }
+
+    EdgeCapture m_pin;
+    pthread_mutex_t m_measureLock;
+
+    dustData m_filtered;
+    bool m_haveFiltered;
+    uint64_t m_lastCpu;
+
+    pthread_t m_thread;
+    volatile bool m_continuous;
+    unsigned int m_windowMs;
+    void (*m_fptr)(dustData, void *);
+    void *m_args;
+  };
+}
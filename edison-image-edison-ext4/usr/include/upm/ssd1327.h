@@ -113,4 +113,144 @@ class SSD1327 : public I2CLcd {
         uint8_t grayHigh;
         uint8_t grayLow;
     };
+
+/**
+ * @brief SSD1327 drawing text into a shadow buffer
+ *
+ * write(), setCursor(), clear() and home() only change an in-memory copy
+ * of the 12x12 character grid; flush() then renders the changed cells.
+ * Each run of changed cells costs one i2c write setting vertical
+ * addressing and a column/row window over the run, and one write carrying
+ * the 32 pixel bytes of every character in it, instead of one transaction
+ * per pixel byte. Use invalidate() after draw() or anything else that
+ * changes the display behind the buffer.
+ *
+ * @ingroup i2clcd i2c
+ */
+class SSD1327Buffered : public SSD1327 {
+    public:
+        using I2CLcd::write;
+
+       /**
+        * SSD1327Buffered constructor
+        *
+        * @param bus i2c bus to use
+        * @param address the slave address the lcd is registered on
+        */
+        SSD1327Buffered (int bus, int address=0x3C) :
+            SSD1327 (bus, address), m_shadow (12, 12), m_gray (12) {}
+       /**
+        * Set gray level of the text, redrawn on the next flush
+        *
+        * @param gray level from 0-255
+        * @return Result of operation
+        */
+        mraa_result_t setGrayLevel (uint8_t level) {
+            m_gray = level;
+            m_shadow.invalidate ();
+            return SSD1327::setGrayLevel (level);
+        }
+       /**
+        * Write a string to the buffer
+        *
+        * @param msg The std::string to write, clipped at the end of the row
+        * @return Result of operation
+        */
+        mraa_result_t write (std::string msg) {
+            m_shadow.write (msg);
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Set the buffer cursor to a coordinate
+        *
+        * @param row The row to set cursor to
+        * @param column The column to set cursor to
+        * @return Result of operation
+        */
+        mraa_result_t setCursor (int row, int column) {
+            m_shadow.setCursor (row, column);
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Blank the buffer
+        *
+        * @return Result of operation
+        */
+        mraa_result_t clear () {
+            m_shadow.clear ();
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Return to coordinate 0,0
+        *
+        * @return Result of operation
+        */
+        mraa_result_t home () {
+            m_shadow.home ();
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Render the cells that changed since the last flush
+        *
+        * @return Result of operation
+        */
+        mraa_result_t flush () {
+            int pos = 0, row, column, len;
+
+            while (m_shadow.nextRun (pos, 0, &row, &column, &len)) {
+                uint8_t window[] = {
+                    0x00,                                   /* command stream */
+                    0xA0, 0x46,                             /* vertical addressing */
+                    0x15, (uint8_t) (0x08 + column * 4),    /* columns of the run */
+                    (uint8_t) (0x08 + (column + len) * 4 - 1),
+                    0x75, (uint8_t) (row * 8),              /* rows of the text line */
+                    (uint8_t) (row * 8 + 7)
+                };
+                std::vector<uint8_t> pixels (1, 0x40);      /* data stream */
+                for (int i = 0; i < len; i++) {
+                    appendChar (pixels, m_shadow.cells (row)[column + i]);
+                }
+
+                mraa_i2c_address (m_i2c_lcd_control, m_lcd_control_address);
+                mraa_result_t error = mraa_i2c_write (m_i2c_lcd_control, window, sizeof (window));
+                if (error == MRAA_SUCCESS) {
+                    error = mraa_i2c_write (m_i2c_lcd_control, &pixels[0], pixels.size ());
+                }
+                if (error != MRAA_SUCCESS) {
+                    return error;
+                }
+                m_shadow.markShown (row, column, len);
+            }
+            return MRAA_SUCCESS;
+        }
+       /**
+        * Redraw every cell on the next flush
+        */
+        void invalidate () {
+            m_shadow.invalidate ();
+        }
+
+    private:
+        /* same pixel layout as SSD1327::writeChar, two pixels per byte */
+        void appendChar (std::vector<uint8_t> &pixels, uint8_t value) {
+            uint8_t high = (m_gray << 4) & 0xF0;
+            uint8_t low  = m_gray & 0x0F;
+
+            if (value < 0x20 || value > 0x7F) {
+                value = 0x20;
+            }
+            for (uint8_t row = 0; row < 8; row += 2) {
+                for (uint8_t col = 0; col < 8; col++) {
+                    uint8_t data = 0x00;
+                    data |= ((BasicFont[value - 32][row] >> col) & 0x1) ? high : 0x00;
+                    data |= ((BasicFont[value - 32][row + 1] >> col) & 0x1) ? low : 0x00;
+                    pixels.push_back (data);
+                }
+            }
+        }
+
+        LcdShadowBuffer m_shadow;
+        uint8_t         m_gray;
+};
+
 }
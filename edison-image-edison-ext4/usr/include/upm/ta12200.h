@@ -29,6 +29,8 @@
 #include <sys/time.h>
 #include <mraa/aio.h>
 
+#include "analogsampler.h"
+
 // default ADC resolution. 
 #define TA12200_ADC_RES 1024
 
@@ -94,6 +96,61 @@ namespace upm {
     struct timeval m_startTime;
     mraa_aio_context m_aio;
   };
-}
 
+  /**
+   * @brief TA12-200 current transformer fed by an AnalogSampler
+   *
+   * Finds the peak in the history of a shared background sampler instead
+   * of busy-reading the ADC for a second, so highestValue() returns at
+   * once when the sampler already holds the window.
+   *
+   * @ingroup analog
+   */
+  class TA12200Stream {
+  public:
+    /**
+     * TA12200 sensor constructor
+     *
+     * @param sampler sampler reading the pin; its depth bounds the window
+     * @param pin analog pin to use
+     */
+    TA12200Stream(AnalogSampler &sampler, int pin) :
+      m_sampler(sampler), m_channel(sampler.addChannel(pin)) {}
 
+    /**
+     * Get the conversion value from the sensor
+     *
+     * @param windowMs length of the window to search, in milliseconds
+     * @return the highest value over the most recent window
+     */
+    unsigned int highestValue(unsigned int windowMs=1000)
+    {
+      blockStats stats;
+      unsigned int len = (unsigned int) ((uint64_t) windowMs * 1000 / m_sampler.periodUs());
+
+      if (len == 0)
+        len = 1;
+      m_sampler.waitWindow(m_channel, len);
+      m_sampler.stats(m_channel, len, &stats);
+      return stats.count ? stats.max : 0;
+    }
+
+    /**
+     * Compute the measured voltage
+     *
+     * @param val value measured by highestValue()
+     * @param res ADC resolution
+     *
+     * @return the measured current in milliamps
+     */
+    float milliAmps(unsigned int val, int res=TA12200_ADC_RES)
+    {
+      float ampCurrent = ((float)val / (float)res * 5.0) / 800.0 * 2000000.0;
+      return ampCurrent / 1.414;
+    }
+
+  private:
+    AnalogSampler &m_sampler;
+    int m_channel;
+  };
+}
@@ -27,6 +27,8 @@
 #include <mraa/aio.h>
 #include <mraa/gpio.h>
 
+#include "bitbang.h"
+
 #define SEG_A               0b00000001
 #define SEG_B               0b00000010
 #define SEG_C               0b00000100
@@ -128,4 +130,137 @@ class TM1637 {
         uint8_t m_brightness;
 };
 
+/**
+ * @brief TM1637 driven through the bit-bang engine
+ *
+ * Same display protocol as TM1637, but every update is built as one frame
+ * of TwoWireBitBang and played in a single timed loop over memory mapped
+ * pins, instead of a gpio call and a sleep per edge. As in TM1637, the data
+ * pin is switched to input for the acknowledge clock so the chip can pull
+ * it low; the acknowledge itself is not read.
+ *
+ * @ingroup gpio
+ */
+class TM1637Batched {
+    public:
+        /**
+         * Instanciates a TM1637Batched object
+         *
+         * @param di data pin
+         * @param dcki clock pin
+         * @param halfPeriodNs time each clock level is held
+         */
+        TM1637Batched (uint8_t di, uint8_t dcki, uint32_t halfPeriodNs = 5000) :
+                m_wire(dcki, di), m_halfPeriodNs(halfPeriodNs), m_brightness(0x0f) {}
+
+        /**
+         * Set the brightness of the seven segment display
+         *
+         * @param level The brightness level of leds
+         */
+        mraa_result_t setBrightness (uint8_t level) {
+            m_brightness = (level & 0x07) | 0x08;
+            return MRAA_SUCCESS;
+        }
+
+        /**
+         * Set the the segment screen data and number of segments
+         *
+         * @param segments data to write on the segments, each elemnt
+         * in array is segment
+         * @param length number of elements in segments array
+         * @param pos data writing offset
+         */
+        mraa_result_t setSegments (const uint8_t segments[], uint8_t length = 4, uint8_t pos = 0) {
+            m_wire.clear ();
+            start ();
+            writeByte (TM1637_I2C_COMM1);
+            stop ();
+
+            start ();
+            writeByte (TM1637_I2C_COMM2 + (pos & 0x03));
+            for (uint8_t idx = 0; idx < length; idx++) {
+                writeByte (segments[idx]);
+            }
+            stop ();
+
+            start ();
+            writeByte (TM1637_I2C_COMM3 + (m_brightness & 0x0f));
+            stop ();
+
+            return m_wire.emit ();
+        }
+
+        /**
+         * Write up to four hexadecimal digits, other characters are blank
+         *
+         * @param msg The message to be written on the sreen
+         */
+        mraa_result_t write (std::string msg) {
+            static const uint8_t digits[] = {
+                0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07,
+                0x7f, 0x6f, 0x77, 0x7c, 0x39, 0x5e, 0x79, 0x71
+            };
+            uint8_t data[] = { 0x0, 0x0, 0x0, 0x0 };
+
+            for (std::string::size_type idx = 0; idx < msg.length () && idx < 4; idx++) {
+                char c = msg[idx];
+                if (c >= '0' && c <= '9') {
+                    data[idx] = digits[c - '0'];
+                } else if (c >= 'a' && c <= 'f') {
+                    data[idx] = digits[c - 'a' + 10];
+                } else if (c >= 'A' && c <= 'F') {
+                    data[idx] = digits[c - 'A' + 10];
+                }
+            }
+            return setSegments (data);
+        }
+
+        /**
+         * Duration of the last update, in nanoseconds
+         */
+        uint64_t frameTime () {
+            return m_wire.frameTime ();
+        }
+
+    private:
+        void start () {
+            m_wire.data (HIGH);
+            m_wire.clock (HIGH);
+            m_wire.hold (m_halfPeriodNs);
+            m_wire.data (LOW);
+            m_wire.hold (m_halfPeriodNs);
+        }
+
+        void stop () {
+            m_wire.clock (LOW);
+            m_wire.data (LOW);
+            m_wire.hold (m_halfPeriodNs);
+            m_wire.clock (HIGH);
+            m_wire.hold (m_halfPeriodNs);
+            m_wire.data (HIGH);
+            m_wire.hold (m_halfPeriodNs);
+        }
+
+        void writeByte (uint8_t value) {
+            for (uint8_t idx = 0; idx < 8; idx++, value >>= 1) {
+                m_wire.clock (LOW);
+                m_wire.data (value & 0x01);
+                m_wire.hold (m_halfPeriodNs);
+                m_wire.clock (HIGH);
+                m_wire.hold (m_halfPeriodNs);
+            }
+            /* acknowledge clock, the chip drives the data pin */
+            m_wire.clock (LOW);
+            m_wire.releaseData ();
+            m_wire.hold (m_halfPeriodNs);
+            m_wire.clock (HIGH);
+            m_wire.hold (m_halfPeriodNs);
+        }
+
+        TwoWireBitBang  m_wire;
+        uint32_t        m_halfPeriodNs;
+        uint8_t         m_brightness;
+};
+
 }
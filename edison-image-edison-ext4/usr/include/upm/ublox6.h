@@ -28,6 +28,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <math.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
@@ -37,6 +38,7 @@
 #include <sys/select.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 
 #include <mraa/uart.h>
 
@@ -111,6 +113,559 @@ namespace upm {
     mraa_uart_context m_uart;
     int m_ttyFd;
   };
-}
 
+  /**
+   * @struct ublox6Fix
+   * @brief Latest navigation solution decoded from the receiver
+   */
+  typedef struct {
+    bool     valid;      /**< Receiver reports a position fix */
+    uint8_t  quality;    /**< GGA fix quality, 0 none, 1 GPS, 2 DGPS */
+    uint8_t  satellites; /**< Satellites used in the solution */
+    float    hdop;       /**< Horizontal dilution of precision */
+    double   latitude;   /**< Degrees, north positive */
+    double   longitude;  /**< Degrees, east positive */
+    float    altitude;   /**< Meters above mean sea level */
+    float    speed;      /**< Ground speed in m/s */
+    float    course;     /**< Degrees from true north */
+    uint32_t timeMs;     /**< UTC time of day in milliseconds */
+    uint32_t date;       /**< UTC date as ddmmyy */
+    uint32_t updates;    /**< Sentences and frames merged so far */
+  } ublox6Fix;
+
+  /**
+   * @brief Incremental NMEA and UBX parser for the U-BLOX 6
+   *
+   * Bytes are received straight into a fixed buffer owned by the parser
+   * (see buffer() and parse()), and sentences and frames are decoded in
+   * place: fields are read where they lie, with no strtok, no copies and
+   * no allocation. Only the tail of an incomplete sentence is moved to
+   * the front of the buffer. NMEA checksums and UBX Fletcher checksums
+   * are checked; GGA, RMC and VTG sentences and the NAV-POSLLH, NAV-SOL,
+   * NAV-VELNED and NAV-TIMEUTC frames are merged into a fix that other
+   * threads read under a lock with getFix().
+   *
+   * @ingroup uart
+   */
+  class Ublox6Parser {
+  public:
+    /** Size of the receive buffer, larger than any sentence or frame */
+    static const size_t BUFFER_SIZE = 512;
+
+    /** Longest NMEA sentence, with its line ending */
+    static const int NMEA_MAX = 82;
+
+    /**
+     * Ublox6Parser constructor
+     */
+    Ublox6Parser() : m_len(0), m_sentences(0), m_frames(0), m_errors(0)
+    {
+      memset(&m_fix, 0, sizeof(m_fix));
+      memset(&m_work, 0, sizeof(m_work));
+      pthread_mutex_init(&m_lock, NULL);
+    }
+
+    /**
+     * Ublox6Parser Destructor
+     */
+    ~Ublox6Parser()
+    {
+      pthread_mutex_destroy(&m_lock);
+    }
+
+    /**
+     * Free space at the end of the receive buffer, to read into
+     *
+     * @param space set to the number of bytes that fit
+     * @return where the next bytes go
+     */
+    char *buffer(size_t *space)
+    {
+      *space = BUFFER_SIZE - m_len;
+      return m_buf + m_len;
+    }
+
+    /**
+     * Decode what was received into buffer()
+     *
+     * @param len number of bytes added
+     */
+    void parse(size_t len)
+    {
+      size_t pos = 0;
+
+      m_len += len;
+      while (pos < m_len)
+        {
+          size_t used = (uint8_t) m_buf[pos] == 0xB5 ? ubx(pos) : nmea(pos);
+          if (used == 0)
+            break;            // incomplete, wait for more
+          pos += used;
+        }
+
+      m_len -= pos;
+      memmove(m_buf, m_buf + pos, m_len);
+    }
+
+    /**
+     * Copy data in and decode it, e.g. to replay a log
+     *
+     * @param data received bytes
+     * @param len number of bytes
+     */
+    void feed(const char *data, size_t len)
+    {
+      while (len)
+        {
+          size_t space;
+          char *dst = buffer(&space);
+          size_t n = len < space ? len : space;
+          memcpy(dst, data, n);
+          parse(n);
+          data += n;
+          len -= n;
+        }
+    }
+
+    /**
+     * Get the latest fix
+     *
+     * @param fix filled in with a copy of the fix
+     * @return true if the receiver has a position fix
+     */
+    bool getFix(ublox6Fix *fix)
+    {
+      pthread_mutex_lock(&m_lock);
+      *fix = m_fix;
+      pthread_mutex_unlock(&m_lock);
+      return fix->valid;
+    }
+
+    /**
+     * Number of NMEA sentences decoded
+     */
+    uint32_t sentences() { return m_sentences; }
+
+    /**
+     * Number of UBX frames decoded
+     */
+    uint32_t frames() { return m_frames; }
+
+    /**
+     * Number of sentences and frames dropped on a bad checksum, and of
+     * sentences cut short by the start of the next one
+     */
+    uint32_t checksumErrors() { return m_errors; }
+
+    /**
+     * Build a UBX frame with its sync bytes and checksum
+     *
+     * @param frame buffer of at least len + 8 bytes
+     * @param cls message class
+     * @param id message id
+     * @param payload message payload
+     * @param len payload length
+     * @return frame length
+     */
+    static size_t ubxFrame(uint8_t *frame, uint8_t cls, uint8_t id,
+                           const uint8_t *payload, uint16_t len)
+    {
+      uint8_t a = 0, b = 0;
+
+      frame[0] = 0xB5;
+      frame[1] = 0x62;
+      frame[2] = cls;
+      frame[3] = id;
+      frame[4] = len & 0xff;
+      frame[5] = len >> 8;
+      memcpy(frame + 6, payload, len);
+      for (size_t i = 2; i < 6u + len; i++)
+        {
+          a += frame[i];
+          b += a;
+        }
+      frame[6 + len] = a;
+      frame[7 + len] = b;
+      return len + 8;
+    }
+
+  private:
+    /* one NMEA sentence at pos, or garbage up to the next start */
+    size_t nmea(size_t pos)
+    {
+      const char *p = m_buf + pos;
+      size_t avail = m_len - pos;
+
+      if (*p != '$')
+        {
+          size_t skip = 1;
+          while (skip < avail && p[skip] != '$' && (uint8_t) p[skip] != 0xB5)
+            skip++;
+          return skip;
+        }
+
+      // sentences are printable and at most 82 characters, anything else
+      // is a '$' inside binary data: resync on the next byte. A '$' within
+      // the sentence means the UART lost its end: drop it, keep the next
+      const char *end = p + 1;
+      while (end < p + avail && *end != '\n')
+        {
+          if ((*end < 0x20 && *end != '\r') || *end > 0x7e || end - p > NMEA_MAX)
+            return 1;
+          if (*end == '$')
+            {
+              m_errors++;
+              return end - p;
+            }
+          end++;
+        }
+      if (end == p + avail)
+        return 0;
+
+      const char *star = p + 1;
+      uint8_t sum = 0;
+      while (star < end && *star != '*')
+        sum ^= (uint8_t) *star++;
+      if (star + 2 >= end || hex(star[1]) < 0 || hex(star[2]) < 0 ||
+          ((hex(star[1]) << 4) | hex(star[2])) != sum)
+        {
+          m_errors++;
+          return end - p + 1;
+        }
+
+      if (star - p > 6)
+        {
+          const char *type = p + 3;
+          const char *fields = p + 7;
+          bool known = true;
+          if (!memcmp(type, "GGA", 3))
+            gga(fields, star);
+          else if (!memcmp(type, "RMC", 3))
+            rmc(fields, star);
+          else if (!memcmp(type, "VTG", 3))
+            vtg(fields, star);
+          else
+            known = false;
+          if (known)
+            {
+              m_sentences++;
+              publish();
+            }
+        }
+      return end - p + 1;
+    }
 
+    /* one UBX frame at pos */
+    size_t ubx(size_t pos)
+    {
+      const uint8_t *f = (const uint8_t *) m_buf + pos;
+      size_t avail = m_len - pos;
+
+      if (avail < 2)
+        return 0;
+      if (f[1] != 0x62)
+        return 1;
+      if (avail < 6)
+        return 0;
+      size_t len = f[4] | (f[5] << 8);
+      if (len + 8 > BUFFER_SIZE)
+        return 1;
+      if (avail < len + 8)
+        return 0;
+
+      uint8_t a = 0, b = 0;
+      for (size_t i = 2; i < 6 + len; i++)
+        {
+          a += f[i];
+          b += a;
+        }
+      if (a != f[6 + len] || b != f[7 + len])
+        {
+          m_errors++;
+          return 1;
+        }
+
+      const uint8_t *pl = f + 6;
+      bool known = true;
+      if (f[2] == 0x01 && f[3] == 0x02 && len >= 28)         // NAV-POSLLH
+        {
+          m_work.longitude = (int32_t) le32(pl + 4) * 1e-7;
+          m_work.latitude  = (int32_t) le32(pl + 8) * 1e-7;
+          m_work.altitude  = (int32_t) le32(pl + 16) * 1e-3f;
+        }
+      else if (f[2] == 0x01 && f[3] == 0x06 && len >= 52)    // NAV-SOL
+        {
+          uint8_t gpsFix = pl[10];
+          m_work.valid      = (pl[11] & 0x01) && gpsFix >= 2 && gpsFix <= 4;
+          m_work.quality    = m_work.valid ? ((pl[11] & 0x02) ? 2 : 1) : 0;
+          m_work.hdop       = le16(pl + 44) * 0.01f;        // pDOP, the closest UBX has
+          m_work.satellites = pl[47];
+        }
+      else if (f[2] == 0x01 && f[3] == 0x12 && len >= 36)    // NAV-VELNED
+        {
+          m_work.speed  = le32(pl + 20) * 0.01f;
+          m_work.course = (int32_t) le32(pl + 24) * 1e-5f;
+        }
+      else if (f[2] == 0x01 && f[3] == 0x21 && len >= 20)    // NAV-TIMEUTC
+        {
+          if (pl[19] & 0x04)
+            {
+              m_work.timeMs = ((pl[16] * 60 + pl[17]) * 60 + pl[18]) * 1000 +
+                              (int32_t) le32(pl + 8) / 1000000;
+              m_work.date = (pl[15] * 100 + pl[14]) * 100 + le16(pl + 12) % 100;
+            }
+        }
+      else
+        known = false;
+
+      if (known)
+        {
+          m_frames++;
+          publish();
+        }
+      return len + 8;
+    }
+
+    void gga(const char *p, const char *end)
+    {
+      const char *f[10];
+      fields(p, end, f, 10);
+      time(f[0]);
+      position(f[1], f[2], f[3], f[4]);
+      if (!empty(f[5]))
+        {
+          m_work.quality = (uint8_t) number(f[5]);
+          m_work.valid = m_work.quality != 0;
+        }
+      if (!empty(f[6]))
+        m_work.satellites = (uint8_t) number(f[6]);
+      if (!empty(f[7]))
+        m_work.hdop = number(f[7]);
+      if (!empty(f[8]))
+        m_work.altitude = number(f[8]);
+    }
+
+    void rmc(const char *p, const char *end)
+    {
+      const char *f[10];
+      fields(p, end, f, 10);
+      time(f[0]);
+      m_work.valid = *f[1] == 'A';
+      position(f[2], f[3], f[4], f[5]);
+      if (!empty(f[6]))
+        m_work.speed = number(f[6]) * 0.514444;
+      if (!empty(f[7]))
+        m_work.course = number(f[7]);
+      if (!empty(f[8]))
+        m_work.date = (uint32_t) number(f[8]);
+    }
+
+    void vtg(const char *p, const char *end)
+    {
+      const char *f[8];
+      fields(p, end, f, 8);
+      if (!empty(f[0]))
+        m_work.course = number(f[0]);
+      if (!empty(f[6]))
+        m_work.speed = number(f[6]) / 3.6;
+    }
+
+    /* start of each field, ended by ',' or by the '*' before the
+     * checksum; fields the sentence does not have start at the '*' */
+    static void fields(const char *p, const char *end, const char **f, int n)
+    {
+      int i = 0;
+      f[i++] = p;
+      while (p < end && i < n)
+        {
+          if (*p++ == ',')
+            f[i++] = p;
+        }
+      while (i < n)
+        f[i++] = end;
+    }
+
+    static bool empty(const char *f)
+    {
+      return *f == ',' || *f == '*';
+    }
+
+    /* hhmmss.sss */
+    void time(const char *p)
+    {
+      if (empty(p))
+        return;
+      double t = number(p);
+      uint32_t hms = (uint32_t) t;
+      m_work.timeMs = ((hms / 10000) * 3600 + (hms / 100 % 100) * 60 + hms % 100) * 1000 +
+                      (uint32_t) ((t - hms) * 1000 + 0.5);
+    }
+
+    /* ddmm.mmmm,N,dddmm.mmmm,E */
+    void position(const char *lat, const char *ns, const char *lon, const char *ew)
+    {
+      if (empty(lat) || empty(lon))
+        return;
+      double v = number(lat);
+      m_work.latitude = (int) (v / 100) + fmod(v, 100) / 60;
+      if (*ns == 'S')
+        m_work.latitude = -m_work.latitude;
+      v = number(lon);
+      m_work.longitude = (int) (v / 100) + fmod(v, 100) / 60;
+      if (*ew == 'W')
+        m_work.longitude = -m_work.longitude;
+    }
+
+    /* decimal field, stops at the first character that does not fit */
+    static double number(const char *p)
+    {
+      bool negative = *p == '-';
+      if (negative)
+        p++;
+      uint64_t mantissa = 0;
+      double scale = 1;
+      for (; *p >= '0' && *p <= '9'; p++)
+        mantissa = mantissa * 10 + (*p - '0');
+      if (*p == '.')
+        for (p++; *p >= '0' && *p <= '9'; p++)
+          {
+            mantissa = mantissa * 10 + (*p - '0');
+            scale *= 10;
+          }
+      return (negative ? -(double) mantissa : (double) mantissa) / scale;
+    }
+
+    static int hex(char c)
+    {
+      if (c >= '0' && c <= '9')
+        return c - '0';
+      if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+      return -1;
+    }
+
+    static uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+    static uint32_t le32(const uint8_t *p)
+    {
+      return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+    }
+
+    void publish()
+    {
+      m_work.updates++;
+      pthread_mutex_lock(&m_lock);
+      m_fix = m_work;
+      pthread_mutex_unlock(&m_lock);
+    }
+
+    char            m_buf[BUFFER_SIZE];
+    size_t          m_len;
+    ublox6Fix       m_work;
+    ublox6Fix       m_fix;
+    pthread_mutex_t m_lock;
+    volatile uint32_t m_sentences;
+    volatile uint32_t m_frames;
+    volatile uint32_t m_errors;
+  };
+
+  /**
+   * @brief U-BLOX 6 receiver with an attached Ublox6Parser
+   *
+   * update() reads whatever the UART has straight into the parser's
+   * buffer and decodes it, so applications get the latest fix with
+   * getFix() instead of splitting and parsing NMEA themselves.
+   *
+   * @ingroup grove uart
+   */
+  class Ublox6Reader {
+  public:
+    /**
+     * Ublox6Reader constructor
+     *
+     * @param gps receiver to read from
+     */
+    Ublox6Reader(Ublox6 &gps) : m_gps(gps) {}
+
+    /**
+     * Read and decode the data available, without blocking
+     *
+     * @return the number of bytes read
+     */
+    int update()
+    {
+      int total = 0;
+
+      while (m_gps.dataAvailable())
+        {
+          size_t space;
+          char *dst = m_parser.buffer(&space);
+          int n = m_gps.readData(dst, space);
+          if (n <= 0)
+            break;
+          m_parser.parse(n);
+          total += n;
+        }
+      return total;
+    }
+
+    /**
+     * Get the latest fix
+     *
+     * @param fix filled in with a copy of the fix
+     * @return true if the receiver has a position fix
+     */
+    bool getFix(ublox6Fix *fix) { return m_parser.getFix(fix); }
+
+    /**
+     * Switch the receiver output to UBX binary navigation frames, which
+     * are shorter to send and to decode than NMEA, at a higher rate.
+     * The receiver keeps accepting both protocols as input.
+     *
+     * @param rateMs measurement period in milliseconds, 200 (5Hz) is the
+     * fastest the U-BLOX 6 supports
+     * @param baud baud rate of the receiver port, unchanged by this call
+     * @return true if all configuration messages were written
+     */
+    bool enableUbx(uint16_t rateMs=200, uint32_t baud=9600)
+    {
+      static const uint8_t nav[] = { 0x02, 0x06, 0x12, 0x21 };
+      bool ok = true;
+
+      // CFG-MSG: each navigation message once per solution on UART1
+      for (size_t i = 0; i < sizeof(nav); i++)
+        {
+          uint8_t msg[] = { 0x01, nav[i], 0, 1, 0, 0, 0, 0 };
+          ok = send(0x06, 0x01, msg, sizeof(msg)) && ok;
+        }
+
+      // CFG-RATE: measurement period, one solution per measurement, GPS time
+      uint8_t rate[] = { (uint8_t) (rateMs & 0xff), (uint8_t) (rateMs >> 8), 1, 0, 1, 0 };
+      ok = send(0x06, 0x08, rate, sizeof(rate)) && ok;
+
+      // CFG-PRT: UART1, 8N1, UBX and NMEA in, UBX out
+      uint8_t prt[20] = { 1, 0, 0, 0, 0xD0, 0x08, 0, 0,
+                          (uint8_t) baud, (uint8_t) (baud >> 8),
+                          (uint8_t) (baud >> 16), (uint8_t) (baud >> 24),
+                          0x03, 0, 0x01, 0, 0, 0, 0, 0 };
+      ok = send(0x06, 0x00, prt, sizeof(prt)) && ok;
+
+      return ok;
+    }
+
+    /**
+     * The parser fed by this reader, for its counters
+     */
+    Ublox6Parser &parser() { return m_parser; }
+
+  private:
+    bool send(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len)
+    {
+      uint8_t frame[32];
+      size_t n = Ublox6Parser::ubxFrame(frame, cls, id, payload, len);
+      return m_gps.writeData((char *) frame, n) == (int) n;
+    }
+
+    Ublox6 &m_gps;
+    Ublox6Parser m_parser;
+  };
+}
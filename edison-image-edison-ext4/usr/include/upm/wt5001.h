@@ -37,6 +37,8 @@
 #include <sys/select.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <mraa/uart.h>
 
@@ -333,6 +335,509 @@ namespace upm {
     mraa_uart_context m_uart;
     int m_ttyFd;
   };
-}
 
+  /**
+   * @brief Pipelined command queue for the WT5001
+   *
+   * Every WT5001 call writes one command and then blocks until the module
+   * echoes its opcode, so a script that queues tracks and polls state
+   * spends most of its time waiting on the UART. WT5001Async takes the
+   * commands instead: they are numbered in submission order and written by
+   * an I/O thread, which keeps up to depth of them in flight and matches
+   * the replies to the outstanding opcodes. The module answers in order,
+   * each reply being the echoed opcode followed by the data a READ_*
+   * command returns, so matching is first in, first out. A reply that does
+   * not match fails the oldest command, as does a reply that does not come
+   * within the timeout. Replies carry only the opcode, so when a reply is
+   * lost among commands with the same opcode, the later replies answer
+   * the earlier commands and the failure falls on the last of them.
+   *
+   * Completion is reported through an optional callback, run on the I/O
+   * thread, and through wait() on the number returned by submit(). The
+   * command helpers below take the same optional callback and argument
+   * as submit().
+   *
+   * While a WT5001Async is attached, the WT5001 methods that talk to the
+   * module must not be used.
+   *
+   * @ingroup grove uart
+   */
+  class WT5001Async {
+  public:
+    /**
+     * Completion callback
+     *
+     * @param opcode the command that completed
+     * @param ok true if the module acknowledged it
+     * @param data the returned data, see responseSize()
+     * @param arg user argument given to submit()
+     */
+    typedef void (*callback_t)(WT5001::WT5001_OPCODE_T opcode, bool ok,
+                               const uint8_t *data, void *arg);
+
+    /** Number of commands that can be queued or remembered */
+    static const uint32_t SLOTS = 32;
+
+    /**
+     * WT5001Async constructor, starts the I/O thread
+     *
+     * @param mp3 module to drive
+     * @param depth commands in flight at once, kept small because the
+     * module buffers few bytes; 1 is the behavior of WT5001
+     * @param timeoutMs time allowed for each reply, counted from when the
+     * command is the oldest one in flight
+     */
+    WT5001Async(WT5001 &mp3, uint32_t depth=4, unsigned int timeoutMs=500) :
+      m_mp3(mp3), m_depth(depth ? depth : 1), m_timeoutMs(timeoutMs),
+      m_submitted(0), m_sent(0), m_done(0), m_failures(0), m_stray(0),
+      m_running(true)
+    {
+      if (m_depth > SLOTS)
+        m_depth = SLOTS;
+
+      pthread_condattr_t attr;
+      pthread_condattr_init(&attr);
+      pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+      pthread_cond_init(&m_changed, &attr);
+      pthread_condattr_destroy(&attr);
+      pthread_mutex_init(&m_lock, NULL);
+
+      if (pthread_create(&m_thread, NULL, run, this) != 0)
+        {
+          std::cerr << __FUNCTION__ << ": pthread_create failed" << std::endl;
+          m_running = false;
+        }
+    }
+
+    /**
+     * WT5001Async Destructor, fails the commands not completed yet
+     */
+    ~WT5001Async()
+    {
+      bool joined = m_running;
+
+      pthread_mutex_lock(&m_lock);
+      m_running = false;
+      pthread_cond_broadcast(&m_changed);
+      pthread_mutex_unlock(&m_lock);
+      if (joined)
+        pthread_join(m_thread, NULL);
+
+      pthread_cond_destroy(&m_changed);
+      pthread_mutex_destroy(&m_lock);
+    }
+
+    /**
+     * Queue a command. This blocks only if SLOTS commands are waiting.
+     *
+     * @param opcode command to send
+     * @param args command arguments
+     * @param nargs number of arguments, at most 4
+     * @param cb called once the command completes, can be NULL
+     * @param arg passed to cb
+     * @return the command number, for wait(), or 0 on error
+     */
+    uint32_t submit(WT5001::WT5001_OPCODE_T opcode, const uint8_t *args=NULL,
+                    int nargs=0, callback_t cb=NULL, void *arg=NULL)
+    {
+      if (nargs < 0 || nargs > 4)
+        return 0;
+
+      pthread_mutex_lock(&m_lock);
+      while (m_running && m_submitted - m_done >= SLOTS)
+        pthread_cond_wait(&m_changed, &m_lock);
+      if (!m_running)
+        {
+          pthread_mutex_unlock(&m_lock);
+          return 0;
+        }
+
+      command_t &c = m_slots[m_submitted % SLOTS];
+      c.opcode = opcode;
+      c.frame[0] = WT5001_START;
+      c.frame[1] = nargs + 2;
+      c.frame[2] = opcode;
+      if (nargs)
+        memcpy(c.frame + 3, args, nargs);
+      c.frame[3 + nargs] = WT5001_END;
+      c.len = nargs + 4;
+      c.need = responseSize(opcode);
+      c.got = 0;
+      c.acked = false;
+      c.ok = false;
+      c.cb = cb;
+      c.arg = arg;
+
+      uint32_t ticket = ++m_submitted;
+      pthread_cond_broadcast(&m_changed);
+      pthread_mutex_unlock(&m_lock);
+      return ticket;
+    }
+
+    /**
+     * Wait for a command to complete
+     *
+     * @param ticket number returned by submit()
+     * @param data if not NULL, receives the returned data, see responseSize()
+     * @param millis longest wait in milliseconds
+     * @return true if the module acknowledged the command, false if it
+     * failed, the wait timed out or the result was overwritten by a
+     * newer command
+     */
+    bool wait(uint32_t ticket, uint8_t *data=NULL, unsigned int millis=1000)
+    {
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += millis / 1000;
+      deadline.tv_nsec += (millis % 1000) * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L)
+        {
+          deadline.tv_sec++;
+          deadline.tv_nsec -= 1000000000L;
+        }
+
+      bool ok = false;
+      pthread_mutex_lock(&m_lock);
+      while (ticket && ticket <= m_submitted && m_done < ticket)
+        {
+          if (pthread_cond_timedwait(&m_changed, &m_lock, &deadline) == ETIMEDOUT)
+            break;
+        }
+      if (ticket && m_done >= ticket && m_submitted - ticket < SLOTS)
+        {
+          command_t &c = m_slots[(ticket - 1) % SLOTS];
+          ok = c.ok;
+          if (data && ok)
+            memcpy(data, c.data, c.need);
+        }
+      pthread_mutex_unlock(&m_lock);
+      return ok;
+    }
+
+    /**
+     * Wait until every queued command has completed
+     *
+     * @param millis longest wait in milliseconds
+     * @return true if all of them were acknowledged
+     */
+    bool flush(unsigned int millis=5000)
+    {
+      pthread_mutex_lock(&m_lock);
+      uint32_t last = m_submitted;
+      pthread_mutex_unlock(&m_lock);
+      return last == 0 || wait(last, NULL, millis);
+    }
+
+    /**
+     * Number of data bytes the module returns after acknowledging a
+     * command: getVolume and getPlayState 1, file counts and the current
+     * file 2 (high byte first), time 3 (hour, minute, second), date 4
+     * (year high, year low, month, day)
+     *
+     * @param opcode command
+     * @return number of bytes
+     */
+    static int responseSize(WT5001::WT5001_OPCODE_T opcode)
+    {
+      switch (opcode)
+        {
+        case WT5001::READ_VOLUME:
+        case WT5001::READ_PLAY_STATE:
+          return 1;
+        case WT5001::READ_SPI_NUMF:
+        case WT5001::READ_SD_NUMF:
+        case WT5001::READ_UDISK_NUMF:
+        case WT5001::READ_CUR_FNAME:
+          return 2;
+        case WT5001::READ_TIME:
+          return 3;
+        case WT5001::READ_DATE:
+          return 4;
+        default:
+          return 0;
+        }
+    }
+
+    /**
+     * queue playing a file, from a source
+     *
+     * @param psrc the play source (SD, UDISK, SPI)
+     * @param index file number to play
+     * @return the command number, for wait()
+     */
+    uint32_t play(WT5001::WT5001_PLAYSOURCE_T psrc, uint16_t index,
+                  callback_t cb=NULL, void *arg=NULL)
+    {
+      static const WT5001::WT5001_OPCODE_T op[] =
+        { WT5001::PLAY_SD, WT5001::PLAY_SPI, WT5001::PLAY_UDISK };
+      uint8_t args[2] = { (uint8_t) (index >> 8), (uint8_t) index };
+      return submit(op[psrc], args, 2, cb, arg);
+    }
+
+    /**
+     * queue stopping playback
+     */
+    uint32_t stop(callback_t cb=NULL, void *arg=NULL)
+    {
+      return submit(WT5001::STOP, NULL, 0, cb, arg);
+    }
+
+    /**
+     * queue pausing playback, or resuming it if already paused
+     */
+    uint32_t pause(callback_t cb=NULL, void *arg=NULL)
+    {
+      return submit(WT5001::PAUSE, NULL, 0, cb, arg);
+    }
+
+    /**
+     * queue going to the next track
+     */
+    uint32_t next(callback_t cb=NULL, void *arg=NULL)
+    {
+      return submit(WT5001::NEXT, NULL, 0, cb, arg);
+    }
+
+    /**
+     * queue going to the previous track
+     */
+    uint32_t previous(callback_t cb=NULL, void *arg=NULL)
+    {
+      return submit(WT5001::PREVIOUS, NULL, 0, cb, arg);
+    }
 
+    /**
+     * queue setting the volume. Range is between 0-31.  0 means mute.
+     */
+    uint32_t setVolume(uint8_t vol, callback_t cb=NULL, void *arg=NULL)
+    {
+      if (vol > WT5001_MAX_VOLUME)
+        vol = WT5001_MAX_VOLUME;
+      return submit(WT5001::SET_VOLUME, &vol, 1, cb, arg);
+    }
+
+    /**
+     * queue a track to play next, when current song is finished
+     */
+    uint32_t queue(uint16_t index, callback_t cb=NULL, void *arg=NULL)
+    {
+      uint8_t args[2] = { (uint8_t) (index >> 8), (uint8_t) index };
+      return submit(WT5001::QUEUE, args, 2, cb, arg);
+    }
+
+    /**
+     * queue setting the playback mode
+     */
+    uint32_t setPlayMode(WT5001::WT5001_PLAYMODE_T pm, callback_t cb=NULL,
+                         void *arg=NULL)
+    {
+      uint8_t mode = pm;
+      return submit(WT5001::PLAY_MODE, &mode, 1, cb, arg);
+    }
+
+    /**
+     * queue inserting a track to play immediately
+     */
+    uint32_t insert(uint16_t index, callback_t cb=NULL, void *arg=NULL)
+    {
+      uint8_t args[2] = { (uint8_t) (index >> 8), (uint8_t) index };
+      return submit(WT5001::INSERT_SONG, args, 2, cb, arg);
+    }
+
+    /**
+     * queue reading the volume, 1 byte of data
+     */
+    uint32_t getVolume(callback_t cb=NULL, void *arg=NULL)
+    {
+      return submit(WT5001::READ_VOLUME, NULL, 0, cb, arg);
+    }
+
+    /**
+     * queue reading the play state, 1 byte of data: 1 = playing,
+     * 2 = stopped, 3 = paused
+     */
+    uint32_t getPlayState(callback_t cb=NULL, void *arg=NULL)
+    {
+      return submit(WT5001::READ_PLAY_STATE, NULL, 0, cb, arg);
+    }
+
+    /**
+     * queue reading the number of files on a source, 2 bytes of data
+     */
+    uint32_t getNumFiles(WT5001::WT5001_PLAYSOURCE_T psrc, callback_t cb=NULL,
+                         void *arg=NULL)
+    {
+      static const WT5001::WT5001_OPCODE_T op[] =
+        { WT5001::READ_SD_NUMF, WT5001::READ_SPI_NUMF, WT5001::READ_UDISK_NUMF };
+      return submit(op[psrc], NULL, 0, cb, arg);
+    }
+
+    /**
+     * queue reading the index of the current file, 2 bytes of data
+     */
+    uint32_t getCurrentFile(callback_t cb=NULL, void *arg=NULL)
+    {
+      return submit(WT5001::READ_CUR_FNAME, NULL, 0, cb, arg);
+    }
+
+    /**
+     * Number of commands that failed or timed out
+     */
+    uint32_t failures() { return m_failures; }
+
+    /**
+     * Number of received bytes no outstanding command expected
+     */
+    uint32_t strayBytes() { return m_stray; }
+
+  private:
+    typedef struct {
+      WT5001::WT5001_OPCODE_T opcode;
+      uint8_t    frame[8];
+      int        len;
+      int        need;
+      int        got;
+      uint8_t    data[4];
+      bool       acked;
+      bool       ok;
+      callback_t cb;
+      void *     arg;
+      struct timespec deadline;
+    } command_t;
+
+    static void *run(void *ctx)
+    {
+      ((WT5001Async *) ctx)->loop();
+      return NULL;
+    }
+
+    void loop()
+    {
+      uint8_t buf[32];
+
+      pthread_mutex_lock(&m_lock);
+      while (m_running)
+        {
+          // keep the window full
+          while (m_sent < m_submitted && m_sent - m_done < m_depth)
+            {
+              command_t &c = m_slots[m_sent % SLOTS];
+              m_mp3.writeData((char *) c.frame, c.len);
+              arm(c);
+              m_sent++;
+            }
+
+          if (m_done == m_sent)
+            {
+              pthread_cond_wait(&m_changed, &m_lock);
+              continue;
+            }
+
+          pthread_mutex_unlock(&m_lock);
+          int n = 0;
+          if (m_mp3.dataAvailable(POLL_MS))
+            n = m_mp3.readData((char *) buf, sizeof(buf));
+          pthread_mutex_lock(&m_lock);
+
+          for (int i = 0; i < n; i++)
+            receive(buf[i]);
+
+          struct timespec now;
+          clock_gettime(CLOCK_MONOTONIC, &now);
+          while (m_done < m_sent && expired(m_slots[m_done % SLOTS].deadline, now))
+            complete(false);
+        }
+
+      while (m_done < m_submitted)
+        complete(false);
+      pthread_mutex_unlock(&m_lock);
+    }
+
+    /* match one received byte against the oldest command in flight */
+    void receive(uint8_t byte)
+    {
+      while (m_done < m_sent)
+        {
+          command_t &c = m_slots[m_done % SLOTS];
+          if (c.acked)
+            {
+              c.data[c.got++] = byte;
+              if (c.got == c.need)
+                complete(true);
+              return;
+            }
+          if (byte == c.opcode)
+            {
+              c.acked = true;
+              if (c.need == 0)
+                complete(true);
+              return;
+            }
+          complete(false);    // reply lost, try the next command
+        }
+      m_stray++;
+    }
+
+    /* finish the oldest command, its callback runs without the lock */
+    void complete(bool ok)
+    {
+      command_t &c = m_slots[m_done % SLOTS];
+      WT5001::WT5001_OPCODE_T opcode = c.opcode;
+      callback_t cb = c.cb;
+      void *arg = c.arg;
+      uint8_t data[4];
+
+      c.ok = ok;
+      memcpy(data, c.data, sizeof(data));
+      if (!ok)
+        m_failures++;
+      if (m_sent == m_done)
+        m_sent++;             // failed before it was written
+      m_done++;
+      if (m_done < m_sent)
+        arm(m_slots[m_done % SLOTS]);   // the module gets to it only now
+      pthread_cond_broadcast(&m_changed);
+
+      if (cb)
+        {
+          pthread_mutex_unlock(&m_lock);
+          cb(opcode, ok, data, arg);
+          pthread_mutex_lock(&m_lock);
+        }
+    }
+
+    void arm(command_t &c)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &c.deadline);
+      c.deadline.tv_sec += m_timeoutMs / 1000;
+      c.deadline.tv_nsec += (m_timeoutMs % 1000) * 1000000L;
+      if (c.deadline.tv_nsec >= 1000000000L)
+        {
+          c.deadline.tv_sec++;
+          c.deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    static bool expired(const struct timespec &deadline, const struct timespec &now)
+    {
+      return now.tv_sec > deadline.tv_sec ||
+        (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+    }
+
+    static const unsigned int POLL_MS = 10;
+
+    WT5001 &        m_mp3;
+    uint32_t        m_depth;
+    unsigned int    m_timeoutMs;
+    command_t       m_slots[SLOTS];
+    uint32_t        m_submitted;
+    uint32_t        m_sent;
+    uint32_t        m_done;
+    volatile uint32_t m_failures;
+    volatile uint32_t m_stray;
+    volatile bool   m_running;
+    pthread_t       m_thread;
+    pthread_mutex_t m_lock;
+    pthread_cond_t  m_changed;
+  };
+}
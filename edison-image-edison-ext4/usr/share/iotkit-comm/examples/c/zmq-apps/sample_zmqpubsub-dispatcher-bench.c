@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2014 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file sample_zmqpubsub-dispatcher-bench.c
+    Times a client of many ZMQ publishers receiving with a thread per subscriber
+    socket, the way the receive() of the pub/sub plugin is used, against one
+    CommDispatcher with and without worker threads. Every service is a PUB socket
+    on a loopback TCP port with its own SUB socket, as createClient() sets up for
+    each discovered service; one thread publishes 64 byte messages to all of
+    them in turn.
+
+    gcc -O2 -o sample_zmqpubsub-dispatcher-bench sample_zmqpubsub-dispatcher-bench.c -lzmq -lmosquitto -lpthread
+    ./sample_zmqpubsub-dispatcher-bench [services] [messages] [workers]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <zmq.h>
+#include "iotkit-comm/comm_dispatcher.h"
+
+#define MESSAGE_SIZE 64
+
+typedef struct _Service {
+    void *publisher;
+    void *subscriber;
+    long quota; // messages this service gets in one run
+} Service;
+
+void *context = NULL;
+Service *services = NULL;
+int servicesCount = 500;
+long messagesCount = 1000000;
+long received = 0;
+long expected = 0;
+
+double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Publish every service's quota, one message per service in turn.
+*/
+void *publish(void *arg) {
+    char data[MESSAGE_SIZE];
+    long sent;
+    int i;
+
+    (void)arg;
+    memset(data, 'x', sizeof(data));
+    for (sent = 0; sent < messagesCount; sent++) {
+        i = sent % servicesCount;
+        if (zmq_send(services[i].publisher, data, sizeof(data), 0) != sizeof(data)) {
+            fprintf(stderr, "Publish failed: %s\n", zmq_strerror(errno));
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+/** A thread blocked in receive on one subscriber; copies each message out like
+* the plugin's receive() does before handing it to the client.
+*/
+void *receiveThread(void *arg) {
+    Service *service = (Service *)arg;
+    zmq_msg_t msg;
+    char *copy;
+    long i;
+
+    for (i = 0; i < service->quota; i++) {
+        zmq_msg_init(&msg);
+        if (zmq_msg_recv(&msg, service->subscriber, 0) < 0) {
+            fprintf(stderr, "Receive failed: %s\n", zmq_strerror(errno));
+            exit(1);
+        }
+        if ((copy = (char *)malloc(zmq_msg_size(&msg) + 1)) != NULL) {
+            memcpy(copy, zmq_msg_data(&msg), zmq_msg_size(&msg));
+            free(copy);
+        }
+        zmq_msg_close(&msg);
+        __atomic_add_fetch(&received, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+void batchCallback(CommSource *source, CommMessage *messages, int count) {
+    (void)messages;
+    if (__atomic_add_fetch(&received, count, __ATOMIC_RELAXED) >= expected) {
+        commDispatcherStop(source->dispatcher);
+    }
+}
+
+double runThreads() {
+    pthread_t producer, *threads;
+    double start;
+    int i;
+
+    threads = (pthread_t *)malloc(servicesCount * sizeof(pthread_t));
+    start = now();
+    for (i = 0; i < servicesCount; i++) {
+        pthread_create(&threads[i], NULL, receiveThread, &services[i]);
+    }
+    pthread_create(&producer, NULL, publish, NULL);
+    for (i = 0; i < servicesCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_join(producer, NULL);
+    free(threads);
+    return now() - start;
+}
+
+double runDispatcher(int workers) {
+    CommDispatcher *dispatcher;
+    pthread_t producer;
+    double start;
+    int i;
+
+    dispatcher = createCommDispatcher(workers);
+    if (dispatcher == NULL) {
+        fprintf(stderr, "Could not create a dispatcher\n");
+        exit(1);
+    }
+    for (i = 0; i < servicesCount; i++) {
+        if (!commDispatcherAddZmq(dispatcher, services[i].subscriber, batchCallback, NULL)) {
+            exit(1);
+        }
+    }
+
+    start = now();
+    pthread_create(&producer, NULL, publish, NULL);
+    commDispatcherRun(dispatcher);
+    pthread_join(producer, NULL);
+    destroyCommDispatcher(dispatcher);
+    return now() - start;
+}
+
+/** Bind a publisher for every service and connect its subscriber, then wait
+* until each subscription has reached its publisher so no message is dropped.
+*/
+void setupServices() {
+    char endpoint[64];
+    size_t size;
+    int i, hwm = 0;
+
+    services = (Service *)calloc(servicesCount, sizeof(Service));
+    for (i = 0; i < servicesCount; i++) {
+        services[i].publisher = zmq_socket(context, ZMQ_PUB);
+        services[i].subscriber = zmq_socket(context, ZMQ_SUB);
+        zmq_setsockopt(services[i].publisher, ZMQ_SNDHWM, &hwm, sizeof(hwm));
+        zmq_setsockopt(services[i].subscriber, ZMQ_RCVHWM, &hwm, sizeof(hwm));
+        zmq_setsockopt(services[i].subscriber, ZMQ_SUBSCRIBE, "", 0);
+
+        size = sizeof(endpoint);
+        if (zmq_bind(services[i].publisher, "tcp://127.0.0.1:*") != 0 ||
+                zmq_getsockopt(services[i].publisher, ZMQ_LAST_ENDPOINT, endpoint, &size) != 0 ||
+                zmq_connect(services[i].subscriber, endpoint) != 0) {
+            fprintf(stderr, "Could not set up service %d: %s\n", i, zmq_strerror(errno));
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < servicesCount; i++) {
+        char buf[8];
+        while (1) {
+            zmq_send(services[i].publisher, "hello", 5, 0);
+            usleep(1000);
+            if (zmq_recv(services[i].subscriber, buf, sizeof(buf), ZMQ_DONTWAIT) >= 0) {
+                break;
+            }
+        }
+        while (zmq_recv(services[i].subscriber, buf, sizeof(buf), ZMQ_DONTWAIT) >= 0);
+    }
+}
+
+void startRun() {
+    int i;
+
+    received = 0;
+    expected = messagesCount;
+    for (i = 0; i < servicesCount; i++) {
+        services[i].quota = messagesCount / servicesCount + (i < messagesCount % servicesCount ? 1 : 0);
+    }
+}
+
+void report(const char *name, double elapsed, double baseline) {
+    printf("%-24s %.3f s, %.0f msg/s", name, elapsed, received / elapsed);
+    if (baseline > 0) {
+        printf(" (%.1fx)", baseline / elapsed);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    double threadTime, elapsed;
+    int workers = 4, i;
+    char name[32];
+
+    if (argc > 1) {
+        servicesCount = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        messagesCount = atol(argv[2]);
+    }
+    if (argc > 3) {
+        workers = atoi(argv[3]);
+    }
+    if (servicesCount <= 0 || messagesCount <= 0 || workers < 0) {
+        puts("usage: sample_zmqpubsub-dispatcher-bench [services] [messages] [workers]");
+        return 1;
+    }
+
+    context = zmq_ctx_new();
+    zmq_ctx_set(context, ZMQ_MAX_SOCKETS, 2 * servicesCount + 16);
+    setupServices();
+    printf("%d services, %ld messages of %d bytes\n", servicesCount, messagesCount, MESSAGE_SIZE);
+
+    startRun();
+    threadTime = runThreads();
+    report("thread per service", threadTime, 0);
+
+    startRun();
+    elapsed = runDispatcher(0);
+    report("dispatcher, inline", elapsed, threadTime);
+
+    if (workers > 0) {
+        startRun();
+        elapsed = runDispatcher(workers);
+        snprintf(name, sizeof(name), "dispatcher, %d workers", workers);
+        report(name, elapsed, threadTime);
+    }
+
+    for (i = 0; i < servicesCount; i++) {
+        zmq_close(services[i].publisher);
+        zmq_close(services[i].subscriber);
+    }
+    free(services);
+    zmq_ctx_destroy(context);
+    return 0;
+}
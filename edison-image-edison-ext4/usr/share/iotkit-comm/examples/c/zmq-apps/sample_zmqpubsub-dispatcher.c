@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2014 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file sample_zmqpubsub-dispatcher.c
+    Sample client program of ZMQ subscriber, receiving through a CommDispatcher.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "iotkit-comm/iotkit-comm.h"
+#include "iotkit-comm/util.h"
+#include "iotkit-comm/comm_dispatcher.h"
+
+ServiceQuery *servQuery = NULL;
+int received = 0;
+
+/** Callback function. Invoked with the messages that arrived for the subscribed topic since the last call.
+* @param source the dispatcher source the messages came from
+* @param messages the messages received from service/publisher
+* @param count number of messages
+*/
+void clientBatchCallback(CommSource *source, CommMessage *messages, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        fprintf(stderr,"Message received in Client: %s\n", messages[i].data);
+    }
+
+    received += count;
+    if (received >= 5) {
+        commDispatcherStop(source->dispatcher);
+    }
+}
+
+/** Callback function. Once the service is discovered, this callback function will be invoked.
+* @param[in] handle left for future purpose, currently unused
+* @param error_code the error code
+* @param commHandle the communication handle used to invoke the interfaces
+*/
+void subDiscoveryCallback(void *handle, int32_t error_code, CommHandle *commHandle) {
+    CommDispatcher *dispatcher;
+
+    if (commHandle != NULL) {
+        // more handles can be added to the same dispatcher, all served by this thread
+        dispatcher = createCommDispatcher(0);
+
+        if (dispatcher != NULL && commDispatcherAddCommHandle(dispatcher, commHandle, clientBatchCallback, NULL)) {
+            commDispatcherRun(dispatcher);
+        } else {
+            puts("Could not watch the communication handle");
+        }
+
+        if (dispatcher != NULL) {
+            destroyCommDispatcher(dispatcher);
+        }
+
+        // clean the service query object
+        cleanUpService(&servQuery, &commHandle);
+        exit(0);
+    } else {
+        puts("\nComm Handle is NULL\n");
+    }
+}
+
+/** The starting point. Starts browsing for the given Service name.
+*/
+int main(void) {
+    puts("Sample program to test the iotkit-comm dispatcher with the ZMQ pub/sub plugin !!");
+    servQuery = (ServiceQuery *) parseServiceQuery("./serviceQueries/temperatureServiceQueryZMQPUBSUB.json");
+
+    if (servQuery) {
+        discoverServicesBlocking(servQuery, subDiscoveryCallback);
+    }
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2014 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file json-arena.c
+    Checks that the cJSON arena of json_stream.h only catches allocations of
+    the thread that began it, restores the default cJSON allocator when the
+    last arena ends, and backs the completion callbacks of a connection pool
+    when enabled. The pool requests are file:// URLs, so no network is needed.
+    Then times parsing a response with malloc against parsing it in an arena.
+
+    gcc -O2 -o json-arena json-arena.c -liotkit -lcurl -lpthread
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "iotkit-lib/rest_pool.h"
+
+#define BENCH_DOCUMENTS 100000
+#define POOL_REQUESTS 3
+
+static const char *RESPONSE = "{\"from\":1420070400000,\"to\":1420156800000,"
+        "\"series\":[{\"deviceId\":\"edison-01\",\"componentId\":\"temp-01\","
+        "\"points\":[{\"ts\":1420070400000,\"value\":\"21.5\"},"
+        "{\"ts\":1420070460000,\"value\":\"21.6\"},{\"ts\":1420070520000,\"value\":\"21.4\"}]}]}";
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if(!ok) {
+        failures ++;
+    }
+}
+
+static void *parseOnOtherThread(void *arena) {
+    cJSON *json = cJSON_Parse(RESPONSE);
+
+    check(json && !jsonArenaOwns((JsonArena *)arena, json), "other threads keep using malloc");
+    cJSON_Delete(json);
+    return NULL;
+}
+
+static void testArena() {
+    JsonArena outer, inner;
+    pthread_t thread;
+    cJSON *json;
+
+    jsonArenaInit(&outer, 0);
+    jsonArenaInit(&inner, 0);
+
+    jsonArenaBegin(&outer);
+    json = cJSON_Parse(RESPONSE);
+    check(json && jsonArenaOwns(&outer, json), "parse allocates from the arena");
+    check(cJSON_GetObjectItem(json, "series") != NULL, "arena tree is readable");
+    cJSON_Delete(json); // arena memory, ignored by the free hook
+
+    pthread_create(&thread, NULL, parseOnOtherThread, &outer);
+    pthread_join(thread, NULL);
+
+    jsonArenaBegin(&inner);
+    json = cJSON_Parse(RESPONSE);
+    check(json && jsonArenaOwns(&inner, json) && !jsonArenaOwns(&outer, json), "nested arena takes over");
+    jsonArenaEnd(&inner);
+    json = cJSON_Parse(RESPONSE);
+    check(json && jsonArenaOwns(&outer, json), "ending the nested arena goes back to the outer one");
+    jsonArenaEnd(&outer);
+
+    check(jsonCurrentArena == NULL && jsonArenaUsers == 0, "no arena left active");
+    json = cJSON_Parse(RESPONSE);
+    check(json && !jsonArenaOwns(&outer, json) && !jsonArenaOwns(&inner, json),
+            "default allocator is back after the last arena");
+    cJSON_Delete(json);
+
+    jsonArenaReset(&outer);
+    check(outer.current == outer.blocks && outer.blocks->used == 0, "reset releases the whole tree");
+
+    jsonArenaFree(&outer);
+    jsonArenaFree(&inner);
+}
+
+typedef struct _PoolResult {
+    HttpConnectionPool *pool;
+    int completed;
+    int inArena;
+} PoolResult;
+
+static void poolCallback(HttpResponse *response, void *userData) {
+    PoolResult *result = (PoolResult *)userData;
+    cJSON *json = response->data ? cJSON_Parse(response->data) : NULL;
+
+    if(json && cJSON_GetObjectItem(json, "series")) {
+        result->completed ++;
+        if(jsonArenaOwns(&result->pool->arena, json)) {
+            result->inArena ++;
+        }
+    }
+    cJSON_Delete(json);
+}
+
+static void runPool(HttpConnectionPool *pool, char *url, PoolResult *result) {
+    int i;
+
+    result->pool = pool;
+    result->completed = 0;
+    result->inArena = 0;
+    for(i = 0; i < POOL_REQUESTS; i ++) {
+        doPooledHttpRequestAsync(pool, "GET", url, NULL, NULL, poolCallback, result);
+    }
+    while(performHttpConnectionPool(pool, 100) > 0);
+}
+
+static void testPool() {
+    char path[64], url[80];
+    HttpConnectionPool *pool;
+    PoolResult result;
+    FILE *file;
+
+    snprintf(path, sizeof(path), "/tmp/json-arena-%d.json", (int)getpid());
+    snprintf(url, sizeof(url), "file://%s", path);
+    file = fopen(path, "w");
+    if(!file) {
+        check(false, "write the pool response");
+        return;
+    }
+    fputs(RESPONSE, file);
+    fclose(file);
+
+    pool = createHttpConnectionPool(0);
+    if(!pool) {
+        check(false, "create a connection pool");
+        unlink(path);
+        return;
+    }
+
+    runPool(pool, url, &result);
+    check(result.completed == POOL_REQUESTS && result.inArena == 0, "pool callbacks use malloc by default");
+
+    httpPoolUseJsonArena(pool, true);
+    runPool(pool, url, &result);
+    check(result.completed == POOL_REQUESTS && result.inArena == POOL_REQUESTS,
+            "pool callbacks parse into the pool arena");
+    check(pool->arena.blocks && pool->arena.blocks->used == 0 && jsonArenaUsers == 0,
+            "arena is reset and the hooks released after each callback");
+
+    destroyHttpConnectionPool(pool);
+    unlink(path);
+}
+
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void benchmark() {
+    double start, mallocTime, arenaTime;
+    JsonArena arena;
+    long items = 0;
+    int i;
+
+    start = now();
+    for(i = 0; i < BENCH_DOCUMENTS; i ++) {
+        cJSON *json = cJSON_Parse(RESPONSE);
+        items += cJSON_GetArraySize(cJSON_GetObjectItem(json, "series"));
+        cJSON_Delete(json);
+    }
+    mallocTime = now() - start;
+
+    jsonArenaInit(&arena, 0);
+    start = now();
+    jsonArenaBegin(&arena);
+    for(i = 0; i < BENCH_DOCUMENTS; i ++) {
+        cJSON *json = cJSON_Parse(RESPONSE);
+        items += cJSON_GetArraySize(cJSON_GetObjectItem(json, "series"));
+        jsonArenaReset(&arena);
+    }
+    jsonArenaEnd(&arena);
+    arenaTime = now() - start;
+    jsonArenaFree(&arena);
+
+    check(items == 2 * BENCH_DOCUMENTS, "both runs parsed every document");
+    printf("%d documents of %d bytes\n", BENCH_DOCUMENTS, (int)strlen(RESPONSE));
+    printf("malloc: %.3f s, %.0f documents/s\n", mallocTime, BENCH_DOCUMENTS / mallocTime);
+    printf("arena:  %.3f s, %.0f documents/s (%.1fx)\n", arenaTime, BENCH_DOCUMENTS / arenaTime,
+            mallocTime / arenaTime);
+}
+
+int main(int argc, char **argv) {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    testArena();
+    testPool();
+    if(argc < 2 || strcmp(argv[1], "--no-bench") != 0) {
+        benchmark();
+    }
+
+    curl_global_cleanup();
+    if(failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
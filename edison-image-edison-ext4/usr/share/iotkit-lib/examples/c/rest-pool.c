@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2014 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file rest-pool.c
+    Checks that the connection pool of rest_pool.h keeps its connections
+    alive: blocking requests share one connection, async requests stay within
+    the connection limit, and a connection the server closes is replaced
+    without failing a request. The server is a small keep-alive HTTP/1.1
+    stand-in on a loopback port, run on threads of this program, which counts
+    the connections it accepts. Then times POSTs on a new curl handle per
+    request, the way the REST layer sends them, against the pool.
+
+    The stand-in speaks plain HTTP, so the connection setup saved is a TCP
+    handshake; against the cloud each new connection also costs a TLS
+    handshake. Give a base URL to time against a real server instead,
+    e.g. a local HTTPS server, in which case only the benchmark runs.
+
+    gcc -O2 -o rest-pool rest-pool.c -liotkit -lcurl -lpthread
+    ./rest-pool [--no-bench] [base url]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "iotkit-lib/rest_pool.h"
+
+#define TEST_REQUESTS 50
+#define BENCH_REQUESTS 2000
+#define SERVER_HEADERS_MAX 4096
+
+static const char *BODY = "{\"on\":1420070400000,\"accountId\":\"acc\",\"data\":[{\"componentId\":"
+        "\"temp-01\",\"on\":1420070400000,\"value\":\"21.5\"}]}";
+static const char *REPLY = "{\"ok\":true}";
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if(!ok) {
+        failures ++;
+    }
+}
+
+static double now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** The stand-in server. Answers every request with 201 and REPLY. A request
+* for a path ending in /close is answered with "Connection: close", and one
+* ending in /drop without it, then the connection is closed.
+*/
+static int listener = -1;
+static long accepted = 0;
+
+static bool readFully(int fd, char *buf, size_t len) {
+    ssize_t n;
+
+    while(len > 0) {
+        if((n = read(fd, buf, len)) <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void *serveConnection(void *arg) {
+    int fd = (int)(long)arg;
+    char buf[SERVER_HEADERS_MAX], reply[256];
+    size_t have = 0, headers, length;
+    char *end, *field;
+    ssize_t n;
+    bool closing, dropping;
+
+    while(1) {
+        buf[have] = '\0';
+        while(!(end = strstr(buf, "\r\n\r\n"))) {
+            if(have == sizeof(buf) - 1 || (n = read(fd, buf + have, sizeof(buf) - 1 - have)) <= 0) {
+                goto done;
+            }
+            have += n;
+            buf[have] = '\0';
+        }
+        headers = end + 4 - buf;
+
+        length = 0;
+        for(field = strstr(buf, "\r\n"); field && field < end; field = strstr(field + 2, "\r\n")) {
+            if(strncasecmp(field + 2, "Content-Length:", 15) == 0) {
+                length = strtoul(field + 17, NULL, 10);
+            }
+        }
+        *strstr(buf, "\r\n") = '\0';
+        closing = strstr(buf, "/close ") != NULL;
+        dropping = strstr(buf, "/drop ") != NULL;
+
+        // skip the headers and the body, keeping what follows them
+        if(have - headers >= length) {
+            have -= headers + length;
+            memmove(buf, buf + headers + length, have);
+        } else {
+            char *body = (char *)malloc(length - (have - headers));
+            bool ok = body && readFully(fd, body, length - (have - headers));
+            free(body);
+            if(!ok) {
+                goto done;
+            }
+            have = 0;
+        }
+
+        n = snprintf(reply, sizeof(reply), "HTTP/1.1 201 Created\r\nContent-Type: application/json\r\n"
+                "Content-Length: %d\r\n%s\r\n%s", (int)strlen(REPLY), closing ? "Connection: close\r\n" : "", REPLY);
+        if(write(fd, reply, n) != n) {
+            goto done;
+        }
+        if(closing || dropping) {
+            goto done;
+        }
+    }
+
+done:
+    close(fd);
+    return NULL;
+}
+
+static void *serve(void *arg) {
+    pthread_t thread;
+    int fd;
+
+    (void)arg;
+    while((fd = accept(listener, NULL, NULL)) >= 0) {
+        __atomic_add_fetch(&accepted, 1, __ATOMIC_RELAXED);
+        if(pthread_create(&thread, NULL, serveConnection, (void *)(long)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static bool startServer(char *baseUrl, size_t len) {
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    pthread_t thread;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if(listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(listener, 64) != 0 || getsockname(listener, (struct sockaddr *)&addr, &addrLen) != 0) {
+        perror("startServer");
+        return false;
+    }
+    snprintf(baseUrl, len, "http://127.0.0.1:%d", ntohs(addr.sin_port));
+    if(pthread_create(&thread, NULL, serve, NULL) != 0) {
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+static long connections() {
+    return __atomic_load_n(&accepted, __ATOMIC_RELAXED);
+}
+
+typedef struct _AsyncResult {
+    int completed;
+    int created;
+} AsyncResult;
+
+static void asyncCallback(HttpResponse *response, void *userData) {
+    AsyncResult *result = (AsyncResult *)userData;
+
+    result->completed ++;
+    if(response->code == 201 && response->data && strcmp(response->data, REPLY) == 0) {
+        result->created ++;
+    }
+}
+
+static struct curl_slist *jsonHeaders() {
+    return curl_slist_append(NULL, "Content-Type: application/json");
+}
+
+static void testPool(const char *baseUrl) {
+    char url[128], closeUrl[128], dropUrl[128], name[96];
+    struct curl_slist *headers = jsonHeaders();
+    SharedHeaders shared;
+    HttpConnectionPool *pool;
+    HttpResponse response;
+    AsyncResult result = {0, 0};
+    long before;
+    int i, created = 0;
+
+    snprintf(url, sizeof(url), "%s/v1/api/data/edison-01", baseUrl);
+    snprintf(closeUrl, sizeof(closeUrl), "%s/v1/api/data/close", baseUrl);
+    snprintf(dropUrl, sizeof(dropUrl), "%s/v1/api/data/drop", baseUrl);
+    pool = createHttpConnectionPool(0);
+    if(!pool) {
+        check(false, "create a connection pool");
+        return;
+    }
+
+    before = connections();
+    for(i = 0; i < TEST_REQUESTS; i ++) {
+        if(doPooledHttpRequest(pool, "POST", url, headers, (char *)BODY, &response) == CURLE_OK &&
+                response.code == 201 && response.data && strcmp(response.data, REPLY) == 0) {
+            created ++;
+        }
+        free(response.data);
+    }
+    snprintf(name, sizeof(name), "%d blocking POSTs answered", TEST_REQUESTS);
+    check(created == TEST_REQUESTS, name);
+    check(connections() - before == 1 && pool->connects == 1, "blocking requests share one connection");
+
+    // the server ends a connection after a request for /close with
+    // "Connection: close", and after /drop without a word, as an idle
+    // timeout would; both are replaced by the next request
+    before = connections();
+    created = 0;
+    for(i = 0; i < 5; i ++) {
+        char *target = i == 1 ? closeUrl : i == 3 ? dropUrl : url;
+        if(doPooledHttpRequest(pool, "POST", target, headers, (char *)BODY, &response) == CURLE_OK &&
+                response.code == 201) {
+            created ++;
+        }
+        free(response.data);
+    }
+    check(created == 5 && connections() - before == 2,
+            "connections ended by the server are replaced without failing a request");
+
+    pool->connects = 0;
+    before = connections();
+    shared.list = headers;
+    shared.refs = 1; // held by this function, so the pool never frees the list
+    for(i = 0; i < TEST_REQUESTS; i ++) {
+        doPooledHttpRequestAsync(pool, "POST", url, &shared, (char *)BODY, asyncCallback, &result);
+    }
+    while(performHttpConnectionPool(pool, 100) > 0);
+    snprintf(name, sizeof(name), "%d async POSTs answered", TEST_REQUESTS);
+    check(result.completed == TEST_REQUESTS && result.created == TEST_REQUESTS, name);
+    snprintf(name, sizeof(name), "async requests open at most %d connections", HTTP_POOL_MAX_CONNECTIONS);
+    check(pool->connects >= 1 && pool->connects <= HTTP_POOL_MAX_CONNECTIONS &&
+            connections() - before == pool->connects, name);
+
+    before = connections();
+    result.completed = result.created = 0;
+    for(i = 0; i < TEST_REQUESTS; i ++) {
+        doPooledHttpRequestAsync(pool, "POST", url, &shared, (char *)BODY, asyncCallback, &result);
+    }
+    while(performHttpConnectionPool(pool, 100) > 0);
+    check(result.created == TEST_REQUESTS && connections() == before,
+            "a second async batch reuses the kept-alive connections");
+
+    destroyHttpConnectionPool(pool);
+    check(shared.refs == 1, "completed requests released their header references");
+    curl_slist_free_all(headers);
+}
+
+static size_t discard(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    (void)ptr;
+    (void)userdata;
+    return size * nmemb;
+}
+
+static void benchmark(const char *baseUrl) {
+    char url[128];
+    struct curl_slist *headers = jsonHeaders();
+    SharedHeaders shared;
+    HttpConnectionPool *pool;
+    HttpResponse response;
+    AsyncResult result = {0, 0};
+    double start, handleTime, blockingTime, asyncTime;
+    long code, connects;
+    int i, created = 0;
+
+    snprintf(url, sizeof(url), "%s/v1/api/data/edison-01", baseUrl);
+
+    start = now();
+    for(i = 0; i < BENCH_REQUESTS; i ++) {
+        CURL *curl = curl_easy_init();
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, BODY);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+        if(curl_easy_perform(curl) == CURLE_OK &&
+                curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code) == CURLE_OK && code == 201) {
+            created ++;
+        }
+        curl_easy_cleanup(curl);
+    }
+    handleTime = now() - start;
+
+    pool = createHttpConnectionPool(0);
+    start = now();
+    for(i = 0; i < BENCH_REQUESTS; i ++) {
+        if(doPooledHttpRequest(pool, "POST", url, headers, (char *)BODY, &response) == CURLE_OK &&
+                response.code == 201) {
+            created ++;
+        }
+        free(response.data);
+    }
+    blockingTime = now() - start;
+    connects = pool->connects;
+
+    memset(&shared, 0, sizeof(shared));
+    shared.list = headers;
+    shared.refs = 1;
+    pool->connects = 0;
+    start = now();
+    for(i = 0; i < BENCH_REQUESTS; i ++) {
+        doPooledHttpRequestAsync(pool, "POST", url, &shared, (char *)BODY, asyncCallback, &result);
+    }
+    while(performHttpConnectionPool(pool, 100) > 0);
+    asyncTime = now() - start;
+
+    check(created == 2 * BENCH_REQUESTS && result.completed == BENCH_REQUESTS,
+            "every benchmark request was answered");
+    printf("%d POSTs of %d bytes to %s\n", BENCH_REQUESTS, (int)strlen(BODY), baseUrl);
+    printf("handle per request: %.3f s, %.3f ms/request, %d connections\n", handleTime,
+            handleTime * 1000 / BENCH_REQUESTS, BENCH_REQUESTS);
+    printf("pool, blocking:     %.3f s, %.3f ms/request, %ld connections (%.1fx)\n", blockingTime,
+            blockingTime * 1000 / BENCH_REQUESTS, connects, handleTime / blockingTime);
+    printf("pool, async:        %.3f s, %.3f ms/request, %ld connections (%.1fx)\n", asyncTime,
+            asyncTime * 1000 / BENCH_REQUESTS, pool->connects, handleTime / asyncTime);
+
+    destroyHttpConnectionPool(pool);
+    curl_slist_free_all(headers);
+}
+
+int main(int argc, char **argv) {
+    char baseUrl[128] = "";
+    bool bench = true;
+    int i;
+
+    for(i = 1; i < argc; i ++) {
+        if(strcmp(argv[i], "--no-bench") == 0) {
+            bench = false;
+        } else {
+            snprintf(baseUrl, sizeof(baseUrl), "%s", argv[i]);
+        }
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if(!baseUrl[0]) {
+        if(!startServer(baseUrl, sizeof(baseUrl))) {
+            return 1;
+        }
+        testPool(baseUrl);
+    }
+    if(bench) {
+        benchmark(baseUrl);
+    }
+    curl_global_cleanup();
+
+    if(failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
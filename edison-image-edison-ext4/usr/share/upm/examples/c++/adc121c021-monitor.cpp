@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks upm::ADC121C021Monitor against a simulated converter and counts
+ * the I2C traffic it takes next to polling the result register. The
+ * simulated ADC121C021 converts a slow sine wave that swings through both
+ * limits, keeps the lowest and highest results, and drives the ALERT pin
+ * low while a result is outside the limits, letting it go once the result
+ * is back inside by the hysteresis. The simulation stands in for the mraa
+ * I2C and GPIO calls, so no converter is needed and neither libmraa nor
+ * libupm-adc121c021 is linked. Build it with -fsanitize=thread as well to
+ * check the ring between the interrupt and the application threads.
+ *
+ *   g++ -O2 -I/usr/include/upm -o adc121c021-monitor adc121c021-monitor.cpp -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "adc121c021.h"
+
+using namespace upm;
+
+#define CONVERSIONS 20000
+#define PERIOD      4000        // conversions per swing of the input
+#define LOW_LIMIT   1000
+#define HIGH_LIMIT  3000
+#define HYSTERESIS  100
+#define BLOCK       64
+#define BUS_HZ      100000
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+/*
+ * The simulated converter. Registers hold the values the part returns,
+ * big endian on the bus; busBytes counts the bytes of every transfer,
+ * address bytes included, and busTransfers the transfers.
+ */
+static pthread_mutex_t chipLock = PTHREAD_MUTEX_INITIALIZER;
+static uint16_t regs[8];
+static uint8_t pointer = 0, alertStatus = 0;
+static bool pinLow = false;
+static uint32_t busBytes = 0, busTransfers = 0;
+static void (*alertIsr) (void *) = NULL;
+static void *alertArg = NULL;
+
+/* the edges the converter raised, to check the alerts against */
+typedef struct {
+    uint16_t value;
+    uint8_t  status;
+} Edge;
+
+static Edge edges[CONVERSIONS];
+static unsigned int edgeCount = 0;
+
+static void
+bus (uint8_t reg, uint32_t bytes)
+{
+    pointer = reg;
+    busBytes += bytes;
+    busTransfers++;
+}
+
+extern "C" {
+
+mraa_i2c_context
+mraa_i2c_init (int bus)
+{
+    (void) bus;
+    return (mraa_i2c_context) &chipLock;
+}
+
+mraa_result_t
+mraa_i2c_address (mraa_i2c_context dev, uint8_t address)
+{
+    (void) dev;
+    (void) address;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_i2c_stop (mraa_i2c_context dev)
+{
+    (void) dev;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_i2c_write_byte (mraa_i2c_context dev, uint8_t data)
+{
+    (void) dev;
+    pthread_mutex_lock (&chipLock);
+    bus (data, 2);
+    pthread_mutex_unlock (&chipLock);
+    return MRAA_SUCCESS;
+}
+
+int
+mraa_i2c_read (mraa_i2c_context dev, uint8_t *data, int length)
+{
+    (void) dev;
+    pthread_mutex_lock (&chipLock);
+    bus (pointer, 1 + length);
+    for (int i = 0; i + 1 < length; i += 2) {
+        data[i] = regs[pointer] >> 8;
+        data[i + 1] = regs[pointer] & 0xff;
+    }
+    pthread_mutex_unlock (&chipLock);
+    return length;
+}
+
+uint8_t
+mraa_i2c_read_byte_data (mraa_i2c_context dev, uint8_t command)
+{
+    uint8_t data;
+
+    (void) dev;
+    pthread_mutex_lock (&chipLock);
+    bus (command, 4);
+    data = command == ADC121C021_REG_ALERT_STATUS ? alertStatus : regs[command];
+    pthread_mutex_unlock (&chipLock);
+    return data;
+}
+
+/* SMBus words are little endian */
+uint16_t
+mraa_i2c_read_word_data (mraa_i2c_context dev, uint8_t command)
+{
+    uint16_t data;
+
+    (void) dev;
+    pthread_mutex_lock (&chipLock);
+    bus (command, 5);
+    data = (regs[command] >> 8) | (regs[command] << 8);
+    pthread_mutex_unlock (&chipLock);
+    return data;
+}
+
+mraa_result_t
+mraa_i2c_write_byte_data (mraa_i2c_context dev, uint8_t data, uint8_t command)
+{
+    (void) dev;
+    pthread_mutex_lock (&chipLock);
+    bus (command, 3);
+    if (command == ADC121C021_REG_ALERT_STATUS) {
+        alertStatus &= ~data;       // write one to clear
+    } else {
+        regs[command] = data;
+    }
+    pthread_mutex_unlock (&chipLock);
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_i2c_write_word_data (mraa_i2c_context dev, uint16_t data, uint8_t command)
+{
+    (void) dev;
+    pthread_mutex_lock (&chipLock);
+    bus (command, 4);
+    data = (data >> 8) | (data << 8);
+    if (command == ADC121C021_REG_LOWEST_CONV || command == ADC121C021_REG_HIGHEST_CONV) {
+        /* any write restarts the range */
+        regs[ADC121C021_REG_LOWEST_CONV] = 0x0fff;
+        regs[ADC121C021_REG_HIGHEST_CONV] = 0;
+    } else {
+        regs[command] = data;
+    }
+    pthread_mutex_unlock (&chipLock);
+    return MRAA_SUCCESS;
+}
+
+mraa_gpio_context
+mraa_gpio_init (int pin)
+{
+    (void) pin;
+    return (mraa_gpio_context) &chipLock;
+}
+
+mraa_result_t
+mraa_gpio_dir (mraa_gpio_context dev, gpio_dir_t dir)
+{
+    (void) dev;
+    (void) dir;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_close (mraa_gpio_context dev)
+{
+    (void) dev;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_isr (mraa_gpio_context dev, gpio_edge_t edge, void (*fptr) (void *), void *args)
+{
+    (void) dev;
+    (void) edge;
+    alertIsr = fptr;
+    alertArg = args;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_isr_exit (mraa_gpio_context dev)
+{
+    (void) dev;
+    alertIsr = NULL;
+    return MRAA_SUCCESS;
+}
+
+}
+
+static void
+resetChip ()
+{
+    memset (regs, 0, sizeof (regs));
+    regs[ADC121C021_REG_LOWEST_CONV] = 0x0fff;
+    pointer = alertStatus = 0;
+    pinLow = false;
+    busBytes = busTransfers = edgeCount = 0;
+}
+
+static uint16_t
+input (int n)
+{
+    return 2000 + (int) lround (1500 * sin (n * 2 * M_PI / PERIOD));
+}
+
+/* Automatic conversion; runs the monitor's interrupt handler on its own
+ * thread, as mraa runs it on the interrupt thread */
+static void *
+convert (void *arg)
+{
+    (void) arg;
+    for (int n = 0; n < CONVERSIONS; n++) {
+        uint16_t v = input (n);
+        bool edge = false;
+
+        pthread_mutex_lock (&chipLock);
+        if (regs[ADC121C021_REG_CONFIG] & 0xe0) {
+            uint16_t low = regs[ADC121C021_REG_ALERT_LIM_UNDER];
+            uint16_t high = regs[ADC121C021_REG_ALERT_LIM_OVER];
+            uint16_t hys = regs[ADC121C021_REG_ALERT_HYS];
+
+            regs[ADC121C021_REG_RESULT] = v;
+            if (v < regs[ADC121C021_REG_LOWEST_CONV]) {
+                regs[ADC121C021_REG_LOWEST_CONV] = v;
+            }
+            if (v > regs[ADC121C021_REG_HIGHEST_CONV]) {
+                regs[ADC121C021_REG_HIGHEST_CONV] = v;
+            }
+            /* alerts self-clear when ALERT_HOLD is off */
+            if (!pinLow && (v < low || v > high)) {
+                alertStatus = v < low ? ADC121C021_ALERT_UNDER : ADC121C021_ALERT_OVER;
+                pinLow = edge = true;
+            } else if (pinLow && v >= low + hys && v <= high - hys) {
+                alertStatus = 0;
+                pinLow = false;
+                edge = true;
+            }
+            if (edge) {
+                edges[edgeCount].value = v;
+                edges[edgeCount].status = alertStatus;
+                edgeCount++;
+            }
+        }
+        pthread_mutex_unlock (&chipLock);
+
+        if (edge && alertIsr) {
+            alertIsr (alertArg);
+        }
+        usleep (10);
+    }
+    return NULL;
+}
+
+/* Run the input through a monitor; returns the alerts it handed out */
+static unsigned int
+runMonitor (ADC121C021Monitor *mon, ADC121C021_ALERT_T *alerts, int consumerDelayUs)
+{
+    unsigned int count = 0;
+    pthread_t thread;
+    void *result;
+    bool finished = false;
+
+    pthread_create (&thread, NULL, convert, NULL);
+    while (!finished) {
+        if (!mon->waitAlert (50)) {
+            finished = pthread_tryjoin_np (thread, &result) == 0;
+        }
+        while (count < CONVERSIONS && mon->getAlert (&alerts[count])) {
+            count++;
+        }
+        if (consumerDelayUs) {
+            usleep (consumerDelayUs);
+        }
+    }
+    while (count < CONVERSIONS && mon->getAlert (&alerts[count])) {
+        count++;
+    }
+    return count;
+}
+
+static void
+testMonitor ()
+{
+    static ADC121C021_ALERT_T alerts[CONVERSIONS];
+    ADC121C021Monitor mon (0, 7);
+    unsigned int count;
+    bool match = true;
+    char name[96];
+
+    resetChip ();
+    check (mon.start (ADC121C021_CYCLE_32, LOW_LIMIT, HIGH_LIMIT, HYSTERESIS) == MRAA_SUCCESS &&
+           regs[ADC121C021_REG_ALERT_LIM_UNDER] == LOW_LIMIT &&
+           regs[ADC121C021_REG_ALERT_LIM_OVER] == HIGH_LIMIT &&
+           regs[ADC121C021_REG_ALERT_HYS] == HYSTERESIS &&
+           regs[ADC121C021_REG_CONFIG] == ((ADC121C021_CYCLE_32 << 5) | ADC121C021_CONFIG_ALERT_FLAG |
+                                           ADC121C021_CONFIG_ALERT_PIN),
+           "start() programs the limits and automatic conversion");
+
+    count = runMonitor (&mon, alerts, 0);
+    for (unsigned int i = 0; i < count && i < edgeCount; i++) {
+        match = match && alerts[i].value == edges[i].value &&
+                alerts[i].low == ((edges[i].status & ADC121C021_ALERT_UNDER) != 0) &&
+                alerts[i].high == ((edges[i].status & ADC121C021_ALERT_OVER) != 0) &&
+                (i == 0 || alerts[i].timeUs >= alerts[i - 1].timeUs);
+    }
+    snprintf (name, sizeof (name), "%d conversions over %d swings raised %u alerts, all handed out",
+              CONVERSIONS, CONVERSIONS / PERIOD, edgeCount);
+    check (edgeCount == 4 * CONVERSIONS / PERIOD && count == edgeCount && mon.alerts () == edgeCount &&
+           mon.dropped () == 0, name);
+    check (match, "each alert has the result and the limit of its edge, in order");
+    snprintf (name, sizeof (name), "%u I2C transfers, 5 to start and 2 per alert", mon.transfers ());
+    check (mon.transfers () == busTransfers && busTransfers == 5 + 2 * edgeCount, name);
+
+    /* the last alert left the pointer on the result register */
+    uint16_t block[BLOCK];
+    uint32_t before = busBytes;
+    check (mon.readBlock (block, BLOCK) == BLOCK && busBytes - before == 3 * BLOCK &&
+           block[0] == input (CONVERSIONS - 1), "readBlock() reuses the register pointer");
+
+    uint16_t lowest, highest;
+    check (mon.getRange (&lowest, &highest, true) == MRAA_SUCCESS && lowest == 500 && highest == 3500,
+           "getRange() returns the lowest and highest results");
+    check (mon.getRange (&lowest, &highest) == MRAA_SUCCESS && lowest == 0x0fff && highest == 0,
+           "getRange() can restart the range");
+
+    before = busBytes;
+    check (mon.readBlock (block, BLOCK) == BLOCK && busBytes - before == 2 + 3 * BLOCK,
+           "readBlock() sets the pointer again after getRange()");
+
+    float volts[BLOCK];
+    bool same = true;
+    mon.toVolts (block, volts, BLOCK);
+    for (int i = 0; i < BLOCK; i++) {
+        same = same && volts[i] == mon.toVolts (block[i]);
+    }
+    check (same && fabsf (mon.toVolts (2048) - 1.5f) < 1e-6f, "batch and single conversions to volts agree");
+
+    mon.stop ();
+    check (regs[ADC121C021_REG_CONFIG] == 0 && alertIsr == NULL && !mon.waitAlert (-1),
+           "stop() turns conversion and the alert pin off");
+
+    /* a small ring and a slow reader */
+    ADC121C021Monitor slow (0, 7, ADC121C021_DEFAULT_I2C_ADDR, ADC121C021_DEFAULT_VREF, 2);
+    resetChip ();
+    slow.start (ADC121C021_CYCLE_32, LOW_LIMIT, HIGH_LIMIT, HYSTERESIS);
+    count = runMonitor (&slow, alerts, 200000);
+    check (slow.dropped () > 0 && count + slow.dropped () == edgeCount && slow.alerts () == edgeCount,
+           "a full ring drops and counts alerts");
+    slow.stop ();
+}
+
+/* Bus time at 100 kHz, 9 clocks a byte */
+static double
+busMs (uint32_t bytes)
+{
+    return bytes * 9 * 1000.0 / BUS_HZ;
+}
+
+static void
+benchmark ()
+{
+    ADC121C021Monitor mon (0, 7);
+    static ADC121C021_ALERT_T alerts[CONVERSIONS];
+    uint16_t block[BLOCK];
+    uint32_t monitorBytes, pollBytes, blockBytes, wordBytes;
+
+    resetChip ();
+    mon.start (ADC121C021_CYCLE_32, LOW_LIMIT, HIGH_LIMIT, HYSTERESIS);
+    runMonitor (&mon, alerts, 0);
+    monitorBytes = busBytes;
+
+    /* what applications did without the monitor: value() per conversion */
+    busBytes = 0;
+    for (int n = 0; n < CONVERSIONS; n++) {
+        mraa_i2c_read_word_data (NULL, ADC121C021_REG_RESULT);
+    }
+    pollBytes = busBytes;
+
+    busBytes = 0;
+    for (int n = 0; n < 100; n++) {
+        mon.readBlock (block, BLOCK);
+    }
+    blockBytes = busBytes;
+    busBytes = 0;
+    for (int n = 0; n < 100 * BLOCK; n++) {
+        mraa_i2c_read_word_data (NULL, ADC121C021_REG_RESULT);
+    }
+    wordBytes = busBytes;
+    mon.stop ();
+
+    printf ("%d conversions, limits %d and %d, I2C at %d kHz\n", CONVERSIONS, LOW_LIMIT, HIGH_LIMIT,
+            BUS_HZ / 1000);
+    printf ("polling value():  %6u bytes, %7.1f ms of bus time\n", pollBytes, busMs (pollBytes));
+    printf ("monitor:          %6u bytes, %7.1f ms of bus time (%.0fx less)\n", monitorBytes,
+            busMs (monitorBytes), (double) pollBytes / monitorBytes);
+    printf ("%d results: word reads %u bytes, readBlock() %u bytes (%.2fx less)\n", 100 * BLOCK,
+            wordBytes, blockBytes, (double) wordBytes / blockBytes);
+}
+
+int
+main (int argc, char **argv)
+{
+    testMonitor ();
+    if (argc < 2 || strcmp (argv[1], "--no-bench") != 0) {
+        benchmark ();
+    }
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
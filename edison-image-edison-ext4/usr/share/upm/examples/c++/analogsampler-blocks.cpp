@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks the upm::SampleBlock kernels against plain per-sample loops over
+ * random blocks of every length up to a few thousand samples, at odd
+ * offsets, for 12 bit and full 15 bit readings, and checks mean, RMS and
+ * crossings on a square wave. Then times the kernels against the loops.
+ * No sensor is needed and neither libmraa nor a upm library is linked.
+ *
+ * The kernels use SSE2 when the compiler targets it, which -msse2 turns
+ * on for the Edison's Atom; build a second time with -U__SSE2__ to check
+ * the plain loop fallback.
+ *
+ *   g++ -O2 -msse2 -I/usr/include/upm -o analogsampler-blocks analogsampler-blocks.cpp
+ *   g++ -O2 -U__SSE2__ -I/usr/include/upm -o analogsampler-blocks-plain analogsampler-blocks.cpp
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "analogsampler.h"
+
+using namespace upm;
+
+#define RANDOM_BLOCKS 2000
+#define MAX_BLOCK     3000
+#define FULL_SCALE    100000
+#define BENCH_SAMPLES (1 << 20)
+#define BENCH_ROUNDS  100
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The per-sample definitions the kernels must agree with */
+static void
+referenceStats (const uint16_t *block, unsigned int len, blockStats *stats)
+{
+    SampleBlock::reset (stats);
+    for (unsigned int i = 0; i < len; i++) {
+        stats->sum += block[i];
+        stats->sumSquares += (uint64_t) block[i] * block[i];
+        if (block[i] < stats->min) {
+            stats->min = block[i];
+        }
+        if (block[i] > stats->max) {
+            stats->max = block[i];
+        }
+    }
+    stats->count = len;
+}
+
+static unsigned int
+referenceCrossings (const uint16_t *block, unsigned int len, uint16_t threshold, int previous)
+{
+    unsigned int count = 0;
+
+    for (unsigned int i = 0; i < len; i++) {
+        int before = i ? block[i - 1] : previous;
+        if (before >= 0 && before < threshold && block[i] >= threshold) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool
+sameStats (const blockStats *a, const blockStats *b)
+{
+    return a->count == b->count && a->sum == b->sum && a->sumSquares == b->sumSquares &&
+           a->min == b->min && a->max == b->max;
+}
+
+static void
+testRandomBlocks ()
+{
+    static uint16_t buffer[MAX_BLOCK + 8];
+    bool stats = true, split = true, crossings = true;
+
+    srand (41);
+    for (int n = 0; n < RANDOM_BLOCKS; n++) {
+        unsigned int len = rand () % MAX_BLOCK;
+        unsigned int offset = rand () % 8;
+        int top = n % 2 ? 0x7fff : 4095;
+        uint16_t *block = buffer + offset;
+        blockStats expected, actual;
+
+        for (unsigned int i = 0; i < len; i++) {
+            block[i] = rand () % (top + 1);
+        }
+
+        referenceStats (block, len, &expected);
+        SampleBlock::reset (&actual);
+        SampleBlock::accumulate (block, len, &actual);
+        stats = stats && sameStats (&actual, &expected);
+
+        /* the same samples in two pieces, as the sampler's ring hands them out */
+        unsigned int cut = len ? rand () % len : 0;
+        SampleBlock::reset (&actual);
+        SampleBlock::accumulate (block, cut, &actual);
+        SampleBlock::accumulate (block + cut, len - cut, &actual);
+        split = split && sameStats (&actual, &expected);
+
+        uint16_t threshold = rand () % (top + 1);
+        int previous = n % 3 ? rand () % (top + 1) : -1;
+        crossings = crossings &&
+                    SampleBlock::crossings (block, len, threshold, previous) ==
+                    referenceCrossings (block, len, threshold, previous);
+    }
+
+    check (stats, "accumulate matches the per-sample sums, min and max");
+    check (split, "accumulating a block in two pieces gives the same stats");
+    check (crossings, "crossings matches the per-sample count");
+}
+
+static void
+testEdges ()
+{
+    static uint16_t block[FULL_SCALE];
+    blockStats stats;
+
+    /* more than 4096 rounds of full scale samples, past the 32 bit lanes */
+    for (int i = 0; i < FULL_SCALE; i++) {
+        block[i] = 0x7fff;
+    }
+    SampleBlock::reset (&stats);
+    SampleBlock::accumulate (block, FULL_SCALE, &stats);
+    check (stats.sum == (uint64_t) FULL_SCALE * 0x7fff &&
+           stats.sumSquares == (uint64_t) FULL_SCALE * 0x7fff * 0x7fff &&
+           stats.min == 0x7fff && stats.max == 0x7fff, "100000 full scale samples");
+
+    SampleBlock::reset (&stats);
+    SampleBlock::accumulate (block, 0, &stats);
+    check (stats.count == 0 && SampleBlock::mean (&stats) == 0 && SampleBlock::rms (&stats) == 0 &&
+           SampleBlock::crossings (block, 0, 1) == 0, "empty block");
+
+    /* square wave between 0 and 100, 10 samples each */
+    for (int i = 0; i < 1000; i++) {
+        block[i] = (i / 10) % 2 ? 100 : 0;
+    }
+    SampleBlock::reset (&stats);
+    SampleBlock::accumulate (block, 1000, &stats);
+    check (fabs (SampleBlock::mean (&stats) - 50) < 1e-9 &&
+           fabs (SampleBlock::rms (&stats) - sqrt (5000.0)) < 1e-9 &&
+           fabs (SampleBlock::acRms (&stats) - 50) < 1e-9, "square wave mean, RMS and AC RMS");
+    /* mapped to -0.5 and 0.5 */
+    check (fabs (SampleBlock::rms (&stats, 0.01, -0.5) - 0.5) < 1e-9, "scaled RMS around a bias");
+    check (SampleBlock::crossings (block, 1000, 50) == 50 &&
+           SampleBlock::crossings (block + 10, 990, 50, 0) == 50 &&
+           SampleBlock::crossings (block + 10, 990, 50) == 49, "square wave crossings");
+}
+
+static void
+benchmark ()
+{
+    uint16_t *block = (uint16_t *) malloc (BENCH_SAMPLES * sizeof (uint16_t));
+    blockStats kernel, loop;
+    unsigned int kernelCrossings = 0, loopCrossings = 0;
+    double start, kernelTime, loopTime;
+
+    srand (7);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        block[i] = 2048 + (int) (1500 * sin (i * 0.05)) + rand () % 64;
+    }
+
+    start = now ();
+    SampleBlock::reset (&kernel);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        SampleBlock::accumulate (block, BENCH_SAMPLES, &kernel);
+        kernelCrossings += SampleBlock::crossings (block, BENCH_SAMPLES, 2048);
+    }
+    kernelTime = now () - start;
+
+    start = now ();
+    SampleBlock::reset (&loop);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        blockStats round;
+        referenceStats (block, BENCH_SAMPLES, &round);
+        loop.count += round.count;
+        loop.sum += round.sum;
+        loop.sumSquares += round.sumSquares;
+        loop.min = round.min < loop.min ? round.min : loop.min;
+        loop.max = round.max > loop.max ? round.max : loop.max;
+        loopCrossings += referenceCrossings (block, BENCH_SAMPLES, 2048, -1);
+    }
+    loopTime = now () - start;
+
+    check (sameStats (&kernel, &loop) && kernelCrossings == loopCrossings,
+           "kernels and loops agree on the benchmark data");
+#ifdef __SSE2__
+    printf ("SampleBlock kernels built with SSE2\n");
+#else
+    printf ("SampleBlock kernels built without SSE2, as plain loops\n");
+#endif
+    printf ("%d rounds of %d 12 bit samples, stats and crossings\n", BENCH_ROUNDS, BENCH_SAMPLES);
+    printf ("per-sample loops: %.3f s, %7.0f Msamples/s\n", loopTime,
+            BENCH_ROUNDS * (double) BENCH_SAMPLES / loopTime / 1e6);
+    printf ("SampleBlock:      %.3f s, %7.0f Msamples/s (%.1fx)\n", kernelTime,
+            BENCH_ROUNDS * (double) BENCH_SAMPLES / kernelTime / 1e6, loopTime / kernelTime);
+    free (block);
+}
+
+int
+main (int argc, char **argv)
+{
+    testRandomBlocks ();
+    testEdges ();
+    if (argc < 2 || strcmp (argv[1], "--no-bench") != 0) {
+        benchmark ();
+    }
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Feeds the same sample windows to Microphone::findThreshold and
+ * MicrophoneStream::findThreshold and checks that the threshold contexts
+ * and the results stay identical for several smoothing factors. Uses
+ * analog pin A0 only to construct the objects; the samples are generated.
+ *
+ *   g++ -O2 -I/usr/include/upm -o mic-stream mic-stream.cpp -lupm-mic -lmraa -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mic.h"
+
+using namespace upm;
+
+#define WINDOWS 200
+#define WINDOW_LEN 128
+
+static const int SMOOTHING[] = { 1, 2, 5, 16 };
+static const unsigned int THRESHOLDS[] = { 0, 30, 512 };
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static bool
+sameContext (const thresholdContext *a, const thresholdContext *b)
+{
+    return a->averageReading == b->averageReading &&
+           a->runningAverage == b->runningAverage &&
+           a->averagedOver   == b->averagedOver;
+}
+
+/* a noisy tone whose level drifts from window to window */
+static void
+fillWindow (uint16_t *buffer, int window)
+{
+    int level = 200 + (window * 37) % 600;
+
+    for (int i = 0; i < WINDOW_LEN; i++) {
+        int sample = level + ((i % 16) - 8) * 6 + rand () % 40;
+        buffer[i] = sample < 0 ? 0 : (sample > 1023 ? 1023 : sample);
+    }
+}
+
+static void
+compare (Microphone &reference, MicrophoneStream &stream)
+{
+    uint16_t buffer[WINDOW_LEN];
+    char what[96];
+
+    for (unsigned int s = 0; s < sizeof (SMOOTHING) / sizeof (SMOOTHING[0]); s++) {
+        for (unsigned int t = 0; t < sizeof (THRESHOLDS) / sizeof (THRESHOLDS[0]); t++) {
+            thresholdContext expected, actual;
+            bool same = true;
+
+            memset (&expected, 0, sizeof (expected));
+            expected.averagedOver = SMOOTHING[s];
+            actual = expected;
+
+            srand (s * 31 + t);
+            for (int w = 0; w < WINDOWS && same; w++) {
+                fillWindow (buffer, w);
+                int want = reference.findThreshold (&expected, THRESHOLDS[t], buffer, WINDOW_LEN);
+                int got  = stream.findThreshold (&actual, THRESHOLDS[t], buffer, WINDOW_LEN);
+                same = want == got && sameContext (&expected, &actual);
+            }
+
+            snprintf (what, sizeof (what), "averagedOver %d threshold %u",
+                      SMOOTHING[s], THRESHOLDS[t]);
+            check (same && actual.averagedOver == SMOOTHING[s], what);
+        }
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+    AnalogSampler sampler (1000);
+    Microphone microphone (0);
+    MicrophoneStream stream (sampler, 0);
+
+    compare (microphone, stream);
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
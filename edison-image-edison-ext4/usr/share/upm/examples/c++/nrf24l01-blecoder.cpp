@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks upm::NRF24L01BleCoder against known BLE vectors, then times beacon
+ * encoding through the bit-serial and the table-driven paths into a
+ * simulated SPI bus. No radio is needed.
+ *
+ *   g++ -O2 -I/usr/include/upm -o nrf24l01-blecoder nrf24l01-blecoder.cpp
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "nrf24l01.h"
+
+using namespace upm;
+
+/* CRC-24/BLE check value of "123456789" from the CRC catalogue */
+static const uint8_t  CHECK_INPUT[] = "123456789";
+static const uint32_t CHECK_CRC     = 0xC25A56;
+
+/* ADV_NONCONN_IND from a random address, flags and the name "Edison" */
+static const uint8_t ADV_PDU[] = {
+    0x42, 0x11, 0xEF, 0xFF, 0xC0, 0xAA, 0x18, 0x00, 0x02, 0x01,
+    0x06, 0x07, 0x09, 0x45, 0x64, 0x69, 0x73, 0x6F, 0x6E
+};
+static const uint32_t ADV_CRC = 0x8DA55F;
+
+/* whitening sequences of the advertising channels, LSB first */
+static const uint8_t WHITENING[3][16] = {
+    { 0x8D, 0xD2, 0x57, 0xA1, 0x3D, 0xA7, 0x66, 0xB0, 0x75, 0x31, 0x11, 0x48, 0x96, 0x77, 0xF8, 0xE3 },
+    { 0xD6, 0xC5, 0x44, 0x20, 0x59, 0xDE, 0xE1, 0x8F, 0x1B, 0xA5, 0xAF, 0x42, 0x7B, 0x4E, 0xCD, 0x60 },
+    { 0x1F, 0x37, 0x4A, 0x5F, 0x85, 0xF6, 0x9C, 0x9A, 0xC1, 0xD6, 0xC5, 0x44, 0x20, 0x59, 0xDE, 0xE1 }
+};
+
+/* ADV_PDU with its CRC, whitened and bit reversed for the NRF24L01 */
+static const uint8_t ADV_FRAMES[3][sizeof (ADV_PDU) + 3] = {
+    { 0xF3, 0xC3, 0x1D, 0x7A, 0xBF, 0xB0, 0x7E, 0x0D, 0xEE, 0x0C, 0xE8,
+      0xF2, 0xF9, 0x4C, 0x39, 0x51, 0xAC, 0x61, 0xA3, 0xF1, 0xDC, 0x7B },
+    { 0x29, 0x2B, 0xD5, 0xFB, 0x99, 0x2E, 0x9F, 0xF1, 0x98, 0x25, 0x95,
+      0xA2, 0x4E, 0xD0, 0x95, 0x90, 0x19, 0xB0, 0x32, 0xF3, 0x91, 0x46 },
+    { 0xBA, 0x64, 0xA5, 0x05, 0xA2, 0x3A, 0x21, 0x59, 0xC3, 0xEB, 0xC3,
+      0xC2, 0x94, 0x38, 0x5D, 0x11, 0x3F, 0x2E, 0xD3, 0x0F, 0xE7, 0x6F }
+};
+
+#define BENCH_BEACONS 200000
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+/* CRC bytes as left by crc(), back to the catalogue's reflected value */
+static uint32_t
+crcValue (const uint8_t *dst)
+{
+    return NRF24L01BleCoder::swapbits (dst[0]) |
+           (NRF24L01BleCoder::swapbits (dst[1]) << 8) |
+           (NRF24L01BleCoder::swapbits (dst[2]) << 16);
+}
+
+static void
+checkCrc (const uint8_t *data, uint8_t len, uint32_t expected, const char *what)
+{
+    uint8_t fast[3] = { 0x55, 0x55, 0x55 };
+    uint8_t slow[3] = { 0x55, 0x55, 0x55 };
+    char name[64];
+
+    NRF24L01BleCoder::crc (data, len, fast);
+    NRF24L01BleCoder::crcReference (data, len, slow);
+    snprintf (name, sizeof (name), "crc %s", what);
+    check (crcValue (fast) == expected, name);
+    snprintf (name, sizeof (name), "crcReference %s", what);
+    check (crcValue (slow) == expected, name);
+}
+
+static void
+testVectors ()
+{
+    uint8_t buf[MAX_BUFFER], frames[3][MAX_BUFFER];
+    char name[64];
+    uint8_t len = sizeof (ADV_PDU);
+
+    for (int i = 0; i < 256; i++) {
+        if (NRF24L01BleCoder::swapbits (i) != NRF24L01BleCoder::swapbitsReference (i)) {
+            check (false, "swapbits");
+            return;
+        }
+    }
+    check (true, "swapbits");
+
+    checkCrc (CHECK_INPUT, 9, CHECK_CRC, "check value");
+    checkCrc (ADV_PDU, len, ADV_CRC, "advertising PDU");
+    checkCrc (ADV_PDU, 0, 0xAAAAAA, "empty");
+
+    for (int i = 0; i < 3; i++) {
+        memset (buf, 0, sizeof (buf));
+        NRF24L01BleCoder::whiten (buf, sizeof (WHITENING[i]), 37 + i);
+        snprintf (name, sizeof (name), "whiten channel %d", 37 + i);
+        check (memcmp (buf, WHITENING[i], sizeof (WHITENING[i])) == 0, name);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        memcpy (buf, ADV_PDU, len);
+        memset (buf + len, 0x55, 3);
+        NRF24L01BleCoder::packetEncode (buf, len + 3, 37 + i);
+        snprintf (name, sizeof (name), "packetEncode channel %d", 37 + i);
+        check (memcmp (buf, ADV_FRAMES[i], len + 3) == 0, name);
+
+        memcpy (buf, ADV_PDU, len);
+        memset (buf + len, 0x55, 3);
+        NRF24L01BleCoder::packetEncodeReference (buf, len + 3, 37 + i);
+        snprintf (name, sizeof (name), "packetEncodeReference channel %d", 37 + i);
+        check (memcmp (buf, ADV_FRAMES[i], len + 3) == 0, name);
+    }
+
+    check (NRF24L01BleCoder::encodeAdvertising (ADV_PDU, len, frames) == len + 3 &&
+           memcmp (frames[0], ADV_FRAMES[0], len + 3) == 0 &&
+           memcmp (frames[1], ADV_FRAMES[1], len + 3) == 0 &&
+           memcmp (frames[2], ADV_FRAMES[2], len + 3) == 0, "encodeAdvertising");
+    check (NRF24L01BleCoder::encodeAdvertising (ADV_PDU, MAX_BUFFER - 2, frames) == 0,
+           "encodeAdvertising rejects oversized PDUs");
+}
+
+/*
+ * Stands in for the SPI bus of the radio: takes W_TX_PAYLOAD transfers the
+ * way NRF24L01::sendBeacon issues them and keeps a running sum so the
+ * encoding cannot be optimized away.
+ */
+class SpiSink {
+    public:
+        SpiSink () : m_bytes (0), m_sum (0) {}
+
+        void writePayload (const uint8_t *payload, uint8_t len) {
+            uint8_t tx[MAX_BUFFER + 1];
+
+            tx[0] = W_TX_PAYLOAD;
+            memcpy (tx + 1, payload, len);
+            for (uint8_t i = 0; i <= len; i++) {
+                m_sum += tx[i];
+            }
+            m_bytes += len + 1;
+        }
+
+        unsigned long m_bytes;
+        unsigned long m_sum;
+};
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+benchmark ()
+{
+    uint8_t packet[MAX_BUFFER], frames[3][MAX_BUFFER];
+    uint8_t len = sizeof (ADV_PDU);
+    SpiSink reference, table;
+    double start, referenceTime, tableTime;
+
+    start = now ();
+    for (int n = 0; n < BENCH_BEACONS; n++) {
+        for (int i = 0; i < 3; i++) {
+            memcpy (packet, ADV_PDU, len);
+            memset (packet + len, 0x55, 3);
+            NRF24L01BleCoder::packetEncodeReference (packet, len + 3, 37 + i);
+            reference.writePayload (packet, len + 3);
+        }
+    }
+    referenceTime = now () - start;
+
+    start = now ();
+    for (int n = 0; n < BENCH_BEACONS; n++) {
+        uint8_t frameLen = NRF24L01BleCoder::encodeAdvertising (ADV_PDU, len, frames);
+        for (int i = 0; i < 3; i++) {
+            table.writePayload (frames[i], frameLen);
+        }
+    }
+    tableTime = now () - start;
+
+    check (reference.m_bytes == table.m_bytes && reference.m_sum == table.m_sum,
+           "both paths sent the same bytes");
+    printf ("%d beacons on 3 channels, %lu bytes to SPI each way\n", BENCH_BEACONS, table.m_bytes);
+    printf ("bit-serial:   %.3f s, %.0f beacons/s\n", referenceTime, BENCH_BEACONS / referenceTime);
+    printf ("table-driven: %.3f s, %.0f beacons/s (%.1fx)\n", tableTime, BENCH_BEACONS / tableTime,
+            referenceTime / tableTime);
+}
+
+int
+main (int argc, char **argv)
+{
+    testVectors ();
+    if (argc < 2 || strcmp (argv[1], "--no-bench") != 0) {
+        benchmark ();
+    }
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
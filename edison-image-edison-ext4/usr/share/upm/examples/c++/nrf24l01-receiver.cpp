@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks upm::NRF24L01Receiver against a simulated radio and times it
+ * against polling the radio. The simulated chip has the 3 entry RX FIFO
+ * of the nRF24L01 and pulls its IRQ line low when a payload lands in an
+ * empty FIFO; while the FIFO is full the transmitter retries, as with
+ * auto acknowledgement. The simulation stands in for the NRF24L01 methods
+ * and the IRQ pin, so no radio is needed and neither libupm-nrf24l01 nor
+ * libmraa is linked. Build it with -fsanitize=thread as well to check the
+ * ring between the interrupt and the application threads.
+ *
+ *   g++ -O2 -I/usr/include/upm -o nrf24l01-receiver nrf24l01-receiver.cpp -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nrf24l01.h"
+
+using namespace upm;
+
+#define CHIP_FIFO     3
+#define BURST         32
+#define TEST_PAYLOADS 20000
+#define BENCH_PAYLOADS 200000
+#define POLL_PAYLOADS 5000
+#define IDLE_MS       200
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The simulated chip. Payloads carry their sequence number in the first
+ * four bytes; spiReads counts the SPI transactions of the receive side.
+ */
+static pthread_mutex_t chipLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t chipFifo[CHIP_FIFO], chipCount = 0, chipSent = 0, chipTotal = 0;
+static uint32_t retries = 0, spiReads = 0, transmits = 0;
+static void (*irqIsr) (void *) = NULL;
+static void *irqArg = NULL;
+
+NRF24L01::NRF24L01 (uint8_t cs, uint8_t ce)
+{
+    (void) cs;
+    (void) ce;
+}
+
+NRF24L01::~NRF24L01 ()
+{
+}
+
+bool
+NRF24L01::dataReady ()
+{
+    bool ready;
+
+    pthread_mutex_lock (&chipLock);
+    spiReads++;
+    ready = chipCount > 0;
+    pthread_mutex_unlock (&chipLock);
+    return ready;
+}
+
+void
+NRF24L01::getData (uint8_t *data)
+{
+    pthread_mutex_lock (&chipLock);
+    spiReads++;
+    memset (data, chipFifo[0] & 0xff, MAX_BUFFER);
+    memcpy (data, &chipFifo[0], sizeof (chipFifo[0]));
+    memmove (chipFifo, chipFifo + 1, (CHIP_FIFO - 1) * sizeof (chipFifo[0]));
+    chipCount--;
+    pthread_mutex_unlock (&chipLock);
+}
+
+void
+NRF24L01::rxPowerUp ()
+{
+}
+
+void
+NRF24L01::send (uint8_t *value)
+{
+    (void) value;
+    pthread_mutex_lock (&chipLock);
+    transmits++;
+    pthread_mutex_unlock (&chipLock);
+}
+
+extern "C" {
+
+mraa_gpio_context
+mraa_gpio_init (int pin)
+{
+    (void) pin;
+    return (mraa_gpio_context) &chipLock;
+}
+
+mraa_result_t
+mraa_gpio_dir (mraa_gpio_context dev, gpio_dir_t dir)
+{
+    (void) dev;
+    (void) dir;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_close (mraa_gpio_context dev)
+{
+    (void) dev;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_isr (mraa_gpio_context dev, gpio_edge_t edge, void (*fptr) (void *), void *args)
+{
+    (void) dev;
+    (void) edge;
+    irqIsr = fptr;
+    irqArg = args;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_isr_exit (mraa_gpio_context dev)
+{
+    (void) dev;
+    irqIsr = NULL;
+    return MRAA_SUCCESS;
+}
+
+}
+
+/* The transmitter and the IRQ line; runs the receiver's interrupt handler
+ * on its own thread, as mraa runs it on the interrupt thread */
+static void *
+air (void *arg)
+{
+    (void) arg;
+    while (chipSent < chipTotal) {
+        bool edge = false, full;
+
+        pthread_mutex_lock (&chipLock);
+        full = chipCount == CHIP_FIFO;
+        if (full) {
+            retries++;
+        } else {
+            edge = chipCount == 0;
+            chipFifo[chipCount++] = chipSent++;
+        }
+        pthread_mutex_unlock (&chipLock);
+
+        if (edge && irqIsr) {
+            irqIsr (irqArg);
+        }
+        if (full) {
+            usleep (20);
+        } else if (chipSent % BURST == 0) {
+            usleep (100);
+        }
+    }
+    return NULL;
+}
+
+static void
+startAir (uint32_t total, pthread_t *thread)
+{
+    chipCount = chipSent = retries = spiReads = 0;
+    chipTotal = total;
+    pthread_create (thread, NULL, air, NULL);
+}
+
+typedef struct {
+    uint32_t delivered;
+    uint32_t next;      // lowest sequence number still acceptable
+    bool     ordered;
+    bool     intact;
+    unsigned batches;
+} Delivery;
+
+static void
+deliver (Delivery *d, const uint8_t *payload)
+{
+    uint32_t seq;
+
+    memcpy (&seq, payload, sizeof (seq));
+    d->ordered = d->ordered && seq >= d->next;
+    d->intact = d->intact && payload[MAX_BUFFER - 1] == (seq & 0xff);
+    d->next = seq + 1;
+    d->delivered++;
+}
+
+static void
+handler (const uint8_t *payloads, unsigned int count, void *arg)
+{
+    Delivery *d = (Delivery *) arg;
+
+    d->batches++;
+    for (unsigned int i = 0; i < count; i++) {
+        deliver (d, payloads + i * MAX_BUFFER);
+    }
+}
+
+/* Receive total payloads through a receiver; returns payloads per second */
+static double
+runReceiver (uint32_t total, unsigned int depth, int consumerDelayUs, bool copyOut,
+             Delivery *d, NRF24L01Receiver **done)
+{
+    static NRF24L01 radio (0, 0);
+    NRF24L01Receiver *rx = new NRF24L01Receiver (radio, 7, depth);
+    uint8_t payload[MAX_BUFFER];
+    pthread_t thread;
+    double start;
+    void *result;
+    bool finished = false;
+
+    memset (d, 0, sizeof (*d));
+    d->ordered = d->intact = true;
+    if (rx->start () != MRAA_SUCCESS) {
+        check (false, "start the receiver");
+        *done = rx;
+        return 0;
+    }
+
+    start = now ();
+    startAir (total, &thread);
+    while (!finished) {
+        if (!rx->waitData (100)) {
+            finished = pthread_tryjoin_np (thread, &result) == 0;
+        }
+        if (copyOut) {
+            while (rx->getData (payload)) {
+                deliver (d, payload);
+                /* an application transmit now and then, e.g. an ack */
+                if (d->delivered % 1000 == 0) {
+                    rx->send (payload);
+                }
+            }
+        } else {
+            rx->dispatch (handler, d);
+        }
+        if (consumerDelayUs) {
+            usleep (consumerDelayUs);
+        }
+    }
+    rx->dispatch (handler, d);
+    rx->stop ();
+    *done = rx;
+    return total / (now () - start);
+}
+
+static void
+testReceiver ()
+{
+    NRF24L01Receiver *rx;
+    Delivery d;
+    char name[96];
+
+    runReceiver (TEST_PAYLOADS, 64, 0, false, &d, &rx);
+    snprintf (name, sizeof (name), "%d payloads dispatched in order, none dropped", TEST_PAYLOADS);
+    check (d.delivered == TEST_PAYLOADS && d.ordered && d.intact && rx->dropped () == 0 &&
+           rx->received () == TEST_PAYLOADS, name);
+    check (d.batches < d.delivered && rx->interrupts () > 0, "payloads arrive in batches");
+    delete rx;
+
+    runReceiver (TEST_PAYLOADS, 64, 0, true, &d, &rx);
+    check (d.delivered == TEST_PAYLOADS && d.ordered && d.intact && transmits == TEST_PAYLOADS / 1000,
+           "getData() with transmits in between, every payload in order");
+    delete rx;
+
+    runReceiver (TEST_PAYLOADS / 4, 4, 2000, false, &d, &rx);
+    check (rx->dropped () > 0 && d.delivered + rx->dropped () == TEST_PAYLOADS / 4 &&
+           rx->received () == TEST_PAYLOADS / 4 && d.ordered && d.intact,
+           "a full ring drops and counts payloads, the rest stay in order");
+    delete rx;
+}
+
+/* What applications did without the receiver: poll the radio every ms */
+static double
+runPolling (uint32_t total)
+{
+    NRF24L01 radio (0, 0);
+    uint8_t payload[MAX_BUFFER];
+    Delivery d;
+    pthread_t thread;
+    double start;
+
+    memset (&d, 0, sizeof (d));
+    d.ordered = d.intact = true;
+    start = now ();
+    startAir (total, &thread);
+    while (d.delivered < total) {
+        while (radio.dataReady ()) {
+            radio.getData (payload);
+            deliver (&d, payload);
+        }
+        usleep (1000);
+    }
+    pthread_join (thread, NULL);
+    check (d.ordered && d.intact, "polling: every payload, in order");
+    return total / (now () - start);
+}
+
+static void
+benchmark ()
+{
+    static NRF24L01 radio (0, 0);
+    NRF24L01Receiver *rx;
+    Delivery d;
+    double rate;
+    uint32_t reads;
+
+    printf ("chip FIFO of %d payloads, bursts of %d\n", CHIP_FIFO, BURST);
+    rate = runReceiver (BENCH_PAYLOADS, 256, 0, false, &d, &rx);
+    printf ("receiver, ring of 256: %8.0f payloads/s, %u interrupts, %u batches, %.2f SPI reads/payload\n",
+            rate, rx->interrupts (), d.batches, (double) spiReads / BENCH_PAYLOADS);
+    check (d.delivered == BENCH_PAYLOADS && d.ordered, "receiver: every payload, in order");
+    delete rx;
+
+    rate = runPolling (POLL_PAYLOADS);
+    printf ("1 ms polling:          %8.0f payloads/s, %.2f SPI reads/payload, %u retransmits\n",
+            rate, (double) spiReads / POLL_PAYLOADS, retries);
+
+    /* SPI traffic while nothing is received */
+    rx = new NRF24L01Receiver (radio, 7, 256);
+    rx->start ();
+    reads = spiReads;
+    rx->waitData (IDLE_MS);
+    reads = spiReads - reads;
+    rx->stop ();
+    delete rx;
+    check (reads == 0, "the receiver leaves SPI alone while idle");
+
+    uint32_t pollReads = spiReads;
+    for (double end = now () + IDLE_MS / 1e3; now () < end; ) {
+        radio.dataReady ();
+        usleep (1000);
+    }
+    pollReads = spiReads - pollReads;
+    printf ("idle %d ms:            receiver %u SPI reads, 1 ms polling %u\n", IDLE_MS, reads, pollReads);
+}
+
+int
+main (int argc, char **argv)
+{
+    testReceiver ();
+    if (argc < 2 || strcmp (argv[1], "--no-bench") != 0) {
+        benchmark ();
+    }
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
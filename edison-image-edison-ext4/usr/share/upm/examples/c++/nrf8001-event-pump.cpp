@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks aci_ring_t and times upm::NRF8001EventPump against a scripted ACI
+ * stub: a "chip" that holds at most 4 events, like the transport layer
+ * queue, and raises them in notification bursts of 20. The stub stands in
+ * for lib_aci_event_get() and the RDYN pin, so no nRF8001 is needed and
+ * neither libupm-nrf8001 nor libmraa is linked.
+ *
+ *   g++ -O2 -I/usr/include/upm -o nrf8001-event-pump nrf8001-event-pump.cpp -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nrf8001.h"
+
+#define CHIP_EVENTS  4
+#define BURST        20
+#define BENCH_EVENTS 100000
+#define POLL_EVENTS  20000
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+/*
+ * The scripted chip. Events carry their sequence number; the chip raises
+ * a falling RDYN edge for each one, unless edge interrupts are turned off
+ * to exercise the polling fallback of the pump.
+ */
+static pthread_mutex_t chipLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t chipRaised = 0, chipRead = 0, chipTotal = 0;
+static bool chipEdges = true;
+static void (*rdynIsr) (void *) = NULL;
+static void *rdynArg = NULL;
+
+bool
+lib_aci_event_get (aci_state_t *aci, hal_aci_evt_t *event)
+{
+    bool have;
+
+    (void) aci;
+    pthread_mutex_lock (&chipLock);
+    have = chipRead < chipRaised;
+    if (have) {
+        memset (event, 0, sizeof (*event));
+        memcpy (&event->evt, &chipRead, sizeof (chipRead));
+        chipRead++;
+    }
+    pthread_mutex_unlock (&chipLock);
+    return have;
+}
+
+extern "C" {
+
+mraa_gpio_context
+mraa_gpio_init (int pin)
+{
+    (void) pin;
+    return (mraa_gpio_context) &chipLock;
+}
+
+mraa_result_t
+mraa_gpio_dir (mraa_gpio_context dev, gpio_dir_t dir)
+{
+    (void) dev;
+    (void) dir;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_close (mraa_gpio_context dev)
+{
+    (void) dev;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_isr (mraa_gpio_context dev, gpio_edge_t edge, void (*fptr) (void *), void *args)
+{
+    (void) dev;
+    (void) edge;
+    if (!chipEdges) {
+        return MRAA_ERROR_FEATURE_NOT_SUPPORTED;
+    }
+    rdynIsr = fptr;
+    rdynArg = args;
+    return MRAA_SUCCESS;
+}
+
+mraa_result_t
+mraa_gpio_isr_exit (mraa_gpio_context dev)
+{
+    (void) dev;
+    rdynIsr = NULL;
+    return MRAA_SUCCESS;
+}
+
+}
+
+static void *
+chip (void *arg)
+{
+    (void) arg;
+    for (uint32_t n = 0; n < chipTotal; ) {
+        bool room;
+
+        pthread_mutex_lock (&chipLock);
+        room = chipRaised - chipRead < CHIP_EVENTS;
+        if (room) {
+            chipRaised++;
+            n++;
+        }
+        pthread_mutex_unlock (&chipLock);
+
+        if (room && rdynIsr) {
+            rdynIsr (rdynArg);
+        }
+        if (!room) {
+            usleep (20);
+        } else if (n % BURST == 0) {
+            usleep (200);
+        }
+    }
+    return NULL;
+}
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+testRing ()
+{
+    aci_ring_t ring;
+    hal_aci_data_t in, out;
+    bool ordered = true;
+
+    check (aci_ring_init (&ring, 0) && ring.mask == 0, "size 0 gives one entry");
+    aci_ring_free (&ring);
+    check (aci_ring_init (&ring, 5) && ring.mask == 7, "size 5 is rounded up to 8");
+    aci_ring_free (&ring);
+    check (!aci_ring_init (&ring, ACI_RING_MAX_SIZE + 1) && ring.aci_data == NULL,
+           "sizes over ACI_RING_MAX_SIZE are refused");
+    check (!aci_ring_init (&ring, 0xffffffffu) && ring.aci_data == NULL, "size 2^32 - 1 is refused");
+
+    aci_ring_init (&ring, 4);
+    /* start just below the wrap of the free running indices */
+    ring.head = ring.tail = 0xfffffffeu;
+    memset (&in, 0, sizeof (in));
+    for (int round = 0; round < 3; round++) {
+        for (uint8_t i = 0; i < 4; i++) {
+            in.status_byte = round * 4 + i;
+            aci_ring_enqueue (&ring, &in);
+        }
+        if (round == 0) {
+            check (aci_ring_is_full (&ring) && !aci_ring_enqueue (&ring, &in), "full ring refuses a fifth packet");
+        }
+        for (uint8_t i = 0; i < 4; i++) {
+            ordered = ordered && aci_ring_dequeue (&ring, &out) && out.status_byte == round * 4 + i;
+        }
+    }
+    check (ordered && aci_ring_is_empty (&ring), "packets come out in order across the index wrap");
+    aci_ring_free (&ring);
+}
+
+/* Pump total events through a pump of the given depth; returns events per second */
+static double
+runPump (bool edges, uint32_t total, uint32_t depth, int pollMs, uint32_t *wakeups)
+{
+    aci_state_t aci;
+    hal_aci_evt_t event;
+    pthread_t thread;
+    uint32_t expected = 0, seq;
+    double start, elapsed;
+    bool ordered = true;
+    char name[64];
+
+    chipEdges = edges;
+    chipTotal = total;
+    chipRaised = chipRead = 0;
+    memset (&aci, 0, sizeof (aci));
+    aci.aci_pins.rdyn_pin = 9;
+
+    upm::NRF8001EventPump pump (&aci, depth, pollMs);
+    if (pump.start () != MRAA_SUCCESS || pump.edgeDriven () != edges) {
+        check (false, "start the pump");
+        return 0;
+    }
+
+    start = now ();
+    pthread_create (&thread, NULL, chip, NULL);
+    while (expected < total && pump.getEvent (&event, 2000)) {
+        memcpy (&seq, &event.evt, sizeof (seq));
+        ordered = ordered && seq == expected;
+        expected++;
+        /* an application command now and then, which wakes the pump */
+        if (expected % 500 == 0) {
+            pump.lock ();
+            pump.unlock ();
+        }
+    }
+    elapsed = now () - start;
+    pthread_join (thread, NULL);
+    *wakeups = pump.wakeups ();
+    pump.stop ();
+
+    snprintf (name, sizeof (name), "%s, depth %u: every event, in order",
+              edges ? "edges" : "polling", depth);
+    check (expected == total && ordered, name);
+    return total / elapsed;
+}
+
+static void
+benchmark ()
+{
+    uint32_t wakeups;
+    double rate;
+
+    printf ("chip holding %d events, bursts of %d\n", CHIP_EVENTS, BURST);
+    rate = runPump (true, BENCH_EVENTS, 64, 100, &wakeups);
+    printf ("edge wake-ups, depth 64: %8.0f events/s, %u wake-ups\n", rate, wakeups);
+    rate = runPump (true, BENCH_EVENTS, 4, 100, &wakeups);
+    printf ("edge wake-ups, depth 4:  %8.0f events/s, %u wake-ups\n", rate, wakeups);
+    rate = runPump (false, POLL_EVENTS, 64, 1, &wakeups);
+    printf ("1 ms polling, depth 64:  %8.0f events/s, %u wake-ups\n", rate, wakeups);
+}
+
+int
+main (int argc, char **argv)
+{
+    uint32_t wakeups;
+
+    testRing ();
+    if (argc < 2 || strcmp (argv[1], "--no-bench") != 0) {
+        benchmark ();
+    } else {
+        runPump (true, 2000, 4, 100, &wakeups);
+        runPump (false, 200, 64, 1, &wakeups);
+    }
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Counts on a TM1637 four digit display, first through upm::TM1637 and
+ * then through upm::TM1637Batched, and prints the time per display update
+ * of each. The batched figures include its own frame time, the time the
+ * pins were being played, against the whole call.
+ *
+ *   g++ -O2 -I/usr/include/upm -o tm1637-batched tm1637-batched.cpp \
+ *       -lupm-tm1637 -lmraa
+ *
+ *   ./tm1637-batched [data pin] [clock pin] [updates]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tm1637.h"
+
+using namespace upm;
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+counter (char *msg, int n)
+{
+    snprintf (msg, 5, "%04x", n & 0xffff);
+}
+
+int
+main (int argc, char **argv)
+{
+    int di      = argc > 1 ? atoi (argv[1]) : 0;
+    int dcki    = argc > 2 ? atoi (argv[2]) : 1;
+    int updates = argc > 3 ? atoi (argv[3]) : 200;
+    double start, gpioTime, batchedTime, frames = 0;
+    char msg[5];
+
+    if (updates <= 0) {
+        updates = 200;
+    }
+
+    {
+        TM1637 display (di, dcki);
+
+        start = now ();
+        for (int n = 0; n < updates; n++) {
+            counter (msg, n);
+            display.write (msg);
+        }
+        gpioTime = now () - start;
+    }
+
+    {
+        TM1637Batched display (di, dcki);
+
+        start = now ();
+        for (int n = 0; n < updates; n++) {
+            counter (msg, n);
+            display.write (msg);
+            frames += display.frameTime ();
+        }
+        batchedTime = now () - start;
+    }
+
+    printf ("%d updates\n", updates);
+    printf ("TM1637:        %8.1f us per update\n", gpioTime * 1e6 / updates);
+    printf ("TM1637Batched: %8.1f us per update, %.1f us of it on the pins (%.1fx)\n",
+            batchedTime * 1e6 / updates, frames / 1e3 / updates, gpioTime / batchedTime);
+
+    return 0;
+}
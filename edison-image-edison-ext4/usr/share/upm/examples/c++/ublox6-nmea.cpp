@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Replays an NMEA log through upm::Ublox6Parser in random UART sized reads
+ * and checks its counts and its last fix against a line by line reference
+ * decoder, the copy, strsep() and atof() way applications decoded the
+ * output of upm::Ublox6 themselves. Then times both over the log.
+ *
+ * ublox6-sample.nmea, next to this file, is five minutes of the default
+ * 1 Hz output of a U-BLOX 6 (RMC, VTG, GGA, GSA, GSV, GLL), from a cold
+ * start with no fix through a drive with two turns. It was generated in
+ * that format rather than recorded, and has two sentences with a flipped
+ * character and one cut short by an overrun. A log recorded from the
+ * receiver, e.g. with "cat /dev/ttyMFD1 > drive.nmea", can be given
+ * instead. No receiver is needed and libupm-ublox6 is not linked.
+ *
+ *   g++ -O2 -I/usr/include/upm -o ublox6-nmea ublox6-nmea.cpp -lpthread
+ *
+ *   ./ublox6-nmea [log] [--no-bench]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "ublox6.h"
+
+using namespace upm;
+
+#define SAMPLE_LOG  "/usr/share/upm/examples/c++/ublox6-sample.nmea"
+#define BENCH_BYTES (32 * 1024 * 1024)
+#define READ_SIZE   4096
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reference decoder: the fix and counts the log should give */
+typedef struct {
+    ublox6Fix fix;
+    uint32_t  sentences;
+    uint32_t  errors;
+} Reference;
+
+static double
+degrees (const char *value, const char *hemisphere)
+{
+    double v = atof (value);
+    double d = (int) (v / 100) + fmod (v, 100) / 60;
+    return (*hemisphere == 'S' || *hemisphere == 'W') ? -d : d;
+}
+
+static void
+referenceSentence (char *s, Reference *ref)
+{
+    char *f[20], *p = s + 1, *star = strchr (s, '*');
+    unsigned sum = 0;
+    int n = 0;
+
+    for (char *c = p; c < star; c++) {
+        sum ^= (unsigned char) *c;
+    }
+    if (strlen (star) < 3 || strtoul (star + 1, NULL, 16) != sum) {
+        ref->errors++;
+        return;
+    }
+    *star = '\0';
+    while (n < 20 && (f[n] = strsep (&p, ",")) != NULL) {
+        n++;
+    }
+    if (n < 1 || strlen (f[0]) != 5) {
+        return;
+    }
+
+    ublox6Fix *fix = &ref->fix;
+    const char *type = f[0] + 2;
+    if (!strcmp (type, "GGA") && n >= 10) {
+        if (*f[1]) {
+            double t = atof (f[1]);
+            long hms = (long) t;
+            fix->timeMs = ((hms / 10000) * 3600 + hms / 100 % 100 * 60 + hms % 100) * 1000 +
+                          lround ((t - hms) * 1000);
+        }
+        if (*f[2] && *f[4]) {
+            fix->latitude = degrees (f[2], f[3]);
+            fix->longitude = degrees (f[4], f[5]);
+        }
+        if (*f[6]) {
+            fix->quality = atoi (f[6]);
+            fix->valid = fix->quality != 0;
+        }
+        if (*f[7]) {
+            fix->satellites = atoi (f[7]);
+        }
+        if (*f[8]) {
+            fix->hdop = atof (f[8]);
+        }
+        if (*f[9]) {
+            fix->altitude = atof (f[9]);
+        }
+    } else if (!strcmp (type, "RMC") && n >= 10) {
+        if (*f[1]) {
+            double t = atof (f[1]);
+            long hms = (long) t;
+            fix->timeMs = ((hms / 10000) * 3600 + hms / 100 % 100 * 60 + hms % 100) * 1000 +
+                          lround ((t - hms) * 1000);
+        }
+        fix->valid = *f[2] == 'A';
+        if (*f[3] && *f[5]) {
+            fix->latitude = degrees (f[3], f[4]);
+            fix->longitude = degrees (f[5], f[6]);
+        }
+        if (*f[7]) {
+            fix->speed = atof (f[7]) * 0.514444;
+        }
+        if (*f[8]) {
+            fix->course = atof (f[8]);
+        }
+        if (*f[9]) {
+            fix->date = atoi (f[9]);
+        }
+    } else if (!strcmp (type, "VTG") && n >= 8) {
+        if (*f[1]) {
+            fix->course = atof (f[1]);
+        }
+        if (*f[7]) {
+            fix->speed = atof (f[7]) / 3.6;
+        }
+    } else {
+        return;
+    }
+    ref->sentences++;
+}
+
+/*
+ * Decodes a log a line at a time. A '$' always starts a sentence, so
+ * whatever came before one on the same line was cut short by an overrun.
+ */
+static void
+referenceLog (const char *log, size_t len, Reference *ref)
+{
+    char line[256];
+    const char *end = log + len;
+
+    memset (ref, 0, sizeof (*ref));
+    while (log < end) {
+        const char *nl = (const char *) memchr (log, '\n', end - log);
+        size_t n = nl ? nl - log : end - log;
+        char *start, *next;
+
+        if (!nl) {
+            break;      // the parser waits for the rest of a last line
+        }
+        if (n < sizeof (line)) {
+            memcpy (line, log, n);
+            line[n] = '\0';
+            if (n && line[n - 1] == '\r') {
+                line[n - 1] = '\0';
+            }
+            for (start = strchr (line, '$'); start; start = next) {
+                next = strchr (start + 1, '$');
+                if (next) {
+                    ref->errors++;
+                } else if (strlen (start) <= Ublox6Parser::NMEA_MAX && strchr (start, '*')) {
+                    referenceSentence (start, ref);
+                } else if (strlen (start) <= Ublox6Parser::NMEA_MAX) {
+                    ref->errors++;
+                }
+            }
+        }
+        log += n + 1;
+    }
+}
+
+static bool
+sameFix (const ublox6Fix *a, const ublox6Fix *b)
+{
+    return a->valid == b->valid && a->quality == b->quality &&
+           a->satellites == b->satellites && fabs (a->hdop - b->hdop) < 1e-3 &&
+           fabs (a->latitude - b->latitude) < 1e-8 && fabs (a->longitude - b->longitude) < 1e-8 &&
+           fabs (a->altitude - b->altitude) < 1e-3 && fabs (a->speed - b->speed) < 1e-3 &&
+           fabs (a->course - b->course) < 1e-3 && a->timeMs == b->timeMs && a->date == b->date;
+}
+
+static void
+testLog (const char *log, size_t len, const Reference *ref)
+{
+    Ublox6Parser whole, chunked;
+    ublox6Fix wholeFix, chunkedFix;
+    char name[96];
+
+    whole.feed (log, len);
+    whole.getFix (&wholeFix);
+
+    srand (47);
+    for (size_t off = 0; off < len; ) {
+        size_t space, n = 1 + rand () % 64;
+        char *dst = chunked.buffer (&space);
+
+        n = n < space ? n : space;
+        n = n < len - off ? n : len - off;
+        memcpy (dst, log + off, n);
+        chunked.parse (n);
+        off += n;
+    }
+    chunked.getFix (&chunkedFix);
+
+    snprintf (name, sizeof (name), "%u GGA, RMC and VTG sentences decoded", ref->sentences);
+    check (whole.sentences () == ref->sentences, name);
+    snprintf (name, sizeof (name), "%u damaged sentences dropped", ref->errors);
+    check (whole.checksumErrors () == ref->errors, name);
+    check (whole.sentences () == wholeFix.updates, "every decoded sentence was merged into the fix");
+    check (sameFix (&wholeFix, &ref->fix), "last fix matches the reference decoder");
+    check (chunked.sentences () == whole.sentences () && chunked.checksumErrors () == whole.checksumErrors () &&
+           sameFix (&chunkedFix, &wholeFix), "reads of 1 to 64 bytes decode the same");
+
+    printf ("last fix: %s %.6f %.6f, %.1f m, %.2f m/s, %.1f deg, %u satellites\n",
+            wholeFix.valid ? "valid" : "no fix", wholeFix.latitude, wholeFix.longitude,
+            wholeFix.altitude, wholeFix.speed, wholeFix.course, wholeFix.satellites);
+}
+
+static void
+benchmark (const char *log, size_t len, const Reference *ref)
+{
+    int rounds = BENCH_BYTES / len + 1;
+    double start, parserTime, referenceTime;
+    Reference decoded;
+    Ublox6Parser parser;
+
+    start = now ();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t off = 0; off < len; off += READ_SIZE) {
+            parser.feed (log + off, len - off < READ_SIZE ? len - off : READ_SIZE);
+        }
+    }
+    parserTime = now () - start;
+
+    start = now ();
+    for (int r = 0; r < rounds; r++) {
+        referenceLog (log, len, &decoded);
+    }
+    referenceTime = now () - start;
+
+    check (parser.sentences () == rounds * ref->sentences && decoded.sentences == ref->sentences,
+           "both decoders saw every sentence of every round");
+    printf ("%d rounds of %zu bytes\n", rounds, len);
+    printf ("strsep/atof:  %.3f s, %6.1f MB/s, %9.0f sentences/s\n", referenceTime,
+            rounds * len / referenceTime / 1e6, rounds * ref->sentences / referenceTime);
+    printf ("Ublox6Parser: %.3f s, %6.1f MB/s, %9.0f sentences/s (%.1fx)\n", parserTime,
+            rounds * len / parserTime / 1e6, rounds * ref->sentences / parserTime,
+            referenceTime / parserTime);
+}
+
+int
+main (int argc, char **argv)
+{
+    const char *path = SAMPLE_LOG;
+    bool bench = true;
+    Reference ref;
+    FILE *file;
+    char *log;
+    long len;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp (argv[i], "--no-bench") == 0) {
+            bench = false;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    file = fopen (path, "rb");
+    if (!file || fseek (file, 0, SEEK_END) != 0 || (len = ftell (file)) <= 0) {
+        printf ("cannot read %s\n", path);
+        return 1;
+    }
+    rewind (file);
+    log = (char *) malloc (len);
+    if (!log || fread (log, 1, len, file) != (size_t) len) {
+        printf ("cannot read %s\n", path);
+        return 1;
+    }
+    fclose (file);
+
+    referenceLog (log, len, &ref);
+    testLog (log, len, &ref);
+    if (bench) {
+        benchmark (log, len, &ref);
+    }
+    free (log);
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2015 Intel Corporation.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks upm::WT5001Async against a simulated WT5001 and times command
+ * pipelining. The simulated module handles frames in order, takes
+ * PROCESS_MS for each and sends its reply REPLY_MS later: the echoed
+ * opcode, then the data of the READ_* commands. It keeps the volume it
+ * was set to and has FILES files on the SD card, and can be told to
+ * lose every n-th reply. It stands in for the UART methods of WT5001, so
+ * no module is needed and libupm-wt5001 is not linked. Build it with
+ * -fsanitize=thread as well to check the I/O thread.
+ *
+ *   g++ -O2 -I/usr/include/upm -o wt5001-async wt5001-async.cpp -lpthread
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wt5001.h"
+
+using namespace upm;
+
+#define PROCESS_MS     5
+#define REPLY_MS       4
+#define FILES          300
+#define MAX_COMMANDS   100
+#define LOSE_EVERY     7
+#define TIMEOUT_MS     100
+#define BYTES          1024
+
+static int failures = 0;
+
+static void
+check (bool ok, const char *what)
+{
+    printf ("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) {
+        failures++;
+    }
+}
+
+static double
+now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The simulated module. Bytes written by the host wait in toModule, the
+ * replies wait in toHost until their time has come.
+ */
+static pthread_mutex_t uartLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uartWritten = PTHREAD_COND_INITIALIZER;
+static uint8_t toModule[BYTES], toHost[BYTES];
+static double toHostReady[BYTES];
+static unsigned int moduleHead = 0, moduleTail = 0, hostHead = 0, hostTail = 0;
+static bool moduleOn = true;
+static unsigned int loseEvery = 0;
+static unsigned int handled = 0;
+static bool lost[MAX_COMMANDS];
+static uint8_t volume = 0;
+
+WT5001::WT5001 (int uart)
+{
+    (void) uart;
+}
+
+WT5001::~WT5001 ()
+{
+}
+
+bool
+WT5001::dataAvailable (unsigned int millis)
+{
+    double end = now () + millis / 1e3;
+
+    while (true) {
+        pthread_mutex_lock (&uartLock);
+        bool ready = hostTail != hostHead && toHostReady[hostTail % BYTES] <= now ();
+        pthread_mutex_unlock (&uartLock);
+        if (ready) {
+            return true;
+        }
+        if (now () >= end) {
+            return false;
+        }
+        usleep (200);
+    }
+}
+
+int
+WT5001::readData (char *buffer, size_t len)
+{
+    size_t n = 0;
+    double t = now ();
+
+    pthread_mutex_lock (&uartLock);
+    while (n < len && hostTail != hostHead && toHostReady[hostTail % BYTES] <= t) {
+        buffer[n++] = toHost[hostTail++ % BYTES];
+    }
+    pthread_mutex_unlock (&uartLock);
+    return n;
+}
+
+int
+WT5001::writeData (char *buffer, size_t len)
+{
+    pthread_mutex_lock (&uartLock);
+    for (size_t i = 0; i < len; i++) {
+        toModule[moduleHead++ % BYTES] = buffer[i];
+    }
+    pthread_cond_broadcast (&uartWritten);
+    pthread_mutex_unlock (&uartLock);
+    return len;
+}
+
+static void
+reply (uint8_t byte, double ready)
+{
+    toHostReady[hostHead % BYTES] = ready;
+    toHost[hostHead++ % BYTES] = byte;
+}
+
+static void *
+module (void *arg)
+{
+    uint8_t frame[8];
+
+    (void) arg;
+    pthread_mutex_lock (&uartLock);
+    while (moduleOn) {
+        unsigned int avail = moduleHead - moduleTail;
+        if (avail && toModule[moduleTail % BYTES] != WT5001_START) {
+            moduleTail++;
+            continue;
+        }
+        if (avail < 2 || avail < (unsigned int) toModule[(moduleTail + 1) % BYTES] + 2) {
+            pthread_cond_wait (&uartWritten, &uartLock);
+            continue;
+        }
+        unsigned int len = toModule[(moduleTail + 1) % BYTES] + 2;
+        for (unsigned int i = 0; i < len && i < sizeof (frame); i++) {
+            frame[i] = toModule[(moduleTail + i) % BYTES];
+        }
+        moduleTail += len;
+
+        pthread_mutex_unlock (&uartLock);
+        usleep (PROCESS_MS * 1000);
+        pthread_mutex_lock (&uartLock);
+
+        WT5001::WT5001_OPCODE_T opcode = (WT5001::WT5001_OPCODE_T) frame[2];
+        unsigned int n = handled++;
+        if (loseEvery && n % loseEvery == loseEvery - 1) {
+            lost[n % MAX_COMMANDS] = true;
+            continue;
+        }
+        double ready = now () + REPLY_MS / 1e3;
+        reply (opcode, ready);
+        if (opcode == WT5001::SET_VOLUME) {
+            volume = frame[3];
+        } else if (opcode == WT5001::READ_VOLUME) {
+            reply (volume, ready);
+        } else if (opcode == WT5001::READ_SD_NUMF) {
+            reply (FILES >> 8, ready);
+            reply (FILES & 0xff, ready);
+        }
+    }
+    pthread_mutex_unlock (&uartLock);
+    return NULL;
+}
+
+static void
+resetModule (unsigned int lose)
+{
+    pthread_mutex_lock (&uartLock);
+    loseEvery = lose;
+    handled = 0;
+    memset (lost, 0, sizeof (lost));
+    pthread_mutex_unlock (&uartLock);
+}
+
+/* What the callbacks saw, by command */
+typedef struct {
+    bool    ok;
+    uint8_t data[4];
+} Result;
+
+static Result results[MAX_COMMANDS];
+static int completed = 0;
+
+static void
+callback (WT5001::WT5001_OPCODE_T opcode, bool ok, const uint8_t *data, void *arg)
+{
+    Result *r = (Result *) arg;
+
+    (void) opcode;
+    r->ok = ok;
+    memcpy (r->data, data, sizeof (r->data));
+    __atomic_add_fetch (&completed, 1, __ATOMIC_RELEASE);
+}
+
+static void
+waitCallbacks (int count)
+{
+    while (__atomic_load_n (&completed, __ATOMIC_ACQUIRE) < count) {
+        usleep (1000);
+    }
+}
+
+/* Alternate setting the volume and reading it back */
+static void
+volumeRun (WT5001Async &mp3, int commands)
+{
+    memset (results, 0, sizeof (results));
+    __atomic_store_n (&completed, 0, __ATOMIC_RELEASE);
+    for (int i = 0; i < commands; i += 2) {
+        mp3.setVolume (i / 2 % (WT5001_MAX_VOLUME + 1), callback, &results[i]);
+        mp3.getVolume (callback, &results[i + 1]);
+    }
+    mp3.flush ();
+    waitCallbacks (commands);
+}
+
+static void
+testPipeline ()
+{
+    WT5001 device (0);
+    bool readBack = true, matched = true;
+    int commands = 6 * LOSE_EVERY, lostCount = 0;
+    uint8_t data[4];
+    char name[96];
+
+    {
+        WT5001Async mp3 (device, 4, TIMEOUT_MS);
+
+        resetModule (0);
+        volumeRun (mp3, commands);
+        for (int i = 0; i < commands; i += 2) {
+            readBack = readBack && results[i].ok && results[i + 1].ok &&
+                       results[i + 1].data[0] == i / 2 % (WT5001_MAX_VOLUME + 1);
+        }
+        snprintf (name, sizeof (name), "%d commands 4 deep, every volume read back as set", commands);
+        check (readBack && mp3.failures () == 0 && mp3.strayBytes () == 0, name);
+
+        uint32_t ticket = mp3.getNumFiles (WT5001::SD);
+        check (mp3.wait (ticket, data) && data[0] == (FILES >> 8) && data[1] == (FILES & 0xff),
+               "wait() returns the data of a read");
+    }
+
+    {
+        WT5001Async mp3 (device, 4, TIMEOUT_MS);
+
+        resetModule (LOSE_EVERY);
+        volumeRun (mp3, commands);
+        pthread_mutex_lock (&uartLock);
+        for (int i = 0; i < commands; i++) {
+            matched = matched && results[i].ok == !lost[i];
+            lostCount += lost[i];
+        }
+        pthread_mutex_unlock (&uartLock);
+        snprintf (name, sizeof (name), "every %dth reply lost: exactly those %d commands failed",
+                  LOSE_EVERY, lostCount);
+        check (matched && (int) mp3.failures () == lostCount && mp3.strayBytes () == 0, name);
+    }
+
+    /*
+     * Replies carry no sequence number, only the opcode, so a lost reply
+     * to one of several identical commands is noticed on the last of them:
+     * the count of failures is right, the failed command may be a later one
+     */
+    {
+        WT5001Async mp3 (device, 4, TIMEOUT_MS);
+        int ok = 0;
+
+        resetModule (LOSE_EVERY);
+        memset (results, 0, sizeof (results));
+        __atomic_store_n (&completed, 0, __ATOMIC_RELEASE);
+        for (int i = 0; i < commands; i++) {
+            mp3.queue (i, callback, &results[i]);
+        }
+        mp3.flush ();
+        waitCallbacks (commands);
+        for (int i = 0; i < commands; i++) {
+            ok += results[i].ok;
+        }
+        check (ok == commands - commands / LOSE_EVERY && mp3.strayBytes () == 0,
+               "identical commands: as many failures as lost replies");
+    }
+    resetModule (0);
+}
+
+/* Queue a song and read the file count, as a playlist script does */
+static double
+timeRun (WT5001 &device, uint32_t depth, int commands)
+{
+    WT5001Async mp3 (device, depth, 500);
+    double start = now ();
+    char name[64];
+
+    memset (results, 0, sizeof (results));
+    __atomic_store_n (&completed, 0, __ATOMIC_RELEASE);
+    for (int i = 0; i < commands; i += 2) {
+        mp3.queue (i / 2 + 1, callback, &results[i]);
+        mp3.getNumFiles (WT5001::SD, callback, &results[i + 1]);
+    }
+    mp3.flush ();
+    double elapsed = now () - start;
+    waitCallbacks (commands);
+
+    snprintf (name, sizeof (name), "depth %u: every command acknowledged", depth);
+    check (mp3.failures () == 0, name);
+    return elapsed;
+}
+
+static void
+benchmark ()
+{
+    WT5001 device (0);
+    double serial, pipelined;
+
+    serial = timeRun (device, 1, MAX_COMMANDS);
+    pipelined = timeRun (device, 4, MAX_COMMANDS);
+    printf ("%d commands, %d ms processing and %d ms reply latency each\n",
+            MAX_COMMANDS, PROCESS_MS, REPLY_MS);
+    printf ("depth 1: %4.0f ms, %.1f ms/command\n", serial * 1e3, serial * 1e3 / MAX_COMMANDS);
+    printf ("depth 4: %4.0f ms, %.1f ms/command (%.1fx)\n", pipelined * 1e3,
+            pipelined * 1e3 / MAX_COMMANDS, serial / pipelined);
+}
+
+int
+main (int argc, char **argv)
+{
+    pthread_t thread;
+
+    pthread_create (&thread, NULL, module, NULL);
+    testPipeline ();
+    if (argc < 2 || strcmp (argv[1], "--no-bench") != 0) {
+        benchmark ();
+    }
+
+    pthread_mutex_lock (&uartLock);
+    moduleOn = false;
+    pthread_cond_broadcast (&uartWritten);
+    pthread_mutex_unlock (&uartLock);
+    pthread_join (thread, NULL);
+
+    if (failures) {
+        printf ("%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}